@@ -0,0 +1,269 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks ACC_SIX_POSITION_CALIBRATION against a simulated accelerometer with gain errors, offsets, noise and the
+// MC3210's resolution, held by a slightly shaky hand.  The Makefile links it with imu.c and vectors.c built with
+// ACC_SIX_POSITION_CALIBRATION.  The main loop takes 1.5 to 2.5ms; each loop runs imucalculateestimatedattitude()
+// and accsixpositioncalibrationstep() like mainloopiteration() does.
+//
+// One CSV line for each step, in order:
+//   level    the level calibration from nothing, which only measures offsets
+//   six      the six position calibration, positions held for 3 seconds a few degrees off square, in an order
+//            that never turns the aircraft over in one go, and 1.5 seconds to turn between them
+//   relevel  the level calibration again, which keeps the six position gains
+//   five     the six position calibration with one position missing, which times out and keeps the old one
+// with the state the six position calibration ended in, the positions it took, the seconds it took, the loops it
+// spent solving, the eeprom writes, the largest errors of the gains and offsets against the ones that undo the
+// simulated errors, and the largest error of |a| in g over 500 random orientations through
+// imucalculateestimatedattitude().  It exits with 1 if the six position fit has a gain error of 0.002 or more or
+// an offset error of 0.005 g or more, if relevel changes the gains or five doesn't keep the old calibration.
+//
+// usage: acccalibration [-h]
+//   -h  print the CSV header line first
+
+#include "bradwii.h"
+#include "imu.h"
+#include "lib_host.h"
+
+globalstruct global;
+usersettingsstruct usersettings;
+
+#define ACCRESOLUTION (1.0 / 1024.0)   // g
+#define ACCNOISE .005           // g
+#define HANDWOBBLE .004         // radians
+#define HOLDSECONDS 3.0
+#define MOVESECONDS 1.5
+#define MAXSECONDS 200.0
+#define ORIENTATIONS 500
+#define MAXGAINERROR .002
+#define MAXOFFSETERROR .005     // g
+
+static const double gainerror[3] = { .04, -.03, .06 };
+static const double offset[3] = { .05, -.08, .12 };     // g
+
+// the directions of gravity in the six positions, in an order where each turn is 90 degrees
+static const int positionorder[6][3] = { { 0, 0, 1 }, { 1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 }, { -1, 0, 0 }, { 0, -1, 0 } };
+
+static double down[3] = { 0, 0, 1 };    // where gravity points in the aircraft's frame, g
+static double poses[6][3];
+static int posecount;           // 0 to leave down alone
+static double simtime, scriptstart;
+static double noise = ACCNOISE;
+static int eepromwrites;
+
+static void normalize(double *v)
+{
+    double length = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for (int x = 0; x < 3; ++x)
+        v[x] /= length;
+}
+
+// moves down along the script of poses: each held for HOLDSECONDS, then turned to the next over MOVESECONDS
+static void updatedown(void)
+{
+    if (!posecount)
+        return;
+    double t = simtime - scriptstart;
+    int pose = (int) (t / (HOLDSECONDS + MOVESECONDS));
+    double within = t - pose * (HOLDSECONDS + MOVESECONDS);
+    double s = 0;
+
+    if (pose >= posecount - 1)
+        pose = posecount - 1;
+    else if (within > HOLDSECONDS) {
+        s = (within - HOLDSECONDS) / MOVESECONDS;
+        s = s * s * (3 - 2 * s);
+    }
+    for (int x = 0; x < 3; ++x)
+        down[x] = (1 - s) * poses[pose][x] + (pose < posecount - 1 ? s * poses[pose + 1][x] : 0);
+    // the hand shakes a little
+    down[XINDEX] += HANDWOBBLE * sin(2 * M_PI * 1.3 * simtime);
+    down[YINDEX] += HANDWOBBLE * sin(2 * M_PI * 0.7 * simtime + 1);
+    normalize(down);
+}
+
+void readgyro(void)
+{
+    for (int x = 0; x < 3; ++x)
+        global.gyrorate[x] = (fixedpointnum) lrint(.1 * lib_host_gaussian() * FIXEDPOINTONE);
+}
+
+void readacc(void)
+{
+    for (int x = 0; x < 3; ++x) {
+        double reading = down[x] * (1 + gainerror[x]) + offset[x] + noise * lib_host_gaussian();
+        global.acc_g_vector[x] = (fixedpointnum) lrint(lrint(reading / ACCRESOLUTION) * ACCRESOLUTION * FIXEDPOINTONE);
+    }
+}
+
+void calculatetimesliver(void)
+{
+    double dt = .0015 + .001 * lib_host_uniform();
+
+    simtime += dt;
+    global.timesliver = FIXEDPOINT24CONSTANT(dt);
+    updatedown();
+}
+
+void x4_set_leds(unsigned char state)
+{
+}
+
+void writeusersettingstoeeprom(void)
+{
+    ++eepromwrites;
+}
+
+// the positions of the script, each a few degrees off square
+static void setscript(int count)
+{
+    for (int i = 0; i < count; ++i) {
+        for (int x = 0; x < 3; ++x)
+            poses[i][x] = positionorder[i][x] + .06 * (2 * lib_host_uniform() - 1);
+        normalize(poses[i]);
+    }
+    posecount = count;
+    scriptstart = simtime;
+}
+
+static void level(void)
+{
+    posecount = 0;
+    down[XINDEX] = down[YINDEX] = 0;
+    down[ZINDEX] = 1;
+}
+
+static double gain(int x)
+{
+    return 1 + usersettings.accgaincorrection[x] / 65536.0;
+}
+
+static double largestgainerror(void)
+{
+    double error = 0;
+    for (int x = 0; x < 3; ++x)
+        error = fmax(error, fabs(gain(x) - 1 / (1 + gainerror[x])));
+    return error;
+}
+
+static double largestoffseterror(void)
+{
+    double error = 0;
+    for (int x = 0; x < 3; ++x)
+        error = fmax(error, fabs(usersettings.acccalibration[x] / (double) FIXEDPOINTONE + offset[x] / (1 + gainerror[x])));
+    return error;
+}
+
+// the largest error of |a| after the calibration, without noise
+static double largestmagnitudeerror(void)
+{
+    double error = 0;
+
+    level();
+    noise = 0;
+    for (int i = 0; i < ORIENTATIONS; ++i) {
+        for (int x = 0; x < 3; ++x)
+            down[x] = lib_host_gaussian();
+        normalize(down);
+        calculatetimesliver();
+        imucalculateestimatedattitude();
+        double magnitude = 0;
+        for (int x = 0; x < 3; ++x)
+            magnitude += pow(global.acc_g_vector[x] / (double) FIXEDPOINTONE, 2);
+        error = fmax(error, fabs(sqrt(magnitude) - 1));
+    }
+    noise = ACCNOISE;
+    level();
+    return error;
+}
+
+static void printstep(const char *name, double seconds, int solveloops)
+{
+    printf("%s,%d,0x%02X,%.2f,%d,%d,%.5f,%.5f,%.5f\n", name, accsixpositioninfo.state, accsixpositioninfo.positions,
+        seconds, solveloops, eepromwrites, largestgainerror(), largestoffseterror(), largestmagnitudeerror());
+}
+
+static void levelcalibration(const char *name)
+{
+    double start = simtime;
+
+    level();
+    eepromwrites = 0;
+    calibrategyroandaccelerometer(true);
+    printstep(name, simtime - start, 0);
+}
+
+// runs the six position calibration through the first positions of the script until it ends
+static void sixpositioncalibration(const char *name, int positions)
+{
+    double start = simtime;
+    int solveloops = 0;
+
+    eepromwrites = 0;
+    setscript(positions);
+    startaccsixpositioncalibration();
+    while (simtime - start < MAXSECONDS && (accsixpositioninfo.state == ACCSIXPOSITIONCOLLECTING
+            || accsixpositioninfo.state == ACCSIXPOSITIONSOLVING)) {
+        calculatetimesliver();
+        imucalculateestimatedattitude();
+        if (accsixpositioninfo.state == ACCSIXPOSITIONSOLVING)
+            ++solveloops;
+        accsixpositioncalibrationstep();
+    }
+    printstep(name, simtime - start, solveloops);
+}
+
+int main(int argc, char **argv)
+{
+    bool pass = true;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-h"))
+            printf("step,state,positions,seconds,solve_loops,eeprom_writes,gain_error,offset_error_g,magnitude_error_g\n");
+        else {
+            fprintf(stderr, "usage: %s [-h]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    levelcalibration("level");
+
+    sixpositioncalibration("six", 6);
+    if (accsixpositioninfo.state != ACCSIXPOSITIONDONE || eepromwrites != 1 || largestgainerror() >= MAXGAINERROR
+        || largestoffseterror() >= MAXOFFSETERROR)
+        pass = false;
+
+    int16_t gains[3];
+    for (int x = 0; x < 3; ++x)
+        gains[x] = usersettings.accgaincorrection[x];
+    levelcalibration("relevel");
+    for (int x = 0; x < 3; ++x)
+        if (usersettings.accgaincorrection[x] != gains[x])
+            pass = false;
+
+    fixedpointnum offsets[3];
+    for (int x = 0; x < 3; ++x)
+        offsets[x] = usersettings.acccalibration[x];
+    sixpositioncalibration("five", 5);
+    if (accsixpositioninfo.state != ACCSIXPOSITIONFAILED || eepromwrites)
+        pass = false;
+    for (int x = 0; x < 3; ++x)
+        if (usersettings.accgaincorrection[x] != gains[x] || usersettings.acccalibration[x] != offsets[x])
+            pass = false;
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Runs the profiler's probes (see src/profiler.h) on the host build of the X4, which the Makefile builds with
+// PROFILER.  On the host the cycles are nanoseconds of clock_gettime(), so the probes measure what the flight code
+// costs on this machine, not the virtual time of the emulated buses.  The Makefile links it with
+// serialcheckforaction() wrapped, to keep a copy of the probes as the serial task built its reply.
+//
+// The aircraft is armed and flown at mid throttle.  After a second to settle, the probes are cleared with
+// MSP_RESET_PROFILER and the main loop runs for the given virtual seconds, then MSP_PROFILER is asked for.  One CSV
+// line per probe with what it sent: its runs, mean and longest run in microseconds and its share of the control
+// task's time.  It exits with 1 if a reply didn't come or didn't match the probes, if the control task's probes
+// didn't run once per control task, or the receiver's once per receiver task, if the battery's didn't run, or if
+// the probes inside the control task took longer than it.
+//
+// usage: cycleprofile [-s seconds] [-h]
+//   -s  virtual seconds to measure, default 10
+//   -h  print the CSV header line first
+
+#include "bradwii.h"
+#include "lib_host.h"
+#include "scheduler.h"
+#include "profiler.h"
+
+#define MSP_PROFILER 156
+#define MSP_RESET_PROFILER 157
+#define PASSMICROSECONDS 10     // a pass's own overhead
+#define SETTLESECONDS 1.0
+#define MSPTIMEOUT 100000       // microseconds
+
+static const char *probenames[NUMPROBES] = { "control", "imu", "pilot", "pid", "rx", "battery" };
+
+// the probes and the task runs as the serial task left them
+static profilerprobestruct snapshot[NUMPROBES];
+static uint16_t snapshotruns[NUMPROBES], resetruns[NUMPROBES];
+static bool resetrequested;
+
+// the probe each task runs, -1 for none
+static int taskprobe(int task)
+{
+    switch (tasks[task].id) {
+    case TASKCONTROL:
+        return PROBECONTROL;
+    case TASKRX:
+        return PROBERX;
+    case TASKBATTERY:
+        return PROBEBATTERY;
+    }
+    return -1;
+}
+
+void __real_serialcheckforaction(void);
+
+void __wrap_serialcheckforaction(void)
+{
+    __real_serialcheckforaction();
+    // the serial task is counted when it starts, the others once they are done
+    for (int i = 0; i < numtasks; ++i)
+        if (taskprobe(i) >= 0)
+            snapshotruns[taskprobe(i)] = taskstats[i].runs;
+    memcpy(snapshot, profilerprobes, sizeof(snapshot));
+    if (resetrequested && profilerprobes[PROBECONTROL].count == 0) {
+        resetrequested = false;
+        memcpy(resetruns, snapshotruns, sizeof(resetruns));
+    }
+}
+
+static void pass(void)
+{
+    mainloopiteration();
+    lib_host_timers_advancemicroseconds(PASSMICROSECONDS);
+}
+
+static uint32_t payloadlong(const unsigned char *payload)
+{
+    return payload[0] | payload[1] << 8 | payload[2] << 16 | (uint32_t) payload[3] << 24;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 10;
+    bool good = true;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-h"))
+            printf("probe,name,runs,mean_us,max_us,control_share\n");
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-s seconds] [-h]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    lib_host_setlevelsensors();
+    initbradwii();
+
+    // roll, pitch, throttle, yaw, aux1, aux2...  aux1 low arms the X4
+    uint16_t channels[LIB_HOST_RX_NUMCHANNELS] = { 1500, 1500, 1000, 1500, 1000, 2000, 1500, 1500 };
+    lib_host_rx_setchannels(channels);
+
+    uint32_t start = lib_timers_getcurrentmicroseconds();
+    while (lib_timers_getcurrentmicroseconds() - start < SETTLESECONDS * 1000000)
+        pass();
+    channels[THROTTLEINDEX] = 1500;
+    lib_host_rx_setchannels(channels);
+
+    unsigned char payload[256];
+    resetrequested = true;
+    if (lib_host_mspcommand(MSP_RESET_PROFILER, payload, pass, MSPTIMEOUT) != 0 || resetrequested) {
+        fprintf(stderr, "cycleprofile: no reply to MSP_RESET_PROFILER\n");
+        return 1;
+    }
+    start = lib_timers_getcurrentmicroseconds();
+    while (lib_timers_getcurrentmicroseconds() - start < seconds * 1000000)
+        pass();
+
+    if (lib_host_mspcommand(MSP_PROFILER, payload, pass, MSPTIMEOUT) != 3 + NUMPROBES * 10 || payload[2] != NUMPROBES) {
+        fprintf(stderr, "cycleprofile: no good reply to MSP_PROFILER\n");
+        return 1;
+    }
+    double cyclesperus = payload[0] | payload[1] << 8;
+    uint32_t controlcycles = payloadlong(payload + 3 + PROBECONTROL * 10 + 2), insidecycles = 0;
+
+    for (int i = 0; i < NUMPROBES; ++i) {
+        const unsigned char *probe = payload + 3 + i * 10;
+        unsigned count = probe[0] | probe[1] << 8;
+        uint32_t cycles = payloadlong(probe + 2), maxcycles = payloadlong(probe + 6);
+
+        printf("%d,%s,%u,%.2f,%.2f,%.3f\n", i, probenames[i], count, count ? cycles / cyclesperus / count : 0,
+            maxcycles / cyclesperus, controlcycles ? (double) cycles / controlcycles : 0);
+        if (count != snapshot[i].count || cycles != snapshot[i].cycles || maxcycles != snapshot[i].maxcycles)
+            good = false;
+        if (i == PROBEIMU || i == PROBEPILOT || i == PROBEPID) {
+            insidecycles += cycles;
+            if (count != snapshot[PROBECONTROL].count)
+                good = false;
+        }
+        if (i == PROBECONTROL || i == PROBERX)
+            if (count != (uint16_t) (snapshotruns[i] - resetruns[i]))
+                good = false;
+        if (!count)
+            good = false;
+    }
+    if (insidecycles > controlcycles)
+        good = false;
+    if (!good)
+        fprintf(stderr, "cycleprofile: the probes didn't add up\n");
+    return good ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// How often the main loop works out the euler angles in each flight mode.
+// The host build of the X4 sits level on the bench like bradwii_host's.  For every mode a child is fork()ed that
+// turns the mode on for all aux switch positions, arms unless the mode is disarmed, sets the throttle and then runs
+// the main loop for a while.  The Makefile links it with lib_fp_atan2() wrapped, so every call is counted; the
+// euler angles are the only atan2s in the X4's loop, three per conversion.
+//
+// One CSV line per mode: the loops measured, the atan2 calls and conversions per loop, and a Cortex-M0 estimate of
+// the cycles per loop they take and save against converting in every loop.  It exits with 1 if a mode converts more
+// than once per loop.
+//
+// usage: eulermodes [-n loops] [-h]
+//   -n  loops to measure per mode, default 2000
+//   -h  print the CSV header line first
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include "bradwii.h"
+#include "lib_host.h"
+#include "checkboxes.h"
+#include "rx.h"
+
+extern globalstruct global;
+extern usersettingsstruct usersettings;
+
+#define MSP_ATTITUDE 108
+#define ARMLOOPS 100
+#define SETTLELOOPS 1000        // the failsafe takes a second to come on
+#define COMPUTEMICROSECONDS 500
+
+// Cortex-M0 cycle model like fpbench's: a CORDIC lib_fp_atan2() is about 30 cycles of octant reduction and
+// 10 iterations of 17, a conversion adds the pitch choice, the yaw sign, lib_fp_constrain180() and the stores.
+#define M0CYCLESPERATAN2 200
+#define M0CYCLESPERCONVERSION (3 * M0CYCLESPERATAN2 + 50)
+
+typedef struct {
+    const char *name;
+    uint32_t checkboxes;        // turned on for every aux switch position
+    uint16_t throttle;          // us
+    bool failsafe;              // the transmitter goes away after arming
+    int mspattitudeevery;       // loops between MSP_ATTITUDE requests, 0 for none
+    bool armed;
+} modestruct;
+
+static const modestruct modes[] = {
+    { "disarmed_level", 0, 1000, false, 0, false },
+    { "disarmed_fullacro", CHECKBOXMASKFULLACRO, 1000, false, 0, false },
+    { "level", 0, 1300, false, 0, true },
+    { "semiacro", CHECKBOXMASKSEMIACRO, 1300, false, 0, true },
+    { "fullacro", CHECKBOXMASKFULLACRO, 1300, false, 0, true },
+    { "fullacro_headfree", CHECKBOXMASKFULLACRO | CHECKBOXMASKHEADFREE, 1300, false, 0, true },
+    { "fullacro_compass", CHECKBOXMASKFULLACRO | CHECKBOXMASKCOMPASS, 1300, false, 0, true },
+    { "fullacro_msp_attitude", CHECKBOXMASKFULLACRO, 1300, false, 10, true },
+    { "fullacro_failsafe", CHECKBOXMASKFULLACRO, 1300, true, 0, true },
+    { "autotune", CHECKBOXMASKAUTOTUNE, 1300, false, 0, true },
+};
+
+#define NUMMODES (sizeof(modes) / sizeof(modes[0]))
+
+static uint32_t atan2calls;
+
+fixedpointnum __real_lib_fp_atan2(fixedpointnum y, fixedpointnum x);
+
+fixedpointnum __wrap_lib_fp_atan2(fixedpointnum y, fixedpointnum x)
+{
+    ++atan2calls;
+    return (__real_lib_fp_atan2(y, x));
+}
+
+static void requestattitude(void)
+{
+    const unsigned char request[6] = { '$', 'M', '<', 0, MSP_ATTITUDE, MSP_ATTITUDE };
+    unsigned char reply[64];
+
+    while (lib_host_serial_receivefromfirmware(reply, sizeof(reply)) > 0);
+    lib_host_serial_sendtofirmware(request, sizeof(request));
+}
+
+static void loop(void)
+{
+    mainloopiteration();
+    lib_host_timers_advancemicroseconds(COMPUTEMICROSECONDS);
+}
+
+// runs in the child, returns true if the mode converted at most once per loop
+static bool runmode(const modestruct * mode, long loops)
+{
+    // roll, pitch, throttle, yaw, aux1, aux2...
+    uint16_t channels[LIB_HOST_RX_NUMCHANNELS] = { 1500, 1500, 1000, 1500, 1500, 1500, 1500, 1500 };
+
+    for (int x = 0; x < NUMCHECKBOXES; ++x)
+        usersettings.checkboxconfiguration[x] = 0;
+    for (int x = 0; x < NUMCHECKBOXES; ++x)
+        if ((mode->checkboxes | (mode->armed ? CHECKBOXMASKARM : 0)) & (1 << x))
+            usersettings.checkboxconfiguration[x] = 0xFFF;
+
+    lib_host_rx_setchannels(channels);
+    for (int i = 0; i < ARMLOOPS; ++i)
+        loop();
+    channels[THROTTLEINDEX] = mode->throttle;
+    lib_host_rx_setchannels(channels);
+    if (mode->failsafe)
+        lib_host_rx_setenabled(false);
+    for (int i = 0; i < SETTLELOOPS; ++i)
+        loop();
+
+    atan2calls = 0;
+    for (long i = 0; i < loops; ++i) {
+        if (mode->mspattitudeevery && i % mode->mspattitudeevery == 0)
+            requestattitude();
+        uint32_t before = atan2calls;
+        loop();
+        if (atan2calls - before > 3) {
+            fprintf(stderr, "eulermodes: %s converted %u times in one loop\n", mode->name, (atan2calls - before) / 3);
+            return false;
+        }
+    }
+
+    double conversions = atan2calls / 3.0 / loops;
+    printf("%s,%d,%ld,%.3f,%.3f,%.0f,%.0f\n", mode->name, global.armed, loops, (double) atan2calls / loops, conversions,
+        conversions * M0CYCLESPERCONVERSION, (1 - conversions) * M0CYCLESPERCONVERSION);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    long loops = 2000;
+    bool header = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-h"))
+            header = true;
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            loops = atol(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-n loops] [-h]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (loops <= 0)
+        loops = 1;
+
+    lib_host_setlevelsensors();
+    initbradwii();
+
+    if (header)
+        printf("mode,armed,loops,atan2_per_loop,conversions_per_loop,m0_cycles_per_loop,m0_cycles_saved_per_loop\n");
+    fflush(stdout);
+
+    bool pass = true;
+    for (unsigned m = 0; m < NUMMODES; ++m) {
+        pid_t child = fork();
+        if (child == 0) {
+            bool ok = runmode(&modes[m], loops);
+            fflush(stdout);
+            _exit(ok ? 0 : 1);
+        }
+        int status = 1;
+        if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            pass = false;
+    }
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,248 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Frequency response and speed of the biquad filters in src/filter.c.
+//
+// Each test filter is set up with initbiquad() for a 500 Hz main loop and fed a sine of 200 degrees per second
+// every 5 Hz from 5 to 245 Hz.  After it has settled, the gain is measured over 10 seconds (a whole number of
+// periods) and compared with the gain the same filter has in double precision, worked out from the cookbook
+// formulas.  One CSV line per filter: the filter, its largest coefficient error, its largest gain error, the
+// frequency of that error and the double and fixed point gains there.  With -r every frequency gets a line.
+//
+// Then the speed of chains of 1 to 4 stages on 3 axes: host nanoseconds and host cycles per stage and axis,
+// which rank changes but are not Mini51 cycles, and a Cortex-M0 estimate.
+//
+// It exits with 1 if a gain is off by 0.002 or more.
+//
+// usage: filterbench [-r] [-h]
+//   -r  print the response at every frequency
+//   -h  print the CSV header lines
+
+#include <time.h>
+#include <complex.h>
+#include "bradwii.h"
+#include "filter.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HOSTCYCLES() __rdtsc()
+#else
+#define HOSTCYCLES() 0
+#endif
+
+globalstruct global;
+
+#define SAMPLERATE 500.0
+#define AMPLITUDE 200.0
+#define SETTLESAMPLES 2000
+#define MEASURESAMPLES 5000     // 10 seconds, whole periods at every multiple of 0.1 Hz
+#define MAXGAINERROR 0.002
+#define BENCHSAMPLES 1000000
+
+// Cortex-M0 cycle model, counted by hand from the Thumb instruction timings like fpbench's.  lib_fp_multiply30()
+// inlined is 4 multiplies and about 18 shifts, masks and adds; a stage adds the loads and stores of the
+// coefficients and the state and the chain's loop.
+#define M0CYCLESPERMULTIPLY30 22
+#define M0CYCLESPERSTAGEOVERHEAD 30
+
+typedef struct {
+    const char *name;
+    biquadsettingsstruct settings;
+} testfilterstruct;
+
+static const testfilterstruct testfilters[] = {
+    { "lowpass_100hz_q0.707", BIQUAD_LOWPASS(100, 0.707) },
+    { "lowpass_30hz_q0.707", BIQUAD_LOWPASS(30, 0.707) },
+    { "lowpass_200hz_q2", BIQUAD_LOWPASS(200, 2) },
+    { "notch_180hz_q3", BIQUAD_NOTCH(180, 3) },
+    { "notch_120hz_q10", BIQUAD_NOTCH(120, 10) },
+    { "bandstop_150_225hz", BIQUAD_BANDSTOP(150, 225) },
+};
+
+#define NUMTESTFILTERS (sizeof(testfilters) / sizeof(testfilters[0]))
+
+typedef struct {
+    double b0, b1, b2, a1, a2;
+} doublecoefficientsstruct;
+
+static double hostnanoseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// the cookbook coefficients in double precision
+static void doublecoefficients(const biquadsettingsstruct * settings, doublecoefficientsstruct * c)
+{
+    double frequency = settings->frequency / (double) FIXEDPOINTONE;
+    double q = settings->parameter / (double) FIXEDPOINTONE;
+
+    if (settings->type == BIQUADBANDSTOP) {
+        double high = q;
+        q = sqrt(frequency * high) / (high - frequency);
+        frequency = sqrt(frequency * high);
+    }
+    double w0 = 2 * M_PI * frequency / SAMPLERATE;
+    double alpha = sin(w0) / (2 * q);
+    double a0 = 1 + alpha;
+
+    c->a1 = -2 * cos(w0) / a0;
+    c->a2 = (1 - alpha) / a0;
+    if (settings->type == BIQUADLOWPASS) {
+        c->b0 = (1 - cos(w0)) / 2 / a0;
+        c->b1 = (1 - cos(w0)) / a0;
+    } else {
+        c->b0 = 1 / a0;
+        c->b1 = c->a1;
+    }
+    c->b2 = c->b0;
+}
+
+// |H(e^jw)|
+static double doublegain(const doublecoefficientsstruct * c, double frequency)
+{
+    double w = 2 * M_PI * frequency / SAMPLERATE;
+    double complex z1 = cexp(-I * w);
+    double complex z2 = z1 * z1;
+    return cabs((c->b0 + c->b1 * z1 + c->b2 * z2) / (1 + c->a1 * z1 + c->a2 * z2));
+}
+
+// the measured gain of the fixed point filter at a frequency
+static double fixedgain(const biquadsettingsstruct * settings, double frequency)
+{
+    biquadstruct filter;
+    double sinesum = 0, cosinesum = 0;
+
+    initbiquad(&filter, settings, FIXEDPOINTCONSTANT(SAMPLERATE));
+    for (int i = 0; i < SETTLESAMPLES + MEASURESAMPLES; ++i) {
+        double phase = 2 * M_PI * frequency * i / SAMPLERATE;
+        fixedpointnum input = (fixedpointnum) lrint(AMPLITUDE * sin(phase) * FIXEDPOINTONE);
+        double output = biquadfilter(&filter, 0, input) / (double) FIXEDPOINTONE;
+        if (i >= SETTLESAMPLES) {
+            sinesum += output * sin(phase);
+            cosinesum += output * cos(phase);
+        }
+    }
+    return 2 * sqrt(sinesum * sinesum + cosinesum * cosinesum) / MEASURESAMPLES / AMPLITUDE;
+}
+
+static double largestcoefficienterror(const biquadsettingsstruct * settings, const doublecoefficientsstruct * c)
+{
+    biquadstruct filter;
+    double error = 0;
+
+    initbiquad(&filter, settings, FIXEDPOINTCONSTANT(SAMPLERATE));
+    const fixedpointnum30 fixed[5] = { filter.coefficients.b0, filter.coefficients.b1, filter.coefficients.b2,
+        filter.coefficients.a1, filter.coefficients.a2 };
+    const double reference[5] = { c->b0, c->b1, c->b2, c->a1, c->a2 };
+    for (int i = 0; i < 5; ++i)
+        if (fabs(fixed[i] / (double) FIXEDPOINT30ONE - reference[i]) > error)
+            error = fabs(fixed[i] / (double) FIXEDPOINT30ONE - reference[i]);
+    return error;
+}
+
+static bool testresponse(bool everyfrequency, bool header)
+{
+    bool pass = true;
+
+    if (header) {
+        if (everyfrequency)
+            printf("filter,frequency_hz,double_gain,fixed_gain\n");
+        else
+            printf("filter,coefficient_error,gain_error,at_hz,double_gain,fixed_gain\n");
+    }
+    for (unsigned f = 0; f < NUMTESTFILTERS; ++f) {
+        const testfilterstruct *test = &testfilters[f];
+        doublecoefficientsstruct c;
+        double worsterror = -1, worstfrequency = 0, worstdouble = 0, worstfixed = 0;
+
+        doublecoefficients(&test->settings, &c);
+        for (double frequency = 5; frequency < SAMPLERATE / 2; frequency += 5) {
+            double expected = doublegain(&c, frequency);
+            double measured = fixedgain(&test->settings, frequency);
+            if (everyfrequency)
+                printf("%s,%.0f,%.5f,%.5f\n", test->name, frequency, expected, measured);
+            if (fabs(measured - expected) > worsterror) {
+                worsterror = fabs(measured - expected);
+                worstfrequency = frequency;
+                worstdouble = expected;
+                worstfixed = measured;
+            }
+        }
+        if (!everyfrequency)
+            printf("%s,%.7f,%.5f,%.0f,%.5f,%.5f\n", test->name, largestcoefficienterror(&test->settings, &c), worsterror,
+                worstfrequency, worstdouble, worstfixed);
+        if (worsterror >= MAXGAINERROR)
+            pass = false;
+    }
+    return pass;
+}
+
+static void benchchains(bool header)
+{
+    static fixedpointnum inputs[1024];
+    biquadstruct chain[4];
+    uint32_t randomstate = 12345;
+
+    for (int i = 0; i < 1024; ++i) {
+        randomstate ^= randomstate << 13;
+        randomstate ^= randomstate >> 17;
+        randomstate ^= randomstate << 5;
+        inputs[i] = (int32_t) randomstate >> 8;     // within 128 degrees per second
+    }
+    if (header)
+        printf("stages,ns_per_stage,host_cycles_per_stage,m0_cycles_per_stage\n");
+    for (int stages = 1; stages <= 4; ++stages) {
+        for (int i = 0; i < stages; ++i)
+            initbiquad(&chain[i], &testfilters[i].settings, FIXEDPOINTCONSTANT(SAMPLERATE));
+
+        volatile fixedpointnum sink = 0;
+        double start = hostnanoseconds();
+        uint64_t startcycles = HOSTCYCLES();
+        for (int i = 0; i < BENCHSAMPLES; ++i)
+            for (int x = 0; x < 3; ++x)
+                sink += biquadchainfilter(chain, stages, x, inputs[(i + x) & 1023]);
+        uint64_t cycles = HOSTCYCLES() - startcycles;
+        double nanoseconds = hostnanoseconds() - start;
+        (void) sink;
+
+        double count = (double) BENCHSAMPLES * 3 * stages;
+        printf("%d,%.2f,%.1f,%d\n", stages, nanoseconds / count, cycles / count,
+            5 * M0CYCLESPERMULTIPLY30 + M0CYCLESPERSTAGEOVERHEAD);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool everyfrequency = false, header = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-r"))
+            everyfrequency = true;
+        else if (!strcmp(argv[i], "-h"))
+            header = true;
+        else {
+            fprintf(stderr, "usage: %s [-r] [-h]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bool pass = testresponse(everyfrequency, header);
+    benchchains(header);
+    return pass ? 0 : 1;
+}
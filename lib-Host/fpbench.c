@@ -0,0 +1,814 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Accuracy and speed of the lib_fp kernels on the host.
+// lib_fp.c is built with LIB_FP_ALL_KERNELS so every selectable implementation can be compared
+// in one run.  Errors are against double precision math on the same integer inputs, times are
+// host nanoseconds and host cycles per call; they rank the kernels but are not Mini51 cycles.
+// The fused vector kernels in src/vectors.c are compared against the separate calls they replace.
+// vectors.c is built with lib_fp_multiply() renamed to a counting wrapper so the calls can be counted.
+// With -g, a gyro trace recorded by simquad -g is integrated instead, with the attitude vectors as
+// fixedpointnums the way they used to be and as fixedpointnum30s, and the drift of both is reported.
+//
+// usage: fpbench [-g tracefile]
+
+#include <time.h>
+#include <math.h>
+#include "lib_fp.h"
+#include "vectors.h"
+#include "bradwii.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HOSTCYCLES() __rdtsc()
+#else
+#define HOSTCYCLES() 0
+#endif
+
+#define FIXEDPOINTTODOUBLE(value) ((double) (value) / FIXEDPOINTONE)
+
+typedef fixedpointnum (*atan2function)(fixedpointnum y, fixedpointnum x);
+
+typedef struct {
+    const char *name;
+    atan2function function;
+} atan2kernelstruct;
+
+static const atan2kernelstruct atan2kernels[] = {
+    { "cordic", lib_fp_atan2_cordic },
+    { "polynomial", lib_fp_atan2_polynomial },
+    { "table", lib_fp_atan2_table },
+};
+
+#define NUMATAN2KERNELS (sizeof(atan2kernels) / sizeof(atan2kernels[0]))
+
+// deterministic random numbers
+static uint32_t randomstate = 12345;
+static uint32_t randomnumber(void)
+{
+    randomstate ^= randomstate << 13;
+    randomstate ^= randomstate >> 17;
+    randomstate ^= randomstate << 5;
+    return randomstate;
+}
+
+static double hostnanoseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// inputs: every 0.05 degrees at magnitudes 2^minbits to 2^maxbits, then random points with |x|,|y| < 2^maxbits
+static int makeatan2inputs(fixedpointnum **ys, fixedpointnum **xs, int minbits, int maxbits)
+{
+    const int numangles = 7200, numrandom = 1000000;
+    int count = numangles * (maxbits - minbits + 1) + numrandom;
+    int n = 0;
+    *ys = malloc(count * sizeof(fixedpointnum));
+    *xs = malloc(count * sizeof(fixedpointnum));
+    for (int m = minbits; m <= maxbits; ++m) {
+        for (int a = 0; a < numangles; ++a) {
+            double angle = (a * 0.05 - 180) * M_PI / 180;
+            double radius = ldexp(1.0, m);
+            (*ys)[n] = (fixedpointnum) lrint(radius * sin(angle));
+            (*xs)[n] = (fixedpointnum) lrint(radius * cos(angle));
+            ++n;
+        }
+    }
+    while (n < count) {
+        (*ys)[n] = (int32_t) randomnumber() >> (31 - maxbits);
+        (*xs)[n] = (int32_t) randomnumber() >> (31 - maxbits);
+        ++n;
+    }
+    return count;
+}
+
+static void benchatan2(const char *domain, int minbits, int maxbits)
+{
+    fixedpointnum *ys, *xs;
+    int count = makeatan2inputs(&ys, &xs, minbits, maxbits);
+
+    printf("atan2, %s: %d inputs with magnitudes 2^%d to 2^%d\n", domain, count, minbits, maxbits);
+    printf("%-12s %12s %12s %24s %10s %12s\n", "kernel", "max_err_deg", "rms_err_deg", "worst_input(y,x)", "ns/call", "cycles/call");
+    for (unsigned k = 0; k < NUMATAN2KERNELS; ++k) {
+        atan2function function = atan2kernels[k].function;
+        double maxerror = 0, sumsquares = 0;
+        int worst = 0;
+        for (int i = 0; i < count; ++i) {
+            if (ys[i] == 0 && xs[i] == 0)
+                continue;
+            double error = FIXEDPOINTTODOUBLE(function(ys[i], xs[i])) - atan2(ys[i], xs[i]) * 180 / M_PI;
+            if (error > 180) error -= 360;
+            if (error < -180) error += 360;
+            sumsquares += error * error;
+            if (fabs(error) > maxerror) {
+                maxerror = fabs(error);
+                worst = i;
+            }
+        }
+
+        volatile fixedpointnum sink = 0;
+        double start = hostnanoseconds();
+        uint64_t startcycles = HOSTCYCLES();
+        for (int i = 0; i < count; ++i)
+            sink += function(ys[i], xs[i]);
+        uint64_t cycles = HOSTCYCLES() - startcycles;
+        double nanoseconds = hostnanoseconds() - start;
+        (void) sink;
+
+        char worstinput[32];
+        snprintf(worstinput, sizeof(worstinput), "(%d,%d)", ys[worst], xs[worst]);
+        printf("%-12s %12.5f %12.5f %24s %10.2f %12.1f\n", atan2kernels[k].name, maxerror, sqrt(sumsquares / count), worstinput,
+            nanoseconds / count, (double) cycles / count);
+    }
+    free(ys);
+    free(xs);
+}
+
+// lib_fp_multiply() calls made from vectors.c, see the Makefile
+static uint32_t multiplycalls;
+fixedpointnum fpbench_countedmultiply(fixedpointnum x, fixedpointnum y)
+{
+    ++multiplycalls;
+    return lib_fp_multiply(x, y);
+}
+
+// Cortex-M0 cycle model, counted by hand from the Thumb instruction timings (single cycle multiplier,
+// 3 cycle branches).  It is an estimate to compare the two versions, not a measurement.
+#define M0CYCLESPERLIBFPMULTIPLY 30 // call and return, operand split, 4 multiplies, shifts and adds
+#define M0CYCLESPERSPLITPRODUCT 6   // 2 multiplies, 2 shifts, an add and a move
+#define MULTIPLIESPERLIBFPMULTIPLY 4
+#define MULTIPLIESPERSPLITPRODUCT 2
+
+#define NUMVECTORINPUTS 100000
+
+typedef struct {
+    fixedpointnum v1[3];
+    fixedpointnum v2[3];
+    fixedpointnum angles[3];
+} vectorinputstruct;
+
+static void randomunitvector(fixedpointnum * v)
+{
+    double d[3], length;
+    do {
+        length = 0;
+        for (int x = 0; x < 3; ++x) {
+            d[x] = (int32_t) randomnumber() / 2147483648.0;
+            length += d[x] * d[x];
+        }
+    } while (length < 0.01 || length > 1);
+    for (int x = 0; x < 3; ++x)
+        v[x] = (fixedpointnum) lrint(d[x] / sqrt(length) * FIXEDPOINTONE);
+}
+
+static void printvectorresult(const char *name, int count, uint32_t calls, int inlineproducts, double nanoseconds, uint64_t cycles)
+{
+    double callspercall = (double) calls / count;
+    printf("%-34s %10.1f %10.1f %10.1f %10.1f %10.2f %12.1f\n", name, callspercall, (double) inlineproducts,
+        callspercall * MULTIPLIESPERLIBFPMULTIPLY + inlineproducts * MULTIPLIESPERSPLITPRODUCT,
+        callspercall * M0CYCLESPERLIBFPMULTIPLY + inlineproducts * M0CYCLESPERSPLITPRODUCT, nanoseconds / count, (double) cycles / count);
+}
+
+static void benchvectors(void)
+{
+    vectorinputstruct *inputs = malloc(NUMVECTORINPUTS * sizeof(vectorinputstruct));
+    fixedpointnum (*results)[6] = malloc(NUMVECTORINPUTS * sizeof(*results));
+    fixedpointnum v1[3], v2[3];
+    fixedpointnum30 v1q30[3], v2q30[3];
+
+    // unit vectors and delta angles up to 2000 deg/s for 20ms, the longest timesliver
+    for (int i = 0; i < NUMVECTORINPUTS; ++i) {
+        randomunitvector(inputs[i].v1);
+        randomunitvector(inputs[i].v2);
+        for (int x = 0; x < 3; ++x)
+            inputs[i].angles[x] = (int32_t) randomnumber() / (int32_t) ((1UL << 31) / (FIXEDPOINTCONSTANT(0.7) << TIMESLIVEREXTRASHIFT));
+    }
+
+    printf("vector kernels: %d random unit vectors\n", NUMVECTORINPUTS);
+    printf("%-34s %10s %10s %10s %10s %10s %12s\n", "kernel", "fp_calls", "split_prod", "muls", "m0_cycles", "ns/call", "cycles/call");
+
+    // rotate down and west vectors, separately and fused
+    double start = hostnanoseconds();
+    uint64_t startcycles = HOSTCYCLES();
+    multiplycalls = 0;
+    for (int i = 0; i < NUMVECTORINPUTS; ++i) {
+        memcpy(v1, inputs[i].v1, sizeof(v1));
+        memcpy(v2, inputs[i].v2, sizeof(v2));
+        rotatevectorwithsmallangles(v1, inputs[i].angles[0], inputs[i].angles[1], inputs[i].angles[2]);
+        rotatevectorwithsmallangles(v2, inputs[i].angles[0], inputs[i].angles[1], inputs[i].angles[2]);
+        memcpy(results[i], v1, sizeof(v1));
+        memcpy(results[i] + 3, v2, sizeof(v2));
+    }
+    // 12 lib_fp_multiply24() products, each the multiplies of two split products
+    printvectorresult("rotatevectorwithsmallangles x2", NUMVECTORINPUTS, multiplycalls, 24, hostnanoseconds() - start, HOSTCYCLES() - startcycles);
+
+    start = hostnanoseconds();
+    startcycles = HOSTCYCLES();
+    multiplycalls = 0;
+    double separateerror = 0, fusederror = 0;
+    for (int i = 0; i < NUMVECTORINPUTS; ++i) {
+        for (int x = 0; x < 3; ++x) {
+            v1q30[x] = FIXEDPOINTTOFIXEDPOINT30(inputs[i].v1[x]);
+            v2q30[x] = FIXEDPOINTTOFIXEDPOINT30(inputs[i].v2[x]);
+        }
+        rotatevectorswithsmallangles(v1q30, v2q30, inputs[i].angles[0], inputs[i].angles[1], inputs[i].angles[2]);
+        // the same small angle step in double precision
+        for (int vector = 0; vector < 2; ++vector) {
+            fixedpointnum *v = vector ? inputs[i].v2 : inputs[i].v1;
+            fixedpointnum30 *vq30 = vector ? v2q30 : v1q30;
+            double roll = inputs[i].angles[ROLLINDEX] / (double) FIXEDPOINT24ONE;
+            double pitch = inputs[i].angles[PITCHINDEX] / (double) FIXEDPOINT24ONE;
+            double yaw = inputs[i].angles[YAWINDEX] / (double) FIXEDPOINT24ONE;
+            double reference[3];
+            reference[XINDEX] = FIXEDPOINTTODOUBLE(v[XINDEX]) + roll * FIXEDPOINTTODOUBLE(v[ZINDEX]) - yaw * FIXEDPOINTTODOUBLE(v[YINDEX]);
+            reference[YINDEX] = FIXEDPOINTTODOUBLE(v[YINDEX]) + pitch * FIXEDPOINTTODOUBLE(v[ZINDEX]) + yaw * FIXEDPOINTTODOUBLE(v[XINDEX]);
+            reference[ZINDEX] = FIXEDPOINTTODOUBLE(v[ZINDEX]) - roll * FIXEDPOINTTODOUBLE(v[XINDEX]) - pitch * FIXEDPOINTTODOUBLE(v[YINDEX]);
+            for (int x = 0; x < 3; ++x) {
+                double error = fabs(FIXEDPOINTTODOUBLE(results[i][x + vector * 3]) - reference[x]);
+                if (error > separateerror)
+                    separateerror = error;
+                error = fabs(vq30[x] / (double) FIXEDPOINT30ONE - reference[x]);
+                if (error > fusederror)
+                    fusederror = error;
+            }
+        }
+    }
+    // time the fused kernel on its own
+    start = hostnanoseconds();
+    startcycles = HOSTCYCLES();
+    for (int i = 0; i < NUMVECTORINPUTS; ++i)
+        rotatevectorswithsmallangles(v1q30, v2q30, inputs[i].angles[0], inputs[i].angles[1], inputs[i].angles[2]);
+    printvectorresult("rotatevectorswithsmallangles", NUMVECTORINPUTS, multiplycalls, 12, hostnanoseconds() - start, HOSTCYCLES() - startcycles);
+    printf("  max error against double: %.2e for the separate fixedpointnum calls, %.2e for the fixedpointnum30 kernel\n", separateerror, fusederror);
+
+    // cross product and normalize, separately and fused.  Both call lib_fp_invsqrt() once, which isn't counted.
+    start = hostnanoseconds();
+    startcycles = HOSTCYCLES();
+    multiplycalls = 0;
+    for (int i = 0; i < NUMVECTORINPUTS; ++i) {
+        vectorcrossproduct(inputs[i].v1, inputs[i].v2, results[i]);
+        normalizevector(results[i]);
+    }
+    printvectorresult("vectorcrossproduct+normalizevector", NUMVECTORINPUTS, multiplycalls, 0, hostnanoseconds() - start, HOSTCYCLES() - startcycles);
+
+    start = hostnanoseconds();
+    startcycles = HOSTCYCLES();
+    multiplycalls = 0;
+    int maxdifference = 0;
+    int shortvectors = 0;
+    for (int i = 0; i < NUMVECTORINPUTS; ++i) {
+        // the direction of a very short cross product is mostly rounding in both versions
+        if (vectorcrossproductnormalized(inputs[i].v1, inputs[i].v2, v1, LIB_FP_INVSQRT_ONENEWTON) < (FIXEDPOINTONE >> 8)) {
+            ++shortvectors;
+            continue;
+        }
+        for (int x = 0; x < 3; ++x)
+            if (abs(v1[x] - results[i][x]) > maxdifference)
+                maxdifference = abs(v1[x] - results[i][x]);
+    }
+    // 6 split products for the cross product, 3 for the length and 3 for the scaling
+    printvectorresult("vectorcrossproductnormalized", NUMVECTORINPUTS, multiplycalls, 12, hostnanoseconds() - start, HOSTCYCLES() - startcycles);
+    printf("  max difference to the separate calls: %d LSB, %d cross products shorter than 1/16 not compared\n", maxdifference, shortvectors);
+
+    free(inputs);
+    free(results);
+}
+
+typedef fixedpointnum (*sinefunction)(fixedpointnum angle);
+
+typedef struct {
+    const char *name;
+    sinefunction function;
+} sinekernelstruct;
+
+static const sinekernelstruct sinekernels[] = {
+    { "smallangle", lib_fp_sine_smallangle },
+    { "quadratic", lib_fp_sine_quadratic },
+};
+
+#define NUMSINEKERNELS (sizeof(sinekernels) / sizeof(sinekernels[0]))
+
+static double sinereference(fixedpointnum angle)
+{
+    return sin(fmod(FIXEDPOINTTODOUBLE(angle), 360) * M_PI / 180);
+}
+
+static void printsineresult(const char *name, double maxerror, double sumsquares, int count, fixedpointnum worst, double nanoseconds, uint64_t cycles)
+{
+    printf("%-12s %12.7f %12.7f %14.4f %10.2f %12.1f\n", name, maxerror, sqrt(sumsquares / count), FIXEDPOINTTODOUBLE(worst),
+        nanoseconds / count, (double) cycles / count);
+}
+
+// inputs: every 0.01 degrees from -360 to 360 and random angles with |angle| < 2^maxbits
+static void benchsine(const char *domain, int maxbits)
+{
+    const int numsweep = 72000, numrandom = 1000000;
+    int count = numsweep + numrandom;
+    fixedpointnum *angles = malloc(count * sizeof(fixedpointnum));
+    for (int i = 0; i < numsweep; ++i)
+        angles[i] = (fixedpointnum) lrint((i * 0.01 - 360) * FIXEDPOINTONE);
+    for (int i = numsweep; i < count; ++i)
+        angles[i] = (int32_t) randomnumber() >> (31 - maxbits);
+
+    printf("sine, %s: %d inputs, random angles up to %.0f degrees\n", domain, count, ldexp(1.0, maxbits - FIXEDPOINTSHIFT));
+    printf("%-12s %12s %12s %14s %10s %12s\n", "kernel", "max_err", "rms_err", "worst_deg", "ns/call", "cycles/call");
+    for (unsigned k = 0; k < NUMSINEKERNELS; ++k) {
+        sinefunction function = sinekernels[k].function;
+        double maxerror = 0, sumsquares = 0;
+        int worst = 0;
+        for (int i = 0; i < count; ++i) {
+            double error = FIXEDPOINTTODOUBLE(function(angles[i])) - sinereference(angles[i]);
+            sumsquares += error * error;
+            if (fabs(error) > maxerror) {
+                maxerror = fabs(error);
+                worst = i;
+            }
+        }
+
+        volatile fixedpointnum sink = 0;
+        double start = hostnanoseconds();
+        uint64_t startcycles = HOSTCYCLES();
+        for (int i = 0; i < count; ++i)
+            sink += function(angles[i]);
+        uint64_t cycles = HOSTCYCLES() - startcycles;
+        double nanoseconds = hostnanoseconds() - start;
+        (void) sink;
+        printsineresult(sinekernels[k].name, maxerror, sumsquares, count, angles[worst], nanoseconds, cycles);
+    }
+
+    // sine and cosine of the same angle: two smallangle calls against one lib_fp_sincos_quadratic()
+    for (int k = 0; k < 2; ++k) {
+        double maxerror = 0, sumsquares = 0;
+        int worst = 0;
+        volatile fixedpointnum sink = 0;
+        double start = hostnanoseconds();
+        uint64_t startcycles = HOSTCYCLES();
+        for (int i = 0; i < count; ++i) {
+            fixedpointnum sine, cosine;
+            if (k == 0) {
+                sine = lib_fp_sine_smallangle(angles[i]);
+                cosine = lib_fp_sine_smallangle(angles[i] + FIXEDPOINT90);
+            } else
+                lib_fp_sincos_quadratic(angles[i], &sine, &cosine);
+            sink += sine + cosine;
+        }
+        uint64_t cycles = HOSTCYCLES() - startcycles;
+        double nanoseconds = hostnanoseconds() - start;
+        (void) sink;
+
+        for (int i = 0; i < count; ++i) {
+            fixedpointnum sine, cosine;
+            if (k == 0) {
+                sine = lib_fp_sine_smallangle(angles[i]);
+                cosine = lib_fp_sine_smallangle(angles[i] + FIXEDPOINT90);
+            } else
+                lib_fp_sincos_quadratic(angles[i], &sine, &cosine);
+            double error = fmax(fabs(FIXEDPOINTTODOUBLE(sine) - sinereference(angles[i])),
+                fabs(FIXEDPOINTTODOUBLE(cosine) - sinereference(angles[i] + FIXEDPOINT90)));
+            sumsquares += error * error;
+            if (error > maxerror) {
+                maxerror = error;
+                worst = i;
+            }
+        }
+        printsineresult(k == 0 ? "sine+cosine" : "sincos", maxerror, sumsquares, count, angles[worst], nanoseconds, cycles);
+    }
+    free(angles);
+}
+
+// lib_fp_invsqrt() before the table normalization, for comparison
+static fixedpointnum oldinvsqrt(fixedpointnum x)
+{
+    static const fixedpointnum invsqrtstartingpoint[12] = {
+        123575L, 111778L, 102821L, 95721L, 89914L, 85050L, 80899L, 77302L, 74145L, 71346L, 68842L, 66584L
+    };
+    if (x <= 0)
+        return (0);
+    fixedpointnum y = FIXEDPOINTONE;
+    fixedpointnum xysquared = x;
+    while (xysquared < FIXEDPOINTONEOVERFOUR) {
+        y = y << 1;
+        xysquared = xysquared << 2;
+    }
+    while (xysquared >= FIXEDPOINTONE) {
+        y = y >> 1;
+        xysquared = xysquared >> 2;
+    }
+    y = lib_fp_multiply(y, invsqrtstartingpoint[(xysquared >> (FIXEDPOINTSHIFT - 4)) - 4]);
+    xysquared = lib_fp_multiply(y, lib_fp_multiply(x, y));
+    y = lib_fp_multiply(y, (FIXEDPOINTTHREE - xysquared)) >> 1;
+    return (y);
+}
+
+static fixedpointnum invsqrttable(fixedpointnum x) { return lib_fp_invsqrtprecision(x, LIB_FP_INVSQRT_TABLE); }
+static fixedpointnum invsqrtonenewton(fixedpointnum x) { return lib_fp_invsqrtprecision(x, LIB_FP_INVSQRT_ONENEWTON); }
+static fixedpointnum invsqrttwonewton(fixedpointnum x) { return lib_fp_invsqrtprecision(x, LIB_FP_INVSQRT_TWONEWTON); }
+
+static const sinekernelstruct invsqrtkernels[] = {
+    { "old", oldinvsqrt },
+    { "table", invsqrttable },
+    { "onenewton", invsqrtonenewton },
+    { "twonewton", invsqrttwonewton },
+};
+
+#define NUMINVSQRTKERNELS (sizeof(invsqrtkernels) / sizeof(invsqrtkernels[0]))
+
+// Every positive fixedpointnum, in 31 bands by highest bit.  Below 1.0 the result is above 1.0 and the
+// relative error is reported, from 1.0 up the result is at most 1.0 and the error in LSBs is reported.
+// The timing columns are the fastest and slowest band, which shows how much the run time depends on x.
+static void benchinvsqrt(void)
+{
+    const int perband = 65536;
+    fixedpointnum *inputs = malloc(perband * sizeof(fixedpointnum));
+
+    printf("invsqrt: %d inputs in each of 31 magnitude bands, 2^0 to 2^31\n", perband);
+    printf("%-12s %12s %12s %14s %10s %10s %12s\n", "kernel", "max_relerr", "rms_relerr", "max_lsb_x>=1", "min_ns", "max_ns", "cycles/call");
+    for (unsigned k = 0; k < NUMINVSQRTKERNELS; ++k) {
+        sinefunction function = invsqrtkernels[k].function;
+        double maxrelative = 0, sumsquares = 0, maxlsb = 0, minns = 1e9, maxns = 0;
+        uint64_t totalcycles = 0;
+        int count = 0;
+        for (int band = 0; band < 31; ++band) {
+            for (int i = 0; i < perband; ++i)
+                inputs[i] = (fixedpointnum) ((1UL << band) + (band ? randomnumber() % (1UL << band) : 0));
+            for (int i = 0; i < perband; ++i) {
+                double reference = FIXEDPOINTONE / sqrt(FIXEDPOINTTODOUBLE(inputs[i]));
+                double error = function(inputs[i]) - reference;
+                if (inputs[i] >= FIXEDPOINTONE) {
+                    if (fabs(error) > maxlsb)
+                        maxlsb = fabs(error);
+                } else {
+                    double relative = fabs(error) / reference;
+                    sumsquares += relative * relative;
+                    ++count;
+                    if (relative > maxrelative)
+                        maxrelative = relative;
+                }
+            }
+            volatile fixedpointnum sink = 0;
+            double start = hostnanoseconds();
+            uint64_t startcycles = HOSTCYCLES();
+            for (int repeat = 0; repeat < 4; ++repeat)
+                for (int i = 0; i < perband; ++i)
+                    sink += function(inputs[i]);
+            totalcycles += HOSTCYCLES() - startcycles;
+            double nanoseconds = (hostnanoseconds() - start) / perband / 4;
+            (void) sink;
+            if (nanoseconds < minns)
+                minns = nanoseconds;
+            if (nanoseconds > maxns)
+                maxns = nanoseconds;
+        }
+        printf("%-12s %11.5f%% %11.5f%% %14.2f %10.2f %10.2f %12.1f\n", invsqrtkernels[k].name, maxrelative * 100, sqrt(sumsquares / count) * 100,
+            maxlsb, minns, maxns, (double) totalcycles / perband / 4 / 31);
+    }
+    free(inputs);
+}
+
+// The M0 has no divide instruction, so the compiler calls __aeabi_idiv, a shift and subtract loop.
+// There is no ARM emulator here, so this is the same algorithm in C: one step per quotient bit,
+// with the leading zeros skipped like the library versions do.
+static uint32_t softwareudivide(uint32_t numerator, uint32_t denominator, int *steps)
+{
+    uint32_t quotient = 0, remainder = 0;
+    int bit = 31;
+    while (bit >= 0 && !(numerator >> bit))
+        --bit;
+    *steps = bit + 1;
+    for (; bit >= 0; --bit) {
+        remainder = (remainder << 1) | ((numerator >> bit) & 1);
+        if (remainder >= denominator) {
+            remainder -= denominator;
+            quotient |= 1UL << bit;
+        }
+    }
+    return quotient;
+}
+
+// the battery path: (batteryvoltageraw << 12) / (bandgapvoltageraw >> 4), the old fixed point divide
+static int softwaresteps;
+static fixedpointnum batteryoldsoftware(fixedpointnum x, fixedpointnum y)
+{
+    int steps;
+    fixedpointnum result = softwareudivide(x << 12, y >> (FIXEDPOINTSHIFT - 12), &steps);
+    softwaresteps += steps;
+    return result;
+}
+
+static fixedpointnum batteryoldhardware(fixedpointnum x, fixedpointnum y)
+{
+    return (x << 12) / (y >> (FIXEDPOINTSHIFT - 12));
+}
+
+typedef fixedpointnum (*dividefunction)(fixedpointnum x, fixedpointnum y);
+
+static void timedivide(const char *name, dividefunction function, const fixedpointnum *xs, const fixedpointnum *ys, int count)
+{
+    double maxerror = 0, sumsquares = 0, maxlsb = 0;
+    int worst = 0;
+    softwaresteps = 0;
+    for (int i = 0; i < count; ++i) {
+        double reference = (double) xs[i] / ys[i] * FIXEDPOINTONE;
+        double error = function(xs[i], ys[i]) - reference;
+        // relative to the result, or to 1.0 for smaller results where only the LSB error means anything
+        double relative = fabs(error) / (fabs(reference) > FIXEDPOINTONE ? fabs(reference) : FIXEDPOINTONE);
+        sumsquares += relative * relative;
+        if (relative > maxerror) {
+            maxerror = relative;
+            worst = i;
+        }
+        if (fabs(error) > maxlsb)
+            maxlsb = fabs(error);
+    }
+    int steps = softwaresteps;
+
+    volatile fixedpointnum sink = 0;
+    double start = hostnanoseconds();
+    uint64_t startcycles = HOSTCYCLES();
+    for (int i = 0; i < count; ++i)
+        sink += function(xs[i], ys[i]);
+    uint64_t cycles = HOSTCYCLES() - startcycles;
+    double nanoseconds = hostnanoseconds() - start;
+    (void) sink;
+
+    char worstinput[32];
+    snprintf(worstinput, sizeof(worstinput), "(%d,%d)", xs[worst], ys[worst]);
+    printf("%-22s %12.2e %12.2e %10.2f %24s %10.2f %12.1f", name, maxerror, sqrt(sumsquares / count), maxlsb, worstinput, nanoseconds / count, (double) cycles / count);
+    if (steps)
+        printf("  %.1f loop steps", (double) steps / count);
+    printf("\n");
+}
+
+static fixedpointnum autothrottleinvsqrt(fixedpointnum x, fixedpointnum y)
+{
+    fixedpointnum reciprocal = lib_fp_invsqrtprecision(y, LIB_FP_INVSQRT_TWONEWTON);
+    return lib_fp_multiply(reciprocal, reciprocal);
+}
+
+static fixedpointnum autothrottlereciprocal(fixedpointnum x, fixedpointnum y) { return lib_fp_reciprocal(y); }
+static fixedpointnum hardwaredivide(fixedpointnum x, fixedpointnum y) { return (fixedpointnum) (((int64_t) x << FIXEDPOINTSHIFT) / y); }
+
+static void benchdivide(void)
+{
+    const int count = 1000000;
+    fixedpointnum *xs = malloc(count * sizeof(fixedpointnum));
+    fixedpointnum *ys = malloc(count * sizeof(fixedpointnum));
+
+    // the battery: ADC readings as 0..1 fractions, the battery at 0.4 to 1.0 and the bandgap at 0.3 to 0.6
+    for (int i = 0; i < count; ++i) {
+        xs[i] = (400 + randomnumber() % 600) << (FIXEDPOINTSHIFT - 10);
+        ys[i] = (300 + randomnumber() % 300) << (FIXEDPOINTSHIFT - 10);
+    }
+    printf("divide, battery voltage ratio: %d inputs\n", count);
+    printf("%-22s %12s %12s %10s %24s %10s %12s\n", "kernel", "max_relerr", "rms_relerr", "max_lsb", "worst_input(x,y)", "ns/call", "cycles/call");
+    timedivide("old, hardware divide", batteryoldhardware, xs, ys, count);
+    timedivide("old, software divide", batteryoldsoftware, xs, ys, count);
+    timedivide("lib_fp_divide", lib_fp_divide, xs, ys, count);
+
+    // general quotients that fit in a fixedpointnum
+    for (int i = 0; i < count; ++i) {
+        do {
+            xs[i] = (int32_t) randomnumber() >> (randomnumber() % 31);
+            ys[i] = (int32_t) randomnumber() >> (randomnumber() % 31);
+        } while (ys[i] == 0 || fabs((double) xs[i] / ys[i]) >= 16384 || xs[i] == 0);
+    }
+    printf("divide, random x and y with |x/y| < 16384: %d inputs\n", count);
+    printf("%-22s %12s %12s %10s %24s %10s %12s\n", "kernel", "max_relerr", "rms_relerr", "max_lsb", "worst_input(x,y)", "ns/call", "cycles/call");
+    timedivide("hardware divide", hardwaredivide, xs, ys, count);
+    timedivide("lib_fp_divide", lib_fp_divide, xs, ys, count);
+
+    // the reciprocal over the range autothrottle uses, z of the down vector from .3 to 1
+    for (int i = 0; i < count; ++i) {
+        xs[i] = FIXEDPOINTONE;
+        ys[i] = FIXEDPOINTCONSTANT(.3) + randomnumber() % FIXEDPOINTCONSTANT(.7);
+    }
+    printf("reciprocal, autothrottle 1/z for z from .3 to 1: %d inputs\n", count);
+    printf("%-22s %12s %12s %10s %24s %10s %12s\n", "kernel", "max_relerr", "rms_relerr", "max_lsb", "worst_input(x,y)", "ns/call", "cycles/call");
+    timedivide("invsqrt squared", autothrottleinvsqrt, xs, ys, count);
+    timedivide("lib_fp_reciprocal", autothrottlereciprocal, xs, ys, count);
+    free(xs);
+    free(ys);
+}
+
+// Attitude drift on a recorded gyro trace.  The trace is replayed until it adds up to DRIFTSECONDS of
+// flight, integrating only the gyro like imucalculateestimatedattitude() does between accelerometer
+// corrections, and setting the vectors back to unit length at 10Hz like it does for the west vector.
+// Both fixed point versions get the same fixedpointnum24 delta angles, and so does a double precision
+// version of the same small angle step, so the differences are only the vector arithmetic.
+#define DRIFTSECONDS 600
+
+// the small angle step from before the attitude vectors were fixedpointnum30s
+#define OLDSMALLANGLESHIFT (FIXEDPOINTSHIFT + TIMESLIVEREXTRASHIFT)
+#define OLDSMALLANGLESPLIT (OLDSMALLANGLESHIFT / 2)
+#define OLDSMALLANGLEMULTIPLY(high, low, v) ((((high) * (v)) >> OLDSMALLANGLESPLIT) + (((low) * (v)) >> OLDSMALLANGLESHIFT))
+
+static void oldrotatevector(fixedpointnum * v, fixedpointnum24 * angles)
+{
+    fixedpointnum high[3], low[3];
+    for (int x = 0; x < 3; ++x) {
+        high[x] = angles[x] >> OLDSMALLANGLESPLIT;
+        low[x] = angles[x] & ((1L << OLDSMALLANGLESPLIT) - 1);
+    }
+    fixedpointnum v_tmp_x = v[XINDEX];
+    fixedpointnum v_tmp_y = v[YINDEX];
+    fixedpointnum v_tmp_z = v[ZINDEX];
+    v[XINDEX] += OLDSMALLANGLEMULTIPLY(high[ROLLINDEX], low[ROLLINDEX], v_tmp_z) - OLDSMALLANGLEMULTIPLY(high[YAWINDEX], low[YAWINDEX], v_tmp_y);
+    v[YINDEX] += OLDSMALLANGLEMULTIPLY(high[PITCHINDEX], low[PITCHINDEX], v_tmp_z) + OLDSMALLANGLEMULTIPLY(high[YAWINDEX], low[YAWINDEX], v_tmp_x);
+    v[ZINDEX] -= OLDSMALLANGLEMULTIPLY(high[ROLLINDEX], low[ROLLINDEX], v_tmp_x) + OLDSMALLANGLEMULTIPLY(high[PITCHINDEX], low[PITCHINDEX], v_tmp_y);
+}
+
+static void referencerotatevector(double *v, const double *angles)
+{
+    double v_tmp_x = v[XINDEX], v_tmp_y = v[YINDEX], v_tmp_z = v[ZINDEX];
+    v[XINDEX] += angles[ROLLINDEX] * v_tmp_z - angles[YAWINDEX] * v_tmp_y;
+    v[YINDEX] += angles[PITCHINDEX] * v_tmp_z + angles[YAWINDEX] * v_tmp_x;
+    v[ZINDEX] -= angles[ROLLINDEX] * v_tmp_x + angles[PITCHINDEX] * v_tmp_y;
+}
+
+// angle between two vectors in degrees and the length of the first relative to the second
+static void comparevectors(const double *v, const double *reference, double *angle, double *lengtherror)
+{
+    double dot = 0, length = 0, referencelength = 0;
+    for (int x = 0; x < 3; ++x) {
+        dot += v[x] * reference[x];
+        length += v[x] * v[x];
+        referencelength += reference[x] * reference[x];
+    }
+    double cosine = dot / sqrt(length * referencelength);
+    *angle = acos(cosine > 1 ? 1 : cosine) * 180 / M_PI;
+    *lengtherror = sqrt(length / referencelength) - 1;
+}
+
+typedef struct {
+    const char *name;
+    double maxangle[2];
+    double maxlengtherror[2];
+} driftresultstruct;
+
+static void updatedrift(driftresultstruct * result, int vector, const double *v, const double *reference)
+{
+    double angle, lengtherror;
+    comparevectors(v, reference, &angle, &lengtherror);
+    if (angle > result->maxangle[vector])
+        result->maxangle[vector] = angle;
+    if (fabs(lengtherror) > fabs(result->maxlengtherror[vector]))
+        result->maxlengtherror[vector] = lengtherror;
+}
+
+static int benchdrift(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror(filename);
+        return 1;
+    }
+    int count = 0, size = 4096;
+    long (*trace)[4] = malloc(size * sizeof(*trace));
+    // only the timesliver and gyro columns
+    while (fscanf(file, "%ld,%ld,%ld,%ld%*[^\n]", &trace[count][0], &trace[count][1], &trace[count][2], &trace[count][3]) == 4) {
+        if (++count == size)
+            trace = realloc(trace, (size *= 2) * sizeof(*trace));
+    }
+    fclose(file);
+    if (!count) {
+        fprintf(stderr, "%s: no samples\n", filename);
+        return 1;
+    }
+
+    fixedpointnum old[2][3] = { { 0, 0, FIXEDPOINTONE }, { FIXEDPOINTONE, 0, 0 } };
+    fixedpointnum30 new[2][3] = { { 0, 0, FIXEDPOINT30ONE }, { FIXEDPOINT30ONE, 0, 0 } };
+    double reference[2][3] = { { 0, 0, 1 }, { 1, 0, 0 } };
+    driftresultstruct results[2] = { { "fixedpointnum" }, { "fixedpointnum30" } };
+    double seconds = 0, normalizetime = 0;
+    long iterations = 0;
+
+    while (seconds < DRIFTSECONDS) {
+        for (int i = 0; i < count; ++i) {
+            // imucalculateestimatedattitude()'s delta angles
+            fixedpointnum24 multiplier = lib_fp_multiply(trace[i][0], FIXEDPOINTPIOVER180);
+            fixedpointnum24 angles[3];
+            double referenceangles[3];
+            for (int x = 0; x < 3; ++x) {
+                angles[x] = lib_fp_multiply(trace[i][x + 1], multiplier);
+                referenceangles[x] = angles[x] / (double) FIXEDPOINT24ONE;
+            }
+            oldrotatevector(old[0], angles);
+            oldrotatevector(old[1], angles);
+            rotatevectorswithsmallangles(new[0], new[1], angles[ROLLINDEX], angles[PITCHINDEX], angles[YAWINDEX]);
+            for (int vector = 0; vector < 2; ++vector) {
+                referencerotatevector(reference[vector], referenceangles);
+                double v[3];
+                for (int x = 0; x < 3; ++x)
+                    v[x] = FIXEDPOINTTODOUBLE(old[vector][x]);
+                updatedrift(&results[0], vector, v, reference[vector]);
+                for (int x = 0; x < 3; ++x)
+                    v[x] = new[vector][x] / (double) FIXEDPOINT30ONE;
+                updatedrift(&results[1], vector, v, reference[vector]);
+            }
+            seconds += trace[i][0] / (double) FIXEDPOINT24ONE;
+            ++iterations;
+            if (seconds - normalizetime >= 0.1) {
+                normalizetime = seconds;
+                for (int vector = 0; vector < 2; ++vector) {
+                    normalizevector(old[vector]);
+                    normalizevector30(new[vector]);
+                    double length = sqrt(reference[vector][0] * reference[vector][0] + reference[vector][1] * reference[vector][1] + reference[vector][2] * reference[vector][2]);
+                    for (int x = 0; x < 3; ++x)
+                        reference[vector][x] /= length;
+                }
+            }
+        }
+    }
+    free(trace);
+
+    printf("attitude drift: %d samples from %s replayed for %.0f seconds, %ld iterations, gyro only\n", count, filename, seconds, iterations);
+    printf("%-16s %14s %14s %14s %14s\n", "vectors", "down_max_deg", "down_length", "west_max_deg", "west_length");
+    for (int i = 0; i < 2; ++i)
+        printf("%-16s %14.2e %14.2e %14.2e %14.2e\n", results[i].name, results[i].maxangle[0], results[i].maxlengtherror[0],
+            results[i].maxangle[1], results[i].maxlengtherror[1]);
+    return 0;
+}
+
+#define NUMLOWPASSCHANNELS 8
+#define NUMLOWPASSITERATIONS 1000000
+
+// the receiver channels: eight channels, a constant period and shift, timeslivers around 3.6ms
+static void benchlowpass(void)
+{
+    static fixedpointnum newvalues[4096][NUMLOWPASSCHANNELS];
+    fixedpointnum timeslivers[4096];
+    fixedpointnum variables[3][NUMLOWPASSCHANNELS] = { { 0 } };
+    const char *names[3] = { "lib_fp_lowpassfilter", "lib_fp_lowpassfilterinline", "lib_fp_lowpassfilterchannels" };
+    double nanoseconds[3];
+    uint64_t cycles[3];
+
+    for (int i = 0; i < 4096; ++i) {
+        timeslivers[i] = (3000 + randomnumber() % 1500) * 4295L >> (8 - TIMESLIVEREXTRASHIFT);
+        for (int x = 0; x < NUMLOWPASSCHANNELS; ++x)
+            newvalues[i][x] = (int32_t) randomnumber() >> 15;
+    }
+
+    for (int kernel = 0; kernel < 3; ++kernel) {
+        double start = hostnanoseconds();
+        uint64_t startcycles = HOSTCYCLES();
+        for (int i = 0; i < NUMLOWPASSITERATIONS; ++i) {
+            fixedpointnum *v = variables[kernel], *n = newvalues[i & 4095], t = timeslivers[i & 4095];
+            if (kernel == 0) {
+                for (int x = 0; x < NUMLOWPASSCHANNELS; ++x)
+                    lib_fp_lowpassfilter(&v[x], n[x], t, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+            } else if (kernel == 1) {
+                for (int x = 0; x < NUMLOWPASSCHANNELS; ++x)
+                    lib_fp_lowpassfilterinline(&v[x], n[x], t, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+            } else
+                lib_fp_lowpassfilterchannels(v, n, NUMLOWPASSCHANNELS, t, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+        }
+        cycles[kernel] = HOSTCYCLES() - startcycles;
+        nanoseconds[kernel] = hostnanoseconds() - start;
+    }
+
+    printf("lowpass filter: %d channels with a constant period, %d updates\n", NUMLOWPASSCHANNELS, NUMLOWPASSITERATIONS);
+    printf("%-30s %14s %14s %10s\n", "kernel", "ns/channel", "cycles/channel", "same");
+    for (int kernel = 0; kernel < 3; ++kernel) {
+        printf("%-30s %14.2f %14.1f %10s\n", names[kernel], nanoseconds[kernel] / NUMLOWPASSITERATIONS / NUMLOWPASSCHANNELS,
+            (double) cycles[kernel] / NUMLOWPASSITERATIONS / NUMLOWPASSCHANNELS,
+            memcmp(variables[kernel], variables[0], sizeof(variables[0])) ? "no" : "yes");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    // the imu passes vectors of about unit length (2^16)
+    if (argc == 3 && !strcmp(argv[1], "-g"))
+        return benchdrift(argv[2]);
+    if (argc != 1) {
+        fprintf(stderr, "usage: %s [-g tracefile]\n", argv[0]);
+        return 1;
+    }
+
+    benchatan2("imu vectors", 8, 18);
+    benchatan2("full range", 0, 30);
+    // the flight code passes angles within a turn or two of zero, navigation bearings can be anything
+    benchsine("attitude angles", 26);
+    benchsine("full range", 30);
+    benchinvsqrt();
+    benchdivide();
+    benchvectors();
+    benchlowpass();
+    return 0;
+}
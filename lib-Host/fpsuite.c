@@ -0,0 +1,449 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Accuracy and speed regression suite for the public lib_fp functions, as they are built for the
+// firmware (the selected kernels only).  Every function is swept over its domain and then fuzzed
+// with random inputs, and the results are compared with double precision math on the same inputs.
+// The Makefile builds it twice, as fpsuite against lib-Mini51/hal/lib_fp.c and as fpsuite_stm32
+// against lib/hal/lib_fp.c.
+//
+// The results go to stdout as JSON, one test per line so the file is easy to diff and to read back.
+// The exit status is 1 if any test is less accurate than its limit.  With -b, the ns/call of each test
+// is also compared with an earlier run's JSON and the suite fails if any got slower by more than
+// the tolerance (default 1.5 times), for catching speed regressions on the same machine.
+//
+// usage: fpsuite [-b baseline.json] [-t tolerance]
+
+#include <time.h>
+#include <math.h>
+#include <stdarg.h>
+#include "lib_fp.h"
+
+#ifndef FPSUITE_LIBRARY
+#define FPSUITE_LIBRARY "lib_fp.c"
+#endif
+
+#define FIXEDPOINTTODOUBLE(value) ((double) (value) / FIXEDPOINTONE)
+
+#define NUMRANDOM 1000000
+#define MAXTESTS 16
+
+// the largest error each function is allowed, in the units of its test.  The selected kernels set them.
+#define MULTIPLYLIMIT 1.0           // rounded down, so below 1 LSB
+#if (LIB_FP_ATAN2 == LIB_FP_ATAN2_CORDIC)
+#define ATAN2LIMIT 0.06
+#elif (LIB_FP_ATAN2 == LIB_FP_ATAN2_POLYNOMIAL)
+#define ATAN2LIMIT 0.006
+#else
+#define ATAN2LIMIT 0.009
+#endif
+#if (LIB_FP_SINE == LIB_FP_SINE_SMALLANGLE)
+#define SINELIMIT 0.01
+#else
+#define SINELIMIT 0.00004
+#endif
+#define INVSQRTLIMIT 1.0            // relative to 2^-16 of results above 1, LSB below
+#define SQRTLIMIT 0.002             // relative, since it multiplies by the rounded invsqrt
+#define LOWPASSLIMIT 2.0            // its rounding pulls towards newvalue by 1 LSB
+#define STRINGLIMIT 1.1             // truncated after six decimals
+
+typedef struct {
+    const char *name;
+    const char *unit;
+    double limit;
+    double maxerror;
+    double sumsquares;
+    long count;
+    char worstinput[64];
+    double nanoseconds;
+} testresultstruct;
+
+static testresultstruct results[MAXTESTS];
+static int numresults;
+
+// deterministic random numbers
+static uint32_t randomstate = 12345;
+static uint32_t randomnumber(void)
+{
+    randomstate ^= randomstate << 13;
+    randomstate ^= randomstate >> 17;
+    randomstate ^= randomstate << 5;
+    return randomstate;
+}
+
+// a random number with a random magnitude from 2^0 to 2^maxbits
+static int32_t randommagnitude(int maxbits)
+{
+    return (int32_t) randomnumber() >> (31 - (int) (randomnumber() % (maxbits + 1)));
+}
+
+static double hostnanoseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static testresultstruct *newtest(const char *name, const char *unit, double limit)
+{
+    testresultstruct *result = &results[numresults++];
+    memset(result, 0, sizeof(*result));
+    result->name = name;
+    result->unit = unit;
+    result->limit = limit;
+    return result;
+}
+
+// the input is only formatted when it is the new worst case
+static void adderror(testresultstruct * result, double error, const char *format, ...)
+{
+    error = fabs(error);
+    result->sumsquares += error * error;
+    ++result->count;
+    if (error > result->maxerror || result->count == 1) {
+        va_list args;
+        va_start(args, format);
+        result->maxerror = error;
+        vsnprintf(result->worstinput, sizeof(result->worstinput), format, args);
+        va_end(args);
+    }
+}
+
+static double angledifference(double a, double b)
+{
+    double difference = fmod(a - b, 360);
+    if (difference > 180)
+        difference -= 360;
+    if (difference < -180)
+        difference += 360;
+    return (difference);
+}
+
+static void testmultiply(void)
+{
+    testresultstruct *result = newtest("lib_fp_multiply", "lsb", MULTIPLYLIMIT);
+    int count = 0;
+    fixedpointnum *xs = malloc((62 * 62 * 4 + NUMRANDOM) * sizeof(fixedpointnum));
+    fixedpointnum *ys = malloc((62 * 62 * 4 + NUMRANDOM) * sizeof(fixedpointnum));
+
+    // sweep: powers of two and their neighbors with every sign, as long as the product fits
+    for (int i = 0; i < 62; ++i) {
+        for (int j = 0; j < 62; ++j) {
+            int32_t x = (int32_t) ((1UL << (i >> 1)) - (i & 1));
+            int32_t y = (int32_t) ((1UL << (j >> 1)) - (j & 1));
+            for (int sign = 0; sign < 4; ++sign) {
+                xs[count] = sign & 1 ? -x : x;
+                ys[count] = sign & 2 ? -y : y;
+                if (fabs((double) xs[count] * ys[count]) < ldexp(1.0, 46))
+                    ++count;
+            }
+        }
+    }
+    // fuzz
+    for (int i = 0; i < NUMRANDOM; ++i) {
+        xs[count] = randommagnitude(31);
+        ys[count] = randommagnitude(31);
+        if (fabs((double) xs[count] * ys[count]) < ldexp(1.0, 46))
+            ++count;
+    }
+
+    for (int i = 0; i < count; ++i)
+        adderror(result, lib_fp_multiply(xs[i], ys[i]) - (double) xs[i] * ys[i] / FIXEDPOINTONE, "%d,%d", xs[i], ys[i]);
+
+    volatile fixedpointnum sink = 0;
+    double start = hostnanoseconds();
+    for (int i = 0; i < count; ++i)
+        sink += lib_fp_multiply(xs[i], ys[i]);
+    result->nanoseconds = (hostnanoseconds() - start) / count;
+    free(xs);
+    free(ys);
+}
+
+static void testatan2(void)
+{
+    testresultstruct *result = newtest("lib_fp_atan2", "deg", ATAN2LIMIT);
+    const int numangles = 36000;
+    int count = 0;
+    fixedpointnum *xs = malloc((numangles * 3 + NUMRANDOM) * sizeof(fixedpointnum));
+    fixedpointnum *ys = malloc((numangles * 3 + NUMRANDOM) * sizeof(fixedpointnum));
+
+    // sweep: every 0.01 degrees at the scale of the imu's unit vectors and at the two ends
+    for (int m = 0; m < 3; ++m) {
+        double radius = ldexp(1.0, (int[]) { 10, 16, 29 }[m]);
+        for (int a = 0; a < numangles; ++a, ++count) {
+            double angle = (a * 0.01 - 180) * M_PI / 180;
+            ys[count] = (fixedpointnum) lrint(radius * sin(angle));
+            xs[count] = (fixedpointnum) lrint(radius * cos(angle));
+        }
+    }
+    // fuzz, keeping |x|+|y| below 2^30 for the CORDIC kernel
+    for (int i = 0; i < NUMRANDOM; ++i, ++count) {
+        ys[count] = randommagnitude(29);
+        xs[count] = randommagnitude(29);
+    }
+
+    for (int i = 0; i < count; ++i)
+        adderror(result, angledifference(FIXEDPOINTTODOUBLE(lib_fp_atan2(ys[i], xs[i])), atan2(ys[i], xs[i]) * 180 / M_PI), "%d,%d", ys[i], xs[i]);
+
+    volatile fixedpointnum sink = 0;
+    double start = hostnanoseconds();
+    for (int i = 0; i < count; ++i)
+        sink += lib_fp_atan2(ys[i], xs[i]);
+    result->nanoseconds = (hostnanoseconds() - start) / count;
+    free(xs);
+    free(ys);
+}
+
+static void testsineandcosine(void)
+{
+    testresultstruct *sineresult = newtest("lib_fp_sine", "abs", SINELIMIT);
+    testresultstruct *cosineresult = newtest("lib_fp_cosine", "abs", SINELIMIT);
+    const int numsweep = 1440000;
+    int count = numsweep + NUMRANDOM;
+    fixedpointnum *angles = malloc(count * sizeof(fixedpointnum));
+
+    // sweep: every 0.001 degrees from -720 to 720, then any angle up to 16384 degrees
+    for (int i = 0; i < numsweep; ++i)
+        angles[i] = (fixedpointnum) lrint((i * 0.001 - 720) * FIXEDPOINTONE);
+    for (int i = numsweep; i < count; ++i)
+        angles[i] = (int32_t) randomnumber() >> 1;
+
+    for (int i = 0; i < count; ++i) {
+        double radians = fmod(FIXEDPOINTTODOUBLE(angles[i]), 360) * M_PI / 180;
+        adderror(sineresult, FIXEDPOINTTODOUBLE(lib_fp_sine(angles[i])) - sin(radians), "%d", angles[i]);
+        adderror(cosineresult, FIXEDPOINTTODOUBLE(lib_fp_cosine(angles[i])) - cos(radians), "%d", angles[i]);
+    }
+
+    volatile fixedpointnum sink = 0;
+    double start = hostnanoseconds();
+    for (int i = 0; i < count; ++i)
+        sink += lib_fp_sine(angles[i]);
+    sineresult->nanoseconds = (hostnanoseconds() - start) / count;
+    start = hostnanoseconds();
+    for (int i = 0; i < count; ++i)
+        sink += lib_fp_cosine(angles[i]);
+    cosineresult->nanoseconds = (hostnanoseconds() - start) / count;
+    free(angles);
+}
+
+// both take every positive fixedpointnum.  The invsqrt errors are in LSB of results below 1 and relative
+// to 2^-16 of the result above that.  Large x give small invsqrts with only a few bits, and sqrt
+// multiplies x by that, so its error is relative.
+static double relativeerror(double value, double reference)
+{
+    return ((value - reference) / (reference > 1 ? reference : 1) * FIXEDPOINTONE);
+}
+
+static void testinvsqrtandsqrt(void)
+{
+    testresultstruct *invsqrtresult = newtest("lib_fp_invsqrt", "lsb", INVSQRTLIMIT);
+    testresultstruct *sqrtresult = newtest("lib_fp_sqrt", "rel", SQRTLIMIT);
+    const int stepsperoctave = 4096;
+    int count = 31 * stepsperoctave + NUMRANDOM;
+    fixedpointnum *xs = malloc(count * sizeof(fixedpointnum));
+    int n = 0;
+
+    // sweep: 4096 steps in every octave from 2^-16 up, then random magnitudes
+    for (int m = 0; m < 31; ++m)
+        for (int i = 0; i < stepsperoctave; ++i)
+            xs[n++] = (fixedpointnum) ((1UL << m) + ((uint64_t) i << m) / stepsperoctave);
+    while (n < count) {
+        xs[n] = randommagnitude(31) & 0x7fffffff;
+        if (xs[n])
+            ++n;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        double x = FIXEDPOINTTODOUBLE(xs[i]);
+        double reference = 1 / sqrt(x);
+        adderror(invsqrtresult, relativeerror(FIXEDPOINTTODOUBLE(lib_fp_invsqrt(xs[i])), reference), "%d", xs[i]);
+        reference = sqrt(x);
+        adderror(sqrtresult, (FIXEDPOINTTODOUBLE(lib_fp_sqrt(xs[i])) - reference) / reference, "%d", xs[i]);
+    }
+
+    volatile fixedpointnum sink = 0;
+    double start = hostnanoseconds();
+    for (int i = 0; i < count; ++i)
+        sink += lib_fp_invsqrt(xs[i]);
+    invsqrtresult->nanoseconds = (hostnanoseconds() - start) / count;
+    start = hostnanoseconds();
+    for (int i = 0; i < count; ++i)
+        sink += lib_fp_sqrt(xs[i]);
+    sqrtresult->nanoseconds = (hostnanoseconds() - start) / count;
+    free(xs);
+}
+
+// one step of the filter the way the flight code calls it: timesliver is a fixedpointnum24 of 0.5 to 20ms
+typedef struct {
+    fixedpointnum variable;
+    fixedpointnum newvalue;
+    fixedpointnum24 timesliver;
+    fixedpointnum oneoverperiod;
+} lowpassinputstruct;
+
+static void testlowpassfilter(void)
+{
+    testresultstruct *result = newtest("lib_fp_lowpassfilter", "lsb", LOWPASSLIMIT);
+    static const fixedpointnum periods[] = {
+        FIXEDPOINTONEOVERONESIXTYITH, FIXEDPOINTONEOVERONESIXTEENTH, FIXEDPOINTONEOVERONEFOURTH, FIXEDPOINTONEOVERONEHALF,
+        FIXEDPOINTONEOVERONE, FIXEDPOINTONEOVERTWO, FIXEDPOINTONEOVERFOUR, FIXEDPOINTCONSTANT(.1),
+    };
+    const int numperiods = sizeof(periods) / sizeof(periods[0]);
+    int count = numperiods * 31 * 2 + NUMRANDOM;
+    lowpassinputstruct *inputs = malloc(count * sizeof(lowpassinputstruct));
+    int n = 0;
+
+    // sweep: steps of every size in both directions with a 2ms timesliver and each period
+    for (int p = 0; p < numperiods; ++p) {
+        for (int m = 0; m < 31; ++m) {
+            for (int sign = 0; sign < 2; ++sign, ++n) {
+                inputs[n].variable = 0;
+                inputs[n].newvalue = (sign ? -(1L << m) : (1L << m)) >> TIMESLIVEREXTRASHIFT;
+                inputs[n].timesliver = FIXEDPOINT24CONSTANT(.002);
+                inputs[n].oneoverperiod = periods[p];
+            }
+        }
+    }
+    // fuzz: values up to 2^23 (128.0), since the filter shifts them left by TIMESLIVEREXTRASHIFT, and
+    // no more than the whole step in one timesliver
+    while (n < count) {
+        inputs[n].variable = randommagnitude(31 - TIMESLIVEREXTRASHIFT);
+        inputs[n].newvalue = randommagnitude(31 - TIMESLIVEREXTRASHIFT);
+        inputs[n].timesliver = FIXEDPOINT24CONSTANT(.0005) + randomnumber() % FIXEDPOINT24CONSTANT(.0195);
+        inputs[n].oneoverperiod = periods[randomnumber() % numperiods];
+        if (lib_fp_multiply(inputs[n].timesliver, inputs[n].oneoverperiod) <= FIXEDPOINT24ONE)
+            ++n;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        fixedpointnum variable = inputs[i].variable;
+        lib_fp_lowpassfilter(&variable, inputs[i].newvalue, inputs[i].timesliver, inputs[i].oneoverperiod, TIMESLIVEREXTRASHIFT);
+        double fraction = inputs[i].timesliver / (double) FIXEDPOINT24ONE * FIXEDPOINTTODOUBLE(inputs[i].oneoverperiod);
+        double reference = inputs[i].variable + (inputs[i].newvalue - (double) inputs[i].variable) * fraction;
+        adderror(result, variable - reference, "%d,%d,%d,%d", inputs[i].variable, inputs[i].newvalue, inputs[i].timesliver, inputs[i].oneoverperiod);
+    }
+
+    volatile fixedpointnum sink = 0;
+    double start = hostnanoseconds();
+    for (int i = 0; i < count; ++i) {
+        fixedpointnum variable = inputs[i].variable;
+        lib_fp_lowpassfilter(&variable, inputs[i].newvalue, inputs[i].timesliver, inputs[i].oneoverperiod, TIMESLIVEREXTRASHIFT);
+        sink += variable;
+    }
+    result->nanoseconds = (hostnanoseconds() - start) / count;
+    free(inputs);
+}
+
+#define STRINGSIZE 24
+
+static void teststringtofixedpointnum(void)
+{
+    testresultstruct *result = newtest("lib_fp_stringtofixedpointnum", "lsb", STRINGLIMIT);
+    const int numsweep = 200001;
+    int count = numsweep + NUMRANDOM;
+    char (*strings)[STRINGSIZE] = malloc(count * sizeof(*strings));
+    char string[STRINGSIZE];
+
+    // sweep: every hundredth from -1000 to 1000, the way settings are typed, then random values
+    // with 0 to 8 decimals
+    for (int i = 0; i < numsweep; ++i)
+        snprintf(strings[i], STRINGSIZE, "%.2f", (i - 100000) / 100.0);
+    for (int i = numsweep; i < count; ++i)
+        snprintf(strings[i], STRINGSIZE, "%.*f", (int) (randomnumber() % 9), ((int32_t) randomnumber() >> 1) / 65536.0);
+
+    for (int i = 0; i < count; ++i) {
+        // lib_fp_stringtofixedpointnum() cuts off long strings in place, so it gets a copy
+        strcpy(string, strings[i]);
+        adderror(result, lib_fp_stringtofixedpointnum(string) - strtod(strings[i], NULL) * FIXEDPOINTONE, "%s", strings[i]);
+    }
+
+    volatile fixedpointnum sink = 0;
+    double start = hostnanoseconds();
+    for (int i = 0; i < count; ++i) {
+        strcpy(string, strings[i]);
+        sink += lib_fp_stringtofixedpointnum(string);
+    }
+    result->nanoseconds = (hostnanoseconds() - start) / count;
+    free(strings);
+}
+
+// the ns_per_call of a test in a JSON file written by this program, or 0 if it isn't there
+static double baselinenanoseconds(FILE * file, const char *name)
+{
+    char line[512], key[128];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    rewind(file);
+    while (fgets(line, sizeof(line), file)) {
+        char *value = strstr(line, "\"ns_per_call\": ");
+        if (strstr(line, key) && value)
+            return (atof(value + strlen("\"ns_per_call\": ")));
+    }
+    return (0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *baselinename = NULL;
+    double tolerance = 1.5;
+    FILE *baseline = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && !strcmp(argv[i], "-b"))
+            baselinename = argv[++i];
+        else if (i + 1 < argc && !strcmp(argv[i], "-t"))
+            tolerance = atof(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-b baseline.json] [-t tolerance]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (baselinename && !(baseline = fopen(baselinename, "r"))) {
+        perror(baselinename);
+        return 1;
+    }
+
+    testmultiply();
+    testatan2();
+    testsineandcosine();
+    testinvsqrtandsqrt();
+    testlowpassfilter();
+    teststringtofixedpointnum();
+
+    bool allpassed = true;
+    printf("{\n  \"library\": \"%s\",\n  \"tests\": [\n", FPSUITE_LIBRARY);
+    for (int i = 0; i < numresults; ++i) {
+        testresultstruct *result = &results[i];
+        bool accuracypassed = result->maxerror <= result->limit;
+        printf("    {\"name\": \"%s\", \"unit\": \"%s\", \"inputs\": %ld, \"max_error\": %.6g, \"rms_error\": %.6g, "
+            "\"worst_input\": \"%s\", \"ns_per_call\": %.2f, \"limit\": %g, \"accuracy_pass\": %s",
+            result->name, result->unit, result->count, result->maxerror, sqrt(result->sumsquares / result->count),
+            result->worstinput, result->nanoseconds, result->limit, accuracypassed ? "true" : "false");
+        if (baseline) {
+            double baselinens = baselinenanoseconds(baseline, result->name);
+            bool speedpassed = baselinens == 0 || result->nanoseconds <= baselinens * tolerance;
+            printf(", \"baseline_ns_per_call\": %.2f, \"speed_pass\": %s", baselinens, speedpassed ? "true" : "false");
+            allpassed = allpassed && speedpassed;
+        }
+        allpassed = allpassed && accuracypassed;
+        printf("}%s\n", i + 1 < numresults ? "," : "");
+    }
+    printf("  ],\n  \"pass\": %s\n}\n", allpassed ? "true" : "false");
+
+    if (baseline)
+        fclose(baseline);
+    return (allpassed ? 0 : 1);
+}
@@ -0,0 +1,308 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the gyro calibration and GYRO_BIAS_TRACKING on sensor traces of an aircraft sitting on the ground.  The
+// Makefile links it with imu.c and vectors.c built with GYRO_BIAS_TRACKING.  Each trace is replayed twice: through
+// calibrategyroandaccelerometer(), which stops when its averages settle, and through imucalculateestimatedattitude()
+// from a zero calibration, like a boot with GYRO_BIAS_TRACKING and an old calibration in eeprom.
+//
+// Without trace files it records two traces of 10 seconds with the MPU-3050's resolution, a gyro bias that drifts
+// like a gyro warming up, gyro and accelerometer noise and a main loop of 1.5 to 2.5ms: "still", and "bumped",
+// where the aircraft is knocked three times in the first 2.5 seconds and picked up and tilted from 3 to 3.6
+// seconds.  The traces are in the format of simquad -g (the bias is in the gyro columns), and -w writes them out.
+// A third, "shaken", is knocked every SHAKEEVERY seconds all along, so the calibration has to time out and keep the
+// calibration it had.  It is calibrated twice: "shaken" from a calibration in eeprom, which it can still arm with,
+// and "shaken_new" from none, where the gyro has to stay uncalibrated.
+//
+// It prints one CSV line for each trace: the trace; the seconds the calibration took, how often it started over and
+// whether it timed out (its calibrationinfo), its largest gyro standard deviation and its largest bias error in
+// degrees per second; then the seconds until the aircraft could be armed with GYRO_BIAS_TRACKING, and its largest
+// bias error then, at the end and at any time after it could be armed.  It exits with 1 if on a recorded trace the
+// calibration times out or either bias error is ever 0.1 degrees per second or more, or if on "shaken" it doesn't
+// time out, doesn't keep the calibration it had, or isn't calibrated only if it had one.
+//
+// usage: gyrobias [-w] [-h] [tracefile...]
+//   -w  write the recorded traces to gyrobias_still.csv and gyrobias_bumped.csv
+//   -h  print the CSV header line first
+
+#include "bradwii.h"
+#include "imu.h"
+#include "lib_host.h"
+
+globalstruct global;
+usersettingsstruct usersettings;
+
+#define GYRO_COUNTSPERDEGREEPERSECOND (32768.0 / 2000.0)
+#define RECORDSECONDS 10.0
+#define SHAKEEVERY .4           // seconds, shorter than CALIBRATION_MIN_TIME
+
+typedef struct {
+    fixedpointnum24 timesliver;
+    fixedpointnum gyrorate[3];
+    fixedpointnum acc_g_vector[3];
+    double bias[3];             // the true gyro bias, degrees per second
+} samplestruct;
+
+static samplestruct *samples;
+static int samplecount;
+static int sampleindex;         // the sample the sensors read, calculatetimesliver() moves on to the next
+
+void readgyro(void)
+{
+    for (int x = 0; x < 3; ++x)
+        global.gyrorate[x] = samples[sampleindex].gyrorate[x];
+}
+
+void readacc(void)
+{
+    for (int x = 0; x < 3; ++x)
+        global.acc_g_vector[x] = samples[sampleindex].acc_g_vector[x];
+}
+
+void calculatetimesliver(void)
+{
+    if (sampleindex < samplecount - 1)
+        ++sampleindex;
+    global.timesliver = samples[sampleindex].timesliver;
+}
+
+void x4_set_leds(unsigned char state)
+{
+}
+
+// true if t is in the pulse starting at start
+static bool inpulse(double t, double start, double length)
+{
+    return t >= start && t < start + length;
+}
+
+static void record(bool bumped, bool shaken)
+{
+    int size = (int) (RECORDSECONDS / .0015) + 1;
+    double t = 0, tilt = 0;
+
+    samples = realloc(samples, size * sizeof(samplestruct));
+    samplecount = 0;
+    while (t < RECORDSECONDS && samplecount < size) {
+        samplestruct *s = &samples[samplecount++];
+        double dt = .0015 + .001 * lib_host_uniform();
+        double rate[3] = { 0, 0, 0 }, acc[3];
+
+        t += dt;
+        if (bumped) {
+            // knocks on the roll, pitch and yaw axes, then picked up, tilted and put down again
+            if (inpulse(t, .4, .05))
+                rate[ROLLINDEX] = 40;
+            if (inpulse(t, 1.3, .05))
+                rate[PITCHINDEX] = -30;
+            if (inpulse(t, 2.2, .05))
+                rate[YAWINDEX] = 60;
+            if (inpulse(t, 3.0, .3))
+                rate[ROLLINDEX] = 20;
+            if (inpulse(t, 3.3, .3))
+                rate[ROLLINDEX] = -20;
+        }
+        // knocks both ways, so it stays level
+        if (shaken && fmod(t, SHAKEEVERY) < .05)
+            rate[ROLLINDEX] = fmod(t, 2 * SHAKEEVERY) < SHAKEEVERY ? 40 : -40;
+        tilt += rate[ROLLINDEX] * dt * M_PI / 180;
+        acc[XINDEX] = sin(tilt);
+        acc[YINDEX] = 0;
+        acc[ZINDEX] = cos(tilt);
+        if (bumped && (inpulse(t, .4, .05) || inpulse(t, 1.3, .05) || inpulse(t, 2.2, .05)))
+            acc[ZINDEX] += .3;
+
+        s->timesliver = FIXEDPOINT24CONSTANT(dt);
+        s->bias[ROLLINDEX] = 1.5 + .03 * t;
+        s->bias[PITCHINDEX] = -2.2 - .02 * t;
+        s->bias[YAWINDEX] = .8 + .01 * t;
+        for (int x = 0; x < 3; ++x) {
+            double counts = lrint((rate[x] + s->bias[x] + .15 * lib_host_gaussian()) * GYRO_COUNTSPERDEGREEPERSECOND);
+            s->gyrorate[x] = (fixedpointnum) lrint(counts / GYRO_COUNTSPERDEGREEPERSECOND * FIXEDPOINTONE);
+            s->acc_g_vector[x] = (fixedpointnum) lrint((acc[x] + .01 * lib_host_gaussian()) * FIXEDPOINTONE);
+        }
+    }
+}
+
+static void writetrace(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror(filename);
+        exit(1);
+    }
+    // the true attitude isn't used, it is level
+    for (int i = 0; i < samplecount; ++i)
+        fprintf(file, "%ld,%ld,%ld,%ld,%ld,%ld,%ld,0,0,1,1,0,0\n", (long) samples[i].timesliver, (long) samples[i].gyrorate[0],
+            (long) samples[i].gyrorate[1], (long) samples[i].gyrorate[2], (long) samples[i].acc_g_vector[0],
+            (long) samples[i].acc_g_vector[1], (long) samples[i].acc_g_vector[2]);
+    fclose(file);
+}
+
+// a trace without a known bias has the average rate over the whole trace as its bias
+static bool readtrace(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror(filename);
+        return false;
+    }
+    int size = 4096;
+    long values[7];
+    double vectors[6];
+    double sum[3] = { 0, 0, 0 };
+
+    samples = realloc(samples, size * sizeof(samplestruct));
+    samplecount = 0;
+    while (fscanf(file, "%ld,%ld,%ld,%ld,%ld,%ld,%ld,%lf,%lf,%lf,%lf,%lf,%lf", &values[0], &values[1], &values[2], &values[3],
+            &values[4], &values[5], &values[6], &vectors[0], &vectors[1], &vectors[2], &vectors[3], &vectors[4], &vectors[5]) == 13) {
+        samplestruct *s = &samples[samplecount];
+        s->timesliver = values[0];
+        for (int x = 0; x < 3; ++x) {
+            s->gyrorate[x] = values[x + 1];
+            s->acc_g_vector[x] = values[x + 4];
+            sum[x] += values[x + 1] / (double) FIXEDPOINTONE;
+        }
+        if (++samplecount == size)
+            samples = realloc(samples, (size *= 2) * sizeof(samplestruct));
+    }
+    fclose(file);
+    for (int i = 0; i < samplecount; ++i)
+        for (int x = 0; x < 3; ++x)
+            samples[i].bias[x] = sum[x] / samplecount;
+    if (!samplecount)
+        fprintf(stderr, "%s: no samples\n", filename);
+    return samplecount > 0;
+}
+
+// the largest axis of the calibration's error against the bias of the sample the sensors read
+static double biaserror(void)
+{
+    double error = 0;
+    for (int x = 0; x < 3; ++x) {
+        double axiserror = fabs(usersettings.gyrocalibration[x] / (double) FIXEDPOINTONE + samples[sampleindex].bias[x]);
+        if (axiserror > error)
+            error = axiserror;
+    }
+    return error;
+}
+
+static bool run(const char *name)
+{
+    global.armed = 0;
+
+    // the calibration
+    sampleindex = 0;
+    calibrategyroandaccelerometer(false);
+    double calibrationerror = biaserror();
+    double deviation = 0;
+    for (int x = 0; x < 3; ++x)
+        if (sqrt(calibrationinfo.gyrovariance[x] / (double) FIXEDPOINT24ONE) > deviation)
+            deviation = sqrt(calibrationinfo.gyrovariance[x] / (double) FIXEDPOINT24ONE);
+
+    // GYRO_BIAS_TRACKING from a zero calibration
+    for (int x = 0; x < 3; ++x)
+        usersettings.gyrocalibration[x] = 0;
+    global.usersettingsfromeeprom = 1;
+    sampleindex = 0;
+    initimu();
+
+    double seconds = 0, armseconds = -1, armerror = 0, maxerror = 0;
+    while (sampleindex < samplecount - 1) {
+        calculatetimesliver();
+        imucalculateestimatedattitude();
+        seconds += global.timesliver / (double) FIXEDPOINT24ONE;
+        if (global.gyrocalibrated) {
+            double error = biaserror();
+            if (armseconds < 0) {
+                armseconds = seconds;
+                armerror = error;
+            }
+            if (error > maxerror)
+                maxerror = error;
+        }
+    }
+    printf("%s,%.3f,%d,%d,%.4f,%.4f,%.3f,%.4f,%.4f,%.4f\n", name, calibrationinfo.milliseconds / 1000.0, calibrationinfo.restarts,
+        calibrationinfo.timedout, deviation, calibrationerror, armseconds, armerror, biaserror(), maxerror);
+    return !calibrationinfo.timedout && calibrationerror < .1 && armseconds >= 0 && maxerror < .1;
+}
+
+// the calibration on "shaken", from an old calibration in eeprom or from none
+static bool runshaken(const char *name, bool fromeeprom)
+{
+    const fixedpointnum oldcalibration[3] = { FIXEDPOINTCONSTANT(-1.5), FIXEDPOINTCONSTANT(2.2), FIXEDPOINTCONSTANT(-.8) };
+    bool kept = true;
+
+    for (int x = 0; x < 3; ++x)
+        usersettings.gyrocalibration[x] = oldcalibration[x];
+    global.gyrocalibrated = 0;
+    global.usersettingsfromeeprom = fromeeprom;
+    sampleindex = 0;
+    calibrategyroandaccelerometer(false);
+    for (int x = 0; x < 3; ++x)
+        if (usersettings.gyrocalibration[x] != oldcalibration[x])
+            kept = false;
+    printf("%s,%.3f,%d,%d\n", name, calibrationinfo.milliseconds / 1000.0, calibrationinfo.restarts, calibrationinfo.timedout);
+    if (!calibrationinfo.timedout || !kept || global.gyrocalibrated != fromeeprom) {
+        fprintf(stderr, "gyrobias: the calibration on %s didn't time out, didn't keep the old one or is calibrated wrongly\n", name);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    bool header = false, write = false;
+    int files = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-h"))
+            header = true;
+        else if (!strcmp(argv[i], "-w"))
+            write = true;
+        else if (argv[i][0] != '-')
+            ++files;
+        else {
+            fprintf(stderr, "usage: %s [-w] [-h] [tracefile...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (header)
+        printf("trace,calibration_s,restarts,timed_out,deviation_dps,calibration_error_dps,arm_s,arm_error_dps,last_error_dps,max_error_dps\n");
+    bool pass = true;
+    if (files) {
+        // traces recorded elsewhere are reported, they may not be still
+        for (int i = 1; i < argc; ++i)
+            if (argv[i][0] != '-' && readtrace(argv[i]))
+                run(argv[i]);
+    } else {
+        record(false, false);
+        if (write)
+            writetrace("gyrobias_still.csv");
+        pass &= run("still");
+        record(true, false);
+        if (write)
+            writetrace("gyrobias_bumped.csv");
+        pass &= run("bumped");
+        record(false, true);
+        pass &= runshaken("shaken", true);
+        pass &= runshaken("shaken_new", false);
+    }
+    free(samples);
+    return pass ? 0 : 1;
+}
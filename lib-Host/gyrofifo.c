@@ -0,0 +1,433 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Tests GYRO_FIFO on emulated MPU3050 and MPU6050 registers.  The Makefile builds gyro.c and accelerometer.c with
+// GYRO_FIFO for the X4 (gyrofifo_mpu3050) and the V202 (gyrofifo_mpu6050).  The chip model below takes its sample
+// rate, FIFO contents and FIFO enable and reset from the registers initgyro() and startgyrosampling() write,
+// samples a signal with fast components into its data registers and FIFO, and serves the FIFO through a FIFO
+// register on the emulated I2C bus.  The chip has no low pass filter.
+//
+// A main loop of 1 to 5ms drains the FIFO with readgyrofifo() and readgyrosample() and integrates the samples like
+// the imu does.  For comparison it also reads the data registers once per loop the way readgyro() and readacc()
+// do without GYRO_FIFO.  Then the loop stalls until the FIFO overflows and runs another second of the FIFO path,
+// to check that it starts again on a sample boundary.
+//
+// It prints one CSV line for each method: the chip, the method, the number of loops, the samples the chip made and
+// the ones the method used, the I2C bus microseconds per loop and per sample, the RMS and final error of the
+// integrated gyro angle in degrees (the largest axis), and the RMS error of the accelerometer against the true
+// average over the loop in g (MPU6050 only), then pass or fail.  It fails if the FIFO path lost samples outside
+// the stall, its angle error is 0.5 degrees or more before or after the overflow, or its accelerometer isn't
+// better than the snapshot.
+//
+// usage: gyrofifo [-s seconds] [-h]
+//   -s  seconds to run, default 10
+//   -h  print the CSV header line first
+
+#include "bradwii.h"
+#include "gyro.h"
+#include "accelerometer.h"
+#include "lib_i2c.h"
+#include "lib_timers.h"
+#include "lib_host.h"
+
+globalstruct global;
+usersettingsstruct usersettings;
+lib_host_statsstruct lib_host_stats;
+
+#define CHIPADDRESS 0x68
+#if (GYRO_TYPE == MPU3050)
+#define CHIPNAME "mpu3050"
+#define SMPLRTDIVREGISTER 0x15
+#define DLPFREGISTER 0x16
+#define FIFOENREGISTER 0x12
+#define USERCTRLREGISTER 0x3D
+#define USERCTRLFIFOEN 0x40
+#define USERCTRLFIFORESET 0x02
+#define FIFOCOUNTREGISTER 0x3A
+#define FIFOREGISTER 0x3C
+#define FIFOSIZE 512
+#define GYRODATAREGISTER 0x1D
+#define GYROCOUNTSPERDPS (32768.0 / 2000.0)
+#elif (GYRO_TYPE == MPU6050)
+#define CHIPNAME "mpu6050"
+#define SMPLRTDIVREGISTER 0x19
+#define DLPFREGISTER 0x1A
+#define FIFOENREGISTER 0x23
+#define USERCTRLREGISTER 0x6A
+#define USERCTRLFIFOEN 0x40
+#define USERCTRLFIFORESET 0x04
+#define FIFOCOUNTREGISTER 0x72
+#define FIFOREGISTER 0x74
+#define FIFOSIZE 1024
+#define GYRODATAREGISTER 0x43
+#define GYROCOUNTSPERDPS 16.4
+#define ACCDATAREGISTER 0x3B
+#define ACCCOUNTSPERG 4096.0
+#else
+#error "gyrofifo needs an MPU3050 or MPU6050"
+#endif
+
+#define STALLMICROSECONDS 300000L
+
+static unsigned char fifo[FIFOSIZE];
+static int fifohead, fifocount;
+static uint32_t nextsampletime;
+static uint32_t sampletimes[FIFOSIZE];  // of the samples since the FIFO reset, by number
+static long pushedsamples, poppedbytes;
+static int samplebytes;
+
+// the signal in the chip's axes, degrees per second and g, at virtual microseconds
+static void chipgyro(uint32_t microseconds, double *rate)
+{
+    double t = microseconds * 1e-6;
+    rate[0] = 150 * sin(2 * M_PI * 7 * t) + 60 * sin(2 * M_PI * 170 * t);
+    rate[1] = 90 * sin(2 * M_PI * 13 * t + 1) + 40 * sin(2 * M_PI * 230 * t);
+    rate[2] = 30 + 40 * sin(2 * M_PI * 170 * t + 2);
+}
+
+// the integral of chipgyro(), degrees
+static void chipangle(uint32_t microseconds, double *angle)
+{
+    double t = microseconds * 1e-6;
+    angle[0] = -150 * cos(2 * M_PI * 7 * t) / (2 * M_PI * 7) - 60 * cos(2 * M_PI * 170 * t) / (2 * M_PI * 170);
+    angle[1] = -90 * cos(2 * M_PI * 13 * t + 1) / (2 * M_PI * 13) - 40 * cos(2 * M_PI * 230 * t) / (2 * M_PI * 230);
+    angle[2] = 30 * t - 40 * cos(2 * M_PI * 170 * t + 2) / (2 * M_PI * 170);
+}
+
+#ifdef ACCDATAREGISTER
+static void chipacc(uint32_t microseconds, double *acc)
+{
+    double t = microseconds * 1e-6;
+    acc[0] = 0.1 * sin(2 * M_PI * 3 * t);
+    acc[1] = 0.2 * sin(2 * M_PI * 190 * t);
+    acc[2] = 1 + 0.5 * sin(2 * M_PI * 170 * t);
+}
+
+// the integral of chipacc(), g seconds
+static void chipaccintegral(uint32_t microseconds, double *integral)
+{
+    double t = microseconds * 1e-6;
+    integral[0] = -0.1 * cos(2 * M_PI * 3 * t) / (2 * M_PI * 3);
+    integral[1] = -0.2 * cos(2 * M_PI * 190 * t) / (2 * M_PI * 190);
+    integral[2] = t - 0.5 * cos(2 * M_PI * 170 * t) / (2 * M_PI * 170);
+}
+#endif
+
+static int16_t tocounts(double value)
+{
+    if (value > 32767)
+        return 32767;
+    if (value < -32768)
+        return -32768;
+    return (int16_t) lrint(value);
+}
+
+static void tobigendian(int16_t value, unsigned char *data)
+{
+    data[0] = (uint16_t) value >> 8;
+    data[1] = value & 0xFF;
+}
+
+static void pushfifo(unsigned char *data, int length)
+{
+    // a full FIFO keeps the newest bytes, so it doesn't start on a sample boundary any more
+    for (int i = 0; i < length; ++i) {
+        fifo[(fifohead + fifocount) % FIFOSIZE] = data[i];
+        if (fifocount < FIFOSIZE)
+            ++fifocount;
+        else
+            fifohead = (fifohead + 1) % FIFOSIZE;
+    }
+}
+
+static uint32_t sampleperiod(void)
+{
+    int dlpf = lib_host_i2c_getregister(CHIPADDRESS, DLPFREGISTER) & 7;
+    uint32_t base = (dlpf == 0 || dlpf == 7) ? 8000 : 1000;
+    return 1000000L * (lib_host_i2c_getregister(CHIPADDRESS, SMPLRTDIVREGISTER) + 1) / base;
+}
+
+// makes the samples that are due into the data registers and the FIFO
+static void catchup(void)
+{
+    uint32_t now = lib_timers_getcurrentmicroseconds();
+    unsigned char fifoenable = lib_host_i2c_getregister(CHIPADDRESS, FIFOENREGISTER);
+    bool enabled = lib_host_i2c_getregister(CHIPADDRESS, USERCTRLREGISTER) & USERCTRLFIFOEN;
+
+    while ((int32_t) (now - nextsampletime) >= 0) {
+        double rate[3];
+        unsigned char data[6];
+        int before = fifocount;
+
+#ifdef ACCDATAREGISTER
+        double acc[3];
+        chipacc(nextsampletime, acc);
+        for (int x = 0; x < 3; ++x)
+            tobigendian(tocounts(acc[x] * ACCCOUNTSPERG), &data[2 * x]);
+        lib_host_i2c_setregisters(CHIPADDRESS, ACCDATAREGISTER, data, 6);
+        if (enabled && (fifoenable & 0x08))
+            pushfifo(data, 6);
+#endif
+        chipgyro(nextsampletime, rate);
+        for (int x = 0; x < 3; ++x)
+            tobigendian(tocounts(rate[x] * GYROCOUNTSPERDPS), &data[2 * x]);
+        lib_host_i2c_setregisters(CHIPADDRESS, GYRODATAREGISTER, data, 6);
+        if (enabled) {
+            // the gyro axes in register order, each if its FIFO_EN bit is set
+            for (int x = 0; x < 3; ++x)
+                if (fifoenable & (0x40 >> x))
+                    pushfifo(&data[2 * x], 2);
+            samplebytes = fifocount - before;
+            sampletimes[pushedsamples++ % FIFOSIZE] = nextsampletime;
+        }
+        nextsampletime += sampleperiod();
+    }
+    unsigned char count[2] = { fifocount >> 8, fifocount & 0xFF };
+    lib_host_i2c_setregisters(CHIPADDRESS, FIFOCOUNTREGISTER, count, 2);
+}
+
+static void readcallback(unsigned char address, unsigned char reg)
+{
+    if (address == CHIPADDRESS)
+        catchup();
+}
+
+static void writecallback(unsigned char address, unsigned char reg)
+{
+    if (address == CHIPADDRESS && reg == USERCTRLREGISTER) {
+        catchup();
+        unsigned char value = lib_host_i2c_getregister(CHIPADDRESS, USERCTRLREGISTER);
+        if (value & USERCTRLFIFORESET) {
+            fifohead = fifocount = 0;
+            pushedsamples = poppedbytes = 0;
+            value &= ~USERCTRLFIFORESET;
+            lib_host_i2c_setregisters(CHIPADDRESS, USERCTRLREGISTER, &value, 1);
+        }
+    }
+}
+
+static unsigned char fifocallback(unsigned char address)
+{
+    if (!fifocount)
+        return 0;
+    unsigned char value = fifo[fifohead];
+    fifohead = (fifohead + 1) % FIFOSIZE;
+    --fifocount;
+    ++poppedbytes;
+    return value;
+}
+
+void x4_set_leds(unsigned char state)
+{
+}
+
+static uint32_t loopmicroseconds(void)
+{
+    return 1000 + lib_host_random() % 4001;
+}
+
+typedef struct {
+    double angle[3];            // integrated, firmware axes, degrees
+    double startangle[3];       // the truth where the integration starts, chip axes
+    double anglesquaresum;
+    double lastangleerror;
+    double accsquaresum;
+    long accloops;
+    long loops;
+    long samples;
+    uint32_t busmicroseconds;
+} methodstruct;
+
+static void addangleerror(methodstruct * method, uint32_t microseconds)
+{
+    double chipnow[3], chiptruth[3], truth[3], worst = 0;
+
+    chipangle(microseconds, chipnow);
+    for (int x = 0; x < 3; ++x)
+        chiptruth[x] = chipnow[x] - method->startangle[x];
+    GYRO_ORIENTATION(truth, chiptruth[0], chiptruth[1], chiptruth[2]);
+    for (int x = 0; x < 3; ++x)
+        if (fabs(method->angle[x] - truth[x]) > worst)
+            worst = fabs(method->angle[x] - truth[x]);
+    method->anglesquaresum += worst * worst;
+    method->lastangleerror = worst;
+    ++method->loops;
+}
+
+#ifdef ACCDATAREGISTER
+// the error of an accelerometer reading against the average of the signal from start to end
+static void addaccerror(methodstruct * method, fixedpointnum * reading, uint32_t start, uint32_t end)
+{
+    double before[3], after[3], mean[3], truth[3];
+
+    chipaccintegral(start, before);
+    chipaccintegral(end, after);
+    for (int x = 0; x < 3; ++x)
+        mean[x] = (after[x] - before[x]) / ((uint32_t) (end - start) * 1e-6);
+    ACC_ORIENTATION(truth, mean[0], mean[1], mean[2]);
+    for (int x = 0; x < 3; ++x) {
+        double error = reading[x] / (double) FIXEDPOINTONE - truth[x];
+        method->accsquaresum += error * error / 3;
+    }
+    ++method->accloops;
+}
+#endif
+
+// the main loop for seconds, the FIFO path from the FIFO reset and the snapshot path if there is one
+static void run(double seconds, methodstruct * fifomethod, methodstruct * snapshotmethod)
+{
+    uint32_t starttime = lib_timers_getcurrentmicroseconds();
+    uint32_t lastsnapshottime = 0;
+#ifdef ACCDATAREGISTER
+    uint32_t lastpoppedtime = 0;
+#endif
+    fixedpointnum rates[3];
+    unsigned char count;
+
+    while ((uint32_t) (lib_timers_getcurrentmicroseconds() - starttime) < seconds * 1e6) {
+        // the FIFO path, like integrategyrosamples() and readacc().  The samples integrate from a period before
+        // the first one to the last one read.
+        uint32_t start = lib_host_stats.busmicroseconds;
+        readgyrofifo();
+        while ((count = readgyrosample(rates))) {
+            for (int x = 0; x < 3; ++x)
+                fifomethod->angle[x] += rates[x] / (double) FIXEDPOINTONE / GYRO_SAMPLE_RATE;
+            fifomethod->samples += count;
+        }
+#ifdef ACCDATAREGISTER
+        readacc();
+#endif
+        fifomethod->busmicroseconds += lib_host_stats.busmicroseconds - start;
+        if (fifomethod->samples) {
+            uint32_t poppedtime = sampletimes[(poppedbytes / samplebytes - 1) % FIFOSIZE];
+            if (!fifomethod->loops)
+                chipangle(sampletimes[0] - sampleperiod(), fifomethod->startangle);
+#ifdef ACCDATAREGISTER
+            if (fifomethod->loops && poppedtime != lastpoppedtime)
+                addaccerror(fifomethod, global.acc_g_vector, lastpoppedtime, poppedtime);
+#endif
+            addangleerror(fifomethod, poppedtime);
+#ifdef ACCDATAREGISTER
+            lastpoppedtime = poppedtime;
+#endif
+        }
+
+        if (snapshotmethod) {
+            // the data registers once per loop times the loop time, like readgyro() and readacc() without the FIFO
+            uint32_t now = lib_timers_getcurrentmicroseconds();
+            unsigned char data[6];
+            double chipvalues[3];
+            fixedpointnum values[3];
+
+            start = lib_host_stats.busmicroseconds;
+            lib_i2c_readdata(CHIPADDRESS, GYRODATAREGISTER, data, 6);
+            for (int x = 0; x < 3; ++x)
+                chipvalues[x] = (int16_t) ((data[2 * x] << 8) | data[2 * x + 1]) / GYROCOUNTSPERDPS;
+            GYRO_ORIENTATION(values, lrint(chipvalues[0] * FIXEDPOINTONE), lrint(chipvalues[1] * FIXEDPOINTONE),
+                lrint(chipvalues[2] * FIXEDPOINTONE));
+            if (snapshotmethod->samples)
+                for (int x = 0; x < 3; ++x)
+                    snapshotmethod->angle[x] += values[x] / (double) FIXEDPOINTONE * (uint32_t) (now - lastsnapshottime) * 1e-6;
+            else
+                chipangle(now, snapshotmethod->startangle);
+            ++snapshotmethod->samples;
+#ifdef ACCDATAREGISTER
+            lib_i2c_readdata(CHIPADDRESS, ACCDATAREGISTER, data, 6);
+            for (int x = 0; x < 3; ++x)
+                chipvalues[x] = (int16_t) ((data[2 * x] << 8) | data[2 * x + 1]) / ACCCOUNTSPERG;
+            ACC_ORIENTATION(values, lrint(chipvalues[0] * FIXEDPOINTONE), lrint(chipvalues[1] * FIXEDPOINTONE),
+                lrint(chipvalues[2] * FIXEDPOINTONE));
+            if (snapshotmethod->loops)
+                addaccerror(snapshotmethod, values, lastsnapshottime, now);
+#endif
+            snapshotmethod->busmicroseconds += lib_host_stats.busmicroseconds - start;
+            addangleerror(snapshotmethod, now);
+            lastsnapshottime = now;
+        }
+        lib_host_timers_advancemicroseconds(loopmicroseconds());
+    }
+}
+
+static void printmethod(const char *name, methodstruct * method)
+{
+    printf("%s,%s,%ld,%ld,%ld,%.1f,%.1f,%.4f,%.4f,", CHIPNAME, name, method->loops, pushedsamples, method->samples,
+        method->busmicroseconds / (double) method->loops, method->busmicroseconds / (double) method->samples,
+        sqrt(method->anglesquaresum / method->loops), method->lastangleerror);
+    if (method->accloops)
+        printf("%.4f\n", sqrt(method->accsquaresum / method->accloops));
+    else
+        printf("\n");
+}
+
+// the FIFO path has to use every sample the chip made but the ones still in the FIFO, and follow the angle
+static bool fifopassed(methodstruct * method)
+{
+    return method->samples == pushedsamples - fifocount / samplebytes && method->lastangleerror < 0.5;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 10;
+    bool header = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && !strcmp(argv[i], "-s"))
+            seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-h"))
+            header = true;
+        else {
+            fprintf(stderr, "usage: %s [-s seconds] [-h]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    lib_host_i2c_setreadcallback(readcallback);
+    lib_host_i2c_setwritecallback(writecallback);
+    lib_host_i2c_setfiforegister(CHIPADDRESS, FIFOREGISTER, fifocallback);
+    nextsampletime = lib_timers_getcurrentmicroseconds();
+
+    initgyro();
+    initacc();
+    startgyrosampling();
+
+    methodstruct fifomethod = { { 0 } }, snapshotmethod = { { 0 } }, overflowmethod = { { 0 } };
+    run(seconds, &fifomethod, &snapshotmethod);
+
+    if (header)
+        printf("chip,method,loops,chip_samples,used_samples,bus_us_per_loop,bus_us_per_sample,angle_rms_deg,angle_last_deg,acc_rms_g\n");
+    printmethod("fifo", &fifomethod);
+    printmethod("snapshot", &snapshotmethod);
+    bool pass = fifopassed(&fifomethod);
+#ifdef ACCDATAREGISTER
+    if (fifomethod.accsquaresum / fifomethod.accloops >= snapshotmethod.accsquaresum / snapshotmethod.accloops)
+        pass = false;
+#endif
+
+    // stall until the FIFO overflows.  The next read resets it and then the FIFO path has to find whole samples again.
+    lib_host_timers_advancemicroseconds(STALLMICROSECONDS);
+    fixedpointnum rates[3];
+    readgyrofifo();
+    while (readgyrosample(rates))
+        ;
+    run(1, &overflowmethod, NULL);
+    printmethod("overflow", &overflowmethod);
+    if (!fifopassed(&overflowmethod))
+        pass = false;
+
+    printf("%s,%s\n", CHIPNAME, pass ? "pass" : "fail");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the attitude estimate with and without gyro oversampling (GYRO_SAMPLE_RATE) on a synthetic high frequency
+// rotation.  gyro.c reads an emulated MPU-3050 on the emulated I2C bus and imu.c estimates the attitude.  With
+// GYRO_SAMPLE_RATE the virtual clock's periodic callback stands in for the timer interrupt.  The main loop is a
+// loop that runs the imu and then spends either a steady 1ms or a random 1 to 5ms, like the gaps the FlySky
+// receiver's soft SPI reads make, before the next update.  The Makefile builds it as gyrosampling_loop (the main
+// loop reads the gyro) and gyrosampling_oversampled (GYRO_SAMPLE_RATE 500).
+//
+// The rotation is coning: the body rate has a constant length and turns around the body's Z axis at coning_hz.
+// Roll and pitch just oscillate, but the body also turns steadily around Z, which only an integration that takes
+// enough samples and composes them in the right order gets right.  There is no compass, so nothing corrects the
+// west vector and its error is the integration error.  The accelerometer reads the true down vector.
+//
+// It prints one CSV line for each loop: the build, the loop, the motion, the number of imu updates, the
+// angle between the estimated and true down vectors as the mean and maximum, and the angle between the
+// estimated and true west vectors as the mean, the maximum and at the end, in degrees.
+//
+// usage: gyrosampling [-f coning_hz] [-a cone_degrees] [-s seconds] [-h]
+//   -f  coning frequency, default 20Hz
+//   -a  half angle of the cone, default 2 degrees
+//   -s  seconds of coning, default 10
+//   -h  print the CSV header line first
+
+#include "bradwii.h"
+#include "imu.h"
+#include "gyro.h"
+#include "lib_timers.h"
+#include "lib_host.h"
+
+globalstruct global;
+usersettingsstruct usersettings;
+lib_host_statsstruct lib_host_stats;
+
+#define MPU3050_ADDRESS 0x68
+#define MPU3050_DATAREGISTER 0x1D
+#define GYRO_COUNTSPERDEGREEPERSECOND (32768.0 / 2000.0)
+#define RADIANSTODEGREES (180.0 / M_PI)
+#define TRUTHSTEPMICROSECONDS 5
+
+#if (GYRO_SAMPLE_RATE != 0)
+#define BUILDNAME "oversampled"
+#else
+#define BUILDNAME "loop"
+#endif
+
+static double coninghz = 20;
+static double conedegrees = 2;
+static double coningseconds = 10;
+
+static double quaternion[4];       // true body to world rotation, w x y z
+static uint32_t truthtime;         // virtual microseconds the quaternion is at
+static uint32_t coningstarttime;
+static bool coning = false;
+static unsigned long timeslivertimer;
+
+// the body rate in radians per second, in the body frame (X left, Y forward, Z down) like sim_quad.c
+static void bodyrate(uint32_t microseconds, double *rate)
+{
+    double t = (uint32_t) (microseconds - coningstarttime) * 1e-6;
+    double amplitude = 2 * M_PI * coninghz * conedegrees / RADIANSTODEGREES;
+
+    rate[0] = coning ? amplitude * cos(2 * M_PI * coninghz * t) : 0;
+    rate[1] = coning ? amplitude * sin(2 * M_PI * coninghz * t) : 0;
+    rate[2] = 0;
+}
+
+// moves the true attitude up to the virtual clock with the exact rotation of the rate at the middle of each step
+static void updatetruth(void)
+{
+    uint32_t now = lib_timers_getcurrentmicroseconds();
+
+    while ((int32_t) (now - truthtime) >= TRUTHSTEPMICROSECONDS) {
+        double rate[3], q[4], *p = quaternion;
+        bodyrate(truthtime + TRUTHSTEPMICROSECONDS / 2, rate);
+        double angle = sqrt(rate[0] * rate[0] + rate[1] * rate[1] + rate[2] * rate[2]) * TRUTHSTEPMICROSECONDS * 1e-6;
+        if (angle > 0) {
+            double s = sin(angle / 2) / (angle / (TRUTHSTEPMICROSECONDS * 1e-6));
+            double r[4] = { cos(angle / 2), rate[0] * s, rate[1] * s, rate[2] * s };
+            // q = q * r
+            q[0] = p[0] * r[0] - p[1] * r[1] - p[2] * r[2] - p[3] * r[3];
+            q[1] = p[0] * r[1] + p[1] * r[0] + p[2] * r[3] - p[3] * r[2];
+            q[2] = p[0] * r[2] - p[1] * r[3] + p[2] * r[0] + p[3] * r[1];
+            q[3] = p[0] * r[3] + p[1] * r[2] - p[2] * r[1] + p[3] * r[0];
+            memcpy(quaternion, q, sizeof(q));
+        }
+        truthtime += TRUTHSTEPMICROSECONDS;
+    }
+}
+
+// a world vector in the body frame
+static void tobody(const double *world, double *body)
+{
+    double w = quaternion[0], x = -quaternion[1], y = -quaternion[2], z = -quaternion[3];
+    body[0] = (1 - 2 * (y * y + z * z)) * world[0] + 2 * (x * y - w * z) * world[1] + 2 * (x * z + w * y) * world[2];
+    body[1] = 2 * (x * y + w * z) * world[0] + (1 - 2 * (x * x + z * z)) * world[1] + 2 * (y * z - w * x) * world[2];
+    body[2] = 2 * (x * z - w * y) * world[0] + 2 * (y * z + w * x) * world[1] + (1 - 2 * (x * x + y * y)) * world[2];
+}
+
+// the gyro samples the rate at the moment it is read, big endian like sim_quad.c
+static void readcallback(unsigned char address, unsigned char reg)
+{
+    double rate[3];
+    unsigned char data[6];
+
+    updatetruth();
+    bodyrate(lib_timers_getcurrentmicroseconds(), rate);
+    for (int i = 0; i < 3; ++i) {
+        int16_t counts = (int16_t) lrint(rate[i] * RADIANSTODEGREES * GYRO_COUNTSPERDEGREEPERSECOND);
+        data[2 * i] = (uint16_t) counts >> 8;
+        data[2 * i + 1] = counts & 0xFF;
+    }
+    lib_host_i2c_setregisters(MPU3050_ADDRESS, MPU3050_DATAREGISTER, data, 6);
+}
+
+// the accelerometer reads the true down vector and takes as long on the bus as the MC3210
+void readacc(void)
+{
+    const double worlddown[3] = { 0, 0, 1 };
+    double down[3];
+
+    lib_host_timers_advancemicroseconds(9 * LIB_HOST_I2C_BYTE_MICROSECONDS);
+    updatetruth();
+    tobody(worlddown, down);
+    for (int x = 0; x < 3; ++x)
+        global.acc_g_vector[x] = (fixedpointnum) lrint(down[x] * FIXEDPOINTONE);
+}
+
+void calculatetimesliver(void)
+{
+    global.timesliver = (lib_timers_gettimermicrosecondsandreset(&timeslivertimer) * 4295L) >> (32 - FIXEDPOINT24SHIFT);
+}
+
+void x4_set_leds(unsigned char state)
+{
+}
+
+// the main loop's time after the imu, from the xorshift generator so every run is the same
+static uint32_t loopmicroseconds(bool jitter)
+{
+    uint32_t random = lib_host_random();
+    return jitter ? 1000 + random % 4001 : 1000;
+}
+
+// degrees between an estimated fixedpointnum30 vector and a true unit vector
+static double vectorangle(fixedpointnum30 * estimate, const double *world)
+{
+    double truth[3], dot = 0, length = 0;
+    tobody(world, truth);
+    for (int x = 0; x < 3; ++x) {
+        double value = estimate[x] / (double) FIXEDPOINT30ONE;
+        dot += value * truth[x];
+        length += value * value;
+    }
+    dot /= sqrt(length);
+    return acos(dot > 1 ? 1 : dot < -1 ? -1 : dot) * 180 / M_PI;
+}
+
+static void run(bool jitter)
+{
+    const double worlddown[3] = { 0, 0, 1 };
+    const double worldwest[3] = { 1, 0, 0 };
+    double downsum = 0, downmax = 0, westsum = 0, westmax = 0, westlast = 0;
+    long updates = 0;
+
+    // at rest for the calibration
+    quaternion[0] = 1;
+    quaternion[1] = quaternion[2] = quaternion[3] = 0;
+    coning = false;
+    truthtime = lib_timers_getcurrentmicroseconds();
+    timeslivertimer = lib_timers_starttimer();
+#if (GYRO_SAMPLE_RATE != 0)
+    startgyrosampling();
+#endif
+    initimu();
+
+    updatetruth();
+    coningstarttime = truthtime;
+    coning = true;
+    calculatetimesliver();
+    while ((uint32_t) (lib_timers_getcurrentmicroseconds() - coningstarttime) < coningseconds * 1e6) {
+        calculatetimesliver();
+        imucalculateestimatedattitude();
+        updatetruth();
+        double downerror = vectorangle(global.estimateddownvector, worlddown);
+        westlast = vectorangle(global.estimatedwestvector, worldwest);
+        downsum += downerror;
+        westsum += westlast;
+        if (downerror > downmax)
+            downmax = downerror;
+        if (westlast > westmax)
+            westmax = westlast;
+        ++updates;
+        lib_host_timers_advancemicroseconds(loopmicroseconds(jitter));
+    }
+    printf("%s,%s,%g,%g,%ld,%.4f,%.4f,%.4f,%.4f,%.4f\n", BUILDNAME, jitter ? "1-5ms" : "1ms", coninghz, conedegrees, updates,
+        downsum / updates, downmax, westsum / updates, westmax, westlast);
+}
+
+int main(int argc, char **argv)
+{
+    bool header = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && !strcmp(argv[i], "-f"))
+            coninghz = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-a"))
+            conedegrees = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-s"))
+            coningseconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-h"))
+            header = true;
+        else {
+            fprintf(stderr, "usage: %s [-f coning_hz] [-a cone_degrees] [-s seconds] [-h]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    lib_host_i2c_setreadcallback(readcallback);
+    initgyro();
+    global.usersettingsfromeeprom = 0;
+
+    if (header)
+        printf("build,loop,coning_hz,cone_deg,updates,down_mean_deg,down_max_deg,west_mean_deg,west_max_deg,west_last_deg\n");
+    run(false);
+    run(true);
+    return 0;
+}
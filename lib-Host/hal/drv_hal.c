@@ -0,0 +1,76 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "drv_pwm.h"
+#include "lib_timers.h"
+#include "lib_i2c.h"
+#include "lib_host.h"
+
+// Board setup and data flash emulation of the host build.
+// The 512 byte page at the end of the Mini51 flash becomes a RAM array that starts out
+// erased, so the first boot loads the default settings just like a freshly flashed quad.
+
+#define EEP_SIZE 0x200
+
+static uint8_t eeprom[EEP_SIZE];
+
+lib_host_statsstruct lib_host_stats;
+
+void lib_host_resetstats(void)
+{
+    memset(&lib_host_stats, 0, sizeof(lib_host_stats));
+}
+
+void lib_host_eeprom_erase(void)
+{
+    memset(eeprom, 0xFF, sizeof(eeprom));
+}
+
+void lib_hal_init(void)
+{
+    static bool eepromerased = false;
+    if (!eepromerased) {
+        lib_host_eeprom_erase();
+        eepromerased = true;
+    }
+
+    lib_timers_init();
+
+    drv_pwm_config_t pwm;
+    pwmInit(&pwm);
+
+    lib_i2c_init();
+}
+
+size_t eeprom_write_block(const void *src, uint16_t index, size_t size)
+{
+    if (index + size > EEP_SIZE) return 0;
+    memcpy(eeprom + index, src, size);
+    return size;
+}
+
+void eeprom_commit(void)
+{
+}
+
+size_t eeprom_read_block(void *dst, uint16_t index, size_t size)
+{
+    if (index + size > EEP_SIZE) return 0;
+    memcpy(dst, eeprom + index, size);
+    return size;
+}
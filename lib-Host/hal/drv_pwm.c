@@ -0,0 +1,42 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "drv_pwm.h"
+
+// Motor outputs of the host build, read back with lib_host_pwm_getmotor()
+
+static uint16_t motorvalues[MAX_MOTORS];
+
+bool pwmInit(drv_pwm_config_t *init)
+{
+    int i;
+    for (i = 0; i < MAX_MOTORS; ++i)
+        motorvalues[i] = 1000;
+    return false;
+}
+
+void pwmWriteMotor(uint8_t index, uint16_t value)
+{
+    if (index > 3) return;
+    motorvalues[index] = value;
+}
+
+uint16_t lib_host_pwm_getmotor(uint8_t index)
+{
+    return index < MAX_MOTORS ? motorvalues[index] : 0;
+}
@@ -0,0 +1,97 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_fp.h"
+#include "lib_adc.h"
+#include "lib_timers.h"
+#include "lib_host.h"
+#include "config.h"
+
+// Emulated ADC for the host build.  The input of every channel is a fixed count set by the
+// host program.  A conversion takes LIB_HOST_ADC_CONVERSION_MICROSECONDS of virtual time.
+
+// ADC reference voltage defined in config_*.h as fixedpointnum
+#define FP_ADC_REF_VOLTAGE FIXEDPOINTCONSTANT(ADC_REF_VOLTAGE)
+
+// index 8 is the internal bandgap reference
+#define HOST_ADC_REFINDEX 8
+
+// a 3.75V battery behind the 1:2 divider and a 1.35V bandgap, both against the 3.0V reference
+static uint16_t counts[HOST_ADC_REFINDEX + 1] = { 0, 0, 0, 0, 0, 640, 0, 0, 461 };
+static uint8_t selectedindex;
+static uint16_t result;
+static bool converting;
+static uint32_t conversionstart;
+
+static uint8_t channelindex(uint8_t channel)
+{
+    uint8_t index = 0;
+    if (channel == LIB_ADC_CHANREF)
+        return HOST_ADC_REFINDEX;
+    while (channel > 1) {
+        channel >>= 1;
+        index++;
+    }
+    return index;
+}
+
+void lib_host_adc_setcounts(uint8_t channel, uint16_t value)
+{
+    counts[channelindex(channel)] = value & 0x3FF;
+}
+
+void lib_adc_init(void)
+{
+}
+
+void lib_adc_select_channel(lib_adc_channel_t channel)
+{
+    selectedindex = channelindex(channel);
+}
+
+bool lib_adc_is_busy(void)
+{
+    // polling takes time too, otherwise a busy wait would never end on the virtual clock
+    if (converting)
+        lib_host_timers_advancemicroseconds(1);
+    if (converting && lib_timers_gettimermicroseconds(conversionstart) >= LIB_HOST_ADC_CONVERSION_MICROSECONDS) {
+        converting = false;
+        result = counts[selectedindex];
+    }
+    return converting;
+}
+
+void lib_adc_startconv(void)
+{
+    lib_host_stats.adcconversions++;
+    converting = true;
+    conversionstart = lib_timers_starttimer();
+}
+
+// Returns measured absolute voltage as fixedpointnum
+fixedpointnum lib_adc_read_volt(void)
+{
+    return lib_fp_multiply(lib_adc_read_raw(), FP_ADC_REF_VOLTAGE);
+}
+
+// Returns ADC result as fixedpointnum between 0..1
+fixedpointnum lib_adc_read_raw(void)
+{
+    lib_adc_is_busy();
+    return ((fixedpointnum) result) << (FIXEDPOINTSHIFT - 10);
+}
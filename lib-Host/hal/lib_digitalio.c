@@ -0,0 +1,47 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_digitalio.h"
+
+// Digital IO of the host build.  Outputs are remembered so the host program can look at the
+// LEDs, inputs read back the last output value.
+
+static unsigned char pinstates[0x60];
+
+void lib_digitalio_initpin(unsigned char portandpinnumber, unsigned char output)
+{
+}
+
+unsigned char lib_digitalio_getinput(unsigned char portandpinnumber)
+{
+    return pinstates[portandpinnumber % sizeof(pinstates)];
+}
+
+void lib_digitalio_setoutput(unsigned char portandpinnumber, unsigned char value)
+{
+    pinstates[portandpinnumber % sizeof(pinstates)] = value ? 1 : 0;
+}
+
+unsigned char lib_host_digitalio_getoutput(unsigned char portandpinnumber)
+{
+    return pinstates[portandpinnumber % sizeof(pinstates)];
+}
+
+void lib_digitalio_setinterruptcallback(unsigned char pinnumber, digitalcallbackfunctptr callback)
+{
+}
@@ -0,0 +1,59 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_host.h"
+#include <string.h>
+
+// The fixtures the host programs share, on top of the emulated HAL.
+
+#define MC3210_ADDRESS 0x4C
+#define MPU3050_ADDRESS 0x68
+
+// the quad is level and still: 1g on the MC3210 Z axis (1024 counts at +/-8g), zero rotation
+void lib_host_setlevelsensors(void)
+{
+    const unsigned char accdata[6] = { 0, 0, 0, 0, 0x00, 0x04 };
+    const unsigned char gyrodata[6] = { 0, 0, 0, 0, 0, 0 };
+    lib_host_i2c_setregisters(MC3210_ADDRESS, 0x0D, accdata, 6);
+    lib_host_i2c_setregisters(MPU3050_ADDRESS, 0x1D, gyrodata, 6);
+}
+
+int lib_host_mspcommand(unsigned char command, unsigned char *payload, lib_host_passptr pass, uint32_t timeoutmicroseconds)
+{
+    const unsigned char request[6] = { '$', 'M', '<', 0, command, command };
+    unsigned char reply[256];
+    int replylength = 0;
+
+    lib_host_serial_sendtofirmware(request, sizeof(request));
+    uint32_t start = lib_timers_getcurrentmicroseconds();
+    while (lib_timers_getcurrentmicroseconds() - start < timeoutmicroseconds) {
+        pass();
+        replylength += lib_host_serial_receivefromfirmware(reply + replylength, sizeof(reply) - replylength);
+        if (replylength < 6 || replylength < reply[3] + 6)
+            continue;
+        int size = reply[3];
+        unsigned char checksum = 0;
+        for (int i = 3; i < size + 5; ++i)
+            checksum ^= reply[i];
+        if (reply[0] != '$' || reply[1] != 'M' || reply[2] != '>' || reply[4] != command || checksum != reply[size + 5])
+            return -1;
+        memcpy(payload, reply + 5, size);
+        return size;
+    }
+    return -1;
+}
@@ -0,0 +1,107 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host side controls for the emulated Mini51 HAL in lib-Host/hal.
+// The flight code only sees the normal lib_* interfaces.  The functions below are
+// used by the host program to feed the emulated peripherals and to look at the results.
+
+#pragma once
+
+#include "hal.h"
+
+// Bus timing model. Every bus transfer advances the virtual clock by this much, so the
+// main loop sees roughly the same timesliver as on the quad.
+// I2C runs at ~151kHz on the Mini51 (see lib-Mini51/hal/lib_i2c.c), 9 bits per byte.
+#define LIB_HOST_I2C_BYTE_MICROSECONDS 60
+// Bit banged 3 wire SPI to the A7105. About 2200us for a received packet (see SPI_DELAY in rx_flysky.c).
+#define LIB_HOST_SOFT_SPI_BYTE_MICROSECONDS 70
+// Hardware SPI at ~1MHz
+#define LIB_HOST_SPI_BYTE_MICROSECONDS 8
+// ADC conversion time at 293kHz ADC clock (see lib-Mini51/hal/lib_adc.c)
+#define LIB_HOST_ADC_CONVERSION_MICROSECONDS 137
+// The FlySky transmitter sends a packet every HOP_TIME
+#define LIB_HOST_RX_PACKET_MICROSECONDS 1450
+
+// Counters of the work done on the emulated buses. Reset them with lib_host_resetstats().
+typedef struct {
+    uint32_t i2ctransactions;   // number of START conditions
+    uint32_t i2cbytes;          // bytes on the bus, including addresses
+    uint32_t softspibytes;      // bytes on the A7105 3 wire bus
+    uint32_t spibytes;          // bytes on the hardware SPI bus
+    uint32_t adcconversions;
+    uint32_t rxpackets;         // packets handed to rx_flysky.c
+    uint32_t busmicroseconds;   // virtual time spent on buses
+} lib_host_statsstruct;
+
+extern lib_host_statsstruct lib_host_stats;
+void lib_host_resetstats(void);
+
+// virtual microsecond clock
+uint32_t lib_timers_getcurrentmicroseconds(void);
+void lib_host_timers_advancemicroseconds(uint32_t microseconds);
+// Makes each read of a timer by the flight code (lib_timers_starttimer() and lib_timers_gettimermicroseconds...)
+// advance the clock, like the time the Mini51 spends between two reads.  0, the default, keeps the clock still.
+void lib_host_timers_setreadmicroseconds(uint32_t microseconds);
+
+// I2C devices are emulated as plain register files, one per 7 bit address.
+// The read callback is called at every START so a sensor model can refresh its registers
+// at the moment they are sampled.
+typedef void (*lib_host_i2ccallbackptr)(unsigned char address, unsigned char reg);
+void lib_host_i2c_setregisters(unsigned char address, unsigned char reg, const unsigned char *data, unsigned char length);
+unsigned char lib_host_i2c_getregister(unsigned char address, unsigned char reg);
+void lib_host_i2c_setreadcallback(lib_host_i2ccallbackptr callback);
+void lib_host_i2c_setwritecallback(lib_host_i2ccallbackptr callback);
+// A FIFO register reads the bytes the callback returns instead of the register file, and reading it doesn't
+// auto increment, like FIFO_R of the MPU3050 and FIFO_R_W of the MPU6050.  One per address, NULL removes it.
+typedef unsigned char (*lib_host_i2cfifocallbackptr)(unsigned char address);
+void lib_host_i2c_setfiforegister(unsigned char address, unsigned char reg, lib_host_i2cfifocallbackptr callback);
+
+// A7105 emulation on the 3 wire SPI bus. The transmitter is bound with a fixed id and
+// then sends the given channel values (1000-2000us) every LIB_HOST_RX_PACKET_MICROSECONDS.
+#define LIB_HOST_RX_NUMCHANNELS 8
+void lib_host_rx_setchannels(const uint16_t *channels);
+void lib_host_rx_setenabled(bool enabled);   // false simulates a transmitter that went away
+
+// the values last written by pwmWriteMotor(), 1000-2000
+uint16_t lib_host_pwm_getmotor(uint8_t index);
+
+// ADC input as 10 bit counts. Channel is the same bit mask lib_adc_select_channel() takes.
+void lib_host_adc_setcounts(uint8_t channel, uint16_t counts);
+
+// state of a digital output (for LEDs)
+unsigned char lib_host_digitalio_getoutput(unsigned char portandpinnumber);
+
+// serial port 0 loopback to the host program (MSP)
+void lib_host_serial_sendtofirmware(const unsigned char *data, int length);
+int lib_host_serial_receivefromfirmware(unsigned char *data, int maxlength);
+
+// data flash emulation
+void lib_host_eeprom_erase(void);
+
+// Fixtures the host programs share, see lib_host.c.
+// sets the X4's emulated MC3210 and MPU3050 to a level aircraft at rest
+void lib_host_setlevelsensors(void);
+// sends an MSP command without a payload to serial port 0 and calls pass() until the whole reply is back or
+// timeoutmicroseconds have passed.  Copies its payload and returns the payload's size, -1 if no good reply came.
+typedef void (*lib_host_passptr)(void);
+int lib_host_mspcommand(unsigned char command, unsigned char *payload, lib_host_passptr pass, uint32_t timeoutmicroseconds);
+
+// Random numbers that repeat from run to run, see lib_host_random.c.  uniform is in (0,1), gaussian has a
+// standard deviation of 1.
+uint32_t lib_host_random(void);
+double lib_host_uniform(void);
+double lib_host_gaussian(void);
@@ -0,0 +1,44 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_host.h"
+#include <math.h>
+
+// The host programs' random numbers.  A 32 bit xorshift from the same seed every run, so the runs repeat.  It
+// needs nothing of the emulated HAL, so the programs that replace the sensors link it on its own.
+
+static uint32_t randomstate = 12345;
+
+uint32_t lib_host_random(void)
+{
+    randomstate ^= randomstate << 13;
+    randomstate ^= randomstate >> 17;
+    randomstate ^= randomstate << 5;
+    return randomstate;
+}
+
+double lib_host_uniform(void)
+{
+    return (lib_host_random() + 0.5) / 4294967296.0;
+}
+
+// Box-Muller
+double lib_host_gaussian(void)
+{
+    return sqrt(-2 * log(lib_host_uniform())) * cos(2 * M_PI * lib_host_uniform());
+}
@@ -0,0 +1,170 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_i2c.h"
+#include "lib_host.h"
+
+// Emulated I2C bus for the host build.
+// Every 7 bit address has a 256 byte register file.  A write transaction sets the register
+// pointer with its first data byte and stores the following bytes, a read transaction
+// returns bytes from the register pointer.  Both auto increment, which is what the MPU3050,
+// MPU6050 and MC3210 do for the registers bradwii uses.
+
+// referenced from app/serial.c
+unsigned int lib_i2c_error_count = 0;
+
+static unsigned char registers[128][256];
+static unsigned char currentaddress;
+static unsigned char registerpointer;
+static bool readmode;
+static bool pointerset;
+static lib_host_i2ccallbackptr readcallback = NULL;
+static lib_host_i2ccallbackptr writecallback = NULL;
+static unsigned char fiforegisters[128];
+static lib_host_i2cfifocallbackptr fifocallbacks[128];
+
+static void busbyte(void)
+{
+    lib_host_stats.i2cbytes++;
+    lib_host_stats.busmicroseconds += LIB_HOST_I2C_BYTE_MICROSECONDS;
+    lib_host_timers_advancemicroseconds(LIB_HOST_I2C_BYTE_MICROSECONDS);
+}
+
+void lib_host_i2c_setregisters(unsigned char address, unsigned char reg, const unsigned char *data, unsigned char length)
+{
+    while (length--)
+        registers[address & 0x7F][reg++] = *data++;
+}
+
+unsigned char lib_host_i2c_getregister(unsigned char address, unsigned char reg)
+{
+    return registers[address & 0x7F][reg];
+}
+
+void lib_host_i2c_setreadcallback(lib_host_i2ccallbackptr callback)
+{
+    readcallback = callback;
+}
+
+void lib_host_i2c_setwritecallback(lib_host_i2ccallbackptr callback)
+{
+    writecallback = callback;
+}
+
+void lib_host_i2c_setfiforegister(unsigned char address, unsigned char reg, lib_host_i2cfifocallbackptr callback)
+{
+    fiforegisters[address & 0x7F] = reg;
+    fifocallbacks[address & 0x7F] = callback;
+}
+
+void lib_i2c_init(void)
+{
+}
+
+void lib_i2c_setclockspeed(unsigned char speed)
+{
+}
+
+unsigned char lib_i2c_start(unsigned char address)
+{
+    lib_host_stats.i2ctransactions++;
+    currentaddress = (address >> 1) & 0x7F;
+    readmode = (address & I2C_READ) != 0;
+    pointerset = false;
+    busbyte();
+    if (readmode && readcallback)
+        readcallback(currentaddress, registerpointer);
+    return 0;
+}
+
+char lib_i2c_start_wait(unsigned char address)
+{
+    return lib_i2c_start(address);
+}
+
+unsigned char lib_i2c_rep_start(unsigned char address)
+{
+    return lib_i2c_start(address);
+}
+
+void lib_i2c_stop(void)
+{
+}
+
+unsigned char lib_i2c_write(unsigned char data)
+{
+    busbyte();
+    if (!pointerset) {
+        registerpointer = data;
+        pointerset = true;
+    } else {
+        registers[currentaddress][registerpointer] = data;
+        if (writecallback)
+            writecallback(currentaddress, registerpointer);
+        registerpointer++;
+    }
+    return 0;
+}
+
+unsigned char lib_i2c_readack(void)
+{
+    busbyte();
+    if (fifocallbacks[currentaddress] && registerpointer == fiforegisters[currentaddress])
+        return fifocallbacks[currentaddress](currentaddress);
+    return registers[currentaddress][registerpointer++];
+}
+
+unsigned char lib_i2c_readnak(void)
+{
+    return lib_i2c_readack();
+}
+
+void lib_i2c_writereg(unsigned char address, unsigned char reg, unsigned char value)
+{
+    lib_i2c_start((address << 1) + I2C_WRITE);
+    lib_i2c_write(reg);
+    lib_i2c_write(value);
+    lib_i2c_stop();
+}
+
+unsigned char lib_i2c_readreg(unsigned char address, unsigned char reg)
+{
+    lib_i2c_start((address << 1) + I2C_WRITE);
+    lib_i2c_write(reg);
+    lib_i2c_rep_start((address << 1) + I2C_READ);
+
+    unsigned char returnvalue = lib_i2c_readnak();
+
+    lib_i2c_stop();
+
+    return (returnvalue);
+}
+
+void lib_i2c_readdata(unsigned char address, unsigned char reg, unsigned char *data, unsigned char length)
+{
+    lib_i2c_start((address << 1) + I2C_WRITE);
+    lib_i2c_write(reg);
+    lib_i2c_rep_start((address << 1) + I2C_READ);
+
+    while (--length) {
+        *data++ = lib_i2c_readack();
+    }
+    *data = lib_i2c_readnak();
+
+    lib_i2c_stop();
+}
@@ -0,0 +1,116 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_serial.h"
+#include "lib_host.h"
+
+// Serial port 0 of the host build is a pair of ring buffers between the firmware and the
+// host program, enough to exchange MSP messages.
+
+#define HOST_SERIAL_BUFFER_SIZE 1024
+
+typedef struct {
+    unsigned char data[HOST_SERIAL_BUFFER_SIZE];
+    int head;
+    int tail;
+} hostserialbufferstruct;
+
+static hostserialbufferstruct tofirmware;
+static hostserialbufferstruct fromfirmware;
+
+static void putbyte(hostserialbufferstruct *buffer, unsigned char c)
+{
+    int next = (buffer->head + 1) % HOST_SERIAL_BUFFER_SIZE;
+    if (next == buffer->tail)
+        return;                 // full, drop like an overrun uart
+    buffer->data[buffer->head] = c;
+    buffer->head = next;
+}
+
+static int numbytes(hostserialbufferstruct *buffer)
+{
+    return (buffer->head - buffer->tail + HOST_SERIAL_BUFFER_SIZE) % HOST_SERIAL_BUFFER_SIZE;
+}
+
+static unsigned char getbyte(hostserialbufferstruct *buffer)
+{
+    unsigned char c = 0;
+    if (buffer->head != buffer->tail) {
+        c = buffer->data[buffer->tail];
+        buffer->tail = (buffer->tail + 1) % HOST_SERIAL_BUFFER_SIZE;
+    }
+    return c;
+}
+
+void lib_host_serial_sendtofirmware(const unsigned char *data, int length)
+{
+    while (length-- > 0)
+        putbyte(&tofirmware, *data++);
+}
+
+int lib_host_serial_receivefromfirmware(unsigned char *data, int maxlength)
+{
+    int count = 0;
+    while (count < maxlength && numbytes(&fromfirmware))
+        data[count++] = getbyte(&fromfirmware);
+    return count;
+}
+
+int lib_serial_availableoutputbuffersize(unsigned char serialportnumber)
+{
+    return HOST_SERIAL_BUFFER_SIZE - 1 - numbytes(&fromfirmware);
+}
+
+void lib_serial_initport(unsigned char serialportnumber, long baud)
+{
+}
+
+void lib_serial_sendchar(unsigned char serialportnumber, unsigned char c)
+{
+    if (serialportnumber == 0)
+        putbyte(&fromfirmware, c);
+}
+
+void lib_serial_sendstring(unsigned char serialportnumber, char *string)
+{
+    while (*string)
+        lib_serial_sendchar(serialportnumber, *string++);
+}
+
+void lib_serial_senddata(unsigned char serialportnumber, unsigned char *data, int datalength)
+{
+    while (datalength-- > 0)
+        lib_serial_sendchar(serialportnumber, *data++);
+}
+
+int lib_serial_numcharsavailable(unsigned char serialportnumber)
+{
+    return serialportnumber == 0 ? numbytes(&tofirmware) : 0;
+}
+
+unsigned char lib_serial_getchar(unsigned char serialportnumber)
+{
+    return serialportnumber == 0 ? getbyte(&tofirmware) : 0;
+}
+
+void lib_serial_getdata(unsigned char serialportnumber, unsigned char *data, int numchars)
+{
+    int x;
+    for (x = 0; x < numchars; ++x)
+        *data++ = lib_serial_getchar(serialportnumber);
+}
@@ -0,0 +1,135 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_soft_3_wire_spi.h"
+#include "lib_host.h"
+
+// Emulated A7105 on the bit banged 3 wire SPI bus, only as much as rx_flysky.c needs.
+// The emulated transmitter answers the bind with a fixed id and after that sends a data packet
+// every LIB_HOST_RX_PACKET_MICROSECONDS.  Channel hopping is not emulated, every channel hears it.
+
+#define HOST_TX_ID 0x1A2B3C4DL
+
+#define A7105_FIFO_READ 0x45
+#define A7105_MODE_TRER 0x01
+#define A7105_RX_STROBE 0xC0
+
+static uint8_t pin_SCS;
+static bool selected;
+static bool gotcommand;
+static uint8_t command;
+static uint8_t packet[21];
+static uint8_t packetindex;
+static bool receiving;
+static bool started;
+static bool bound;
+static bool enabled = true;
+static uint32_t nextpackettime;
+static uint16_t channels[LIB_HOST_RX_NUMCHANNELS] = { 1500, 1500, 1000, 1500, 2000, 2000, 1500, 1500 };
+
+static void busbyte(void)
+{
+    lib_host_stats.softspibytes++;
+    lib_host_stats.busmicroseconds += LIB_HOST_SOFT_SPI_BYTE_MICROSECONDS;
+    lib_host_timers_advancemicroseconds(LIB_HOST_SOFT_SPI_BYTE_MICROSECONDS);
+}
+
+static bool packetavailable(void)
+{
+    return (receiving && enabled && (int32_t) (lib_timers_getcurrentmicroseconds() - nextpackettime) >= 0);
+}
+
+static void buildpacket(void)
+{
+    int i;
+    packet[0] = bound ? 0x55 : 0xAA;
+    for (i = 0; i < 4; ++i)
+        packet[1 + i] = (HOST_TX_ID >> (8 * i)) & 0xFF;
+    for (i = 0; i < 8; ++i) {
+        packet[5 + 2 * i] = bound ? channels[i] & 0xFF : 0xFF;
+        packet[6 + 2 * i] = bound ? channels[i] >> 8 : 0xFF;
+    }
+}
+
+void lib_host_rx_setchannels(const uint16_t *newchannels)
+{
+    memcpy(channels, newchannels, sizeof(channels));
+}
+
+void lib_host_rx_setenabled(bool value)
+{
+    enabled = value;
+}
+
+void lib_soft_3_wire_spi_init(uint8_t SDIO_portandpinnumber, uint8_t SCK_portandpinnumber, uint8_t SCS_portandpinnumber)
+{
+    pin_SCS = SCS_portandpinnumber;
+    lib_soft_3_wire_spi_setCS(DIGITALOFF);
+}
+
+void lib_soft_3_wire_spi_setCS(uint8_t state)
+{
+    lib_digitalio_setoutput(pin_SCS, state);
+    if (state == DIGITALOFF) {
+        // chip select is active low
+        selected = true;
+        gotcommand = false;
+    } else if (selected) {
+        selected = false;
+        if (gotcommand && command == A7105_FIFO_READ && packetindex == sizeof(packet)) {
+            // the payload was read, the next one comes with the next hop
+            lib_host_stats.rxpackets++;
+            bound = true;
+            while ((int32_t) (lib_timers_getcurrentmicroseconds() - nextpackettime) >= 0)
+                nextpackettime += LIB_HOST_RX_PACKET_MICROSECONDS;
+        }
+    }
+}
+
+void lib_soft_3_wire_spi_write(uint8_t data)
+{
+    busbyte();
+    if (!selected || gotcommand)
+        return;                 // register data, not needed by the emulation
+    gotcommand = true;
+    command = data;
+    if (command == A7105_FIFO_READ) {
+        buildpacket();
+        packetindex = 0;
+    } else if (command & 0x80) {
+        // strobe commands. Anything but RX stops reception.
+        if (command == A7105_RX_STROBE) {
+            // the transmitter runs on its own schedule, started by the first RX strobe
+            if (!started)
+                nextpackettime = lib_timers_getcurrentmicroseconds() + LIB_HOST_RX_PACKET_MICROSECONDS;
+            started = true;
+            receiving = true;
+        } else if ((command & 0xF0) != 0xF0)
+            receiving = false;
+    }
+}
+
+uint8_t lib_soft_3_wire_spi_read(void)
+{
+    busbyte();
+    if (command == A7105_FIFO_READ)
+        return packetindex < sizeof(packet) ? packet[packetindex++] : 0;
+    if (command == 0x40)        // mode register
+        return packetavailable() ? 0 : A7105_MODE_TRER;
+    return 0;
+}
@@ -0,0 +1,43 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_spi.h"
+#include "lib_host.h"
+
+// Hardware SPI is only used by receivers that are not part of the X4 build.
+// Nothing is connected, reads return 0xFF like a floating MISO line.
+
+void lib_spi_init(void)
+{
+}
+
+void lib_spi_ss_on(void)
+{
+}
+
+void lib_spi_ss_off(void)
+{
+}
+
+uint8_t lib_spi_xfer(uint8_t data)
+{
+    lib_host_stats.spibytes++;
+    lib_host_stats.busmicroseconds += LIB_HOST_SPI_BYTE_MICROSECONDS;
+    lib_host_timers_advancemicroseconds(LIB_HOST_SPI_BYTE_MICROSECONDS);
+    return 0xFF;
+}
@@ -0,0 +1,158 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_timers.h"
+#include "lib_host.h"
+#include <time.h>
+
+// Virtual microsecond clock for the host build.
+// Time only moves when the host program calls lib_host_timers_advancemicroseconds() or when an
+// emulated peripheral spends time on its bus, so a run is completely deterministic.
+// Like the SysTick based timer on the Mini51 the counter is 32 bits and wraps after ~70 minutes.
+
+static uint32_t currentmicroseconds = 0;
+
+// The periodic callback is emulated by the clock itself: when time advances past the next period, the clock
+// stops there and runs the callback, and the time the callback spends on buses delays whatever was advancing
+// the clock, like an interrupt does.  It doesn't interrupt itself, and like the Mini51's TIMER0 the periods
+// it missed while held or busy only run it once.
+static lib_timers_callbackptr periodiccallback = NULL;
+static uint32_t periodicmicroseconds;
+static uint32_t nextcallbacktime;
+static bool callbackheld = false;
+static bool callbackpending = false;
+static bool incallback = false;
+
+// the virtual time a read of the timer takes the flight code, see lib_host_timers_setreadmicroseconds()
+static uint32_t readmicroseconds = 0;
+
+void lib_timers_init(void)
+{
+}
+
+uint32_t lib_timers_getcurrentmicroseconds(void)
+{
+    return currentmicroseconds;
+}
+
+// runs the callback now and returns the microseconds it took
+static uint32_t runcallback(void)
+{
+    uint32_t start = currentmicroseconds;
+
+    incallback = true;
+    callbackpending = false;
+    periodiccallback();
+    incallback = false;
+    while ((int32_t) (currentmicroseconds - nextcallbacktime) >= 0)
+        nextcallbacktime += periodicmicroseconds;
+    return currentmicroseconds - start;
+}
+
+void lib_host_timers_advancemicroseconds(uint32_t microseconds)
+{
+    uint32_t endtime = currentmicroseconds + microseconds;
+
+    while (periodiccallback && !incallback && (int32_t) (endtime - nextcallbacktime) >= 0) {
+        if ((int32_t) (nextcallbacktime - currentmicroseconds) > 0)
+            currentmicroseconds = nextcallbacktime;
+        if (callbackheld) {
+            callbackpending = true;
+            nextcallbacktime += periodicmicroseconds;
+        } else
+            endtime += runcallback();
+    }
+    currentmicroseconds = endtime;
+}
+
+void lib_timers_startperiodiccallback(unsigned long periodmicroseconds, lib_timers_callbackptr callback)
+{
+    periodicmicroseconds = periodmicroseconds;
+    nextcallbacktime = currentmicroseconds + periodmicroseconds;
+    periodiccallback = callback;
+}
+
+void lib_timers_holdperiodiccallback(bool hold)
+{
+    callbackheld = hold;
+    if (!hold && callbackpending && !incallback)
+        runcallback();
+}
+
+// The cycles are the host's own nanoseconds, not virtual time, so the profiler's probes measure what the flight
+// code costs on the host.  The virtual time spent on the emulated buses doesn't show in them.
+uint32_t lib_timers_getcycles(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint32_t) now.tv_sec * 1000000000u + (uint32_t) now.tv_nsec);
+}
+
+unsigned long lib_timers_cyclespermicrosecond(void)
+{
+    return (1000);
+}
+
+// The next interrupt is the millisecond tick, or the periodic callback if that comes first, which runs it like the
+// Mini51 wakes up for TIMER0.  The serial port and the receiver are polled here, so they don't wake it.
+void lib_timers_sleep(void)
+{
+    uint32_t microseconds = 1000 - currentmicroseconds % 1000;
+
+    if (periodiccallback && !callbackheld && !incallback && (uint32_t) (nextcallbacktime - currentmicroseconds) < microseconds)
+        microseconds = nextcallbacktime - currentmicroseconds;
+    lib_host_timers_advancemicroseconds(microseconds);
+}
+
+void lib_host_timers_setreadmicroseconds(uint32_t microseconds)
+{
+    readmicroseconds = microseconds;
+}
+
+// a read of the timer by the flight code
+static uint32_t readtimer(void)
+{
+    if (readmicroseconds)
+        lib_host_timers_advancemicroseconds(readmicroseconds);
+    return currentmicroseconds;
+}
+
+unsigned long lib_timers_gettimermicroseconds(unsigned long starttime)
+{
+    // unsigned long is 64 bits on the host, keep the 32 bit wrap around of the Mini51
+    return (uint32_t) (readtimer() - (uint32_t) starttime);
+}
+
+unsigned long lib_timers_gettimermicrosecondsandreset(unsigned long *starttime)
+{
+    uint32_t currenttime = readtimer();
+    unsigned long returnvalue = (uint32_t) (currenttime - (uint32_t) *starttime);
+    *starttime = currenttime;
+    return (returnvalue);
+}
+
+unsigned long lib_timers_starttimer()
+{
+    return (readtimer());
+}
+
+void lib_timers_delaymilliseconds(unsigned long delaymilliseconds)
+{
+    // nothing else is running, so just jump ahead
+    lib_host_timers_advancemicroseconds(delaymilliseconds * 1000L);
+}
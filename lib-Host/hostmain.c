@@ -0,0 +1,139 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host build of the flight code.
+// Runs initbradwii() and then steps mainloopiteration() on the virtual microsecond clock of the
+// emulated HAL in lib-Host/hal.  The quad sits level on the bench, the emulated transmitter binds
+// and can arm it.  Per iteration it counts the virtual loop time and the bus traffic, so the
+// output is the same on every run and can be compared between two builds.
+//
+// usage: bradwii_host [-n iterations] [-c compute_us] [-a arm_iteration] [-t throttle_us] [-p print_every] [-m]
+//   -c  time the flight code itself is assumed to take per iteration on the Mini51
+//   -m  also measure host cpu time per iteration (not deterministic)
+
+#include <time.h>
+#include "bradwii.h"
+#include "lib_host.h"
+#include "rx.h"
+#include "imu.h"
+
+extern globalstruct global;
+
+static double hostseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = 10000;
+    long armiteration = -1;
+    long printevery = 1000;
+    uint32_t computemicroseconds = 500;
+    uint16_t throttle = 1000;
+    bool measurehost = false;
+    int i;
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-m"))
+            measurehost = true;
+        else if (i + 1 < argc && argv[i][0] == '-') {
+            long value = atol(argv[i + 1]);
+            switch (argv[i][1]) {
+                case 'n': iterations = value; break;
+                case 'c': computemicroseconds = value; break;
+                case 'a': armiteration = value; break;
+                case 't': throttle = value; break;
+                case 'p': printevery = value > 0 ? value : 1; break;
+                default: goto usage;
+            }
+            ++i;
+        } else
+            goto usage;
+    }
+
+    lib_host_setlevelsensors();
+
+    uint32_t starttime = lib_timers_getcurrentmicroseconds();
+    initbradwii();
+    printf("init: %u us virtual, %u i2c bytes, %u rx bytes\n", lib_timers_getcurrentmicroseconds() - starttime,
+        lib_host_stats.i2cbytes, lib_host_stats.softspibytes);
+
+    // roll, pitch, throttle, yaw, aux1, aux2...  aux1 low arms the X4
+    uint16_t channels[LIB_HOST_RX_NUMCHANNELS] = { 1500, 1500, 1000, 1500, 2000, 2000, 1500, 1500 };
+    uint32_t minloop = 0xFFFFFFFF, maxloop = 0;
+    uint64_t totalloop = 0;
+    lib_host_statsstruct totals;
+    double hosttime = 0;
+    memset(&totals, 0, sizeof(totals));
+
+    printf("iteration,time_us,loop_us,i2c_bytes,rx_bytes,armed,roll,pitch,yaw,motor0,motor1,motor2,motor3\n");
+    for (long n = 0; n < iterations; ++n) {
+        if (n == armiteration)
+            channels[4] = 1000;
+        if (n == armiteration + 200)
+            channels[2] = throttle;
+        lib_host_rx_setchannels(channels);
+
+        lib_host_resetstats();
+        uint32_t loopstart = lib_timers_getcurrentmicroseconds();
+        double hoststart = measurehost ? hostseconds() : 0;
+
+        mainloopiteration();
+
+        if (measurehost)
+            hosttime += hostseconds() - hoststart;
+        lib_host_timers_advancemicroseconds(computemicroseconds);
+        uint32_t looptime = lib_timers_getcurrentmicroseconds() - loopstart;
+
+        if (looptime < minloop) minloop = looptime;
+        if (looptime > maxloop) maxloop = looptime;
+        totalloop += looptime;
+        totals.i2cbytes += lib_host_stats.i2cbytes;
+        totals.i2ctransactions += lib_host_stats.i2ctransactions;
+        totals.softspibytes += lib_host_stats.softspibytes;
+        totals.rxpackets += lib_host_stats.rxpackets;
+        totals.adcconversions += lib_host_stats.adcconversions;
+
+        if (n % printevery == 0 || n == iterations - 1) {
+            imuupdateeulerattitude();
+            printf("%ld,%u,%u,%u,%u,%d,%.2f,%.2f,%.2f,%u,%u,%u,%u\n", n, lib_timers_getcurrentmicroseconds(), looptime,
+                lib_host_stats.i2cbytes, lib_host_stats.softspibytes, global.armed,
+                global.currentestimatedeulerattitude[ROLLINDEX] / 65536.0,
+                global.currentestimatedeulerattitude[PITCHINDEX] / 65536.0,
+                global.currentestimatedeulerattitude[YAWINDEX] / 65536.0,
+                lib_host_pwm_getmotor(0), lib_host_pwm_getmotor(1), lib_host_pwm_getmotor(2), lib_host_pwm_getmotor(3));
+        }
+    }
+
+    if (iterations > 0) {
+        printf("loop us: min %u max %u mean %.1f\n", minloop, maxloop, (double) totalloop / iterations);
+        printf("per iteration: %.2f i2c transactions, %.2f i2c bytes, %.2f rx bytes, %.3f rx packets, %.3f adc conversions\n",
+            (double) totals.i2ctransactions / iterations, (double) totals.i2cbytes / iterations,
+            (double) totals.softspibytes / iterations, (double) totals.rxpackets / iterations,
+            (double) totals.adcconversions / iterations);
+        if (measurehost)
+            printf("host cpu: %.1f ns per iteration\n", hosttime * 1e9 / iterations);
+    }
+    return 0;
+
+usage:
+    fprintf(stderr, "usage: %s [-n iterations] [-c compute_us] [-a arm_iteration] [-t throttle_us] [-p print_every] [-m]\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,182 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Models what IDLE_WHEN_DISARMED saves on the host build of the X4.  The Makefile builds it three times:
+// idlecurrent_spin as it is, idlecurrent_sleep with IDLE_WHEN_DISARMED, and idlecurrent_interrupt with it and
+// CONTROL_LOOP_PERIOD 4000 and CONTROL_LOOP_INTERRUPT.  It links it with controltask() wrapped, so the control task
+// takes CONTROLMICROSECONDS of virtual time on top of its bus traffic, and with lib_timers_sleep() wrapped, to
+// measure the virtual time asleep.  The transmitter is on and one packet in LOSTPACKETEVERY is lost.
+//
+// After a second to settle, three phases of the given virtual seconds: disarmed on the bench, the same with the
+// transmitter off, which leaves the receiver task much less to read, then armed at mid throttle.  One CSV line per
+// phase with the control task's rate, the load and the time asleep MSP_CPU_LOAD sent for the last second, the time
+// asleep over the whole phase, and the MCU's average current if it draws RUNMA awake and SLEEPMA asleep.  The
+// currents are rough figures for a Mini51 at 22MHz, set them with -r and -i.  It exits with 1 if the build without
+// IDLE_WHEN_DISARMED slept, if one with it didn't sleep while disarmed or slept while armed, if its control task ran
+// at less than MINDISARMEDHZ while disarmed, or if MSP_CPU_LOAD didn't come or its time asleep was more than
+// MAXASLEEPERROR off the phase's.
+//
+// usage: idlecurrent [-s seconds] [-r run_mA] [-i sleep_mA] [-h]
+//   -s  virtual seconds per phase, default 5
+//   -r  the MCU's current awake, default RUNMA
+//   -i  the MCU's current asleep, default SLEEPMA
+//   -h  print the CSV header line first
+
+#include "bradwii.h"
+#include "lib_host.h"
+#include "scheduler.h"
+
+extern globalstruct global;
+
+#define MSP_CPU_LOAD 158
+#define CONTROLMICROSECONDS 500
+#define PASSMICROSECONDS 10     // a pass's own overhead
+#define SETTLESECONDS 1.0
+#define LOSTPACKETEVERY 5
+#define MSPTIMEOUT 100000       // microseconds
+#define RUNMA 4.5
+#define SLEEPMA 1.5
+#define MINDISARMEDHZ 200
+#define MAXASLEEPERROR .03
+
+static long controlruns;
+static uint64_t controlmicroseconds, asleepmicroseconds;
+static bool transmitter = true;
+
+void __real_controltask(void);
+
+void __wrap_controltask(void)
+{
+    uint32_t start = lib_timers_getcurrentmicroseconds();
+
+    ++controlruns;
+    __real_controltask();
+    lib_host_timers_advancemicroseconds(CONTROLMICROSECONDS);
+    controlmicroseconds += lib_timers_getcurrentmicroseconds() - start;
+}
+
+void __real_lib_timers_sleep(void);
+
+// the timer interrupt that ends a sleep runs the control task before it returns, which isn't asleep
+void __wrap_lib_timers_sleep(void)
+{
+    uint32_t start = lib_timers_getcurrentmicroseconds();
+    uint64_t controlatstart = controlmicroseconds;
+    __real_lib_timers_sleep();
+    asleepmicroseconds += lib_timers_getcurrentmicroseconds() - start - (controlmicroseconds - controlatstart);
+}
+
+// one pass of the main loop, losing a packet now and then
+static void pass(void)
+{
+    lib_host_rx_setenabled(transmitter && lib_timers_getcurrentmicroseconds() / LIB_HOST_RX_PACKET_MICROSECONDS % LOSTPACKETEVERY != 0);
+    mainloopiteration();
+    lib_host_timers_advancemicroseconds(PASSMICROSECONDS);
+}
+
+// runs a phase and prints its line.  Returns the part of it spent asleep, -1 if MSP_CPU_LOAD didn't come or was off.
+static double runphase(const char *build, const char *name, double seconds, double runma, double sleepma)
+{
+    unsigned char payload[4];
+
+    controlruns = 0;
+    asleepmicroseconds = 0;
+    uint32_t start = lib_timers_getcurrentmicroseconds();
+    while (lib_timers_getcurrentmicroseconds() - start < seconds * 1000000)
+        pass();
+    double elapsed = (lib_timers_getcurrentmicroseconds() - start) / 1000000.0;
+    double asleep = asleepmicroseconds / 1000000.0 / elapsed;
+    double controlhz = controlruns / elapsed;
+
+    if (lib_host_mspcommand(MSP_CPU_LOAD, payload, pass, MSPTIMEOUT) != 4) {
+        fprintf(stderr, "idlecurrent: %s no reply to MSP_CPU_LOAD\n", name);
+        return -1;
+    }
+    unsigned load = payload[0] | payload[1] << 8, mspasleep = payload[2] | payload[3] << 8;
+
+    printf("%s,%s,%.1f,%.1f,%.1f,%.1f,%.2f,%.2f\n", build, name, controlhz, load / 10.0, mspasleep / 10.0, asleep * 100,
+        runma * (1 - asleep) + sleepma * asleep, (runma - sleepma) * asleep);
+    if (load + mspasleep > 1000 || fabs(mspasleep / 1000.0 - asleep) > MAXASLEEPERROR) {
+        fprintf(stderr, "idlecurrent: %s MSP_CPU_LOAD was off\n", name);
+        return -1;
+    }
+    if (IDLE_WHEN_DISARMED == YES && !global.armed && controlhz < MINDISARMEDHZ) {
+        fprintf(stderr, "idlecurrent: %s the control task ran at %.1fHz\n", name, controlhz);
+        return -1;
+    }
+    return asleep;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 5, runma = RUNMA, sleepma = SLEEPMA;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-h"))
+            printf("build,phase,control_hz,load_pct,msp_asleep_pct,asleep_pct,mcu_ma,saved_ma\n");
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+            runma = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+            sleepma = atof(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-s seconds] [-r run_mA] [-i sleep_mA] [-h]\n", argv[0]);
+            return 1;
+        }
+    }
+    const char *build = IDLE_WHEN_DISARMED == NO ? "spin" : CONTROL_LOOP_INTERRUPT == YES ? "interrupt" : "sleep";
+    bool good = true;
+
+    lib_host_setlevelsensors();
+    initbradwii();
+
+    // roll, pitch, throttle, yaw, aux1, aux2...  aux1 low arms the X4, so high keeps it disarmed
+    uint16_t channels[LIB_HOST_RX_NUMCHANNELS] = { 1500, 1500, 1000, 1500, 2000, 2000, 1500, 1500 };
+    lib_host_rx_setchannels(channels);
+
+    uint32_t start = lib_timers_getcurrentmicroseconds();
+    while (lib_timers_getcurrentmicroseconds() - start < SETTLESECONDS * 1000000)
+        pass();
+
+    double disarmed = runphase(build, "disarmed", seconds, runma, sleepma);
+
+    // the receiver only polls while the transmitter is off
+    transmitter = false;
+    double notx = runphase(build, "no_transmitter", seconds, runma, sleepma);
+    transmitter = true;
+
+    // arm, then throttle up once it has
+    channels[AUX1INDEX] = 1000;
+    lib_host_rx_setchannels(channels);
+    start = lib_timers_getcurrentmicroseconds();
+    while (!global.armed && lib_timers_getcurrentmicroseconds() - start < SETTLESECONDS * 1000000)
+        pass();
+    channels[THROTTLEINDEX] = 1500;
+    lib_host_rx_setchannels(channels);
+
+    double armed = runphase(build, "armed", seconds, runma, sleepma);
+
+    if (disarmed < 0 || notx < 0 || armed < 0 || !global.armed)
+        good = false;
+    else if (IDLE_WHEN_DISARMED == YES ? disarmed == 0 || notx == 0 || armed != 0 : disarmed != 0 || notx != 0 || armed != 0) {
+        fprintf(stderr, "idlecurrent: slept %.1f%% disarmed, %.1f%% without the transmitter and %.1f%% armed\n",
+            disarmed * 100, notx * 100, armed * 100);
+        good = false;
+    }
+    return good ? 0 : 1;
+}
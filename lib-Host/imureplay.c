@@ -0,0 +1,291 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Replays a sensor trace recorded by simquad -g through imucalculateestimatedattitude(), for comparing the
+// attitude estimators on exactly the same gyro and accelerometer readings.  The Makefile links it with imu.c
+// and vectors.c built for each IMU_ESTIMATOR, as imureplay_vector and imureplay_quaternion, and with
+// ACC_ADAPTIVE_GAIN as imureplay_vector_adaptive and imureplay_quaternion_adaptive.
+//
+// It prints one CSV line: the estimator, the gyro bias, vibration and flip time it ran with, the number of
+// updates, the host time per update without and with the conversion to euler angles, and the angle between the
+// estimated and true down vectors and between the estimated and true west vectors, as the mean, the maximum and
+// the mean over the last second.  Then, with a flip, the largest down vector error from the flip on, and the
+// seconds after the flip until the down vector error stays below 1 degree.
+// The trace is replayed twice more without measuring the errors for the times.
+//
+// usage: imureplay [-b degrees_per_second] [-v g] [-f seconds] [-h] tracefile
+//   -b  add a gyro bias to all three rates, like a gyro that has drifted since it was calibrated
+//   -v  add vibration to the accelerometer readings, noise with this standard deviation on each axis
+//   -f  put a roll flip into the trace at this time.  It takes half a second at hover thrust, so the
+//       accelerometer reads 1 g along the aircraft's Z axis all the way round, and the gyro reads 2% high.
+//   -h  print the CSV header line first
+
+#include <time.h>
+#include "bradwii.h"
+#include "imu.h"
+#include "lib_host.h"
+
+globalstruct global;
+usersettingsstruct usersettings;
+
+typedef struct {
+    fixedpointnum24 timesliver;
+    fixedpointnum gyrorate[3];
+    fixedpointnum acc_g_vector[3];
+    double downvector[3];
+    double westvector[3];
+} samplestruct;
+
+typedef struct {
+    double sum;
+    double max;
+    double lastsecondsum;
+    long lastsecondcount;
+} errorstruct;
+
+static samplestruct *samples;
+static samplestruct *sample;    // what the sensors read next
+static fixedpointnum gyrobias;
+
+#if (IMU_ESTIMATOR == QUATERNION_ESTIMATOR)
+#define ESTIMATORNAME "quaternion"
+#else
+#define ESTIMATORNAME "vector"
+#endif
+#if (ACC_ADAPTIVE_GAIN == YES)
+#define GAINNAME "_adaptive"
+#else
+#define GAINNAME ""
+#endif
+
+#define FLIPSECONDS 0.5
+#define FLIPTIMESLIVER 0.002
+#define FLIPGYROSCALE 1.02
+#define SETTLEDDEGREES 1.0
+
+// the sensors and timer imu.c uses.  initimu() calibrates on a sensor at rest, which is what they read
+// until there is a sample.
+void readgyro(void)
+{
+    for (int x = 0; x < 3; ++x)
+        global.gyrorate[x] = sample ? sample->gyrorate[x] + gyrobias : 0;
+}
+
+void readacc(void)
+{
+    for (int x = 0; x < 3; ++x)
+        global.acc_g_vector[x] = sample ? sample->acc_g_vector[x] : (x == ZINDEX ? FIXEDPOINTONE : 0);
+}
+
+void calculatetimesliver(void)
+{
+    global.timesliver = sample ? sample->timesliver : FIXEDPOINT24CONSTANT(.002);
+}
+
+void x4_set_leds(unsigned char state)
+{
+}
+
+// turns a true vector by degrees of roll, the way the imu turns its vectors by a positive roll rate
+static void rollvector(double *v, double degrees)
+{
+    double angle = degrees * M_PI / 180;
+    double x = v[XINDEX], z = v[ZINDEX];
+    v[XINDEX] = x * cos(angle) + z * sin(angle);
+    v[ZINDEX] = z * cos(angle) - x * sin(angle);
+}
+
+// makes room for a 360 degree roll after the sample at flipseconds and fills it in.  Returns the new count and
+// sets *flipend to the index after the flip.
+static int insertflip(int count, double flipseconds, int *flipend)
+{
+    int flipcount = (int) (FLIPSECONDS / FLIPTIMESLIVER);
+    int start = 0;
+    double time = 0;
+
+    while (start < count - 1 && time < flipseconds)
+        time += samples[start++].timesliver / (double) FIXEDPOINT24ONE;
+    samples = realloc(samples, (count + flipcount) * sizeof(samplestruct));
+    memmove(&samples[start + flipcount], &samples[start], (count - start) * sizeof(samplestruct));
+
+    samplestruct *before = &samples[start > 0 ? start - 1 : start + flipcount];
+    for (int i = 0; i < flipcount; ++i) {
+        samplestruct *s = &samples[start + i];
+        double degrees = 360.0 * (i + 1) / flipcount;
+        *s = *before;
+        s->timesliver = FIXEDPOINT24CONSTANT(FLIPTIMESLIVER);
+        s->gyrorate[ROLLINDEX] += (fixedpointnum) lrint(360.0 / FLIPSECONDS * FLIPGYROSCALE * FIXEDPOINTONE);
+        s->acc_g_vector[XINDEX] = s->acc_g_vector[YINDEX] = 0;
+        s->acc_g_vector[ZINDEX] = FIXEDPOINTONE;
+        rollvector(s->downvector, degrees);
+        rollvector(s->westvector, degrees);
+    }
+    *flipend = start + flipcount;
+    return count + flipcount;
+}
+
+static double hostnanoseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// degrees between an estimated fixedpointnum30 vector and a true unit vector
+static double vectorangle(fixedpointnum30 * estimate, double *truth)
+{
+    double dot = 0, length = 0;
+    for (int x = 0; x < 3; ++x) {
+        double value = estimate[x] / (double) FIXEDPOINT30ONE;
+        dot += value * truth[x];
+        length += value * value;
+    }
+    dot /= sqrt(length);
+    return acos(dot > 1 ? 1 : dot < -1 ? -1 : dot) * 180 / M_PI;
+}
+
+static void adderror(errorstruct * error, double value, bool lastsecond)
+{
+    error->sum += value;
+    if (value > error->max)
+        error->max = value;
+    if (lastsecond) {
+        error->lastsecondsum += value;
+        ++error->lastsecondcount;
+    }
+}
+
+// runs the estimator over the whole trace and returns the host nanoseconds per update
+static double replay(int count, bool eulerangles)
+{
+    sample = NULL;
+    initimu();
+    double start = hostnanoseconds();
+    for (int i = 0; i < count; ++i) {
+        sample = &samples[i];
+        calculatetimesliver();
+        imucalculateestimatedattitude();
+#if (IMU_ESTIMATOR == QUATERNION_ESTIMATOR)
+        if (eulerangles)
+            imucalculateeulerattitude();
+#endif
+    }
+    return (hostnanoseconds() - start) / count;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = NULL;
+    bool header = false;
+    double vibration = 0, flipseconds = -1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && !strcmp(argv[i], "-b"))
+            gyrobias = FIXEDPOINTCONSTANT(atof(argv[++i]));
+        else if (i + 1 < argc && !strcmp(argv[i], "-v"))
+            vibration = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-f"))
+            flipseconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-h"))
+            header = true;
+        else if (!filename && argv[i][0] != '-')
+            filename = argv[i];
+        else
+            filename = NULL, i = argc;
+    }
+    if (!filename) {
+        fprintf(stderr, "usage: %s [-b degrees_per_second] [-v g] [-f seconds] [-h] tracefile\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror(filename);
+        return 1;
+    }
+    int count = 0, size = 4096;
+    samples = malloc(size * sizeof(samplestruct));
+    long values[7];
+    samplestruct *s = samples;
+    while (fscanf(file, "%ld,%ld,%ld,%ld,%ld,%ld,%ld,%lf,%lf,%lf,%lf,%lf,%lf", &values[0], &values[1], &values[2], &values[3],
+            &values[4], &values[5], &values[6], &s->downvector[0], &s->downvector[1], &s->downvector[2],
+            &s->westvector[0], &s->westvector[1], &s->westvector[2]) == 13) {
+        s->timesliver = values[0];
+        for (int x = 0; x < 3; ++x) {
+            s->gyrorate[x] = values[x + 1];
+            s->acc_g_vector[x] = values[x + 4];
+        }
+        if (++count == size)
+            samples = realloc(samples, (size *= 2) * sizeof(samplestruct));
+        s = &samples[count];
+    }
+    fclose(file);
+    if (!count) {
+        fprintf(stderr, "%s: no samples, it needs a trace from simquad -g\n", filename);
+        return 1;
+    }
+
+    int flipend = -1;
+    if (flipseconds >= 0)
+        count = insertflip(count, flipseconds, &flipend);
+    if (vibration > 0)
+        for (int i = 0; i < count; ++i)
+            for (int x = 0; x < 3; ++x)
+                samples[i].acc_g_vector[x] += (fixedpointnum) lrint(vibration * lib_host_gaussian() * FIXEDPOINTONE);
+
+    double seconds = 0;
+    for (int i = 0; i < count; ++i)
+        seconds += samples[i].timesliver / (double) FIXEDPOINT24ONE;
+
+    // the trace starts at the true attitude after takeoff, which is close to level, like the estimators do
+    global.usersettingsfromeeprom = 1;
+    sample = NULL;
+    initimu();
+
+    errorstruct downerror = { 0 }, westerror = { 0 };
+    double time = 0, flipendtime = 0, flipmaxerror = 0, recoveryseconds = 0;
+    for (int i = 0; i < count; ++i) {
+        sample = &samples[i];
+        calculatetimesliver();
+        imucalculateestimatedattitude();
+        time += sample->timesliver / (double) FIXEDPOINT24ONE;
+        double error = vectorangle(global.estimateddownvector, sample->downvector);
+        adderror(&downerror, error, time > seconds - 1);
+        adderror(&westerror, vectorangle(global.estimatedwestvector, sample->westvector), time > seconds - 1);
+        if (flipend >= 0 && i >= flipend - (int) (FLIPSECONDS / FLIPTIMESLIVER)) {
+            if (error > flipmaxerror)
+                flipmaxerror = error;
+            if (i == flipend)
+                flipendtime = time;
+            if (i >= flipend && error >= SETTLEDDEGREES)
+                recoveryseconds = time - flipendtime;
+        }
+    }
+
+    double updatens = replay(count, false);
+    double withanglesns = replay(count, true);
+
+    if (header)
+        printf("estimator,gyrobias_dps,vibration_g,flip_s,updates,seconds,update_ns,withangles_ns,down_mean_deg,down_max_deg,down_last_deg,"
+            "west_mean_deg,west_max_deg,west_last_deg,flip_max_deg,recovery_s\n");
+    printf("%s%s,%g,%g,%g,%d,%.1f,%.1f,%.1f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f\n", ESTIMATORNAME, GAINNAME, gyrobias / 65536.0,
+        vibration, flipseconds, count, seconds, updatens, withanglesns,
+        downerror.sum / count, downerror.max, downerror.lastsecondsum / downerror.lastsecondcount,
+        westerror.sum / count, westerror.max, westerror.lastsecondsum / westerror.lastsecondcount, flipmaxerror, recoveryseconds);
+    free(samples);
+    return 0;
+}
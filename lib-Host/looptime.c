@@ -0,0 +1,251 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the loop time stats that MSP_LOOP_TIME sends (see looptimestatsstruct in src/scheduler.h) on the host
+// build of the X4.  The Makefile builds it twice: looptime_free with the control task on every pass, and
+// looptime_interrupt with CONTROL_LOOP_PERIOD 4000 and CONTROL_LOOP_INTERRUPT.  It links it with controltask()
+// and serialcheckforaction() wrapped, so it keeps its own copy of the stats from the control task's starts, taken
+// as the serial task starts, which is when the firmware builds its reply.  The control task takes
+// CONTROLMICROSECONDS of virtual time on top of its bus traffic, and one radio packet in LOSTPACKETEVERY is lost.
+//
+// The aircraft is armed and flown at mid throttle.  After a second to settle, two phases, each cleared with
+// MSP_RESET_LOOP_TIME first:
+//   steady  the given virtual seconds
+//   stalls  the same, with the main loop stalled for STALLMICROSECONDS every STALLEVERY, like a radio read that
+//           hangs.  Without CONTROL_LOOP_INTERRUPT each stall is a loop time calculatetimesliver() clamps.
+// One CSV line per phase with what MSP_LOOP_TIME sent: the loop times counted, their mean, min, max and p99,
+// the exact p99 of the copy, the clamps and the stalls, then the buckets.  It exits with 1 if the stats take more
+// than 64 bytes, if a reply didn't come or didn't match the copy, if the p99 is below the exact one or more than a
+// bucket above it, or if the clamps aren't the stalls, or none with CONTROL_LOOP_INTERRUPT.
+//
+// usage: looptime [-s seconds] [-h]
+//   -s  virtual seconds per phase, default 10
+//   -h  print the CSV header line first
+
+#include "bradwii.h"
+#include "lib_host.h"
+#include "scheduler.h"
+
+extern globalstruct global;
+
+#define MSP_LOOP_TIME 154
+#define MSP_RESET_LOOP_TIME 155
+#define CONTROLMICROSECONDS 500
+#define PASSMICROSECONDS 10     // a pass's own overhead
+#define SETTLESECONDS 1.0
+#define LOSTPACKETEVERY 5
+#define STALLEVERY 500000       // microseconds
+#define STALLMICROSECONDS 30000
+#define MSPTIMEOUT 100000       // microseconds
+#define MAXLOOPTIMES 100000
+#define MAXSTATSBYTES 64
+
+// the copy, kept from the control task's starts while recording
+static bool recording;
+static uint32_t laststart;
+static uint16_t looptimes[MAXLOOPTIMES];
+static looptimestatsstruct copy, snapshot;
+static bool resetrequested;
+
+// the bucket a loop time goes in, from the edges in scheduler.h: 256us times the square root of two to the
+// bucket's half octave, rounded to 1.5 between octaves
+static int bucketof(uint32_t microseconds)
+{
+    int bucket = 0;
+    for (uint32_t edge = 256; bucket < LOOPTIMEBUCKETS - 1 && microseconds >= edge; edge = (bucket & 1) ? edge * 3 / 2 : edge * 4 / 3)
+        ++bucket;
+    return bucket;
+}
+
+static void clearcopy(void)
+{
+    memset(&copy, 0, sizeof(copy));
+    copy.minmicroseconds = 0xFFFF;
+}
+
+void __real_controltask(void);
+
+void __wrap_controltask(void)
+{
+    uint32_t start = lib_timers_getcurrentmicroseconds();
+
+    if (recording) {
+        uint32_t looptime = start - laststart;
+        if (copy.count < MAXLOOPTIMES)
+            looptimes[copy.count] = looptime > 0xFFFF ? 0xFFFF : looptime;
+        ++copy.buckets[bucketof(looptime)];
+        ++copy.count;
+        copy.microseconds += looptime;
+        if (looptime < copy.minmicroseconds)
+            copy.minmicroseconds = looptime;
+        if (looptime > copy.maxmicroseconds)
+            copy.maxmicroseconds = looptime > 0xFFFF ? 0xFFFF : looptime;
+        if (looptime > 20000)
+            ++copy.clamps;
+    }
+    laststart = start;
+
+    __real_controltask();
+    lib_host_timers_advancemicroseconds(CONTROLMICROSECONDS);
+}
+
+void __real_serialcheckforaction(void);
+
+void __wrap_serialcheckforaction(void)
+{
+    snapshot = copy;
+    __real_serialcheckforaction();
+    // the reset came in, the copy starts over with the firmware's stats
+    if (resetrequested && looptimestats.count == 0) {
+        resetrequested = false;
+        recording = true;
+        clearcopy();
+    }
+}
+
+// one pass of the main loop, losing a packet now and then
+static void pass(void)
+{
+    lib_host_rx_setenabled(lib_timers_getcurrentmicroseconds() / LIB_HOST_RX_PACKET_MICROSECONDS % LOSTPACKETEVERY != 0);
+    mainloopiteration();
+    lib_host_timers_advancemicroseconds(PASSMICROSECONDS);
+}
+
+static int compareuint16(const void *a, const void *b)
+{
+    return *(const uint16_t *) a - *(const uint16_t *) b;
+}
+
+// the loop time 99 in 100 of the copy's are no longer than
+static uint16_t exactp99(void)
+{
+    long count = copy.count < MAXLOOPTIMES ? copy.count : MAXLOOPTIMES;
+
+    if (!count)
+        return 0;
+    qsort(looptimes, count, sizeof(looptimes[0]), compareuint16);
+    return looptimes[(count * 99 + 99) / 100 - 1];
+}
+
+static unsigned payloadint(const unsigned char *payload)
+{
+    return payload[0] | payload[1] << 8;
+}
+
+// runs a phase and checks the reply against the copy
+static bool runphase(const char *build, const char *name, double seconds, bool stalls)
+{
+    unsigned char payload[256];
+    bool good = true;
+
+    resetrequested = true;
+    if (lib_host_mspcommand(MSP_RESET_LOOP_TIME, payload, pass, MSPTIMEOUT) != 0 || !recording) {
+        fprintf(stderr, "looptime: %s no reply to MSP_RESET_LOOP_TIME\n", name);
+        return false;
+    }
+
+    int stallcount = 0;
+    uint32_t start = lib_timers_getcurrentmicroseconds(), laststall = start;
+    while (lib_timers_getcurrentmicroseconds() - start < seconds * 1000000) {
+        pass();
+        if (stalls && lib_timers_getcurrentmicroseconds() - laststall >= STALLEVERY) {
+            lib_host_timers_advancemicroseconds(STALLMICROSECONDS);
+            laststall = lib_timers_getcurrentmicroseconds();
+            ++stallcount;
+        }
+    }
+
+    int size = lib_host_mspcommand(MSP_LOOP_TIME, payload, pass, MSPTIMEOUT);
+    recording = false;
+    if (size != 15 + 2 * LOOPTIMEBUCKETS || payload[14] != LOOPTIMEBUCKETS) {
+        fprintf(stderr, "looptime: %s no good reply to MSP_LOOP_TIME\n", name);
+        return false;
+    }
+    copy = snapshot;
+
+    uint32_t count = payload[0] | payload[1] << 8 | payload[2] << 16 | (uint32_t) payload[3] << 24;
+    unsigned mean = payloadint(payload + 4), min = payloadint(payload + 6), max = payloadint(payload + 8);
+    unsigned p99 = payloadint(payload + 10), clamps = payloadint(payload + 12);
+    unsigned exact = exactp99();
+
+    printf("%s,%s,%u,%u,%u,%u,%u,%u,%u,%d", build, name, count, mean, min, max, p99, exact, clamps, stallcount);
+    for (int i = 0; i < LOOPTIMEBUCKETS; ++i) {
+        unsigned bucket = payloadint(payload + 15 + 2 * i);
+        printf(",%u", bucket);
+        if (bucket != copy.buckets[i])
+            good = false;
+    }
+    printf("\n");
+
+    if (count != copy.count || mean != copy.microseconds / copy.count || min != copy.minmicroseconds
+        || max != copy.maxmicroseconds || clamps != copy.clamps)
+        good = false;
+    if (p99 < exact || p99 > exact * 3 / 2 || p99 > max)
+        good = false;
+    if (clamps != (CONTROL_LOOP_INTERRUPT == YES ? 0 : stallcount))
+        good = false;
+    if (!good)
+        fprintf(stderr, "looptime: %s MSP_LOOP_TIME didn't match\n", name);
+    return good;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 10;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-h")) {
+            printf("build,phase,count,mean_us,min_us,max_us,p99_us,exact_p99_us,clamps,stalls");
+            for (int b = 0; b < LOOPTIMEBUCKETS; ++b)
+                printf(",from_%u_us", looptimebucketedge(b));
+            printf("\n");
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-s seconds] [-h]\n", argv[0]);
+            return 1;
+        }
+    }
+    const char *build = CONTROL_LOOP_INTERRUPT == YES ? "interrupt" : "free";
+    bool good = sizeof(looptimestatsstruct) <= MAXSTATSBYTES;
+
+    // the copy's buckets have to be the firmware's
+    for (int b = 1; b < LOOPTIMEBUCKETS; ++b)
+        if (bucketof(looptimebucketedge(b)) != b || bucketof(looptimebucketedge(b) - 1) != b - 1)
+            good = false;
+    if (!good)
+        fprintf(stderr, "looptime: the stats take %u bytes or the buckets don't match\n", (unsigned) sizeof(looptimestatsstruct));
+
+    lib_host_setlevelsensors();
+    initbradwii();
+
+    // roll, pitch, throttle, yaw, aux1, aux2...  aux1 low arms the X4
+    uint16_t channels[LIB_HOST_RX_NUMCHANNELS] = { 1500, 1500, 1000, 1500, 1000, 2000, 1500, 1500 };
+    lib_host_rx_setchannels(channels);
+
+    uint32_t start = lib_timers_getcurrentmicroseconds();
+    while (lib_timers_getcurrentmicroseconds() - start < SETTLESECONDS * 1000000)
+        pass();
+    channels[THROTTLEINDEX] = 1500;
+    lib_host_rx_setchannels(channels);
+
+    if (!runphase(build, "steady", seconds, false))
+        good = false;
+    if (!runphase(build, "stalls", seconds, true))
+        good = false;
+    return good ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Measures the I2C bus time of the V202's MPU6050 reads with and without MPU6050_COMBINED_READ.  The Makefile
+// builds gyro.c and accelerometer.c for the V202 as mpu6050read_separate and mpu6050read_combined.  A main loop of
+// 1 to 5ms calls readgyro() and readacc() like the imu, on an emulated MPU6050 that takes a new sample every
+// millisecond.  Each sample puts its number into the accelerometer and gyro registers, so the loop can tell
+// whether readacc() and readgyro() returned the same sample.
+//
+// It prints one CSV line: the build, the number of loops, the bus microseconds per loop, the loops where the
+// accelerometer and the gyro came from different samples, and the die temperature (combined only).  It exits with
+// 1 if a reading doesn't decode to a sample, or the combined read mixes samples or gets the temperature wrong.
+//
+// usage: mpu6050read [-l loops] [-h]
+//   -l  loops to run, default 10000
+//   -h  print the CSV header line first
+
+#include "bradwii.h"
+#include "gyro.h"
+#include "accelerometer.h"
+#include "lib_timers.h"
+#include "lib_host.h"
+
+globalstruct global;
+usersettingsstruct usersettings;
+lib_host_statsstruct lib_host_stats;
+
+#define MPU6050_ADDRESS 0x68
+#define SAMPLEMICROSECONDS 1000
+#define SAMPLES 1000            // the sample number in the registers wraps at this
+#define ACCCOUNTSPERSAMPLE 16   // readacc() drops the low 2 bits
+#define GYROCOUNTSPERSAMPLE 8
+#define TEMPERATURECOUNTS -521  // 35.0 degrees
+
+#if (MPU6050_COMBINED_READ == YES)
+#define BUILDNAME "combined"
+#else
+#define BUILDNAME "separate"
+#endif
+
+
+static void setregister16(unsigned char reg, int16_t value)
+{
+    unsigned char data[2] = { (uint16_t) value >> 8, value & 0xFF };
+    lib_host_i2c_setregisters(MPU6050_ADDRESS, reg, data, 2);
+}
+
+// the registers hold the sample of the current millisecond
+static void readcallback(unsigned char address, unsigned char reg)
+{
+    long sample = (lib_timers_getcurrentmicroseconds() / SAMPLEMICROSECONDS) % SAMPLES;
+
+    for (int x = 0; x < 3; ++x) {
+        setregister16(0x3B + 2 * x, sample * ACCCOUNTSPERSAMPLE);
+        setregister16(0x43 + 2 * x, sample * GYROCOUNTSPERSAMPLE);
+    }
+    setregister16(0x41, TEMPERATURECOUNTS);
+}
+
+void x4_set_leds(unsigned char state)
+{
+}
+
+static uint32_t loopmicroseconds(void)
+{
+    return 1000 + lib_host_random() % 4001;
+}
+
+// the sample number of a reading, the same on every axis whatever the orientation, or -1
+static long decodesample(fixedpointnum * values, long countsperfixedpointnum)
+{
+    long sample = -1;
+
+    for (int x = 0; x < 3; ++x) {
+        fixedpointnum value = lib_fp_abs(values[x]);
+        if (value % countsperfixedpointnum || (sample >= 0 && value / countsperfixedpointnum != sample))
+            return -1;
+        sample = value / countsperfixedpointnum;
+    }
+    return sample;
+}
+
+int main(int argc, char **argv)
+{
+    long loops = 10000;
+    bool header = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && !strcmp(argv[i], "-l"))
+            loops = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-h"))
+            header = true;
+        else {
+            fprintf(stderr, "usage: %s [-l loops] [-h]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    lib_host_i2c_setreadcallback(readcallback);
+    initgyro();
+    initacc();
+
+    uint32_t busmicroseconds = 0;
+    long mixed = 0;
+    bool pass = true;
+
+    for (long loop = 0; loop < loops; ++loop) {
+        uint32_t start = lib_host_stats.busmicroseconds;
+        readgyro();
+        readacc();
+        busmicroseconds += lib_host_stats.busmicroseconds - start;
+
+        // fixedpointnum per sample, 3996 per gyro count and 64 per 4 acc counts
+        long gyrosample = decodesample(global.gyrorate, GYROCOUNTSPERSAMPLE * 3996L);
+        long accsample = decodesample(global.acc_g_vector, ACCCOUNTSPERSAMPLE / 4 * 64L);
+        if (gyrosample < 0 || accsample < 0)
+            pass = false;
+        else if (gyrosample != accsample)
+            ++mixed;
+        lib_host_timers_advancemicroseconds(loopmicroseconds());
+    }
+
+    if (header)
+        printf("build,loops,bus_us_per_loop,mixed_samples,temperature_c\n");
+    printf("%s,%ld,%.1f,%ld,", BUILDNAME, loops, busmicroseconds / (double) loops, mixed);
+#if (MPU6050_COMBINED_READ == YES)
+    double temperature = gyrotemperature() / (double) FIXEDPOINTONE;
+    printf("%.2f\n", temperature);
+    if (mixed || fabs(temperature - 35.0) > 0.01)
+        pass = false;
+#else
+    printf("\n");
+#endif
+    return pass ? 0 : 1;
+}
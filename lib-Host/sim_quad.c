@@ -0,0 +1,308 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+#include "sim_quad.h"
+#include "hal/lib_host.h"
+
+#define MPU3050_ADDRESS 0x68
+#define MPU3050_DATAREGISTER 0x1D
+#define MC3210_ADDRESS 0x4C
+#define MC3210_DATAREGISTER 0x0D
+
+// MPU-3050 at +/-2000 deg/s and MC3210 at +/-8g, 14 bit (see gyro.c and accelerometer.c)
+#define GYRO_COUNTSPERDEGREEPERSECOND (32768.0 / 2000.0)
+#define ACC_COUNTSPERG 1024.0
+#define GRAVITY 9.80665
+#define RADIANSTODEGREES (180.0 / M_PI)
+
+sim_quad_statestruct sim_quad_state;
+
+static sim_quad_paramsstruct params;
+static uint32_t lastupdatetime;
+static uint32_t noisestate;
+
+// Motor positions and the direction of their reaction torque.  They follow from the QUADX
+// mixer in bradwii.c: motor 0 rear left, 1 front left, 2 rear right, 3 front right.
+// With the H107L yaw reversal, motors 0 and 3 turn the nose left (positive firmware yaw).
+static const double motorx[SIM_QUAD_NUMMOTORS] = { 1, 1, -1, -1 };
+static const double motory[SIM_QUAD_NUMMOTORS] = { -1, 1, -1, 1 };
+static const double motoryaw[SIM_QUAD_NUMMOTORS] = { 1, -1, -1, 1 };
+
+void sim_quad_defaultparams(sim_quad_paramsstruct *p)
+{
+    // Hubsan H107L: 36g with battery, 65mm between diagonal motors, 7mm coreless motors
+    memset(p, 0, sizeof(*p));
+    p->mass = 0.036;
+    p->armlength = 0.033;
+    p->inertia[0] = 1.6e-5;
+    p->inertia[1] = 1.6e-5;
+    p->inertia[2] = 3.0e-5;
+    p->maxthrust = 0.2;
+    p->thrustlinearity = 0.3;
+    p->motortimeconstant = 0.03;
+    p->torquetothrust = 0.006;
+    p->lineardrag = 0.02;
+    p->quadraticdrag = 0.01;
+    p->rotationaldrag = 2e-6;
+    p->stepmicroseconds = 100;
+    p->seed = 1;
+}
+
+// deterministic gaussian noise (xorshift + sum of uniforms)
+static double noise(void)
+{
+    double sum = 0;
+    int i;
+    for (i = 0; i < 4; ++i) {
+        noisestate ^= noisestate << 13;
+        noisestate ^= noisestate >> 17;
+        noisestate ^= noisestate << 5;
+        sum += (noisestate & 0xFFFF) / 65536.0;
+    }
+    return (sum - 2.0) * 1.7320508;     // unit variance
+}
+
+// v_world = q * v_body
+static void rotatetoworld(const double *q, const double *v, double *out)
+{
+    double w = q[0], x = q[1], y = q[2], z = q[3];
+    out[0] = (1 - 2 * (y * y + z * z)) * v[0] + 2 * (x * y - w * z) * v[1] + 2 * (x * z + w * y) * v[2];
+    out[1] = 2 * (x * y + w * z) * v[0] + (1 - 2 * (x * x + z * z)) * v[1] + 2 * (y * z - w * x) * v[2];
+    out[2] = 2 * (x * z - w * y) * v[0] + 2 * (y * z + w * x) * v[1] + (1 - 2 * (x * x + y * y)) * v[2];
+}
+
+// v_body = q^-1 * v_world
+static void rotatetobody(const double *q, const double *v, double *out)
+{
+    double conjugate[4] = { q[0], -q[1], -q[2], -q[3] };
+    rotatetoworld(conjugate, v, out);
+}
+
+static int16_t tocounts(double value)
+{
+    if (value > 32767) return 32767;
+    if (value < -32768) return -32768;
+    return (int16_t) lrint(value);
+}
+
+static void step(double dt)
+{
+    sim_quad_statestruct *s = &sim_quad_state;
+    double force[3] = { 0, 0, 0 };
+    double torque[3] = { 0, 0, 0 };
+    double arm = params.armlength * M_SQRT1_2;
+    int i;
+
+    for (i = 0; i < SIM_QUAD_NUMMOTORS; ++i) {
+        double command = (lib_host_pwm_getmotor(i) - 1000) / 1000.0;
+        if (command < 0) command = 0;
+        if (command > 1) command = 1;
+        s->rotorspeed[i] += (command - s->rotorspeed[i]) * dt / params.motortimeconstant;
+        double w = s->rotorspeed[i];
+        s->thrust[i] = params.maxthrust * (params.thrustlinearity * w + (1 - params.thrustlinearity) * w * w);
+
+        // thrust points up (-Z), torque = r x F
+        force[2] -= s->thrust[i];
+        torque[0] -= motory[i] * arm * s->thrust[i];
+        torque[1] += motorx[i] * arm * s->thrust[i];
+        torque[2] -= motoryaw[i] * params.torquetothrust * s->thrust[i];
+    }
+
+    // translation in the world frame
+    double worldforce[3];
+    rotatetoworld(s->quaternion, force, worldforce);
+    double speed = sqrt(s->velocity[0] * s->velocity[0] + s->velocity[1] * s->velocity[1] + s->velocity[2] * s->velocity[2]);
+    for (i = 0; i < 3; ++i)
+        worldforce[i] -= (params.lineardrag + params.quadraticdrag * speed) * s->velocity[i];
+    worldforce[2] += params.mass * GRAVITY;
+
+    if (s->onground && worldforce[2] >= 0) {
+        // resting on the ground, nothing moves
+        memset(s->velocity, 0, sizeof(s->velocity));
+        memset(s->angularrate, 0, sizeof(s->angularrate));
+        return;
+    }
+    s->onground = false;
+
+    for (i = 0; i < 3; ++i) {
+        s->velocity[i] += worldforce[i] / params.mass * dt;
+        s->position[i] += s->velocity[i] * dt;
+    }
+    if (s->position[2] > 0) {
+        // touched down: land level, keep the heading
+        double yaw = atan2(2 * (s->quaternion[0] * s->quaternion[3] + s->quaternion[1] * s->quaternion[2]),
+            1 - 2 * (s->quaternion[2] * s->quaternion[2] + s->quaternion[3] * s->quaternion[3]));
+        s->quaternion[0] = cos(yaw / 2);
+        s->quaternion[1] = s->quaternion[2] = 0;
+        s->quaternion[3] = sin(yaw / 2);
+        s->position[2] = 0;
+        memset(s->velocity, 0, sizeof(s->velocity));
+        memset(s->angularrate, 0, sizeof(s->angularrate));
+        s->onground = true;
+        return;
+    }
+
+    // rotation: I dw/dt = torque - w x Iw - damping
+    double *w = s->angularrate;
+    double iw[3] = { params.inertia[0] * w[0], params.inertia[1] * w[1], params.inertia[2] * w[2] };
+    double gyroscopic[3] = { w[1] * iw[2] - w[2] * iw[1], w[2] * iw[0] - w[0] * iw[2], w[0] * iw[1] - w[1] * iw[0] };
+    for (i = 0; i < 3; ++i)
+        w[i] += (torque[i] - gyroscopic[i] - params.rotationaldrag * w[i]) / params.inertia[i] * dt;
+
+    // q += 0.5 * q * (0, w) * dt
+    double *q = s->quaternion;
+    double dq[4] = {
+        -q[1] * w[0] - q[2] * w[1] - q[3] * w[2],
+        q[0] * w[0] + q[2] * w[2] - q[3] * w[1],
+        q[0] * w[1] - q[1] * w[2] + q[3] * w[0],
+        q[0] * w[2] + q[1] * w[1] - q[2] * w[0]
+    };
+    double length = 0;
+    for (i = 0; i < 4; ++i) {
+        q[i] += 0.5 * dq[i] * dt;
+        length += q[i] * q[i];
+    }
+    length = sqrt(length);
+    for (i = 0; i < 4; ++i)
+        q[i] /= length;
+}
+
+// the sensors sample the model at the moment the firmware reads them
+static void writesensors(unsigned char address)
+{
+    sim_quad_statestruct *s = &sim_quad_state;
+    unsigned char data[6];
+    int i;
+
+    if (address == MPU3050_ADDRESS) {
+        // gyro axes are the firmware body axes (see GYRO_ORIENTATION in defs.h), big endian
+        for (i = 0; i < 3; ++i) {
+            double rate = s->angularrate[i] * RADIANSTODEGREES + params.gyronoise * noise();
+            int16_t counts = tocounts(rate * GYRO_COUNTSPERDEGREEPERSECOND);
+            data[2 * i] = (uint16_t) counts >> 8;
+            data[2 * i + 1] = counts & 0xFF;
+        }
+        lib_host_i2c_setregisters(MPU3050_ADDRESS, MPU3050_DATAREGISTER, data, 6);
+    } else if (address == MC3210_ADDRESS) {
+        // the firmware wants gravity minus acceleration in g (1 on Z when resting level)
+        double worldacc[3], bodyacc[3];
+        double speed = sqrt(s->velocity[0] * s->velocity[0] + s->velocity[1] * s->velocity[1] + s->velocity[2] * s->velocity[2]);
+        double totalthrust = 0;
+        for (i = 0; i < SIM_QUAD_NUMMOTORS; ++i)
+            totalthrust += s->thrust[i];
+        if (s->onground) {
+            worldacc[0] = worldacc[1] = 0;
+            worldacc[2] = 1;
+            rotatetobody(s->quaternion, worldacc, bodyacc);
+        } else {
+            // specific force in the body frame: thrust and drag, gravity is not felt
+            double drag[3], bodydrag[3];
+            for (i = 0; i < 3; ++i)
+                drag[i] = -(params.lineardrag + params.quadraticdrag * speed) * s->velocity[i];
+            rotatetobody(s->quaternion, drag, bodydrag);
+            bodyacc[0] = -bodydrag[0] / (params.mass * GRAVITY);
+            bodyacc[1] = -bodydrag[1] / (params.mass * GRAVITY);
+            bodyacc[2] = (totalthrust - bodydrag[2]) / (params.mass * GRAVITY);
+        }
+        // motor vibration shakes mostly the Z axis at the rotor frequency
+        double vibration = params.vibration * sin(lib_timers_getcurrentmicroseconds() * 2e-3) * totalthrust / (params.maxthrust * SIM_QUAD_NUMMOTORS);
+        bodyacc[2] += vibration;
+        // MC3210 axes: X = firmware Y, Y = -firmware X (see ACC_ORIENTATION in defs.h), little endian
+        double sensor[3] = { bodyacc[1], -bodyacc[0], bodyacc[2] };
+        for (i = 0; i < 3; ++i) {
+            int16_t counts = tocounts((sensor[i] + params.accnoise * noise()) * ACC_COUNTSPERG);
+            data[2 * i] = counts & 0xFF;
+            data[2 * i + 1] = (uint16_t) counts >> 8;
+        }
+        lib_host_i2c_setregisters(MC3210_ADDRESS, MC3210_DATAREGISTER, data, 6);
+    }
+}
+
+static void readcallback(unsigned char address, unsigned char reg)
+{
+    sim_quad_update();
+    writesensors(address);
+}
+
+void sim_quad_init(const sim_quad_paramsstruct *p)
+{
+    params = *p;
+    if (params.stepmicroseconds == 0)
+        params.stepmicroseconds = 100;
+    noisestate = params.seed ? params.seed : 1;
+    memset(&sim_quad_state, 0, sizeof(sim_quad_state));
+    sim_quad_state.quaternion[0] = 1;
+    sim_quad_state.onground = true;
+    lastupdatetime = lib_timers_getcurrentmicroseconds();
+    lib_host_i2c_setreadcallback(readcallback);
+    writesensors(MPU3050_ADDRESS);
+    writesensors(MC3210_ADDRESS);
+}
+
+void sim_quad_setairborne(double height, double roll, double pitch)
+{
+    // roll is about -Y, pitch about X (firmware convention)
+    double r = -roll / RADIANSTODEGREES / 2, p = pitch / RADIANSTODEGREES / 2;
+    double *q = sim_quad_state.quaternion;
+    // q = qpitch(X) * qroll(Y)
+    q[0] = cos(p) * cos(r);
+    q[1] = sin(p) * cos(r);
+    q[2] = cos(p) * sin(r);
+    q[3] = sin(p) * sin(r);
+    sim_quad_state.position[2] = -height;
+    sim_quad_state.onground = false;
+}
+
+void sim_quad_update(void)
+{
+    uint32_t now = lib_timers_getcurrentmicroseconds();
+    while ((int32_t) (now - lastupdatetime) >= (int32_t) params.stepmicroseconds) {
+        step(params.stepmicroseconds * 1e-6);
+        lastupdatetime += params.stepmicroseconds;
+    }
+}
+
+void sim_quad_geteulerangles(double *roll, double *pitch, double *yaw)
+{
+    // same definitions as imucalculateestimatedattitude() uses for the down and west vectors
+    const double worlddown[3] = { 0, 0, 1 };
+    const double bodyforward[3] = { 0, 1, 0 };
+    double down[3], forward[3];
+    rotatetobody(sim_quad_state.quaternion, worlddown, down);
+    rotatetoworld(sim_quad_state.quaternion, bodyforward, forward);
+    *roll = atan2(down[0], down[2]) * RADIANSTODEGREES;
+    *pitch = atan2(down[1], down[2]) * RADIANSTODEGREES;
+    *yaw = atan2(forward[0], forward[1]) * RADIANSTODEGREES;
+}
+
+void sim_quad_getattitudevectors(double *down, double *west)
+{
+    // the world's Z and X axes in the body frame, what global.estimateddownvector and estimatedwestvector estimate
+    const double worlddown[3] = { 0, 0, 1 };
+    const double worldwest[3] = { 1, 0, 0 };
+    rotatetobody(sim_quad_state.quaternion, worlddown, down);
+    rotatetobody(sim_quad_state.quaternion, worldwest, west);
+}
+
+void sim_quad_getrates(double *roll, double *pitch, double *yaw)
+{
+    *roll = -sim_quad_state.angularrate[1] * RADIANSTODEGREES;
+    *pitch = sim_quad_state.angularrate[0] * RADIANSTODEGREES;
+    *yaw = -sim_quad_state.angularrate[2] * RADIANSTODEGREES;
+}
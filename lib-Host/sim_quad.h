@@ -0,0 +1,87 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Rigid body model of an H107L sized quad for the host build.
+// The model takes the motor values written by setmotoroutput() (through pwmWriteMotor() of the
+// emulated HAL) and puts its angular rate and specific force into the emulated MPU-3050 and
+// MC3210 registers, so readgyro() and readacc() see it like real sensors.
+//
+// Frame: the firmware body frame, X left, Y forward, Z down.  In that frame the firmware's
+// gyrorate is (pitch, -roll, -yaw), a positive roll is left side down and a positive pitch is
+// nose down.  The world frame is the body frame at zero attitude, gravity is along +Z.
+//
+// Usage:
+//   sim_quad_init(&params);       // params from sim_quad_defaultparams() and modified
+//   initbradwii(); ... mainloopiteration();
+// the model steps itself up to the virtual clock every time the firmware reads a sensor.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIM_QUAD_NUMMOTORS 4
+
+typedef struct {
+    double mass;                // kg
+    double armlength;           // m, motor axis to center
+    double inertia[3];          // kg m^2 about body X, Y, Z
+    double maxthrust;           // N per motor at full command
+    double thrustlinearity;     // 0 = thrust goes with command squared, 1 = linear
+    double motortimeconstant;   // s, first order lag from command to rotor speed
+    double torquetothrust;      // m, yaw reaction torque per newton of thrust
+    double lineardrag;          // N per m/s
+    double quadraticdrag;       // N per (m/s)^2
+    double rotationaldrag;      // N m per rad/s
+    double gyronoise;           // deg/s standard deviation
+    double accnoise;            // g standard deviation
+    double vibration;           // g amplitude of a motor speed vibration on the accelerometer
+    uint32_t stepmicroseconds;  // integration step
+    uint32_t seed;              // noise generator seed, runs with the same seed are identical
+} sim_quad_paramsstruct;
+
+typedef struct {
+    double position[3];         // m, world frame, Z down
+    double velocity[3];         // m/s, world frame
+    double quaternion[4];       // body to world rotation, w x y z
+    double angularrate[3];      // rad/s, body frame
+    double rotorspeed[SIM_QUAD_NUMMOTORS];   // 0..1
+    double thrust[SIM_QUAD_NUMMOTORS];       // N
+    bool onground;
+} sim_quad_statestruct;
+
+extern sim_quad_statestruct sim_quad_state;
+
+void sim_quad_defaultparams(sim_quad_paramsstruct *params);
+
+// resets the state to resting level on the ground and connects the model to the emulated sensors
+void sim_quad_init(const sim_quad_paramsstruct *params);
+
+// start the quad in the air at the given height (m) with the given roll and pitch (degrees)
+void sim_quad_setairborne(double height, double roll, double pitch);
+
+// steps the model to the current virtual time.  Called automatically on sensor reads.
+void sim_quad_update(void);
+
+// true attitude in the firmware's convention, degrees
+void sim_quad_geteulerangles(double *roll, double *pitch, double *yaw);
+
+// true down and west unit vectors in the body frame, like global.estimateddownvector and estimatedwestvector
+void sim_quad_getattitudevectors(double *down, double *west);
+
+// true angular rate in the firmware's convention (global.gyrorate), degrees per second
+void sim_quad_getrates(double *roll, double *pitch, double *yaw);
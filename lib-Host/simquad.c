@@ -0,0 +1,287 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Closed loop PID tuning on the host build.
+// The X4 firmware flies the rigid body model in sim_quad.c.  A simple virtual pilot takes off and
+// holds about one meter, then for every point of a roll P/D gain grid a level mode roll step is
+// flown and the response of the real (simulated) roll angle is measured.
+// The firmware state after takeoff is shared by fork()ing one child per grid point.
+//
+// usage: simquad [-p min:max:step] [-d min:max:step] [-i igain] [-s step_degrees] [-c compute_us] [-v] [-g tracefile [-t seconds]]
+//   -p  roll P gain grid in the units of config_X4.c (pid_pgain = P << 3), default 35:35:1
+//   -d  roll D gain grid in the units of config_X4.c (pid_dgain = D << 2), default 22:22:1
+//   -i  roll I gain (pid_igain), default from config_X4.c
+//   -c  time the flight code takes per iteration, default 500us
+//   -v  print the time series of every run instead of the summary
+//   -g  fly a few stick moves on all axes after takeoff instead, and record the timesliver, corrected gyro
+//       rates and accelerometer readings and the true down and west vectors of every iteration to tracefile,
+//       for fpbench -g and imureplay
+//   -t  seconds to record with -g, default 6.  The stick moves take 6 seconds, then it hovers.
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include "bradwii.h"
+#include "lib_host.h"
+#include "sim_quad.h"
+#include "imu.h"
+
+extern globalstruct global;
+extern usersettingsstruct usersettings;
+
+#define STEPSETTLESECONDS 1.0
+#define STEPRESPONSESECONDS 1.5
+#define TAKEOFFSECONDS 3.0
+#define PILOTHEIGHT 1.0
+
+static uint16_t channels[LIB_HOST_RX_NUMCHANNELS] = { 1500, 1500, 1000, 1500, 2000, 2000, 1500, 1500 };
+static uint32_t computemicroseconds = 500;
+static double hoverthrottle;
+static FILE *tracefile;
+static double traceseconds = 6;
+
+typedef struct {
+    double risetime;        // s, 10% to 90%
+    double overshoot;       // percent of the step
+    double settlingtime;    // s, into a band of 5% of the step
+    double steadystateerror;        // degrees, mean over the last 0.25s
+    double maxrate;         // deg/s
+} stepresultstruct;
+
+static double secondsnow(void)
+{
+    return lib_timers_getcurrentmicroseconds() * 1e-6;
+}
+
+// holds the height with the throttle stick, like a pilot would
+static void pilot(void)
+{
+    double height = -sim_quad_state.position[2];
+    double climbrate = -sim_quad_state.velocity[2];
+    double throttle = hoverthrottle + 250 * (PILOTHEIGHT - height) - 200 * climbrate;
+    if (throttle < 1000) throttle = 1000;
+    if (throttle > 2000) throttle = 2000;
+    channels[2] = (uint16_t) throttle;
+}
+
+static void iterate(void)
+{
+    lib_host_rx_setchannels(channels);
+    mainloopiteration();
+    if (tracefile) {
+        double down[3], west[3];
+        sim_quad_getattitudevectors(down, west);
+        fprintf(tracefile, "%ld,%ld,%ld,%ld,%ld,%ld,%ld,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f\n", (long) global.timesliver,
+            (long) global.gyrorate[ROLLINDEX], (long) global.gyrorate[PITCHINDEX], (long) global.gyrorate[YAWINDEX],
+            (long) global.acc_g_vector[XINDEX], (long) global.acc_g_vector[YINDEX], (long) global.acc_g_vector[ZINDEX],
+            down[0], down[1], down[2], west[0], west[1], west[2]);
+    }
+    lib_host_timers_advancemicroseconds(computemicroseconds);
+}
+
+static void runfor(double seconds, bool flying)
+{
+    double end = secondsnow() + seconds;
+    while (secondsnow() < end) {
+        if (flying)
+            pilot();
+        iterate();
+    }
+}
+
+// level mode stick moves on every axis, one second each, then hovering until traceseconds
+static void flytrace(void)
+{
+    static const int16_t moves[][3] = {
+        { 300, 0, 0 }, { 0, 300, 0 }, { -300, 0, 400 }, { 0, -300, 400 }, { 200, 200, -400 }, { 0, 0, 0 },
+    };
+    unsigned int i;
+    for (i = 0; i < sizeof(moves) / sizeof(moves[0]); ++i) {
+        channels[0] = 1500 + moves[i][0];
+        channels[1] = 1500 + moves[i][1];
+        channels[3] = 1500 + moves[i][2];
+        runfor(1.0, true);
+    }
+    if (traceseconds > i)
+        runfor(traceseconds - i, true);
+}
+
+static bool parserange(const char *text, long *range)
+{
+    return sscanf(text, "%ld:%ld:%ld", &range[0], &range[1], &range[2]) == 3 && range[2] > 0;
+}
+
+static void flystep(double stepdegrees, bool verbose, stepresultstruct *result)
+{
+    runfor(STEPSETTLESECONDS, true);
+
+    // level mode: desired angle = rx value (ppm - 1500) * CHANNEL_GAIN / 65536 * LEVEL_MODE_MAX_TILT
+    int16_t stickoffset = (int16_t) lrint(stepdegrees / LEVEL_MODE_MAX_TILT * 65536.0 / 131);
+    double target = (stickoffset * 131) / 65536.0 * LEVEL_MODE_MAX_TILT;
+    channels[0] = 1500 + stickoffset;
+
+    double start = secondsnow();
+    double t10 = -1, t90 = -1, peak = 0, settled = 0, errorsum = 0;
+    int errorcount = 0;
+    memset(result, 0, sizeof(*result));
+
+    while (secondsnow() - start < STEPRESPONSESECONDS) {
+        pilot();
+        iterate();
+        double t = secondsnow() - start;
+        double roll, pitch, yaw, rollrate, pitchrate, yawrate;
+        sim_quad_geteulerangles(&roll, &pitch, &yaw);
+        sim_quad_getrates(&rollrate, &pitchrate, &yawrate);
+        double fraction = roll / target;
+        if (t10 < 0 && fraction >= 0.1) t10 = t;
+        if (t90 < 0 && fraction >= 0.9) t90 = t;
+        if (fraction > peak) peak = fraction;
+        if (fabs(fraction - 1) > 0.05) settled = t;
+        if (t > STEPRESPONSESECONDS - 0.25) {
+            errorsum += roll - target;
+            errorcount++;
+        }
+        if (fabs(rollrate) > result->maxrate) result->maxrate = fabs(rollrate);
+        if (verbose) {
+            imuupdateeulerattitude();
+            printf("%.4f,%.2f,%.2f,%.2f,%.2f,%.3f,%u,%u,%u,%u\n", t, target, roll, global.currentestimatedeulerattitude[ROLLINDEX] / 65536.0,
+                rollrate, -sim_quad_state.position[2], lib_host_pwm_getmotor(0), lib_host_pwm_getmotor(1),
+                lib_host_pwm_getmotor(2), lib_host_pwm_getmotor(3));
+        }
+    }
+    result->risetime = (t10 >= 0 && t90 >= 0) ? t90 - t10 : -1;
+    result->overshoot = peak > 1 ? (peak - 1) * 100 : 0;
+    result->settlingtime = settled;
+    result->steadystateerror = errorcount ? errorsum / errorcount : 0;
+}
+
+int main(int argc, char **argv)
+{
+    long prange[3] = { 35, 35, 1 };
+    long drange[3] = { 22, 22, 1 };
+    long igain = -1;
+    double stepdegrees = 20;
+    bool verbose = false;
+    const char *tracefilename = NULL;
+    int i;
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-v"))
+            verbose = true;
+        else if (i + 1 < argc && argv[i][0] == '-') {
+            bool ok = true;
+            switch (argv[i][1]) {
+                case 'p': ok = parserange(argv[i + 1], prange); break;
+                case 'd': ok = parserange(argv[i + 1], drange); break;
+                case 'i': igain = atol(argv[i + 1]); break;
+                case 's': stepdegrees = atof(argv[i + 1]); break;
+                case 'c': computemicroseconds = atol(argv[i + 1]); break;
+                case 'g': tracefilename = argv[i + 1]; break;
+                case 't': traceseconds = atof(argv[i + 1]); break;
+                default: ok = false;
+            }
+            if (!ok)
+                goto usage;
+            ++i;
+        } else
+            goto usage;
+    }
+
+    sim_quad_paramsstruct params;
+    sim_quad_defaultparams(&params);
+    sim_quad_init(&params);
+
+    // stick position that makes the motors carry the weight
+    double w = 0.25, hoverthrust = params.mass * 9.80665 / SIM_QUAD_NUMMOTORS;
+    for (i = 0; i < 50; ++i) {
+        double thrust = params.maxthrust * (params.thrustlinearity * w + (1 - params.thrustlinearity) * w * w);
+        double slope = params.maxthrust * (params.thrustlinearity + 2 * (1 - params.thrustlinearity) * w);
+        w -= (thrust - hoverthrust) / slope;
+    }
+    hoverthrottle = 1000 + w * 1000;
+
+    initbradwii();
+
+    // arm with AUX1 low, then take off
+    channels[4] = 1000;
+    runfor(0.2, false);
+    if (!global.armed) {
+        fprintf(stderr, "simquad: the firmware did not arm\n");
+        return 1;
+    }
+    runfor(TAKEOFFSECONDS, true);
+
+    if (tracefilename) {
+        tracefile = fopen(tracefilename, "w");
+        if (!tracefile) {
+            perror(tracefilename);
+            return 1;
+        }
+        flytrace();
+        fclose(tracefile);
+        return 0;
+    }
+
+    if (verbose)
+        printf("p,d,time,target,roll,estimatedroll,rollrate,height,motor0,motor1,motor2,motor3\n");
+    else
+        printf("p,d,i,risetime_s,overshoot_percent,settlingtime_s,steadystateerror_deg,maxrate_dps\n");
+    fflush(stdout);
+
+    for (long p = prange[0]; p <= prange[1]; p += prange[2]) {
+        for (long d = drange[0]; d <= drange[1]; d += drange[2]) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+                perror("pipe");
+                return 1;
+            }
+            pid_t child = fork();
+            if (child == 0) {
+                close(fds[0]);
+                usersettings.pid_pgain[ROLLINDEX] = p << 3;
+                usersettings.pid_dgain[ROLLINDEX] = d << 2;
+                if (igain >= 0)
+                    usersettings.pid_igain[ROLLINDEX] = igain;
+                if (verbose)
+                    printf("# p %ld d %ld\n", p, d);
+                stepresultstruct result;
+                flystep(stepdegrees, verbose, &result);
+                fflush(stdout);
+                if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+                    _exit(1);
+                _exit(0);
+            }
+            close(fds[1]);
+            stepresultstruct result;
+            bool ok = read(fds[0], &result, sizeof(result)) == sizeof(result);
+            close(fds[0]);
+            waitpid(child, NULL, 0);
+            if (!ok) {
+                fprintf(stderr, "simquad: run p %ld d %ld failed\n", p, d);
+                return 1;
+            }
+            if (!verbose)
+                printf("%ld,%ld,%ld,%.4f,%.1f,%.4f,%.2f,%.0f\n", p, d, igain >= 0 ? igain : (long) usersettings.pid_igain[ROLLINDEX],
+                    result.risetime, result.overshoot, result.settlingtime, result.steadystateerror, result.maxrate);
+            fflush(stdout);
+        }
+    }
+    return 0;
+
+usage:
+    fprintf(stderr, "usage: %s [-p min:max:step] [-d min:max:step] [-i igain] [-s step_degrees] [-c compute_us] [-v] [-g tracefile [-t seconds]]\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,227 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the main loop's schedule (see src/scheduler.c) on the host build of the X4.  The Makefile builds it three
+// times: taskschedule_free with the control task on every pass, taskschedule_fixed with CONTROL_LOOP_PERIOD 4000,
+// and taskschedule_interrupt with CONTROL_LOOP_PERIOD 4000 and CONTROL_LOOP_INTERRUPT.  The Makefile links it with
+// controltask() wrapped, so the control task takes CONTROLMICROSECONDS of virtual time on top of its bus traffic.
+// The soft SPI and the I2C sensors take the time the emulated HAL gives them, and the emulated timer interrupt
+// comes between their bytes.  Reading a packet over the soft SPI takes about 2ms and finding none 140us, so one
+// packet in LOSTPACKETEVERY is lost, which is what makes the main loop's passes uneven.  Each read of a timer by
+// the flight code takes READMICROSECONDS, so the scheduler never sees a clock that stood still while it worked.
+// The aircraft is armed and flown at mid throttle while a config program asks for MSP_TASK_STATS every 100ms.
+//
+// After a second to settle, the stats are cleared and the loop runs for the given virtual seconds.  One CSV line
+// per task: its id, period and priority, its runs and rate against the rate its period asks for, its longest
+// and average run and its latest start, then one line for the passes: how many, and the longest.  The control
+// task's line adds the shortest and longest time between its starts and their standard deviation, and the
+// shortest and longest timesliver it ran with.  It exits with 1 if the control task didn't run on every pass
+// (free) or missed its cadence by more than 100us (fixed and interrupt), if the interrupt's timesliver wasn't
+// constant, if another task started more than its period or 10ms late, whichever is longer, or never ran, if the
+// aircraft didn't arm, or if an MSP_TASK_STATS reply was missing or didn't match the task table.
+//
+// usage: taskschedule [-s seconds] [-h]
+//   -s  virtual seconds to measure, default 10
+//   -h  print the CSV header line first
+
+#include "bradwii.h"
+#include "lib_host.h"
+#include "scheduler.h"
+
+extern globalstruct global;
+
+#define MSP_TASK_STATS 153
+#define CONTROLMICROSECONDS 500
+#define PASSMICROSECONDS 10     // a pass's own overhead
+#define SETTLESECONDS 1.0
+#define MSPEVERY 100000         // microseconds
+#define MAXCONTROLLATE 100      // microseconds, with CONTROL_LOOP_PERIOD
+#define LOSTPACKETEVERY 5
+#define READMICROSECONDS 1
+
+// the control task's starts and timeslivers while measuring
+static bool measuring;
+static uint32_t laststart, mininterval = UINT32_MAX, maxinterval;
+static long intervals;
+static double intervalsum, intervalsquaresum;
+static fixedpointnum24 mintimesliver = INT32_MAX, maxtimesliver;
+
+void __real_controltask(void);
+
+void __wrap_controltask(void)
+{
+    uint32_t start = lib_timers_getcurrentmicroseconds();
+
+    if (measuring && laststart) {
+        uint32_t interval = start - laststart;
+        if (interval < mininterval)
+            mininterval = interval;
+        if (interval > maxinterval)
+            maxinterval = interval;
+        intervalsum += interval;
+        intervalsquaresum += (double) interval * interval;
+        ++intervals;
+    }
+    laststart = start;
+
+    __real_controltask();
+    lib_host_timers_advancemicroseconds(CONTROLMICROSECONDS);
+
+    if (measuring) {
+        if (global.timesliver < mintimesliver)
+            mintimesliver = global.timesliver;
+        if (global.timesliver > maxtimesliver)
+            maxtimesliver = global.timesliver;
+    }
+}
+
+static double timeslivermicroseconds(fixedpointnum24 timesliver)
+{
+    return timesliver * 1000000.0 / FIXEDPOINT24ONE;
+}
+
+static unsigned char reply[256];
+static int replylength;
+static int requests, goodreplies;
+
+// collects the firmware's MSP output and checks each whole MSP_TASK_STATS reply against the task table
+static void checkreplies(void)
+{
+    replylength += lib_host_serial_receivefromfirmware(reply + replylength, sizeof(reply) - replylength);
+    while (replylength >= 6) {
+        int size = reply[3];
+        if (replylength < size + 6)
+            return;
+        unsigned char checksum = 0;
+        for (int i = 3; i < size + 5; ++i)
+            checksum ^= reply[i];
+        bool good = reply[0] == '$' && reply[1] == 'M' && reply[2] == '>' && reply[4] == MSP_TASK_STATS
+            && checksum == reply[size + 5] && size == 1 + numtasks * 14 && reply[5] == numtasks;
+        for (int i = 0; good && i < numtasks; ++i) {
+            const unsigned char *task = &reply[6 + i * 14];
+            uint32_t period = task[1] | task[2] << 8 | task[3] << 16 | (uint32_t) task[4] << 24;
+            good = task[0] == tasks[i].id && period == tasks[i].period && task[5] == tasks[i].priority;
+        }
+        if (good)
+            ++goodreplies;
+        replylength -= size + 6;
+        memmove(reply, reply + size + 6, replylength);
+    }
+}
+
+static void requeststats(void)
+{
+    const unsigned char request[6] = { '$', 'M', '<', 0, MSP_TASK_STATS, MSP_TASK_STATS };
+    lib_host_serial_sendtofirmware(request, sizeof(request));
+    ++requests;
+}
+
+static void clearstats(void)
+{
+    for (int i = 0; i < numtasks; ++i) {
+        taskstats[i].runs = 0;
+        taskstats[i].maxmicroseconds = 0;
+        taskstats[i].maxlatemicroseconds = 0;
+    }
+    measuring = true;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 10;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-h"))
+            printf("build,task,period_us,priority,runs,rate_hz,nominal_hz,max_us,average_us,max_late_us,"
+                "interval_min_us,interval_max_us,interval_stddev_us,timesliver_min_us,timesliver_max_us\n");
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-s seconds] [-h]\n", argv[0]);
+            return 1;
+        }
+    }
+    const char *build = CONTROL_LOOP_INTERRUPT == YES ? "interrupt" : CONTROL_LOOP_PERIOD ? "fixed" : "free";
+
+    lib_host_timers_setreadmicroseconds(READMICROSECONDS);
+    lib_host_setlevelsensors();
+    initbradwii();
+
+    // roll, pitch, throttle, yaw, aux1, aux2...  aux1 low arms the X4
+    uint16_t channels[LIB_HOST_RX_NUMCHANNELS] = { 1500, 1500, 1000, 1500, 1000, 2000, 1500, 1500 };
+    lib_host_rx_setchannels(channels);
+
+    uint32_t start = lib_timers_getcurrentmicroseconds();
+    while (lib_timers_getcurrentmicroseconds() - start < SETTLESECONDS * 1000000) {
+        mainloopiteration();
+        lib_host_timers_advancemicroseconds(PASSMICROSECONDS);
+    }
+    channels[THROTTLEINDEX] = 1500;
+    lib_host_rx_setchannels(channels);
+    clearstats();
+
+    long passes = 0;
+    uint32_t maxpass = 0, lastrequest = 0;
+    bool pass = global.armed;
+
+    start = lib_timers_getcurrentmicroseconds();
+    while (lib_timers_getcurrentmicroseconds() - start < seconds * 1000000) {
+        uint32_t passstart = lib_timers_getcurrentmicroseconds();
+        if (passstart - lastrequest >= MSPEVERY) {
+            requeststats();
+            lastrequest = passstart;
+        }
+        lib_host_rx_setenabled(passstart / LIB_HOST_RX_PACKET_MICROSECONDS % LOSTPACKETEVERY != 0);
+        mainloopiteration();
+        lib_host_timers_advancemicroseconds(PASSMICROSECONDS);
+        checkreplies();
+        if (lib_timers_getcurrentmicroseconds() - passstart > maxpass)
+            maxpass = lib_timers_getcurrentmicroseconds() - passstart;
+        ++passes;
+    }
+    double elapsed = (lib_timers_getcurrentmicroseconds() - start) / 1000000.0;
+
+    for (int i = 0; i < numtasks; ++i) {
+        const taskstruct *task = &tasks[i];
+        const taskstatsstruct *stats = &taskstats[i];
+        double nominal = task->period ? 1000000.0 / task->period : passes / elapsed;
+
+        printf("%s,%d,%u,%d,%u,%.1f,%.1f,%u,%u,%u", build, task->id, (unsigned) task->period, task->priority, stats->runs,
+            stats->runs / elapsed, nominal, stats->maxmicroseconds, stats->averagemicroseconds, stats->maxlatemicroseconds);
+        if (task->id == TASKCONTROL) {
+            double mean = intervalsum / intervals;
+            printf(",%u,%u,%.1f,%.1f,%.1f\n", mininterval, maxinterval, sqrt(fmax(intervalsquaresum / intervals - mean * mean, 0)),
+                timeslivermicroseconds(mintimesliver), timeslivermicroseconds(maxtimesliver));
+            if (task->period ? stats->maxlatemicroseconds > MAXCONTROLLATE : stats->runs != (uint16_t) passes)
+                pass = false;
+            if (CONTROL_LOOP_INTERRUPT == YES && mintimesliver != maxtimesliver)
+                pass = false;
+        } else {
+            printf(",,,,,\n");
+            if (stats->maxlatemicroseconds > (task->period > 10000 ? task->period : 10000) || !stats->runs)
+                pass = false;
+        }
+    }
+    printf("%s,passes,,,%ld,%.1f,,%u,,,,,,,\n", build, passes, passes / elapsed, maxpass);
+
+    // the last request may still be on its way
+    if (goodreplies < requests - 1) {
+        fprintf(stderr, "taskschedule: %d of %d MSP_TASK_STATS replies were good\n", goodreplies, requests);
+        pass = false;
+    }
+    return pass ? 0 : 1;
+}
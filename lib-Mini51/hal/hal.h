@@ -10,7 +10,10 @@
 #include <string.h>
 #include <stdio.h>
 
+// The host build (lib-Host) shares this header but has no Mini51 peripherals
+#ifndef HOST_BUILD
 #include "Mini51Series.h"
+#endif
 // These includes are totally not needed here, they only bring
 // dependency on actual processor details into main source
 //#include "drv_gpio.h"
@@ -25,6 +25,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // Therefore, the range of a fixedpointnum is -32768.0 to 32767.0 with an accuracy of 0.000015
 // There is no overflow or underflow protection, so it's up to the programmer to watch out.
 
+#pragma once
+
 #include "hal.h"
 
 #define fixedpointnum int32_t
@@ -54,8 +56,56 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define FIXEDPOINTPIOVER180 1144L // pi/180 for converting degrees to radians
 
-// since time slivers can be very small, we shift them an extra 8 bits to maintain accuracy
-#define TIMESLIVEREXTRASHIFT 8
+// Two more formats for numbers that don't need 16 integer bits.  Unit vectors fit in 2 and time
+// slivers and the small angles made from them fit in 8, so the rest of the bits go after the point.
+// A fixedpointnum30 has a range of -2.0 to 2.0 with an accuracy of 0.000000001, and a
+// fixedpointnum24 has a range of -128.0 to 128.0 with an accuracy of 0.00000006.
+#define fixedpointnum30 int32_t
+#define fixedpointnum24 int32_t
+
+#define FIXEDPOINT30SHIFT 30
+#define FIXEDPOINT24SHIFT 24
+
+#define FIXEDPOINT30ONE (1L<<FIXEDPOINT30SHIFT)
+#define FIXEDPOINT24ONE (1L<<FIXEDPOINT24SHIFT)
+
+#define FIXEDPOINT30CONSTANT(number) ((fixedpointnum30)((number) * FIXEDPOINT30ONE))
+#define FIXEDPOINT24CONSTANT(number) ((fixedpointnum24)((number) * FIXEDPOINT24ONE))
+
+// conversions to and from fixedpointnum, rounded when bits are dropped
+#define FIXEDPOINTTOFIXEDPOINT30(number) ((fixedpointnum30)(number) << (FIXEDPOINT30SHIFT-FIXEDPOINTSHIFT))
+#define FIXEDPOINTTOFIXEDPOINT24(number) ((fixedpointnum24)(number) << (FIXEDPOINT24SHIFT-FIXEDPOINTSHIFT))
+#define FIXEDPOINT30TOFIXEDPOINT(number) (((number) + (1L<<(FIXEDPOINT30SHIFT-FIXEDPOINTSHIFT-1))) >> (FIXEDPOINT30SHIFT-FIXEDPOINTSHIFT))
+#define FIXEDPOINT24TOFIXEDPOINT(number) (((number) + (1L<<(FIXEDPOINT24SHIFT-FIXEDPOINTSHIFT-1))) >> (FIXEDPOINT24SHIFT-FIXEDPOINTSHIFT))
+
+// atan2 implementations. Errors are the worst case over all inputs, see lib-Host/fpbench.c
+#define LIB_FP_ATAN2_CORDIC 0       // 10 CORDIC iterations, max error 0.058 degrees, |x|+|y| must stay below 2^31
+#define LIB_FP_ATAN2_POLYNOMIAL 1   // octant reduction and a 9th order polynomial, max error 0.005 degrees
+#define LIB_FP_ATAN2_TABLE 2        // octant reduction and a 33 entry table, max error 0.008 degrees
+
+// choose which atan2 lib_fp_atan2() uses
+#ifndef LIB_FP_ATAN2
+#define LIB_FP_ATAN2 LIB_FP_ATAN2_CORDIC
+#endif
+
+// sine implementations. Errors are the worst case over all inputs, see lib-Host/fpbench.c
+#define LIB_FP_SINE_SMALLANGLE 0    // 8 degree tables and a small angle step, max error 0.0097
+#define LIB_FP_SINE_QUADRATIC 1     // one step angle reduction, 64 entry quarter wave table and quadratic interpolation, max error 0.00003
+
+// choose which sine lib_fp_sine(), lib_fp_cosine() and lib_fp_sincos() use
+#ifndef LIB_FP_SINE
+#define LIB_FP_SINE LIB_FP_SINE_QUADRATIC
+#endif
+
+// precision of lib_fp_invsqrtprecision(), the number of newton iterations after the table.
+// Errors are the worst case over all positive inputs, relative below 1.0 and in LSBs from 1.0 up, see lib-Host/fpbench.c
+#define LIB_FP_INVSQRT_TABLE 0      // interpolated table only, 0.13%, 85 LSB
+#define LIB_FP_INVSQRT_ONENEWTON 1  // 0.0008%, 0.66 LSB.  What lib_fp_invsqrt() uses
+#define LIB_FP_INVSQRT_TWONEWTON 2  // correctly rounded, 0.5 LSB
+
+// since time slivers can be very small, they are fixedpointnum24s.  TIMESLIVEREXTRASHIFT is the difference,
+// which is what lib_fp_lowpassfilter() wants for its timesliverextrashift.
+#define TIMESLIVEREXTRASHIFT (FIXEDPOINT24SHIFT-FIXEDPOINTSHIFT)
 
 void lib_fp_constrain(fixedpointnum *lf,fixedpointnum low,fixedpointnum high);
 void lib_fp_constrain180(fixedpointnum *lf);
@@ -65,8 +115,92 @@ void lib_fp_lowpassfilter(fixedpointnum *variable,fixedpointnum newvalue,fixedpo
 fixedpointnum lib_fp_abs(fixedpointnum fp);
 fixedpointnum lib_fp_sine(fixedpointnum angle);
 fixedpointnum lib_fp_cosine(fixedpointnum angle);
+void lib_fp_sincos(fixedpointnum angle, fixedpointnum * sine, fixedpointnum * cosine);
+// the kernels behind lib_fp_sine(), only the selected one is built unless LIB_FP_ALL_KERNELS is defined
+fixedpointnum lib_fp_sine_smallangle(fixedpointnum angle);
+fixedpointnum lib_fp_sine_quadratic(fixedpointnum angle);
+void lib_fp_sincos_quadratic(fixedpointnum angle, fixedpointnum * sine, fixedpointnum * cosine);
 fixedpointnum lib_fp_atan2(fixedpointnum y, fixedpointnum x);
+// the kernels behind lib_fp_atan2(), only the selected one is built unless LIB_FP_ALL_KERNELS is defined
+fixedpointnum lib_fp_atan2_cordic(fixedpointnum y, fixedpointnum x);
+fixedpointnum lib_fp_atan2_polynomial(fixedpointnum y, fixedpointnum x);
+fixedpointnum lib_fp_atan2_table(fixedpointnum y, fixedpointnum x);
 fixedpointnum lib_fp_sqrt(fixedpointnum x);
 fixedpointnum lib_fp_stringtofixedpointnum(char *string);
 fixedpointnum lib_fp_invsqrt(fixedpointnum x);
+fixedpointnum lib_fp_invsqrtprecision(fixedpointnum x, int newtoniterations);
+fixedpointnum30 lib_fp_invsqrt30(fixedpointnum30 x, int newtoniterations);
+fixedpointnum lib_fp_reciprocal(fixedpointnum x);
+fixedpointnum lib_fp_divide(fixedpointnum x, fixedpointnum y);
 int32_t lib_fp_stringtolong(char *string);
+
+// Inline versions of lib_fp_multiply() and lib_fp_lowpassfilter() for the main loop.  They give exactly the
+// same results as the functions but save the call, and since oneoverperiod and timesliverextrashift are
+// nearly always constants, the compiler can fold the fraction multiply and the shift away.
+
+// multiply where x is already split into its high and low 16 bits, for when x is shared by several products
+static inline fixedpointnum lib_fp_multiplysplit(int32_t xh, uint32_t xl, fixedpointnum y)
+{
+    int32_t yh = y >> FIXEDPOINTSHIFT;
+    uint32_t yl = y & 0xffff;
+    return ((xh * yh) << FIXEDPOINTSHIFT) + xh * yl + yh * xl + ((xl * yl) >> FIXEDPOINTSHIFT);
+}
+
+static inline fixedpointnum lib_fp_multiplyinline(fixedpointnum x, fixedpointnum y)
+{
+    return lib_fp_multiplysplit(x >> FIXEDPOINTSHIFT, x & 0xffff, y);
+}
+
+// (x*y)>>shift for a shift from 16 to 32, for multiplying numbers of different formats.  Like lib_fp_multiply()
+// the result is rounded down, and there is no overflow protection.  The 64 bit product is put together from
+// 16 bit halves the way lib_fp_multiplyhigh() does in lib_fp.c, but signed.
+static inline int32_t lib_fp_multiplyshift(int32_t x, int32_t y, int shift)
+{
+    int32_t xh = x >> 16;
+    uint32_t xl = x & 0xffff;
+    int32_t yh = y >> 16;
+    uint32_t yl = y & 0xffff;
+    int32_t middle = xh * (int32_t) yl + (int32_t) ((xl * yl) >> 16);
+    int32_t middle2 = (int32_t) xl * yh + (middle & 0xffff);
+    int32_t high = xh * yh + (middle >> 16) + (middle2 >> 16);
+    return ((high << (32 - shift)) + (int32_t) (((uint32_t) middle2 & 0xffff) >> (shift - 16)));
+}
+
+// a fixedpointnum30 times a number of any format, the result is in the other number's format
+static inline int32_t lib_fp_multiply30(fixedpointnum30 x, int32_t y)
+{
+    return lib_fp_multiplyshift(x, y, FIXEDPOINT30SHIFT);
+}
+
+// a fixedpointnum24 times a number of any format, the result is in the other number's format
+static inline int32_t lib_fp_multiply24(fixedpointnum24 x, int32_t y)
+{
+    return lib_fp_multiplyshift(x, y, FIXEDPOINT24SHIFT);
+}
+
+static inline void lib_fp_lowpassfilterinline(fixedpointnum *variable, fixedpointnum newvalue, fixedpointnum timesliver, fixedpointnum oneoverperiod, int timesliverextrashift)
+{   // see lib_fp_lowpassfilter()
+    fixedpointnum fraction = lib_fp_multiplyinline(timesliver, oneoverperiod);
+
+    *variable = (lib_fp_multiplyinline(fraction, newvalue) + lib_fp_multiplyinline((FIXEDPOINTONE << timesliverextrashift) - fraction, *variable)) >> timesliverextrashift;
+
+    if (newvalue > *variable)
+        ++ * variable;
+}
+
+static inline void lib_fp_lowpassfilterchannels(fixedpointnum *variables, const fixedpointnum *newvalues, int numchannels, fixedpointnum timesliver, fixedpointnum oneoverperiod, int timesliverextrashift)
+{   // lib_fp_lowpassfilter() on numchannels variables that share a timesliver and a period.
+    // The fraction and one minus the fraction are worked out and split once for all channels.
+    fixedpointnum fraction = lib_fp_multiplyinline(timesliver, oneoverperiod);
+    fixedpointnum remainder = (FIXEDPOINTONE << timesliverextrashift) - fraction;
+    int32_t fractionh = fraction >> FIXEDPOINTSHIFT;
+    uint32_t fractionl = fraction & 0xffff;
+    int32_t remainderh = remainder >> FIXEDPOINTSHIFT;
+    uint32_t remainderl = remainder & 0xffff;
+
+    for (int x = 0; x < numchannels; ++x) {
+        variables[x] = (lib_fp_multiplysplit(fractionh, fractionl, newvalues[x]) + lib_fp_multiplysplit(remainderh, remainderl, variables[x])) >> timesliverextrashift;
+        if (newvalues[x] > variables[x])
+            ++variables[x];
+    }
+}
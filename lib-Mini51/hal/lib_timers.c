@@ -39,18 +39,29 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 static volatile uint32_t sysTickUptime = 0;
 static uint32_t sysTickLimit;
 
+static lib_timers_callbackptr periodiccallback;
+
 // SysTick
 void SysTick_Handler(void)
 {
     sysTickUptime++;
 }
 
+// TIMER0 runs the periodic callback
+void TMR0_IRQHandler(void)
+{
+    TIMER_ClearIntFlag(TIMER0);
+    periodiccallback();
+}
+
 // needs to be called once in the program before timers can be used
 void lib_timers_init(void)
 {                               
     // SysTick
     sysTickLimit = SystemCoreClock / 1000;
     SysTick_Config(sysTickLimit);
+    // above the periodic callback, so the uptime keeps counting through a callback that takes longer than a tick
+    NVIC_SetPriority(SysTick_IRQn, 0);
 }
 
 uint32_t lib_timers_getcurrentmicroseconds(void)
@@ -65,6 +76,28 @@ uint32_t lib_timers_getcurrentmicroseconds(void)
     return (ms * 1000) + (sysTickLimit - cycle_cnt) / CyclesPerUs;
 }
 
+// The Cortex-M0 has no cycle counter, so the cycles come from SysTick: the ticks since startup times the cycles
+// per tick, and the cycles into this tick, which VAL counts down.  No division, so it is cheaper than the microseconds.
+uint32_t lib_timers_getcycles(void)
+{
+    register uint32_t ms, cycle_cnt;
+    do {
+        ms = sysTickUptime;
+        cycle_cnt = SysTick->VAL;
+    } while (ms != sysTickUptime);
+    return (ms * sysTickLimit + (sysTickLimit - cycle_cnt));
+}
+
+unsigned long lib_timers_cyclespermicrosecond(void)
+{
+    return (CyclesPerUs);
+}
+
+void lib_timers_sleep(void)
+{
+    __WFI();
+}
+
 unsigned long lib_timers_gettimermicroseconds(unsigned long starttime)
 {
     // returns microseconds since this timer was started
@@ -105,3 +138,27 @@ void lib_timers_delaymilliseconds(unsigned long delaymilliseconds)
     while (lib_timers_gettimermicroseconds(timercounts) < delaymilliseconds * 1000L) {
     }
 }
+
+void lib_timers_startperiodiccallback(unsigned long periodmicroseconds, lib_timers_callbackptr callback)
+{
+    periodiccallback = callback;
+
+    CLK_EnableModuleClock(TMR0_MODULE);
+    CLK_SetModuleClock(TMR0_MODULE, CLK_CLKSEL1_TMR0_S_HCLK, 0);
+    TIMER_Open(TIMER0, TIMER_PERIODIC_MODE, 1000000L / periodmicroseconds);
+    TIMER_EnableInt(TIMER0);
+
+    // the lowest priority, so SysTick and the UART can still interrupt a callback that waits on a bus
+    NVIC_SetPriority(TMR0_IRQn, (1 << __NVIC_PRIO_BITS) - 1);
+    NVIC_EnableIRQ(TMR0_IRQn);
+    TIMER_Start(TIMER0);
+}
+
+void lib_timers_holdperiodiccallback(bool hold)
+{
+    // the timer keeps its interrupt flag while the interrupt is disabled, so a held callback runs on release
+    if (hold)
+        NVIC_DisableIRQ(TMR0_IRQn);
+    else
+        NVIC_EnableIRQ(TMR0_IRQn);
+}
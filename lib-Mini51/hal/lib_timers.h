@@ -17,8 +17,26 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 void lib_timers_init(void);
 unsigned long lib_timers_starttimer(void);
 unsigned long lib_timers_gettimermicroseconds(unsigned long starttime);
 unsigned long lib_timers_gettimermicrosecondsandreset(unsigned long *starttime);
 void    lib_timers_delaymilliseconds(unsigned long delaymilliseconds);
+
+// A free running count of the CPU's cycles, for timing short stretches of code like the profiler's probes.  It
+// wraps, so only the difference between two counts means anything.
+uint32_t lib_timers_getcycles(void);
+unsigned long lib_timers_cyclespermicrosecond(void);
+
+// Sleeps the CPU until the next interrupt, which the millisecond SysTick makes a millisecond at the most.
+void lib_timers_sleep(void);
+
+// Calls callback from a timer interrupt every periodmicroseconds, for sampling a sensor or running the control
+// task at a fixed rate while the main loop is busy.  Holding it keeps the interrupt from running, for example while the main loop uses a
+// bus the callback uses too.  A callback that came due while held runs when it is released.
+typedef void (*lib_timers_callbackptr)(void);
+void lib_timers_startperiodiccallback(unsigned long periodmicroseconds, lib_timers_callbackptr callback);
+void lib_timers_holdperiodiccallback(bool hold);
@@ -77,11 +77,7 @@ void lib_fp_constrain180(fixedpointnum *lf)
 fixedpointnum lib_fp_multiply(fixedpointnum x, fixedpointnum y)
 {
     // multiplies two fixed point numbers without overflowing and returns the result
-    int32_t xh = x >> FIXEDPOINTSHIFT;
-    uint32_t xl = x & 0xffff;
-    int32_t yh = y >> FIXEDPOINTSHIFT;
-    uint32_t yl = y & 0xffff;
-    return ((xh * yh) << FIXEDPOINTSHIFT) + xh * yl + yh * xl + ((xl * yl) >> FIXEDPOINTSHIFT);
+    return lib_fp_multiplyinline(x, y);
 }
 
 void lib_fp_lowpassfilter(fixedpointnum *variable, fixedpointnum newvalue, fixedpointnum timesliver, fixedpointnum oneoverperiod, int timesliverextrashift)
@@ -93,14 +89,12 @@ void lib_fp_lowpassfilter(fixedpointnum *variable, fixedpointnum newvalue, fixed
     // except it does it using fixed point arithmatic
     // If timesliver is very small, resolution can be gained by keeping timesliver shifted left by some extra bits.
     // Make sure variable can be also shifted left this same number of bits or else the following will overflow! 
-    fixedpointnum fraction = lib_fp_multiply(timesliver, oneoverperiod);
-
-    *variable = (lib_fp_multiply(fraction, newvalue) + lib_fp_multiply((FIXEDPOINTONE << timesliverextrashift) - fraction, *variable)) >> timesliverextrashift;
-
+    // The work is done in lib_fp_lowpassfilterinline() in lib_fp.h:
+    //    fraction=timesliver*oneoverperiod
+    //    variable=(fraction*newvalue+((1<<timesliverextrashift)-fraction)*variable)>>timesliverextrashift
     // the adder combines adding .5 for rounding error and adding .5 in the direction the newvalue is trying to pull us
     // So we can zero in on the desired value.
-    if (newvalue > *variable)
-        ++ * variable;
+    lib_fp_lowpassfilterinline(variable, newvalue, timesliver, oneoverperiod, timesliverextrashift);
 }
 
 fixedpointnum lib_fp_abs(fixedpointnum fp)
@@ -111,6 +105,7 @@ fixedpointnum lib_fp_abs(fixedpointnum fp)
         return (fp);
 }
 
+#if (LIB_FP_SINE == LIB_FP_SINE_SMALLANGLE) || defined(LIB_FP_ALL_KERNELS)
 // we may be able to make these unsigned ints and save space
 fixedpointnum biganglesinelookup[] = {  // every 8 degrees 
     0,                          // sine(0)
@@ -142,7 +137,7 @@ fixedpointnum biganglecosinelookup[] = {        // every 8 degrees
     2287
 };
 
-fixedpointnum lib_fp_sine(fixedpointnum angle)
+fixedpointnum lib_fp_sine_smallangle(fixedpointnum angle)
 {                               // returns sine of angle where angle is in degrees
     // manipulate so that we only have to work in a range from 0 to 90 degrees
     char negate = 0;
@@ -172,12 +167,132 @@ fixedpointnum lib_fp_sine(fixedpointnum angle)
     return (result);
 }
 
+#endif
+
+#if (LIB_FP_SINE == LIB_FP_SINE_QUADRATIC) || defined(LIB_FP_ALL_KERNELS)
+// sine of a quarter turn in 64 steps, sine(i*90/64 degrees).  sine(90) doesn't fit in 16 bits, see quartersine()
+static const uint16_t quartersinetable[64] = {
+    0, 1608, 3216, 4821, 6424, 8022, 9616, 11204,
+    12785, 14359, 15924, 17479, 19024, 20557, 22078, 23586,
+    25080, 26558, 28020, 29466, 30893, 32303, 33692, 35062,
+    36410, 37736, 39040, 40320, 41576, 42806, 44011, 45190,
+    46341, 47464, 48559, 49624, 50660, 51665, 52639, 53581,
+    54491, 55368, 56212, 57022, 57798, 58538, 59244, 59914,
+    60547, 61145, 61705, 62228, 62714, 63162, 63572, 63944,
+    64277, 64571, 64827, 65043, 65220, 65358, 65457, 65516,
+};
+
+static fixedpointnum quartersine(int index)
+{
+    return (index < 64 ? quartersinetable[index] : FIXEDPOINTONE);
+}
+
+// converts degrees to a binary angle where 2^32 is a full turn.  The unsigned multiply wraps around
+// at whole turns, so any angle is reduced in one step without loops.
+// 11930465 is 2^32/360 and 46603 is 2^24/360.
+static uint32_t degreestobinaryangle(fixedpointnum angle)
+{
+    return ((uint32_t) (angle >> FIXEDPOINTSHIFT)) * 11930465UL + ((((uint32_t) angle & 0xffff) * 46603UL) >> 8);
+}
+
+static void binaryanglesinecosine(uint32_t binaryangle, fixedpointnum * sine, fixedpointnum * cosine)
+{
+    // the table covers the first quadrant.  The top 2 bits are the quadrant, the next 6 the table index
+    // and the next 16 the fraction of a table step.
+    uint32_t x = binaryangle & 0x3fffffff;
+    int index = x >> 24;
+    uint32_t fraction = (x >> 8) & 0xffff;
+    uint32_t s = quartersine(index);
+    uint32_t c = quartersine(64 - index);
+
+    // the fraction in radians shifted 20 bits, a table step is pi/128 radians (3217 is pi/128*2^17)
+    uint32_t delta = (fraction * 3217UL) >> 13;
+    // delta squared, shifted 26 bits
+    uint32_t deltasquared = (delta * delta) >> 14;
+
+    // sine(a+d)=sine(a)+cosine(a)*d-sine(a)*d*d/2 and cosine(a+d)=cosine(a)-sine(a)*d-cosine(a)*d*d/2
+    // Accurate to a third of a bit, which is the size of the d*d*d/6 term left out.
+    fixedpointnum s1 = s + ((c * delta + (1UL << 19)) >> 20) - ((s * deltasquared + (1UL << 26)) >> 27);
+    fixedpointnum c1 = c - ((s * delta + (1UL << 19)) >> 20) - ((c * deltasquared + (1UL << 26)) >> 27);
+
+    switch (binaryangle >> 30) {
+    case 0:
+        *sine = s1;
+        *cosine = c1;
+        break;
+    case 1:
+        *sine = c1;
+        *cosine = -s1;
+        break;
+    case 2:
+        *sine = -s1;
+        *cosine = -c1;
+        break;
+    default:
+        *sine = -c1;
+        *cosine = s1;
+        break;
+    }
+}
+
+fixedpointnum lib_fp_sine_quadratic(fixedpointnum angle)
+{   // returns sine of angle where angle is in degrees
+    fixedpointnum sine, cosine;
+    binaryanglesinecosine(degreestobinaryangle(angle), &sine, &cosine);
+    return (sine);
+}
+
+void lib_fp_sincos_quadratic(fixedpointnum angle, fixedpointnum * sine, fixedpointnum * cosine)
+{
+    binaryanglesinecosine(degreestobinaryangle(angle), sine, cosine);
+}
+#endif
+
+fixedpointnum lib_fp_sine(fixedpointnum angle)
+{
+#if (LIB_FP_SINE == LIB_FP_SINE_QUADRATIC)
+    return (lib_fp_sine_quadratic(angle));
+#else
+    return (lib_fp_sine_smallangle(angle));
+#endif
+}
+
 fixedpointnum lib_fp_cosine(fixedpointnum angle)
 {
     return (lib_fp_sine(angle + FIXEDPOINT90));
 }
 
-fixedpointnum atanlist[] = {
+void lib_fp_sincos(fixedpointnum angle, fixedpointnum * sine, fixedpointnum * cosine)
+{   // sine and cosine of the same angle in one call
+#if (LIB_FP_SINE == LIB_FP_SINE_QUADRATIC)
+    lib_fp_sincos_quadratic(angle, sine, cosine);
+#else
+    *sine = lib_fp_sine_smallangle(angle);
+    *cosine = lib_fp_sine_smallangle(angle + FIXEDPOINT90);
+#endif
+}
+
+// number of leading zero bits in x, 32 for 0.  The M0 has no clz instruction, so narrow the
+// search down to a nibble in three steps and look the nibble up.
+static const unsigned char nibbleleadingzeros[16] = { 4, 3, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+static int lib_fp_countleadingzeros(uint32_t x)
+{
+    int zeros = 0;
+    if (x < 0x10000UL) { x <<= 16; zeros += 16; }
+    if (x < 0x1000000UL) { x <<= 8; zeros += 8; }
+    if (x < 0x10000000UL) { x <<= 4; zeros += 4; }
+    return (zeros + nibbleleadingzeros[x >> 28]);
+}
+
+// starting points for reciprocals, used by lib_fp_reciprocal() and the atan2 kernels
+static const uint16_t reciprocalstartingpoint[16] = {       // =2^31/(32768+2048*x+1024)
+    63550, 59919, 56680, 53773, 51150, 48771, 46603, 44620,
+    42799, 41121, 39569, 38130, 36792, 35545, 34380, 33288
+};
+
+#if (LIB_FP_ATAN2 == LIB_FP_ATAN2_CORDIC) || defined(LIB_FP_ALL_KERNELS)
+static const fixedpointnum atanlist[] = {
     2949120L,                   // atan(2^-i), in fixedpointnum
     1740967L,
     919879L,
@@ -196,7 +311,7 @@ fixedpointnum atanlist[] = {
 // cordic arctan2 using no division!
 // http://www.coranac.com/documents/arctangent/
 
-fixedpointnum lib_fp_atan2(fixedpointnum y, fixedpointnum x)
+fixedpointnum lib_fp_atan2_cordic(fixedpointnum y, fixedpointnum x)
 {                               // returns angle from -180 to 180 degrees
     if (y == 0)
         return (x >= 0 ? 0 : FIXEDPOINT180);
@@ -243,6 +358,129 @@ fixedpointnum lib_fp_atan2(fixedpointnum y, fixedpointnum x)
     }
     return (returnvalue);
 }
+#endif
+
+#if (LIB_FP_ATAN2 != LIB_FP_ATAN2_CORDIC) || defined(LIB_FP_ALL_KERNELS)
+
+// octant flags for lib_fp_atan2reduce() and lib_fp_atan2unfold()
+#define ATAN2SWAPPED 1
+#define ATAN2XNEGATIVE 2
+#define ATAN2YNEGATIVE 4
+
+// Reduces y,x to the first octant and returns the tangent of the reduced angle (0 to 1).
+// The tangent is y/x, which is done without division: x is normalized to 16 bits, its reciprocal
+// is looked up and refined with two newton iterations, then multiplied by y.
+static fixedpointnum lib_fp_atan2reduce(fixedpointnum y, fixedpointnum x, unsigned char *octant)
+{
+    uint32_t ax = x < 0 ? -(uint32_t) x : (uint32_t) x;
+    uint32_t ay = y < 0 ? -(uint32_t) y : (uint32_t) y;
+    uint32_t tmp;
+
+    *octant = (x < 0 ? ATAN2XNEGATIVE : 0) | (y < 0 ? ATAN2YNEGATIVE : 0);
+    if (ay > ax) {
+        tmp = ax;
+        ax = ay;
+        ay = tmp;
+        *octant |= ATAN2SWAPPED;
+    }
+
+    // move the highest bit of ax to bit 15
+    int highbit = 31 - lib_fp_countleadingzeros(ax);
+    if (highbit > 15) {
+        ax >>= highbit - 15;
+        ay >>= highbit - 15;
+    } else {
+        ax <<= 15 - highbit;
+        ay <<= 15 - highbit;
+    }
+
+    // reciprocal = 2^31/ax, newton: r = r*(2-ax*r)
+    int32_t reciprocal = reciprocalstartingpoint[(ax >> 11) - 16];
+    reciprocal += (reciprocal * ((int32_t) (0x80000000UL - ax * reciprocal) >> 11)) >> 20;
+    reciprocal += (reciprocal * ((int32_t) (0x80000000UL - ax * reciprocal) >> 11)) >> 20;
+
+    tmp = (ay * (uint32_t) reciprocal) >> 15;
+    return (tmp > 0xFFFF ? 0xFFFF : tmp);
+}
+
+// Moves an angle from the first octant back to where lib_fp_atan2reduce() found it
+static fixedpointnum lib_fp_atan2unfold(fixedpointnum angle, unsigned char octant)
+{
+    if (octant & ATAN2SWAPPED)
+        angle = FIXEDPOINT90 - angle;
+    if (octant & ATAN2XNEGATIVE)
+        angle = FIXEDPOINT180 - angle;
+    if (octant & ATAN2YNEGATIVE)
+        angle = -angle;
+    return (angle);
+}
+#endif
+
+#if (LIB_FP_ATAN2 == LIB_FP_ATAN2_POLYNOMIAL) || defined(LIB_FP_ALL_KERNELS)
+// minimax fit of atan(t)*4/pi = t*(c1+c3*t^2+c5*t^4+c7*t^6+c9*t^8) for 0<=t<=1
+// fit error 0.00066 degrees, 0.005 degrees with the fixed point tangent
+#define ATAN2C1 83432L
+#define ATAN2C3 -27562L
+#define ATAN2C5 15033L
+#define ATAN2C7 -7106L
+#define ATAN2C9 1739L
+
+fixedpointnum lib_fp_atan2_polynomial(fixedpointnum y, fixedpointnum x)
+{   // returns angle from -180 to 180 degrees
+    if (y == 0)
+        return (x >= 0 ? 0 : FIXEDPOINT180);
+
+    unsigned char octant;
+    fixedpointnum t = lib_fp_atan2reduce(y, x, &octant);
+    fixedpointnum tsquared = ((uint32_t) t * (uint32_t) t) >> FIXEDPOINTSHIFT;
+
+    // all terms stay below 2^31, t and tsquared are less than one
+    fixedpointnum result = ATAN2C7 + ((ATAN2C9 * tsquared) >> FIXEDPOINTSHIFT);
+    result = ATAN2C5 + ((result * tsquared) >> FIXEDPOINTSHIFT);
+    result = ATAN2C3 + ((result * tsquared) >> FIXEDPOINTSHIFT);
+    result = ATAN2C1 + ((result * tsquared) >> FIXEDPOINTSHIFT);
+    result = ((uint32_t) result * (uint32_t) t) >> FIXEDPOINTSHIFT;
+
+    // result is in units of 45 degrees
+    return (lib_fp_atan2unfold(result * 45, octant));
+}
+#endif
+
+#if (LIB_FP_ATAN2 == LIB_FP_ATAN2_TABLE) || defined(LIB_FP_ALL_KERNELS)
+static const uint16_t atantable[33] = {     // =atan(x/32)*4/pi*32768
+    0, 1303, 2604, 3900, 5188, 6467, 7733, 8985, 10221, 11439, 12637, 13814, 14968, 16100, 17206, 18288,
+    19344, 20374, 21378, 22355, 23306, 24230, 25128, 26001, 26848, 27670, 28467, 29241, 29991, 30718, 31423, 32106,
+    32768
+};
+
+fixedpointnum lib_fp_atan2_table(fixedpointnum y, fixedpointnum x)
+{   // returns angle from -180 to 180 degrees
+    if (y == 0)
+        return (x >= 0 ? 0 : FIXEDPOINT180);
+
+    unsigned char octant;
+    fixedpointnum t = lib_fp_atan2reduce(y, x, &octant);
+
+    // 32 steps of 2048 between 0 and 1, linear interpolation between them
+    int index = t >> 11;
+    fixedpointnum fraction = t & 0x7FF;
+    fixedpointnum result = atantable[index] + (((atantable[index + 1] - atantable[index]) * fraction) >> 11);
+
+    // result is in units of 45/32768 degrees
+    return (lib_fp_atan2unfold(result * 90, octant));
+}
+#endif
+
+fixedpointnum lib_fp_atan2(fixedpointnum y, fixedpointnum x)
+{   // returns angle from -180 to 180 degrees
+#if (LIB_FP_ATAN2 == LIB_FP_ATAN2_POLYNOMIAL)
+    return (lib_fp_atan2_polynomial(y, x));
+#elif (LIB_FP_ATAN2 == LIB_FP_ATAN2_TABLE)
+    return (lib_fp_atan2_table(y, x));
+#else
+    return (lib_fp_atan2_cordic(y, x));
+#endif
+}
 
 fixedpointnum lib_fp_sqrt(fixedpointnum x)
 {
@@ -280,7 +518,7 @@ fixedpointnum lib_fp_stringtofixedpointnum(char *string)
     while (*string != '\0' && *string != '.')
         ++string;
     if (*string == '\0')
-        return (value);
+        return (negative ? -value : value);
 
     // use six digits after the decimal
     ++string;
@@ -302,55 +540,129 @@ fixedpointnum lib_fp_stringtofixedpointnum(char *string)
         return (value);
 }
 
-fixedpointnum invsqrtstartingpoint[12] = {      // =(1/((x+4.5)/16)^0.5)
-    // add 4 because range of xysquared starts at .25.
-    // add .5 to get a value in the middle of the range.
-    // 16 is the number of steps we break down into (hence the shift by 4 when calling)
-    123575L,
-    111778L,
-    102821L,
-    95721L,
-    89914L,
-    85050L,
-    80899L,
-    77302L,
-    74145L,
-    71346L,
-    68842L,
-    66584L
+// (x*y)>>32 without overflowing, from four 16 bit multiplies like lib_fp_multiply()
+static uint32_t lib_fp_multiplyhigh(uint32_t x, uint32_t y)
+{
+    uint32_t xh = x >> 16;
+    uint32_t xl = x & 0xffff;
+    uint32_t yh = y >> 16;
+    uint32_t yl = y & 0xffff;
+    uint32_t middle = xh * yl + ((xl * yl) >> 16);
+    uint32_t middle2 = xl * yh + (middle & 0xffff);
+    return (xh * yh + (middle >> 16) + (middle2 >> 16));
+}
+
+// 1/sqrt(x)-1 at x=i/32 for i=8 to 32.  1/sqrt(.25)-1=1.0 doesn't fit and is stored a bit low.
+static const uint16_t invsqrttable[25] = {
+    65535, 58040, 51698, 46243, 41484, 37285, 33545, 30185,
+    27146, 24379, 21845, 19515, 17361, 15363, 13503, 11766,
+    10138, 8610, 7170, 5811, 4525, 3306, 2149, 1049,
+    0,
 };
 
-fixedpointnum lib_fp_invsqrt(fixedpointnum x)
-{
+// 1/sqrt(x) where x and the result are both shifted fractionshift bits (an even number), for
+// lib_fp_invsqrtprecision() and lib_fp_invsqrt30().  Saturates when the result doesn't fit.
+static int32_t lib_fp_invsqrtshifted(int32_t x, int newtoniterations, int fractionshift)
+{   // The run time doesn't depend on x other than through lib_fp_countleadingzeros().
     if (x <= 0)
         return (0);
 
-    fixedpointnum y = FIXEDPOINTONE;
-    fixedpointnum xysquared = x;
-
-    // find the starting point
-    while (xysquared < FIXEDPOINTONEOVERFOUR) {
-        y = y << 1;
-        xysquared = xysquared << 2;
-    }
-    while (xysquared >= FIXEDPOINTONE) {
-        y = y >> 1;
-        xysquared = xysquared >> 2;
+    // shift x by an even number of bits so that .25 <= x < 1, shifted 30 bits.  1/sqrt(x) then gets
+    // shifted back by half as many.
+    int shift = (lib_fp_countleadingzeros(x) - 2) & ~1;
+    uint32_t x30 = shift >= 0 ? (uint32_t) x << shift : (uint32_t) x >> -shift;
+
+    // interpolate the table, which is within .13% at the low end and .01% at the high end
+    int index = (x30 >> 25) - 8;
+    uint32_t fraction = (x30 >> 14) & 0x7ff;
+    uint32_t y30 = (FIXEDPOINTONE + invsqrttable[index] - (((invsqrttable[index] - invsqrttable[index + 1]) * fraction) >> 11)) << 14;
+
+    // newton's method y=y*(3-x*y*y)/2 while x is still normalized, with 30 bits after the point
+    // so no resolution is lost.  Each iteration roughly squares the relative error.
+    while (newtoniterations-- > 0) {
+        uint32_t xysquared = lib_fp_multiplyhigh(lib_fp_multiplyhigh(x30, y30), y30);      // shifted 26 bits
+        y30 = lib_fp_multiplyhigh(y30, (3UL << 26) - xysquared) << 5;
     }
 
-    // at this point .25 <= xysquared < 1
-    // the idea is to get xysquared as close to 1 as possible.  Start by using
-    // the lookup table.
+    // undo the normalization and round.  x30 is x shifted (fractionshift+shift-30) bits, so y30 is
+    // 1/sqrt(x) shifted 30-(fractionshift+shift-30)/2 bits.
+    shift = 45 - fractionshift - ((fractionshift + shift) >> 1);
+    if (shift <= 0)
+        return (shift < 0 || y30 > 0x7fffffffUL ? 0x7fffffffL : (int32_t) y30);
+    return ((y30 + (1UL << (shift - 1))) >> shift);
+}
 
-    y = lib_fp_multiply(y, invsqrtstartingpoint[(xysquared >> (FIXEDPOINTSHIFT - 4)) - 4]);
+fixedpointnum lib_fp_invsqrtprecision(fixedpointnum x, int newtoniterations)
+{   // returns 1/sqrt(x).  See LIB_FP_INVSQRT_TABLE for the precision of each number of newton iterations.
+    return (lib_fp_invsqrtshifted(x, newtoniterations, FIXEDPOINTSHIFT));
+}
 
-    // now use newton's method to increase accuracy
-    // increase iterations if you want more accuracy
-    // this one iteration should get us to within .5% error
-    xysquared = lib_fp_multiply(y, lib_fp_multiply(x, y));
-    y = lib_fp_multiply(y, (FIXEDPOINTTHREE - xysquared)) >> 1;
-//   xysquared=lib_fp_multiply(y,lib_fp_multiply(x,y));
-//   y = lib_fp_multiply(y,(FIXEDPOINTTHREE - xysquared))>>1;
+fixedpointnum30 lib_fp_invsqrt30(fixedpointnum30 x, int newtoniterations)
+{   // returns 1/sqrt(x) for x of at least .25, saturating below that.  With LIB_FP_INVSQRT_TWONEWTON
+    // near unit lengths come out within 2 LSB.
+    return (lib_fp_invsqrtshifted(x, newtoniterations, FIXEDPOINT30SHIFT));
+}
 
-    return (y);
+fixedpointnum lib_fp_invsqrt(fixedpointnum x)
+{
+    return (lib_fp_invsqrtprecision(x, LIB_FP_INVSQRT_ONENEWTON));
+}
+
+// Returns 1/m shifted 30 bits, where m is x with its top bit moved to bit 31 (.5 <= m < 1).
+// Newton's method r=r*(2-m*r) from the middle of the table step, which is within 3%.
+// Each iteration doubles the bits, so three get to the limit of 32 bit arithmetic.
+static uint32_t lib_fp_reciprocalnormalized(uint32_t m)
+{
+    // the atan2 kernels' two newton steps on the top 16 bits get within 2^-16 using 32 bit multiplies,
+    // then one step in Q30 gets the rest
+    uint32_t m16 = m >> 16;
+    int32_t reciprocal = reciprocalstartingpoint[(m16 >> 11) - 16];
+    reciprocal += (reciprocal * ((int32_t) (0x80000000UL - m16 * reciprocal) >> 11)) >> 20;
+    reciprocal += (reciprocal * ((int32_t) (0x80000000UL - m16 * reciprocal) >> 11)) >> 20;
+    uint32_t r30 = (uint32_t) reciprocal << 15;
+    r30 = lib_fp_multiplyhigh(r30, (2UL << 30) - lib_fp_multiplyhigh(m, r30)) << 2;
+    return (r30);
+}
+
+// shifts a positive result into place, saturating if it doesn't fit
+static fixedpointnum lib_fp_shiftresult(uint32_t value, int shift, char negative)
+{
+    if (shift > 0) {
+        if (shift > 31 || value > (0x7fffffffUL >> shift))
+            value = 0x7fffffffUL;
+        else
+            value <<= shift;
+    } else if (shift < 0) {
+        value = shift < -31 ? 0 : (value + (1UL << (-shift - 1))) >> -shift;
+    }
+    return (negative ? -(fixedpointnum) value : (fixedpointnum) value);
+}
+
+fixedpointnum lib_fp_reciprocal(fixedpointnum x)
+{   // returns 1/x without a divide, the M0 doesn't have one.  The error is within 0.5 LSB plus
+    // 5e-9 of the result, so correctly rounded below 1000.  Saturates for |x| below 2^-15 and x=0.
+    if (x == 0)
+        return (0x7fffffffL);
+    uint32_t ax = x < 0 ? -(uint32_t) x : (uint32_t) x;
+    int zeros = lib_fp_countleadingzeros(ax);
+    // x=m*2^(16-zeros), so 1/x=2^(zeros-16)/m
+    return (lib_fp_shiftresult(lib_fp_reciprocalnormalized(ax << zeros), zeros - 30, x < 0));
+}
+
+fixedpointnum lib_fp_divide(fixedpointnum x, fixedpointnum y)
+{   // returns x/y using lib_fp_reciprocal()'s method with both numbers normalized, so small numbers
+    // keep their resolution.  Same error bound: 0.5 LSB plus 5e-9 of the result.  Saturates when the result doesn't fit or y=0.
+    if (x == 0)
+        return (0);
+    uint32_t ax = x < 0 ? -(uint32_t) x : (uint32_t) x;
+    uint32_t ay = y < 0 ? -(uint32_t) y : (uint32_t) y;
+    char negative = (x < 0) != (y < 0);
+    if (ay == 0)
+        return (negative ? -0x7fffffffL : 0x7fffffffL);
+
+    int xzeros = lib_fp_countleadingzeros(ax);
+    int yzeros = lib_fp_countleadingzeros(ay);
+    // x/y*2^16 = (mx*2^(32-xzeros)) / (my*2^(32-yzeros)) * 2^16, and mx*(1/my) is shifted 30 bits by lib_fp_multiplyhigh()
+    uint32_t quotient = lib_fp_multiplyhigh(ax << xzeros, lib_fp_reciprocalnormalized(ay << yzeros));
+    return (lib_fp_shiftresult(quotient, yzeros - xzeros - 14, negative));
 }
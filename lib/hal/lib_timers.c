@@ -36,6 +36,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //    lib_timers_delaymilliseconds(500) {}
 
 
+// the DWT's cycle counter, which the CMSIS here doesn't define
+#define DWT_CTRL (*(volatile uint32_t *) 0xE0001000)
+#define DWT_CYCCNT (*(volatile uint32_t *) 0xE0001004)
+#define DWT_CTRL_CYCCNTENA 1
+
 // cycles per microsecond
 static volatile uint32_t usTicks = 0;
 // current uptime for 1kHz systick timer. will rollover after 49 days. hopefully we won't care.
@@ -57,6 +62,26 @@ void lib_timers_init(void)
 
     // SysTick
     SysTick_Config(SystemCoreClock / 1000);
+
+    // the cycle counter, which needs the trace enabled
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+uint32_t lib_timers_getcycles(void)
+{
+    return (DWT_CYCCNT);
+}
+
+unsigned long lib_timers_cyclespermicrosecond(void)
+{
+    return (usTicks);
+}
+
+void lib_timers_sleep(void)
+{
+    __WFI();
 }
 
 uint32_t lib_timers_getcurrentmicroseconds(void)
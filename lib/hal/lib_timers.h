@@ -17,8 +17,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <stdint.h>
+
 void lib_timers_init(void);
 unsigned long lib_timers_starttimer(void);
 unsigned long lib_timers_gettimermicroseconds(unsigned long starttime);
 unsigned long lib_timers_gettimermicrosecondsandreset(unsigned long *starttime);
 void    lib_timers_delaymilliseconds(unsigned long delaymilliseconds);
+
+// A free running count of the CPU's cycles, for timing short stretches of code like the profiler's probes.  It
+// wraps, so only the difference between two counts means anything.
+uint32_t lib_timers_getcycles(void);
+unsigned long lib_timers_cyclespermicrosecond(void);
+
+// Sleeps the CPU until the next interrupt, which the millisecond SysTick makes a millisecond at the most.
+void lib_timers_sleep(void);
@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "accelerometer.h"
 #include "lib_fp.h"
 #include "lib_timers.h"
+#include "gyro.h"
 
 // when adding accelerometers, you need to include the following functions:
 // void initacc() // initializes the accelerometer
@@ -132,6 +133,21 @@ void initacc(void)
 
 void readacc(void)
 {
+#if (GYRO_FIFO == YES)
+    // the gyro's FIFO has the accelerometer's samples too, readgyrofifo() has averaged them
+    int16_t data[3];
+
+    readgyrofifoacc(data);
+
+    ACC_ORIENTATION(global.acc_g_vector, (data[0] >> 2) * 64L, (data[1] >> 2) * 64L, (data[2] >> 2) * 64L);
+#elif (MPU6050_COMBINED_READ == YES)
+    // readgyro() has read the accelerometer in the same transaction
+    int16_t data[3];
+
+    readgyrocombinedacc(data);
+
+    ACC_ORIENTATION(global.acc_g_vector, (data[0] >> 2) * 64L, (data[1] >> 2) * 64L, (data[2] >> 2) * 64L);
+#else
     unsigned char data[6];
 
     lib_i2c_readdata(MPU6050_ADDRESS, 0x3B, (unsigned char *) &data, 6);
@@ -142,5 +158,6 @@ void readacc(void)
         (((int16_t) ((data[0] << 8) | data[1])) >> 2) * 64L,
         (((int16_t) ((data[2] << 8) | data[3])) >> 2) * 64L,
         (((int16_t) ((data[4] << 8) | data[5])) >> 2) * 64L);
+#endif
 }
 #endif
@@ -42,6 +42,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "bradwii.h"
 #include "eeprom.h"
 #include "autotune.h"
+#include "imu.h"
 
 extern globalstruct global;
 extern usersettingsstruct usersettings;
@@ -70,7 +71,7 @@ void autotune(fixedpointnum * angleerror, unsigned char startingorstopping)
         // we aren't armed.  Don't do anything, but if autotuning is started and we have collected
         // autotuning data, save our settings to eeprom
         if (startingorstopping == AUTOTUNESTARTING && targetangle != 0)
-            writeusersettingstoeeprom();
+            CONTROLTASKWRITEUSERSETTINGS();
 
         return;
     }
@@ -89,6 +90,8 @@ void autotune(fixedpointnum * angleerror, unsigned char startingorstopping)
         return;
     }
 
+    imuupdateeulerattitude();
+
     if (startingorstopping == AUTOTUNESTARTING) {
         currentpvalueshifted = usersettings.pid_pgain[autotuneindex] << AUTOTUNESHIFT;
         currentivalueshifted = usersettings.pid_igain[autotuneindex] << AUTOTUNESHIFT;
@@ -78,6 +78,7 @@ m
 #include "serial.h"
 #include "output.h"
 #include "gyro.h"
+#include "profiler.h"
 #include "accelerometer.h"
 #include "imu.h"
 #include "baro.h"
@@ -87,6 +88,8 @@ m
 #include "navigation.h"
 #include "pilotcontrol.h"
 #include "autotune.h"
+#include "filter.h"
+#include "scheduler.h"
 
 // Data type for stick movement detection to execute accelerometer calibration
 typedef enum stickstate_tag {
@@ -95,6 +98,13 @@ typedef enum stickstate_tag {
     STICK_STATE_HIGH     // Stick was high recently
 } stickstate_t;
 
+// Keeps track of the movements of one stick
+typedef struct {
+    stickstate_t state;
+    uint8_t movecounter;     // Counts stick movements
+    uint32_t timer;          // Timeout for stick movements
+} stickmovementstruct;
+
 globalstruct global;            // global variables
 usersettingsstruct usersettings;        // user editable variables
 
@@ -120,32 +130,53 @@ fixedpointnum integratedangleerror[3];
 #define FP_RXMOVEHIGH FIXEDPOINTCONSTANT(0.2)
 
 // timesliver is a very small slice of time (.002 seconds or so).  This small value doesn't take much advantage
-// of the resolution of fixedpointnum, so we shift timesliver an extra TIMESLIVEREXTRASHIFT bits.
+// of the resolution of fixedpointnum, so timesliver is a fixedpointnum24.
 unsigned long timeslivertimer = 0;
 
+#if CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107L
+// Static to keep it off the stack
+static bool isbatterylow;         // Set to true while voltage is below limit
+static bool isadcchannelref;      // Set to true if the next ADC result is reference channel
+// Current unfiltered battery voltage [V]. Filtered value is in global.batteryvoltage
+static fixedpointnum batteryvoltage;
+// Current raw battery voltage.
+static fixedpointnum batteryvoltageraw;
+// Current raw bandgap reference voltage.
+static fixedpointnum bandgapvoltageraw;
+// Initial bandgap voltage [V]. We measure this once when there is no load on the battery
+// because the specified tolerance for this is pretty high.
+static fixedpointnum initialbandgapvoltage;
+#endif
+static bool isfailsafeactive;     // true while we don't get new data from transmitter
+#if CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107L
+// Time since the last battery voltage reading
+static unsigned long batterytimer;
+#endif
+#if (GPS_TYPE!=NO_GPS)
+// Set by gpstask() when there is a new reading, cleared by controltask() once navigation has seen it
+static unsigned char gotnewgpsreading;
+#endif
+
 // Local functions
 static void detectstickcommand(void);
 
 
 // It all starts here:
+// The host build (see lib-Host) supplies its own main() and steps the loop itself.
+#ifndef HOST_BUILD
 int main(void)
 {
-#if CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107L
-    // Static to keep it off the stack
-    static bool isbatterylow;         // Set to true while voltage is below limit
-    static bool isadcchannelref;      // Set to true if the next ADC result is reference channel
-    // Current unfiltered battery voltage [V]. Filtered value is in global.batteryvoltage
-    static fixedpointnum batteryvoltage;
-    // Current raw battery voltage.
-    static fixedpointnum batteryvoltageraw;
-    // Current raw bandgap reference voltage.
-    static fixedpointnum bandgapvoltageraw;
-    // Initial bandgap voltage [V]. We measure this once when there is no load on the battery
-    // because the specified tolerance for this is pretty high.
-    static fixedpointnum initialbandgapvoltage;
-#endif
-    static bool isfailsafeactive;     // true while we don't get new data from transmitter
+    initbradwii();
 
+    for (;;) {
+        mainloopiteration();
+    } // Endless loop
+} // main()
+#endif
+
+// Initializes the hardware and all modules. Called once before the first mainloopiteration().
+void initbradwii(void)
+{
     // initialize hardware
 	lib_hal_init();
 
@@ -204,8 +235,14 @@ int main(void)
 #endif
 #if (GPS_TYPE != NO_GPS)
     initgps();
+#endif
+#if (GYRO_SAMPLE_RATE != 0)
+    // after the other sensors are set up.  From here on the imu holds the gyro's interrupt while it reads them,
+    // or with GYRO_FIFO the gyro starts filling its FIFO.
+    startgyrosampling();
 #endif
     initimu();
+    initfilters();
 
 #if (CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107L)
     x4_set_leds(X4_LED_ALL);
@@ -228,6 +265,7 @@ int main(void)
     isadcchannelref = false;
     lib_adc_select_channel(LIB_ADC_CHAN5);
     lib_adc_startconv();
+    batterytimer = lib_timers_starttimer();
 #endif
 
     // set the default i2c speed to 400 kHz.  If a device needs to slow it down, it can, but it should set it back.
@@ -236,386 +274,493 @@ int main(void)
     global.armed = 0;
     global.navigationmode = NAVIGATIONMODEOFF;
     global.failsafetimer = lib_timers_starttimer();
+    initscheduler();
+} // initbradwii()
 
-    for (;;) {
+// One pass of the main loop: the control task and whatever housekeeping the scheduler finds due, see scheduler.c.
+void mainloopiteration(void)
+{
+    runscheduler();
+}
 
-        // check to see what switches are activated
-        checkcheckboxitems();
+// The control task: sensors, imu, pilot control, pid and mixer.
+void controltask(void)
+{
+    PROFILERENTER(PROBECONTROL);
 
-#if (MULTIWII_CONFIG_SERIAL_PORTS != NOSERIALPORT)
-        // check for config program activity
-        serialcheckforaction();
-#endif
-        calculatetimesliver();
+    // check to see what switches are activated
+    checkcheckboxitems();
 
-        // run the imu to estimate the current attitude of the aircraft
-        imucalculateestimatedattitude();
+#if (CONTROL_LOOP_INTERRUPT == YES)
+    global.timesliver = CONTROLTIMESLIVER;
+#else
+    calculatetimesliver();
+#endif
 
-        // arm and disarm via rx aux switches
-        if (global.rxvalues[THROTTLEINDEX] < FPSTICKLOW) {      // see if we want to change armed modes
-            if (!global.armed) {
-                if (global.activecheckboxitems & CHECKBOXMASKARM) {
-                    global.armed = 1;
-#if (GPS_TYPE!=NO_GPS)
-                    navigation_sethometocurrentlocation();
-#endif
-                    global.heading_when_armed = global.currentestimatedeulerattitude[YAWINDEX];
-                    global.altitude_when_armed = global.barorawaltitude;
-                }
-            } else if (!(global.activecheckboxitems & CHECKBOXMASKARM))
-                global.armed = 0;
-        } // if throttle low
-
-        if(!global.armed) {
-            // Not armed: check if there is a stick command to execute.
-            detectstickcommand();
-        }
+    // run the imu to estimate the current attitude of the aircraft
+    PROFILERENTER(PROBEIMU);
+    imucalculateestimatedattitude();
+    PROFILEREXIT(PROBEIMU);
+#ifdef GYRO_FILTERS
+    // the imu has used the raw rates, everything after it gets the filtered ones
+    filtergyrorates();
+#endif
 
+    // arm and disarm via rx aux switches
+    if (global.rxvalues[THROTTLEINDEX] < FPSTICKLOW) {      // see if we want to change armed modes
+        if (!global.armed) {
+            if ((global.activecheckboxitems & CHECKBOXMASKARM) && global.gyrocalibrated
+#if (ACC_SIX_POSITION_CALIBRATION == YES)
+                // not while the six position calibration has the acc readings raw
+                && accsixpositioninfo.state != ACCSIXPOSITIONCOLLECTING && accsixpositioninfo.state != ACCSIXPOSITIONSOLVING
+#endif
+                ) {
+                global.armed = 1;
 #if (GPS_TYPE!=NO_GPS)
-        // turn on or off navigation when appropriate
-        if (global.navigationmode == NAVIGATIONMODEOFF) {
-            if (global.activecheckboxitems & CHECKBOXMASKRETURNTOHOME)  // return to home switch turned on
-            {
-                navigation_set_destination(global.gps_home_latitude, global.gps_home_longitude);
-                global.navigationmode = NAVIGATIONMODERETURNTOHOME;
-            } else if (global.activecheckboxitems & CHECKBOXMASKPOSITIONHOLD)   // position hold turned on
-            {
-                navigation_set_destination(global.gps_current_latitude, global.gps_current_longitude);
-                global.navigationmode = NAVIGATIONMODEPOSITIONHOLD;
-            }
-        } else                  // we are currently navigating
-        {                       // turn off navigation if desired
-            if ((global.navigationmode == NAVIGATIONMODERETURNTOHOME && !(global.activecheckboxitems & CHECKBOXMASKRETURNTOHOME))
-                ||(global.navigationmode == NAVIGATIONMODEPOSITIONHOLD && !(global.activecheckboxitems & CHECKBOXMASKPOSITIONHOLD))) {
-                global.navigationmode = NAVIGATIONMODEOFF;
-
-                // we will be turning control back over to the pilot.
-                resetpilotcontrol();
+                navigation_sethometocurrentlocation();
+#endif
+                imuupdateeulerattitude();
+                global.heading_when_armed = global.currentestimatedeulerattitude[YAWINDEX];
+                global.altitude_when_armed = global.barorawaltitude;
             }
-        }
+        } else if (!(global.activecheckboxitems & CHECKBOXMASKARM))
+            global.armed = 0;
+    } // if throttle low
+
+    if(!global.armed) {
+        // Not armed: check if there is a stick command to execute.
+        detectstickcommand();
+    }
+#if (ACC_SIX_POSITION_CALIBRATION == YES)
+    accsixpositioncalibrationstep();
 #endif
 
-        // read the receiver
-        readrx();
+#if (GPS_TYPE!=NO_GPS)
+    // turn on or off navigation when appropriate
+    if (global.navigationmode == NAVIGATIONMODEOFF) {
+        if (global.activecheckboxitems & CHECKBOXMASKRETURNTOHOME)  // return to home switch turned on
+        {
+            navigation_set_destination(global.gps_home_latitude, global.gps_home_longitude);
+            global.navigationmode = NAVIGATIONMODERETURNTOHOME;
+        } else if (global.activecheckboxitems & CHECKBOXMASKPOSITIONHOLD)   // position hold turned on
+        {
+            navigation_set_destination(global.gps_current_latitude, global.gps_current_longitude);
+            global.navigationmode = NAVIGATIONMODEPOSITIONHOLD;
+        }
+    } else                  // we are currently navigating
+    {                       // turn off navigation if desired
+        if ((global.navigationmode == NAVIGATIONMODERETURNTOHOME && !(global.activecheckboxitems & CHECKBOXMASKRETURNTOHOME))
+            ||(global.navigationmode == NAVIGATIONMODEPOSITIONHOLD && !(global.activecheckboxitems & CHECKBOXMASKPOSITIONHOLD))) {
+            global.navigationmode = NAVIGATIONMODEOFF;
 
-        // Hubsan X4 has its own LED management
-#if (CONTROL_BOARD_TYPE != CONTROL_BOARD_HUBSAN_H107L)
-        // turn on the LED when we are stable and the gps has 5 satellites or more
-#if (GPS_TYPE==NO_GPS)
-        lib_digitalio_setoutput(LED1_OUTPUT, (global.stable == 0) ? (!LED1_ON) : LED1_ON);
-#else
-        lib_digitalio_setoutput(LED1_OUTPUT, (!(global.stable && global.gps_num_satelites >= 5)) == LED1_ON);
+            // we will be turning control back over to the pilot.
+            resetpilotcontrol();
+        }
+    }
 #endif
-#endif // Not Hubsan
 
-        // get the angle error.  Angle error is the difference between our current attitude and our desired attitude.
-        // It can be set by navigation, or by the pilot, etc.
-        fixedpointnum angleerror[3];
+    // get the angle error.  Angle error is the difference between our current attitude and our desired attitude.
+    // It can be set by navigation, or by the pilot, etc.
+    fixedpointnum angleerror[3];
 
-        // let the pilot control the aircraft.
-        getangleerrorfrompilotinput(angleerror);
+    // let the pilot control the aircraft.
+    PROFILERENTER(PROBEPILOT);
+    getangleerrorfrompilotinput(angleerror);
+    PROFILEREXIT(PROBEPILOT);
 
 #if (GPS_TYPE!=NO_GPS)
-        // read the gps
-        unsigned char gotnewgpsreading = readgps();
-
-        // if we are navigating, use navigation to determine our desired attitude (tilt angles)
-        if (global.navigationmode != NAVIGATIONMODEOFF) {       // we are navigating
-            navigation_setangleerror(gotnewgpsreading, angleerror);
-        }
+    // if we are navigating, use navigation to determine our desired attitude (tilt angles)
+    if (global.navigationmode != NAVIGATIONMODEOFF) {       // we are navigating
+        navigation_setangleerror(gotnewgpsreading, angleerror);
+    }
 #endif
 
-        if (global.rxvalues[THROTTLEINDEX] < FPSTICKLOW) {
-            // We are probably on the ground. Don't accumnulate error when we can't correct it
-            resetpilotcontrol();
+    if (global.rxvalues[THROTTLEINDEX] < FPSTICKLOW) {
+        // We are probably on the ground. Don't accumnulate error when we can't correct it
+        resetpilotcontrol();
 
-            // bleed off integrated error by averaging in a value of zero
-            lib_fp_lowpassfilter(&integratedangleerror[ROLLINDEX], 0L, global.timesliver >> TIMESLIVEREXTRASHIFT, FIXEDPOINTONEOVERONEFOURTH, 0);
-            lib_fp_lowpassfilter(&integratedangleerror[PITCHINDEX], 0L, global.timesliver >> TIMESLIVEREXTRASHIFT, FIXEDPOINTONEOVERONEFOURTH, 0);
-            lib_fp_lowpassfilter(&integratedangleerror[YAWINDEX], 0L, global.timesliver >> TIMESLIVEREXTRASHIFT, FIXEDPOINTONEOVERONEFOURTH, 0);
-        }
+        // bleed off integrated error by averaging in a value of zero
+        lib_fp_lowpassfilterinline(&integratedangleerror[ROLLINDEX], 0L, global.timesliver >> TIMESLIVEREXTRASHIFT, FIXEDPOINTONEOVERONEFOURTH, 0);
+        lib_fp_lowpassfilterinline(&integratedangleerror[PITCHINDEX], 0L, global.timesliver >> TIMESLIVEREXTRASHIFT, FIXEDPOINTONEOVERONEFOURTH, 0);
+        lib_fp_lowpassfilterinline(&integratedangleerror[YAWINDEX], 0L, global.timesliver >> TIMESLIVEREXTRASHIFT, FIXEDPOINTONEOVERONEFOURTH, 0);
+    }
 #ifndef NO_AUTOTUNE
-        // let autotune adjust the angle error if the pilot has autotune turned on
-        if (global.activecheckboxitems & CHECKBOXMASKAUTOTUNE) {
-            if (!(global.previousactivecheckboxitems & CHECKBOXMASKAUTOTUNE))
-                autotune(angleerror, AUTOTUNESTARTING); // tell autotune that we just started autotuning
-            else
-                autotune(angleerror, AUTOTUNETUNING);   // tell autotune that we are in the middle of autotuning
-        } else if (global.previousactivecheckboxitems & CHECKBOXMASKAUTOTUNE)
-            autotune(angleerror, AUTOTUNESTOPPING);     // tell autotune that we just stopped autotuning
+    // let autotune adjust the angle error if the pilot has autotune turned on
+    if (global.activecheckboxitems & CHECKBOXMASKAUTOTUNE) {
+        if (!(global.previousactivecheckboxitems & CHECKBOXMASKAUTOTUNE))
+            autotune(angleerror, AUTOTUNESTARTING); // tell autotune that we just started autotuning
+        else
+            autotune(angleerror, AUTOTUNETUNING);   // tell autotune that we are in the middle of autotuning
+    } else if (global.previousactivecheckboxitems & CHECKBOXMASKAUTOTUNE)
+        autotune(angleerror, AUTOTUNESTOPPING);     // tell autotune that we just stopped autotuning
 #endif
 
-        // get the pilot's throttle component
-        // convert from fixedpoint -1 to 1 to fixedpoint 0 to 1
-        fixedpointnum throttleoutput = (global.rxvalues[THROTTLEINDEX] >> 1) + FIXEDPOINTONEOVERTWO + FPTHROTTLETOMOTOROFFSET;
+    // get the pilot's throttle component
+    // convert from fixedpoint -1 to 1 to fixedpoint 0 to 1
+    fixedpointnum throttleoutput = (global.rxvalues[THROTTLEINDEX] >> 1) + FIXEDPOINTONEOVERTWO + FPTHROTTLETOMOTOROFFSET;
 
-        // keep a flag to indicate whether we shoud apply altitude hold.  The pilot can turn it on or
-        // uncrashability mode can turn it on.
-        unsigned char altitudeholdactive = 0;
+    // keep a flag to indicate whether we shoud apply altitude hold.  The pilot can turn it on or
+    // uncrashability mode can turn it on.
+    unsigned char altitudeholdactive = 0;
 
-        if (global.activecheckboxitems & CHECKBOXMASKALTHOLD) {
-            altitudeholdactive = 1;
-            if (!(global.previousactivecheckboxitems & CHECKBOXMASKALTHOLD)) {  // we just turned on alt hold.  Remember our current alt. as our target
-                altitudeholddesiredaltitude = global.altitude;
-                integratedaltitudeerror = 0;
-            }
+    if (global.activecheckboxitems & CHECKBOXMASKALTHOLD) {
+        altitudeholdactive = 1;
+        if (!(global.previousactivecheckboxitems & CHECKBOXMASKALTHOLD)) {  // we just turned on alt hold.  Remember our current alt. as our target
+            altitudeholddesiredaltitude = global.altitude;
+            integratedaltitudeerror = 0;
         }
+    }
 
-        // uncrashability mode
+    // uncrashability mode
 #define UNCRASHABLELOOKAHEADTIME FIXEDPOINTONE  // look ahead one second to see if we are going to be at a bad altitude
 #define UNCRASHABLERECOVERYANGLE FIXEDPOINTCONSTANT(15) // don't let the pilot pitch or roll more than 20 degrees when altitude is too low.
 #define FPUNCRASHABLE_RADIUS FIXEDPOINTCONSTANT(UNCRAHSABLE_RADIUS)
 #define FPUNCRAHSABLE_MAX_ALTITUDE_OFFSET FIXEDPOINTCONSTANT(UNCRAHSABLE_MAX_ALTITUDE_OFFSET)
 #if (GPS_TYPE!=NO_GPS)
-        // keep a flag that tells us whether uncrashability is doing gps navigation or not
-        static unsigned char doinguncrashablenavigationflag;
+    // keep a flag that tells us whether uncrashability is doing gps navigation or not
+    static unsigned char doinguncrashablenavigationflag;
 #endif
-        // we need a place to remember what the altitude was when uncrashability mode was turned on
-        static fixedpointnum uncrasabilityminimumaltitude;
-        static fixedpointnum uncrasabilitydesiredaltitude;
-        static unsigned char doinguncrashablealtitudehold = 0;
-
-        if (global.activecheckboxitems & CHECKBOXMASKUNCRASHABLE)       // uncrashable mode
-        {
-            // First, check our altitude
-            // are we about to crash?
-            if (!(global.previousactivecheckboxitems & CHECKBOXMASKUNCRASHABLE)) {      // we just turned on uncrashability.  Remember our current altitude as our new minimum altitude.
-                uncrasabilityminimumaltitude = global.altitude;
+    // we need a place to remember what the altitude was when uncrashability mode was turned on
+    static fixedpointnum uncrasabilityminimumaltitude;
+    static fixedpointnum uncrasabilitydesiredaltitude;
+    static unsigned char doinguncrashablealtitudehold = 0;
+
+    if (global.activecheckboxitems & CHECKBOXMASKUNCRASHABLE)       // uncrashable mode
+    {
+        // First, check our altitude
+        // are we about to crash?
+        if (!(global.previousactivecheckboxitems & CHECKBOXMASKUNCRASHABLE)) {      // we just turned on uncrashability.  Remember our current altitude as our new minimum altitude.
+            uncrasabilityminimumaltitude = global.altitude;
 #if (GPS_TYPE!=NO_GPS)
-                doinguncrashablenavigationflag = 0;
-                // set this location as our new home
-                navigation_sethometocurrentlocation();
+            doinguncrashablenavigationflag = 0;
+            // set this location as our new home
+            navigation_sethometocurrentlocation();
 #endif
-            }
-            // calculate our projected altitude based on how fast our altitude is changing
-            fixedpointnum projectedaltitude = global.altitude + lib_fp_multiply(global.altitudevelocity, UNCRASHABLELOOKAHEADTIME);
+        }
+        // calculate our projected altitude based on how fast our altitude is changing
+        fixedpointnum projectedaltitude = global.altitude + lib_fp_multiply(global.altitudevelocity, UNCRASHABLELOOKAHEADTIME);
 
-            if (projectedaltitude > uncrasabilityminimumaltitude + FPUNCRAHSABLE_MAX_ALTITUDE_OFFSET) { // we are getting too high
-                // Use Altitude Hold to bring us back to the maximum altitude.
-                altitudeholddesiredaltitude = uncrasabilityminimumaltitude + FPUNCRAHSABLE_MAX_ALTITUDE_OFFSET;
+        if (projectedaltitude > uncrasabilityminimumaltitude + FPUNCRAHSABLE_MAX_ALTITUDE_OFFSET) { // we are getting too high
+            // Use Altitude Hold to bring us back to the maximum altitude.
+            altitudeholddesiredaltitude = uncrasabilityminimumaltitude + FPUNCRAHSABLE_MAX_ALTITUDE_OFFSET;
+            integratedaltitudeerror = 0;
+            altitudeholdactive = 1;
+        } else if (projectedaltitude < uncrasabilityminimumaltitude) {      // We are about to get below our minimum crashability altitude
+            if (doinguncrashablealtitudehold == 0) {        // if we just entered uncrashability, set our desired altitude to the current altitude
+                uncrasabilitydesiredaltitude = global.altitude;
                 integratedaltitudeerror = 0;
+                doinguncrashablealtitudehold = 1;
+            }
+            // don't apply throttle until we are almost level
+            if (global.estimateddownvector[ZINDEX] > FIXEDPOINT30CONSTANT(.4)) {
+                altitudeholddesiredaltitude = uncrasabilitydesiredaltitude;
                 altitudeholdactive = 1;
-            } else if (projectedaltitude < uncrasabilityminimumaltitude) {      // We are about to get below our minimum crashability altitude
-                if (doinguncrashablealtitudehold == 0) {        // if we just entered uncrashability, set our desired altitude to the current altitude
-                    uncrasabilitydesiredaltitude = global.altitude;
-                    integratedaltitudeerror = 0;
-                    doinguncrashablealtitudehold = 1;
-                }
-                // don't apply throttle until we are almost level
-                if (global.estimateddownvector[ZINDEX] > FIXEDPOINTCONSTANT(.4)) {
-                    altitudeholddesiredaltitude = uncrasabilitydesiredaltitude;
-                    altitudeholdactive = 1;
-                } else
-                    throttleoutput = 0; // we are trying to rotate to level, kill the throttle until we get there
-
-                // make sure we are level!  Don't let the pilot command more than UNCRASHABLERECOVERYANGLE
-                lib_fp_constrain(&angleerror[ROLLINDEX], -UNCRASHABLERECOVERYANGLE - global.currentestimatedeulerattitude[ROLLINDEX], UNCRASHABLERECOVERYANGLE - global.currentestimatedeulerattitude[ROLLINDEX]);
-                lib_fp_constrain(&angleerror[PITCHINDEX], -UNCRASHABLERECOVERYANGLE - global.currentestimatedeulerattitude[PITCHINDEX], UNCRASHABLERECOVERYANGLE - global.currentestimatedeulerattitude[PITCHINDEX]);
             } else
-                doinguncrashablealtitudehold = 0;
+                throttleoutput = 0; // we are trying to rotate to level, kill the throttle until we get there
+
+            // make sure we are level!  Don't let the pilot command more than UNCRASHABLERECOVERYANGLE
+            imuupdateeulerattitude();
+            lib_fp_constrain(&angleerror[ROLLINDEX], -UNCRASHABLERECOVERYANGLE - global.currentestimatedeulerattitude[ROLLINDEX], UNCRASHABLERECOVERYANGLE - global.currentestimatedeulerattitude[ROLLINDEX]);
+            lib_fp_constrain(&angleerror[PITCHINDEX], -UNCRASHABLERECOVERYANGLE - global.currentestimatedeulerattitude[PITCHINDEX], UNCRASHABLERECOVERYANGLE - global.currentestimatedeulerattitude[PITCHINDEX]);
+        } else
+            doinguncrashablealtitudehold = 0;
 
 #if (GPS_TYPE!=NO_GPS)
-            // Next, check to see if our GPS says we are out of bounds
-            // are we out of bounds?
-            fixedpointnum bearingfromhome;
-            fixedpointnum distancefromhome = navigation_getdistanceandbearing(global.gps_current_latitude, global.gps_current_longitude, global.gps_home_latitude, global.gps_home_longitude, &bearingfromhome);
-
-            if (distancefromhome > FPUNCRASHABLE_RADIUS) {      // we are outside the allowable area, navigate back toward home
-                if (!doinguncrashablenavigationflag) {  // we just started navigating, so we have to set the destination
-                    navigation_set_destination(global.gps_home_latitude, global.gps_home_longitude);
-                    doinguncrashablenavigationflag = 1;
-                }
-                // Let the navigation figure out our roll and pitch attitudes
-                navigation_setangleerror(gotnewgpsreading, angleerror);
-            } else
-                doinguncrashablenavigationflag = 0;
+        // Next, check to see if our GPS says we are out of bounds
+        // are we out of bounds?
+        fixedpointnum bearingfromhome;
+        fixedpointnum distancefromhome = navigation_getdistanceandbearing(global.gps_current_latitude, global.gps_current_longitude, global.gps_home_latitude, global.gps_home_longitude, &bearingfromhome);
+
+        if (distancefromhome > FPUNCRASHABLE_RADIUS) {      // we are outside the allowable area, navigate back toward home
+            if (!doinguncrashablenavigationflag) {  // we just started navigating, so we have to set the destination
+                navigation_set_destination(global.gps_home_latitude, global.gps_home_longitude);
+                doinguncrashablenavigationflag = 1;
+            }
+            // Let the navigation figure out our roll and pitch attitudes
+            navigation_setangleerror(gotnewgpsreading, angleerror);
+        } else
+            doinguncrashablenavigationflag = 0;
 #endif
-        }
+    }
 #if (GPS_TYPE!=NO_GPS)
-        else
-            doinguncrashablenavigationflag = 0;
+    else
+        doinguncrashablenavigationflag = 0;
 #endif
 
 #if (BAROMETER_TYPE!=NO_BAROMETER)
-        // check for altitude hold and adjust the throttle output accordingly
-        if (altitudeholdactive) {
-            integratedaltitudeerror += lib_fp_multiply(altitudeholddesiredaltitude - global.altitude, global.timesliver);
-            lib_fp_constrain(&integratedaltitudeerror, -INTEGRATEDANGLEERRORLIMIT, INTEGRATEDANGLEERRORLIMIT);  // don't let the integrated error get too high
+    // check for altitude hold and adjust the throttle output accordingly
+    if (altitudeholdactive) {
+        integratedaltitudeerror += lib_fp_multiply(altitudeholddesiredaltitude - global.altitude, global.timesliver);
+        lib_fp_constrain(&integratedaltitudeerror, -INTEGRATEDANGLEERRORLIMIT, INTEGRATEDANGLEERRORLIMIT);  // don't let the integrated error get too high
 
-            // do pid for the altitude hold and add it to the throttle output
-            throttleoutput += lib_fp_multiply(altitudeholddesiredaltitude - global.altitude, usersettings.pid_pgain[ALTITUDEINDEX])
-            - lib_fp_multiply(global.altitudevelocity, usersettings.pid_dgain[ALTITUDEINDEX])
-            + lib_fp_multiply(integratedaltitudeerror, usersettings.pid_igain[ALTITUDEINDEX]);
+        // do pid for the altitude hold and add it to the throttle output
+        throttleoutput += lib_fp_multiply(altitudeholddesiredaltitude - global.altitude, usersettings.pid_pgain[ALTITUDEINDEX])
+        - lib_fp_multiply(global.altitudevelocity, usersettings.pid_dgain[ALTITUDEINDEX])
+        + lib_fp_multiply(integratedaltitudeerror, usersettings.pid_igain[ALTITUDEINDEX]);
 
-        }
+    }
 #endif
-        if ((global.activecheckboxitems & CHECKBOXMASKAUTOTHROTTLE) ||altitudeholdactive) {
-            // Auto Throttle Adjust - Increases the throttle when the aircraft is tilted so that the vertical
-            // component of thrust remains constant.
-            // The AUTOTHROTTLEDEADAREA adjusts the value at which the throttle starts taking effect.  If this
-            // value is too low, the aircraft will gain altitude when banked, if it's too low, it will lose
-            // altitude when banked. Adjust to suit.
+    if ((global.activecheckboxitems & CHECKBOXMASKAUTOTHROTTLE) ||altitudeholdactive) {
+        // Auto Throttle Adjust - Increases the throttle when the aircraft is tilted so that the vertical
+        // component of thrust remains constant.
+        // The AUTOTHROTTLEDEADAREA adjusts the value at which the throttle starts taking effect.  If this
+        // value is too low, the aircraft will gain altitude when banked, if it's too low, it will lose
+        // altitude when banked. Adjust to suit.
 #define AUTOTHROTTLEDEADAREA FIXEDPOINTCONSTANT(.25)
 
-            if (global.estimateddownvector[ZINDEX] > FIXEDPOINTCONSTANT(.3)) {
-                // Divide the throttle by the throttleoutput by the z component of the down vector
-                // This is probaly the slow way, but it's a way to do fixed point division
-                fixedpointnum recriprocal = lib_fp_invsqrt(global.estimateddownvector[ZINDEX]);
-                recriprocal = lib_fp_multiply(recriprocal, recriprocal);
+        if (global.estimateddownvector[ZINDEX] > FIXEDPOINT30CONSTANT(.3)) {
+            // Divide the throttle by the throttleoutput by the z component of the down vector
+            fixedpointnum recriprocal = lib_fp_reciprocal(FIXEDPOINT30TOFIXEDPOINT(global.estimateddownvector[ZINDEX]));
 
-                throttleoutput = lib_fp_multiply(throttleoutput - AUTOTHROTTLEDEADAREA, recriprocal) + AUTOTHROTTLEDEADAREA;
-            }
-        }
-        // if we don't hear from the receiver for over a second, try to land safely
-        if (lib_timers_gettimermicroseconds(global.failsafetimer) > 1000000L) {
-            throttleoutput = FPFAILSAFEMOTOROUTPUT;
-            isfailsafeactive = true;
-
-            // make sure we are level!
-            angleerror[ROLLINDEX] = -global.currentestimatedeulerattitude[ROLLINDEX];
-            angleerror[PITCHINDEX] = -global.currentestimatedeulerattitude[PITCHINDEX];
+            throttleoutput = lib_fp_multiply(throttleoutput - AUTOTHROTTLEDEADAREA, recriprocal) + AUTOTHROTTLEDEADAREA;
         }
-        else
-            isfailsafeactive = false;
+    }
+    // if we don't hear from the receiver for over a second, try to land safely
+    if (lib_timers_gettimermicroseconds(global.failsafetimer) > 1000000L) {
+        throttleoutput = FPFAILSAFEMOTOROUTPUT;
+        isfailsafeactive = true;
+
+        // make sure we are level!
+        imuupdateeulerattitude();
+        angleerror[ROLLINDEX] = -global.currentestimatedeulerattitude[ROLLINDEX];
+        angleerror[PITCHINDEX] = -global.currentestimatedeulerattitude[PITCHINDEX];
+    }
+    else
+        isfailsafeactive = false;
 
-        // calculate output values.  Output values will range from 0 to 1.0
+    // calculate output values.  Output values will range from 0 to 1.0
 
-        // calculate pid outputs based on our angleerrors as inputs
-        fixedpointnum pidoutput[3];
+    // calculate pid outputs based on our angleerrors as inputs
+    PROFILERENTER(PROBEPID);
+    fixedpointnum pidoutput[3];
 
-        // Gain Scheduling essentialy modifies the gains depending on
-        // throttle level. If GAIN_SCHEDULING_FACTOR is 1.0, it multiplies PID outputs by 1.5 when at full throttle,
-        // 1.0 when at mid throttle, and .5 when at zero throttle.  This helps
-        // eliminate the wobbles when decending at low throttle.
-        fixedpointnum gainschedulingmultiplier = lib_fp_multiply(throttleoutput - FIXEDPOINTCONSTANT(.5), FIXEDPOINTCONSTANT(GAIN_SCHEDULING_FACTOR)) + FIXEDPOINTONE;
+    // Gain Scheduling essentialy modifies the gains depending on
+    // throttle level. If GAIN_SCHEDULING_FACTOR is 1.0, it multiplies PID outputs by 1.5 when at full throttle,
+    // 1.0 when at mid throttle, and .5 when at zero throttle.  This helps
+    // eliminate the wobbles when decending at low throttle.
+    fixedpointnum gainschedulingmultiplier = lib_fp_multiply(throttleoutput - FIXEDPOINTCONSTANT(.5), FIXEDPOINTCONSTANT(GAIN_SCHEDULING_FACTOR)) + FIXEDPOINTONE;
 
-        for (int x = 0; x < 3; ++x) {
-            integratedangleerror[x] += lib_fp_multiply(angleerror[x], global.timesliver);
+    for (int x = 0; x < 3; ++x) {
+        integratedangleerror[x] += lib_fp_multiply(angleerror[x], global.timesliver);
 
-            // don't let the integrated error get too high (windup)
-            lib_fp_constrain(&integratedangleerror[x], -INTEGRATEDANGLEERRORLIMIT, INTEGRATEDANGLEERRORLIMIT);
+        // don't let the integrated error get too high (windup)
+        lib_fp_constrain(&integratedangleerror[x], -INTEGRATEDANGLEERRORLIMIT, INTEGRATEDANGLEERRORLIMIT);
 
-            // do the attitude pid
-            pidoutput[x] = lib_fp_multiply(angleerror[x], usersettings.pid_pgain[x])
-                - lib_fp_multiply(global.gyrorate[x], usersettings.pid_dgain[x])
-            + (lib_fp_multiply(integratedangleerror[x], usersettings.pid_igain[x]) >> 4);
+        // do the attitude pid
+#ifdef DTERM_FILTERS
+        fixedpointnum dtermrate = filterdtermrate(x, global.gyrorate[x]);
+#else
+        fixedpointnum dtermrate = global.gyrorate[x];
+#endif
+        pidoutput[x] = lib_fp_multiply(angleerror[x], usersettings.pid_pgain[x])
+            - lib_fp_multiply(dtermrate, usersettings.pid_dgain[x])
+        + (lib_fp_multiply(integratedangleerror[x], usersettings.pid_igain[x]) >> 4);
 
-            // add gain scheduling.  
-            pidoutput[x] = lib_fp_multiply(gainschedulingmultiplier, pidoutput[x]);
-        }
+        // add gain scheduling.  
+        pidoutput[x] = lib_fp_multiply(gainschedulingmultiplier, pidoutput[x]);
+    }
 
 #if (CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107L)
 		// On Hubsan X4 H107L the front right motor
 		// rotates clockwise (viewed from top).
 		// On the J385 the motors spin in the opposite direction.
 		// PID output for yaw has to be reversed
-        pidoutput[YAWINDEX] = -pidoutput[YAWINDEX];
+    pidoutput[YAWINDEX] = -pidoutput[YAWINDEX];
 #endif
 
-        lib_fp_constrain(&throttleoutput, 0, FIXEDPOINTONE);
+    lib_fp_constrain(&throttleoutput, 0, FIXEDPOINTONE);
 
-        // set the final motor outputs
-        // if we aren't armed, or if we desire to have the motors stop, 
-        if (!global.armed
+    // set the final motor outputs
+    // if we aren't armed, or if we desire to have the motors stop, 
+    if (!global.armed
 #if (MOTORS_STOP==YES)
-            || (global.rxvalues[THROTTLEINDEX] < FPSTICKLOW && !(global.activecheckboxitems & (CHECKBOXMASKFULLACRO | CHECKBOXMASKSEMIACRO)))
+        || (global.rxvalues[THROTTLEINDEX] < FPSTICKLOW && !(global.activecheckboxitems & (CHECKBOXMASKFULLACRO | CHECKBOXMASKSEMIACRO)))
 #endif
-            )
-            setallmotoroutputs(MIN_MOTOR_OUTPUT);
-        else {
-            // mix the outputs to create motor values
+        )
+        setallmotoroutputs(MIN_MOTOR_OUTPUT);
+    else {
+        // mix the outputs to create motor values
 #if (AIRCRAFT_CONFIGURATION==QUADX)
-            setmotoroutput(0, 0, throttleoutput - pidoutput[ROLLINDEX] + pidoutput[PITCHINDEX] - pidoutput[YAWINDEX]);
-            setmotoroutput(1, 1, throttleoutput - pidoutput[ROLLINDEX] - pidoutput[PITCHINDEX] + pidoutput[YAWINDEX]);
-            setmotoroutput(2, 2, throttleoutput + pidoutput[ROLLINDEX] + pidoutput[PITCHINDEX] + pidoutput[YAWINDEX]);
-            setmotoroutput(3, 3, throttleoutput + pidoutput[ROLLINDEX] - pidoutput[PITCHINDEX] - pidoutput[YAWINDEX]);
+        setmotoroutput(0, 0, throttleoutput - pidoutput[ROLLINDEX] + pidoutput[PITCHINDEX] - pidoutput[YAWINDEX]);
+        setmotoroutput(1, 1, throttleoutput - pidoutput[ROLLINDEX] - pidoutput[PITCHINDEX] + pidoutput[YAWINDEX]);
+        setmotoroutput(2, 2, throttleoutput + pidoutput[ROLLINDEX] + pidoutput[PITCHINDEX] + pidoutput[YAWINDEX]);
+        setmotoroutput(3, 3, throttleoutput + pidoutput[ROLLINDEX] - pidoutput[PITCHINDEX] - pidoutput[YAWINDEX]);
 #endif // QUADX config
-        }
+    }
+    PROFILEREXIT(PROBEPID);
+#if (GPS_TYPE!=NO_GPS)
+    gotnewgpsreading = 0;
+#endif
+    PROFILEREXIT(PROBECONTROL);
+} // controltask()
+
+#if (GPS_TYPE!=NO_GPS)
+// The gps task: reads the gps, navigation uses the reading in the next control task.
+void gpstask(void)
+{
+    if (readgps())
+        gotnewgpsreading = 1;
+}
+#endif
 
 #if (CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107L)
-        // Measure battery voltage
-        if(!lib_adc_is_busy())
-        {
-            // What did we just measure?
-            // Always alternate between reference channel
-            // and battery voltage
-            if(isadcchannelref) {
-                bandgapvoltageraw = lib_adc_read_raw();
-                isadcchannelref = false;
-                lib_adc_select_channel(LIB_ADC_CHAN5);
-            } else {
-                batteryvoltageraw = lib_adc_read_raw();
-                isadcchannelref = true;
-                lib_adc_select_channel(LIB_ADC_CHANREF);
-
-                // Unfortunately we have to use fixed point division now
-                batteryvoltage = (batteryvoltageraw << 12) / (bandgapvoltageraw >> (FIXEDPOINTSHIFT-12));
-                // Now we have battery voltage relative to bandgap reference voltage.
-                // Multiply by initially measured bandgap voltage to get the voltage at the ADC pin.
-                batteryvoltage = lib_fp_multiply(batteryvoltage, initialbandgapvoltage);
-                // Now take the voltage divider into account to get battery voltage.
-                batteryvoltage = lib_fp_multiply(batteryvoltage, FP_BATTERY_VOLTAGE_FACTOR);
-
-                // Since we measure under load, the voltage is not stable.
-                // Apply 0.5 second lowpass filter.
-                // Use constant FIXEDPOINTONEOVERONEFOURTH instead of FIXEDPOINTONEOVERONEHALF
-                // Because we call this only every other iteration.
-                // (...alternatively multiply global.timesliver by two).
-                lib_fp_lowpassfilter(&(global.batteryvoltage), batteryvoltage, global.timesliver, FIXEDPOINTONEOVERONEFOURTH, TIMESLIVEREXTRASHIFT);
-                // Update state of isbatterylow flag.
-                if(global.batteryvoltage < FP_BATTERY_UNDERVOLTAGE_LIMIT)
-                    isbatterylow = true;
-                else
-                    isbatterylow = false;
-            }
-            // Start next conversion
-            lib_adc_startconv();
-        } // IF ADC result available
-
-        // Decide what LEDs have to show
-        if(isbatterylow) {
-            // Highest priority: Battery voltage
-            // Blink all LEDs slow
-            if(lib_timers_gettimermicroseconds(0) % 500000 > 250000)
-                x4_set_leds(X4_LED_ALL);
-            else
-                x4_set_leds(X4_LED_NONE);
-        }
-        else if(isfailsafeactive) {
-            // Lost contact with TX
-            // Blink LEDs fast alternating
-            if(lib_timers_gettimermicroseconds(0) % 250000 > 120000)
-                x4_set_leds(X4_LED_FR | X4_LED_RL);
-            else
-                x4_set_leds(X4_LED_FL | X4_LED_RR);
-        }
-        else if(!global.armed) {
-            // Not armed
-            // Short blinks
-            if(lib_timers_gettimermicroseconds(0) % 500000 > 450000)
-                x4_set_leds(X4_LED_ALL);
+// The battery task: alternately reads the battery voltage and the bandgap reference.
+void batterytask(void)
+{
+    PROFILERENTER(PROBEBATTERY);
+
+    // Measure battery voltage
+    if(!lib_adc_is_busy())
+    {
+        // What did we just measure?
+        // Always alternate between reference channel
+        // and battery voltage
+        if(isadcchannelref) {
+            bandgapvoltageraw = lib_adc_read_raw();
+            isadcchannelref = false;
+            lib_adc_select_channel(LIB_ADC_CHAN5);
+        } else {
+            batteryvoltageraw = lib_adc_read_raw();
+            isadcchannelref = true;
+            lib_adc_select_channel(LIB_ADC_CHANREF);
+
+            // Fixed point division, without the software divide the M0 would call
+            batteryvoltage = lib_fp_divide(batteryvoltageraw, bandgapvoltageraw);
+            // Now we have battery voltage relative to bandgap reference voltage.
+            // Multiply by initially measured bandgap voltage to get the voltage at the ADC pin.
+            batteryvoltage = lib_fp_multiply(batteryvoltage, initialbandgapvoltage);
+            // Now take the voltage divider into account to get battery voltage.
+            batteryvoltage = lib_fp_multiply(batteryvoltage, FP_BATTERY_VOLTAGE_FACTOR);
+
+            // Since we measure under load, the voltage is not stable.
+            // Apply 0.5 second lowpass filter, over the time since the last reading.
+            // 4295L is (1L<<32)*.000001, like in readtimesliver(), which would clamp the 200ms between readings
+            fixedpointnum24 batterytimesliver = (lib_timers_gettimermicrosecondsandreset(&batterytimer) * 4295L) >> (32 - FIXEDPOINT24SHIFT);
+            lib_fp_lowpassfilterinline(&(global.batteryvoltage), batteryvoltage, batterytimesliver, FIXEDPOINTONEOVERONEHALF, TIMESLIVEREXTRASHIFT);
+            // Update state of isbatterylow flag.
+            if(global.batteryvoltage < FP_BATTERY_UNDERVOLTAGE_LIMIT)
+                isbatterylow = true;
             else
-                x4_set_leds(X4_LED_NONE);
-        }
-        else {
-            // LEDs stay on
-            x4_set_leds(X4_LED_ALL);
+                isbatterylow = false;
         }
+        // Start next conversion
+        lib_adc_startconv();
+    } // IF ADC result available
+    PROFILEREXIT(PROBEBATTERY);
+} // batterytask()
+#endif
 
+#if (CONTROL_LOOP_INTERRUPT == YES)
+volatile unsigned char settingsrequests;
+
+// The settings task: the calibration and the eeprom writes the control task asked for.  The control task is held
+// while they use its sensors and settings.
+void settingstask(void)
+{
+    if (!settingsrequests)
+        return;
+
+    HOLDCONTROLTASK();
+    unsigned char requests = settingsrequests;
+    settingsrequests = 0;
+    // the aircraft may have been armed since the stick command
+    if ((requests & SETTINGSCALIBRATE) && !global.armed)
+        calibrategyroandaccelerometer(true);
+    writeusersettingstoeeprom();
+    RELEASECONTROLTASK();
+}
 #endif
-    } // Endless loop
-} // main()
+
+// The LED task
+void ledtask(void)
+{
+    // Hubsan X4 has its own LED management
+#if (CONTROL_BOARD_TYPE != CONTROL_BOARD_HUBSAN_H107L)
+    // turn on the LED when we are stable and the gps has 5 satellites or more
+#if (GPS_TYPE==NO_GPS)
+    lib_digitalio_setoutput(LED1_OUTPUT, (global.stable == 0) ? (!LED1_ON) : LED1_ON);
+#else
+    lib_digitalio_setoutput(LED1_OUTPUT, (!(global.stable && global.gps_num_satelites >= 5)) == LED1_ON);
+#endif
+#else
+    // Decide what LEDs have to show
+    if(isbatterylow) {
+        // Highest priority: Battery voltage
+        // Blink all LEDs slow
+        if(lib_timers_gettimermicroseconds(0) % 500000 > 250000)
+            x4_set_leds(X4_LED_ALL);
+        else
+            x4_set_leds(X4_LED_NONE);
+    }
+    else if(isfailsafeactive) {
+        // Lost contact with TX
+        // Blink LEDs fast alternating
+        if(lib_timers_gettimermicroseconds(0) % 250000 > 120000)
+            x4_set_leds(X4_LED_FR | X4_LED_RL);
+        else
+            x4_set_leds(X4_LED_FL | X4_LED_RR);
+    }
+#if (ACC_SIX_POSITION_CALIBRATION == YES)
+    else if(accsixpositioninfo.state == ACCSIXPOSITIONCOLLECTING || accsixpositioninfo.state == ACCSIXPOSITIONSOLVING) {
+        // Six position accelerometer calibration
+        // All LEDs on for half a second after each position, else front and rear LEDs alternate slowly
+        if(accsixpositioninfo.positions && accsixpositioninfo.waitingtime < FIXEDPOINTCONSTANT(.5))
+            x4_set_leds(X4_LED_ALL);
+        else if(lib_timers_gettimermicroseconds(0) % 1000000 > 500000)
+            x4_set_leds(X4_LED_FL | X4_LED_FR);
+        else
+            x4_set_leds(X4_LED_RL | X4_LED_RR);
+    }
+#endif
+    else if(calibrationinfo.timedout && !global.armed) {
+        // The last gyro and acc calibration gave up, the one before is kept
+        // Left and right LEDs alternate fast
+        if(lib_timers_gettimermicroseconds(0) % 250000 > 120000)
+            x4_set_leds(X4_LED_FR | X4_LED_RR);
+        else
+            x4_set_leds(X4_LED_FL | X4_LED_RL);
+    }
+#if (GYRO_BIAS_TRACKING == YES)
+    else if(!global.gyrocalibrated) {
+        // Waiting for the gyro calibration
+        // Rotating pattern like the startup calibration
+        static const uint8_t rotatingleds[4] = { X4_LED_FL, X4_LED_FR, X4_LED_RR, X4_LED_RL };
+        x4_set_leds(rotatingleds[(lib_timers_gettimermicroseconds(0) >> 17) & 3]);
+    }
+#endif
+    else if(!global.armed) {
+        // Not armed
+        // Short blinks
+        if(lib_timers_gettimermicroseconds(0) % 500000 > 450000)
+            x4_set_leds(X4_LED_ALL);
+        else
+            x4_set_leds(X4_LED_NONE);
+    }
+    else {
+        // LEDs stay on
+        x4_set_leds(X4_LED_ALL);
+    }
+#endif
+} // ledtask()
 
 void calculatetimesliver(void)
 {
     // load global.timesliver with the amount of time that has passed since we last went through this loop
-    // convert from microseconds to fixedpointnum seconds shifted by TIMESLIVEREXTRASHIFT
-    // 4295L is (FIXEDPOINTONE<<FIXEDPOINTSHIFT)*.000001
-    global.timesliver = (lib_timers_gettimermicrosecondsandreset(&timeslivertimer) * 4295L) >> (FIXEDPOINTSHIFT - TIMESLIVEREXTRASHIFT);
+    global.timesliver = readtimesliver(&timeslivertimer);
+}
+
+// the time since *timer was started or last read, as a fixedpointnum24 in seconds, and restarts it.  For the tasks
+// that run at their own pace, like the receiver.
+fixedpointnum24 readtimesliver(unsigned long *timer)
+{
+    // convert from microseconds to fixedpointnum24 seconds
+    // 4295L is (1L<<32)*.000001
+    fixedpointnum24 timesliver = (lib_timers_gettimermicrosecondsandreset(timer) * 4295L) >> (32 - FIXEDPOINT24SHIFT);
 
     // don't allow big jumps in time because of something slowing the update loop down (should never happen anyway)
-    if (global.timesliver > (FIXEDPOINTONEFIFTIETH << TIMESLIVEREXTRASHIFT))
-        global.timesliver = FIXEDPOINTONEFIFTIETH << TIMESLIVEREXTRASHIFT;
+    if (timesliver > FIXEDPOINTTOFIXEDPOINT24(FIXEDPOINTONEFIFTIETH))
+        timesliver = FIXEDPOINTTOFIXEDPOINT24(FIXEDPOINTONEFIFTIETH);
+    return (timesliver);
 }
 
 void defaultusersettings(void)
@@ -662,6 +807,7 @@ void defaultusersettings(void)
         usersettings.compasscalibrationmultiplier[x] = 1L << FIXEDPOINTSHIFT;
         usersettings.gyrocalibration[x] = 0;
         usersettings.acccalibration[x] = 0;
+        usersettings.accgaincorrection[x] = 0;
     }
 #if CONTROL_BOARD_TYPE == CONTROL_BOARD_WLT_V202
     usersettings.boundprotocol = 0; // PROTO_NONE
@@ -670,63 +816,84 @@ void defaultusersettings(void)
 #endif
 }
 
+// Counts back and forth movements of one stick.
+// Returns true after the 6th movement (3x back and forth), each within 1 second of the last one.
+static bool detectstickmovements(stickmovementstruct * stick, fixedpointnum value) {
+    if (value < FP_RXMOVELOW) {
+        // Stick is now low. What has happened before?
+        if(stick->state == STICK_STATE_START) {
+            // We just come from start position, so this is our first movement
+            stick->movecounter=1;
+            stick->state = STICK_STATE_LOW;
+            // Detected stick movement, so restart timeout.
+            stick->timer = lib_timers_starttimer();
+        } else if (stick->state == STICK_STATE_HIGH) {
+            // Stick had been high recently, so increment counter
+            stick->movecounter++;
+            stick->state = STICK_STATE_LOW;
+            // Detected stick movement, so restart timeout.
+            stick->timer = lib_timers_starttimer();
+        } // else: nothing happened, nothing to do
+    } else if (value > FP_RXMOVEHIGH) {
+        // And now the same in opposite direction...
+        if(stick->state == STICK_STATE_START) {
+            // We just come from start position
+            stick->movecounter=1;
+            stick->state = STICK_STATE_HIGH;
+            // Detected stick movement, so restart timeout.
+            stick->timer = lib_timers_starttimer();
+        } else if (stick->state == STICK_STATE_LOW) {
+            // Stick had been low recently, so increment counter
+            stick->movecounter++;
+            stick->state = STICK_STATE_HIGH;
+            // Detected stick movement, so restart timeout.
+            stick->timer = lib_timers_starttimer();
+        } // else: nothing happened, nothing to do
+    }
+
+    if(lib_timers_gettimermicroseconds(stick->timer) > 1000000L) {
+        // Timeout: last detected stick movement was more than 1 second ago.
+        stick->state = STICK_STATE_START;
+    }
+
+    if(stick->movecounter == 6) {
+        // Now we had enough movements. Start over for the next command.
+        stick->movecounter = 0;
+        stick->state = STICK_STATE_START;
+        return true;
+    }
+    return false;
+}
+
 // Executes command based on stick movements.
 // Call this only when not armed.
-// Currently implemented: accelerometer calibration
+// Currently implemented: accelerometer calibration, six position accelerometer calibration
 static void detectstickcommand(void) {
-    // Timeout for stick movements for accelerometer calibration
-    static uint32_t stickcommandtimer;
     // Keeps track of roll stick movements while not armed to execute accelerometer calibration.
-    static stickstate_t lastrollstickstate = STICK_STATE_START;
-    // Counts roll stick movements
-    static uint8_t rollmovecounter;
+    static stickmovementstruct rollstick = { STICK_STATE_START };
+#if (ACC_SIX_POSITION_CALIBRATION == YES)
+    // Keeps track of pitch stick movements to start the six position accelerometer calibration.
+    static stickmovementstruct pitchstick = { STICK_STATE_START };
+#endif
 
-    // Accelerometer calibration (3x back and forth movement of roll stick while
-    // throttle is in lowest position)
     if (global.rxvalues[THROTTLEINDEX] < FPSTICKLOW) {
-        if (global.rxvalues[ROLLINDEX] < FP_RXMOVELOW) {
-            // Stick is now low. What has happened before?
-            if(lastrollstickstate == STICK_STATE_START) {
-                // We just come from start position, so this is our first movement
-                rollmovecounter=1;
-                lastrollstickstate = STICK_STATE_LOW;
-                // Detected stick movement, so restart timeout.
-                stickcommandtimer = lib_timers_starttimer();
-            } else if (lastrollstickstate == STICK_STATE_HIGH) {
-                // Stick had been high recently, so increment counter
-                rollmovecounter++;
-                lastrollstickstate = STICK_STATE_LOW;
-                // Detected stick movement, so restart timeout.
-                stickcommandtimer = lib_timers_starttimer();
-            } // else: nothing happened, nothing to do
-        } else if (global.rxvalues[ROLLINDEX] > FP_RXMOVEHIGH) {
-            // And now the same in opposite direction...
-            if(lastrollstickstate == STICK_STATE_START) {
-                // We just come from start position
-                rollmovecounter=1;
-                lastrollstickstate = STICK_STATE_HIGH;
-                // Detected stick movement, so restart timeout.
-                stickcommandtimer = lib_timers_starttimer();
-            } else if (lastrollstickstate == STICK_STATE_LOW) {
-                // Stick had been low recently, so increment counter
-                rollmovecounter++;
-                lastrollstickstate = STICK_STATE_HIGH;
-                // Detected stick movement, so restart timeout.
-                stickcommandtimer = lib_timers_starttimer();
-            } // else: nothing happened, nothing to do
-        }
-
-        if(lib_timers_gettimermicroseconds(stickcommandtimer) > 1000000L) {
-            // Timeout: last detected stick movement was more than 1 second ago.
-            lastrollstickstate = STICK_STATE_START;
-        }
-
-        if(rollmovecounter == 6) {
-            // Now we had enough movements. Execute calibration.
+        // Accelerometer calibration (3x back and forth movement of roll stick while
+        // throttle is in lowest position)
+        if (detectstickmovements(&rollstick, global.rxvalues[ROLLINDEX])) {
+#if (CONTROL_LOOP_INTERRUPT == YES)
+            // the calibration takes seconds, settingstask() does it and saves in EEPROM
+            settingsrequests |= SETTINGSCALIBRATE;
+#else
             calibrategyroandaccelerometer(true);
             // Save in EEPROM
             writeusersettingstoeeprom();
-            lastrollstickstate = STICK_STATE_START;
+#endif
         }
+#if (ACC_SIX_POSITION_CALIBRATION == YES)
+        // Six position accelerometer calibration (3x back and forth movement of pitch stick while
+        // throttle is in lowest position).  It saves to EEPROM when it is done.
+        if (detectstickmovements(&pitchstick, global.rxvalues[PITCHINDEX]))
+            startaccsixpositioncalibration();
+#endif
     } // if throttle low
 } // checkforstickcommand()
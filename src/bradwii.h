@@ -57,13 +57,13 @@ typedef struct {
     unsigned char usersettingsfromeeprom;       // set to 1 if user settings were read from eeprom
     fixedpointnum barorawaltitude;      // Current altitude read from barometer, in meters (approximately)
     fixedpointnum debugvalue[4];        // for display in the multiwii config program. Use for debugging.
-    fixedpointnum timesliver;   // The time in seconds (shifted TIMESLIVEREXTRASHIFT) since the last iteration of the main loop
+    fixedpointnum24 timesliver; // The time in seconds since the last iteration of the main loop
     fixedpointnum gyrorate[3];  // Corrected gyro rates in degrees per second
     fixedpointnum acc_g_vector[3];      // Corrected accelerometer vector, in G's
     fixedpointnum altitude;     // A filtered version of the baromemter's altitude
     fixedpointnum altitudevelocity;     // The rate of change of the altitude
-    fixedpointnum estimateddownvector[3];       // A unit vector (approximately) poining in the direction we think down is relative to the aircraft
-    fixedpointnum estimatedwestvector[3];       // A unit vector (approximately) poining in the direction we think west is relative to the aircraft
+    fixedpointnum30 estimateddownvector[3];     // A unit vector (approximately) poining in the direction we think down is relative to the aircraft
+    fixedpointnum30 estimatedwestvector[3];     // A unit vector (approximately) poining in the direction we think west is relative to the aircraft
     fixedpointnum currentestimatedeulerattitude[3];     // Euler Angles in degrees of how much we think the aircraft is Rolled, Pitched, and Yawed (from North)
     fixedpointnum rxvalues[RXNUMCHANNELS];      // The values of the RX inputs, ranging from -1.0 to 1.0
     fixedpointnum compassvector[3];     // A unit vector (approximately) poining in the direction our 3d compass is pointing
@@ -84,6 +84,7 @@ typedef struct {
     fixedpointnum navigation_bearing;   // The bearing from the last waypoint to the next one
     unsigned char navigationmode;       // See navigation.h
     unsigned char stable;       // Set to 1 when our gravity vector is close to unit length
+    unsigned char gyrocalibrated;       // Set to 1 when the gyro calibration is good enough to arm
     uint32_t      failsafetimer;        // Timer for determining if we lose radio contact
     fixedpointnum batteryvoltage;       // Battery voltage, fixed point in Volt
 } globalstruct;
@@ -109,7 +110,37 @@ typedef struct {
     uint8_t txid[MAXTXIDSIZE];
     uint8_t freqhopping[MAXFHSIZE];
 #endif    
+    int16_t accgaincorrection[3];   // Accelerometer gains minus one, in 1/65536ths, from the six position calibration
 } usersettingsstruct;
 
+void initbradwii(void);
+void mainloopiteration(void);
 void defaultusersettings(void);
 void calculatetimesliver(void);
+fixedpointnum24 readtimesliver(unsigned long *timer);
+
+#if (CONTROL_LOOP_INTERRUPT == YES)
+// The control task runs every CONTROL_LOOP_PERIOD to the timer's tick, so its timesliver is a constant, and so
+// are its products with constants.
+#define CONTROLTIMESLIVER FIXEDPOINT24CONSTANT(CONTROL_LOOP_PERIOD / 1000000.0)
+#define TIMESLIVERTIMES(constant) ((fixedpointnum) (((int64_t) CONTROLTIMESLIVER * (constant)) >> FIXEDPOINTSHIFT))
+
+// The gyro calibration and the eeprom writes block for too long for the timer interrupt, so the control task
+// leaves them to settingstask() in the main loop.
+#define SETTINGSCALIBRATE 1     // calibrate the gyro and acc, then write the settings
+#define SETTINGSWRITE 2         // write the settings to eeprom
+extern volatile unsigned char settingsrequests;
+#define CONTROLTASKWRITEUSERSETTINGS() (settingsrequests |= SETTINGSWRITE)
+#else
+#define TIMESLIVERTIMES(constant) lib_fp_multiply(global.timesliver, constant)
+#define CONTROLTASKWRITEUSERSETTINGS() writeusersettingstoeeprom()
+#endif
+
+// the main loop's tasks, see scheduler.c
+void controltask(void);
+void gpstask(void);
+void batterytask(void);
+void ledtask(void);
+#if (CONTROL_LOOP_INTERRUPT == YES)
+void settingstask(void);
+#endif
@@ -22,7 +22,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 extern globalstruct global;
 extern usersettingsstruct usersettings;
 
-#ifndef X4_BUILD
+// the X4 has no serial port, so it only needs the names when one is configured (e.g. the host build)
+#if !defined(X4_BUILD) || (MULTIWII_CONFIG_SERIAL_PORTS != NOSERIALPORT)
 char checkboxnames[] /* PROGMEM */  =   // names for dynamic generation of config GUI
     // this could be moved to program memory if we wanted to save a few bytes of space.
     "Arm;" "Thr. Helper;" "Alt. Hold;" "Mag. Hold;" "Pos. Hold;" "Ret. Home;" "Semi Acro;" "Full Acro;" "High Rates;" "High Angle;" "Auto Tune;" "Uncrashable;" "Headfree;" "Yaw Hold;";
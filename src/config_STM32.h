@@ -162,6 +162,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // Leave comment to use the default value.
 //#define GYRO_LOW_PASS_FILTER 2
 
+// Attitude estimator.  VECTOR_ESTIMATOR (the default) keeps a down and a west vector and pulls them towards the
+// accelerometer and compass.  QUATERNION_ESTIMATOR keeps a quaternion, pulls it the same way and also learns the
+// gyro bias from the accelerometer, so a gyro that drifts after calibration doesn't tilt level mode.
+//#define IMU_ESTIMATOR QUATERNION_ESTIMATOR
+
 #define UNCRAHSABLE_MAX_ALTITUDE_OFFSET 30.0    // 30 meters above where uncrashability was enabled
 #define UNCRAHSABLE_RADIUS 50.0 // 50 meter radius
 
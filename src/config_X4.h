@@ -175,6 +175,63 @@ void x4_set_leds(unsigned char state);
 // Leave comment to use the default value.
 #define GYRO_LOW_PASS_FILTER 3 // 3 = 42Hz (mpu3050)
 
+// Attitude estimator.  VECTOR_ESTIMATOR (the default) keeps a down and a west vector and pulls them towards the
+// accelerometer and compass.  QUATERNION_ESTIMATOR keeps a quaternion, pulls it the same way and also learns the
+// gyro bias from the accelerometer, so a gyro that drifts after calibration doesn't tilt level mode.
+//#define IMU_ESTIMATOR QUATERNION_ESTIMATOR
+
+// Accelerometer trust.  By default the accelerometer pulls the attitude towards it at a fixed rate whenever it
+// reads between about 0.95 and 1.05 g, and not at all otherwise.  With ACC_ADAPTIVE_GAIN it pulls by a weight that
+// falls off smoothly away from 1 g, with vibration and with fast rotation like in flips, and harder for a while
+// after fast rotation, so the attitude recovers sooner after flips.  See imu.c for its settings.
+//#define ACC_ADAPTIVE_GAIN YES
+
+// Six position accelerometer calibration.  The usual calibration (roll stick 3x back and forth with throttle low)
+// only measures the offsets, with the aircraft level.  With ACC_SIX_POSITION_CALIBRATION moving the pitch stick 3x
+// back and forth with throttle low, or MSP_ACC_SIX_POSITION_CALIBRATION, starts a calibration that also measures
+// each axis' gain: hold the aircraft still with each side facing down in turn, in any order.  It saves to eeprom
+// once it has all six, and gives up after a minute without a new one.  The LEDs alternate front and rear while it
+// runs and all light up for a moment when it takes a position.
+//#define ACC_SIX_POSITION_CALIBRATION YES
+
+// Gyro calibration.  By default the gyro is calibrated at every startup until its average settles, and the aircraft has to sit
+// still meanwhile.  With GYRO_BIAS_TRACKING it starts from the calibration in eeprom and keeps measuring the gyro
+// bias whenever it sits still while disarmed.  It can be armed as soon as the measurement is good enough, which is
+// usually well under a second, and the LEDs rotate until then.  Without settings in eeprom it still calibrates
+// at startup.
+//#define GYRO_BIAS_TRACKING YES
+
+// Gyro oversampling.  A timer interrupt reads the gyro GYRO_SAMPLE_RATE times a second instead of the main loop
+// reading it once per loop, and the imu integrates every sample, so the attitude stays right while the receiver
+// holds up the main loop.  Each read keeps the I2C bus busy for about half a millisecond.
+//#define GYRO_SAMPLE_RATE 500
+// Or let the MPU3050 queue the gyro's samples in its FIFO at GYRO_SAMPLE_RATE (default 500), and read them all in
+// one burst per loop.  There is no interrupt.
+//#define GYRO_FIFO YES
+
+// Gyro and D-term filters.  Chains of biquads (see filter.h) that the gyro rates go through after the imu has used
+// them, and that the rates for the D-term go through after that.  A notch on the motor noise and a lowpass above
+// the frequencies the aircraft flies at, for example.  Each stage takes about 140 cycles per axis.  They are worked
+// out for a main loop of FILTER_SAMPLE_RATE Hz, and the frequencies have to be below half of it.  Every lowpass
+// delays the D-term, on the X4 model in lib-Host two of them at 100 and 120 Hz double the overshoot of a roll step.
+//#define GYRO_FILTERS BIQUAD_NOTCH(180, 3)
+//#define DTERM_FILTERS BIQUAD_LOWPASS(120, 0.707)
+//#define FILTER_SAMPLE_RATE 500
+
+// Main loop schedule.  By default the control task runs on every pass of the main loop and the receiver, serial
+// and LED tasks are fitted in between it (see scheduler.c).  With CONTROL_LOOP_PERIOD (microseconds) it runs at that
+// fixed period instead, and the other tasks only run if they fit before it is due again.
+//#define CONTROL_LOOP_PERIOD 2000
+// With CONTROL_LOOP_INTERRUPT the timer interrupt runs the control task, so the receiver's SPI and the serial port
+// can't delay it, and its timesliver is a constant.  The gyro's own interrupt for GYRO_SAMPLE_RATE can't be used
+// with it, GYRO_FIFO can.
+//#define CONTROL_LOOP_INTERRUPT YES
+// PROFILER times the imu, pilot control, pid, receiver and battery code in CPU cycles for MSP_PROFILER.  The probes
+// cost a little RAM and time, so leave it off for flying.
+//#define PROFILER YES
+// IDLE_WHEN_DISARMED sleeps the CPU between tasks while disarmed, which saves the battery on the bench.
+//#define IDLE_WHEN_DISARMED YES
+
 #define UNCRAHSABLE_MAX_ALTITUDE_OFFSET 30.0    // 30 meters above where uncrashability was enabled
 #define UNCRAHSABLE_RADIUS 50.0 // 50 meter radius
 
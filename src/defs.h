@@ -268,3 +268,73 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef GAIN_SCHEDULING_FACTOR
 #define GAIN_SCHEDULING_FACTOR 1.0
 #endif
+// default attitude estimator
+#ifndef IMU_ESTIMATOR
+#define IMU_ESTIMATOR VECTOR_ESTIMATOR
+#endif
+// by default the accelerometer corrects the attitude at a fixed rate while it reads close to 1 g.  With
+// ACC_ADAPTIVE_GAIN the correction is weighed by how close, by the vibration and by the rotation rate.
+#ifndef ACC_ADAPTIVE_GAIN
+#define ACC_ADAPTIVE_GAIN NO
+#endif
+// by default the gyro is read once per main loop.  With GYRO_SAMPLE_RATE (Hz) a timer interrupt reads it, or
+// with GYRO_FIFO the gyro's FIFO collects its samples at that rate.
+#ifndef GYRO_FIFO
+#define GYRO_FIFO NO
+#endif
+#ifndef GYRO_SAMPLE_RATE
+#if (GYRO_FIFO == YES)
+#define GYRO_SAMPLE_RATE 500
+#else
+#define GYRO_SAMPLE_RATE 0
+#endif
+#endif
+// by default the accelerometer calibration only measures its offsets, with the aircraft level.  With
+// ACC_SIX_POSITION_CALIBRATION a stick command or MSP starts a calibration that also fits each axis' gain.
+#ifndef ACC_SIX_POSITION_CALIBRATION
+#define ACC_SIX_POSITION_CALIBRATION NO
+#endif
+// by default the gyro is calibrated at startup until its average settles.  With GYRO_BIAS_TRACKING the imu estimates its bias
+// while the aircraft is disarmed and still, and it can be armed as soon as the estimate is good enough.
+#ifndef GYRO_BIAS_TRACKING
+#define GYRO_BIAS_TRACKING NO
+#endif
+// by default an MPU6050 reads the gyro and the accelerometer in two transactions
+#ifndef MPU6050_COMBINED_READ
+#define MPU6050_COMBINED_READ NO
+#endif
+// the main loop rate in Hz that the GYRO_FILTERS and DTERM_FILTERS biquads are worked out for (see filter.c)
+#ifndef FILTER_SAMPLE_RATE
+#define FILTER_SAMPLE_RATE 500
+#endif
+// by default the control task (sensors, imu, pid and mixer) runs on every pass of the main loop.  With
+// CONTROL_LOOP_PERIOD (microseconds) it runs at that fixed period, see scheduler.c.
+#ifndef CONTROL_LOOP_PERIOD
+#define CONTROL_LOOP_PERIOD 0
+#endif
+// With CONTROL_LOOP_INTERRUPT the periodic timer interrupt runs the control task every CONTROL_LOOP_PERIOD,
+// whatever the main loop is doing, and the timesliver is a constant.
+#ifndef CONTROL_LOOP_INTERRUPT
+#define CONTROL_LOOP_INTERRUPT NO
+#endif
+#if (CONTROL_LOOP_INTERRUPT == YES) && (CONTROL_LOOP_PERIOD == 0)
+#error "CONTROL_LOOP_INTERRUPT needs a CONTROL_LOOP_PERIOD"
+#endif
+#if (CONTROL_LOOP_INTERRUPT == YES) && (GYRO_SAMPLE_RATE != 0) && (GYRO_FIFO == NO)
+#error "CONTROL_LOOP_INTERRUPT and GYRO_SAMPLE_RATE both need the periodic timer interrupt, use GYRO_FIFO"
+#endif
+// With IDLE_WHEN_DISARMED the main loop sleeps until the next interrupt when it is disarmed and has nothing to do,
+// instead of spinning.  Without CONTROL_LOOP_PERIOD the control task then runs every DISARMED_CONTROL_LOOP_PERIOD
+// while disarmed, rather than on every pass.
+#ifndef IDLE_WHEN_DISARMED
+#define IDLE_WHEN_DISARMED NO
+#endif
+// With PROFILER the probes in profiler.h time the control task, the imu, the pilot control, the pid, the receiver
+// and the battery in CPU cycles, and MSP_PROFILER sends what they measured.
+#ifndef PROFILER
+#define PROFILER NO
+#endif
+// slots in the gyro sample ring buffer, a power of two
+#ifndef GYRO_SAMPLE_BUFFER_SIZE
+#define GYRO_SAMPLE_BUFFER_SIZE 8
+#endif
@@ -0,0 +1,127 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// library headers
+#include "lib_fp.h"
+
+// project file headers
+#include "bradwii.h"
+#include "filter.h"
+
+extern globalstruct global;
+
+// Biquad filters for the gyro rates and the D-term.  The coefficients are the lowpass and notch of Robert
+// Bristow-Johnson's Audio EQ Cookbook, worked out once in initfilters() for a main loop that runs
+// FILTER_SAMPLE_RATE times a second.  A bandstop is a notch at the geometric centre of its band, as wide as the
+// band.  Each stage costs 5 lib_fp_multiply30()s per axis and 44 bytes of RAM.
+
+#define FP_FILTER_SAMPLE_RATE FIXEDPOINTCONSTANT(FILTER_SAMPLE_RATE)
+
+#ifdef GYRO_FILTERS
+static const biquadsettingsstruct gyrofiltersettings[] = { GYRO_FILTERS };
+#define GYROFILTERSTAGES (sizeof(gyrofiltersettings) / sizeof(gyrofiltersettings[0]))
+static biquadstruct gyrofilters[GYROFILTERSTAGES];
+#endif
+
+#ifdef DTERM_FILTERS
+static const biquadsettingsstruct dtermfiltersettings[] = { DTERM_FILTERS };
+#define DTERMFILTERSTAGES (sizeof(dtermfiltersettings) / sizeof(dtermfiltersettings[0]))
+static biquadstruct dtermfilters[DTERMFILTERSTAGES];
+#endif
+
+// numerator/a0 as a fixedpointnum30.  The numerator goes in with 29 fractional bits, so lib_fp_divide() keeps
+// them, and |numerator| must stay within 4.
+static fixedpointnum30 normalizedcoefficient(fixedpointnum numerator, fixedpointnum a0)
+{
+    return (lib_fp_divide(numerator << (FIXEDPOINT30SHIFT - 1 - FIXEDPOINTSHIFT), a0) << 1);
+}
+
+// works out the coefficients of a stage and clears its state.  Frequencies have to be below half the sample rate.
+void initbiquad(biquadstruct * filter, const biquadsettingsstruct * settings, fixedpointnum samplerate)
+{
+    fixedpointnum frequency = settings->frequency;
+    fixedpointnum q = settings->parameter;
+
+    if (settings->type == BIQUADBANDSTOP) {
+        // the square roots first so the product doesn't overflow
+        frequency = lib_fp_multiply(lib_fp_sqrt(settings->frequency), lib_fp_sqrt(settings->parameter));
+        q = lib_fp_divide(frequency, settings->parameter - settings->frequency);
+    }
+
+    // w0=2*pi*frequency/samplerate, in degrees for lib_fp_sincos()
+    fixedpointnum sine, cosine;
+    lib_fp_sincos(lib_fp_multiply(lib_fp_divide(frequency, samplerate), FIXEDPOINT360), &sine, &cosine);
+
+    fixedpointnum alpha = lib_fp_divide(sine, q << 1);
+    fixedpointnum a0 = FIXEDPOINTONE + alpha;
+    biquadcoefficientsstruct *c = &filter->coefficients;
+
+    c->a1 = normalizedcoefficient(-cosine << 1, a0);
+    c->a2 = normalizedcoefficient(FIXEDPOINTONE - alpha, a0);
+    if (settings->type == BIQUADLOWPASS) {
+        c->b0 = normalizedcoefficient((FIXEDPOINTONE - cosine) >> 1, a0);
+        c->b1 = normalizedcoefficient(FIXEDPOINTONE - cosine, a0);
+    } else {
+        // notch and bandstop: zeros on the unit circle at w0
+        c->b0 = normalizedcoefficient(FIXEDPOINTONE, a0);
+        c->b1 = c->a1;
+    }
+    c->b2 = c->b0;
+
+    for (int x = 0; x < 3; ++x)
+        filter->state[x][0] = filter->state[x][1] = 0;
+}
+
+// runs input through the stages of a chain in order
+fixedpointnum biquadchainfilter(biquadstruct * chain, int stages, int axis, fixedpointnum input)
+{
+    while (stages--)
+        input = biquadfilter(chain++, axis, input);
+    return (input);
+}
+
+void initfilters(void)
+{
+#ifdef GYRO_FILTERS
+    for (int i = 0; i < GYROFILTERSTAGES; ++i)
+        initbiquad(&gyrofilters[i], &gyrofiltersettings[i], FP_FILTER_SAMPLE_RATE);
+#endif
+#ifdef DTERM_FILTERS
+    for (int i = 0; i < DTERMFILTERSTAGES; ++i)
+        initbiquad(&dtermfilters[i], &dtermfiltersettings[i], FP_FILTER_SAMPLE_RATE);
+#endif
+}
+
+// Filters global.gyrorate in place with the GYRO_FILTERS chain.  The main loop calls it after the imu, so the
+// attitude and the gyro calibration use the raw rates and the pilot control and the pid the filtered ones.
+// With GYRO_SAMPLE_RATE a loop that got no new sample filters the last output again.
+void filtergyrorates(void)
+{
+#ifdef GYRO_FILTERS
+    for (int x = 0; x < 3; ++x)
+        global.gyrorate[x] = biquadchainfilter(gyrofilters, GYROFILTERSTAGES, x, global.gyrorate[x]);
+#endif
+}
+
+// the rate for the D-term of axis x through the DTERM_FILTERS chain
+fixedpointnum filterdtermrate(int axis, fixedpointnum rate)
+{
+#ifdef DTERM_FILTERS
+    rate = biquadchainfilter(dtermfilters, DTERMFILTERSTAGES, axis, rate);
+#endif
+    return (rate);
+}
@@ -0,0 +1,66 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "lib_fp.h"
+
+#define BIQUADLOWPASS 0
+#define BIQUADNOTCH 1
+#define BIQUADBANDSTOP 2
+
+// Filters for GYRO_FILTERS and DTERM_FILTERS in the config files, frequencies in Hz.  A lowpass and a notch take
+// a Q (0.707 for a flat lowpass, higher for a narrower notch), a bandstop the edges of the band it stops.
+#define BIQUAD_LOWPASS(frequency, q) { BIQUADLOWPASS, FIXEDPOINTCONSTANT(frequency), FIXEDPOINTCONSTANT(q) }
+#define BIQUAD_NOTCH(frequency, q) { BIQUADNOTCH, FIXEDPOINTCONSTANT(frequency), FIXEDPOINTCONSTANT(q) }
+#define BIQUAD_BANDSTOP(lowfrequency, highfrequency) { BIQUADBANDSTOP, FIXEDPOINTCONSTANT(lowfrequency), FIXEDPOINTCONSTANT(highfrequency) }
+
+typedef struct {
+    unsigned char type;
+    fixedpointnum frequency;    // the lowpass cutoff, the notch centre or the low edge of the bandstop
+    fixedpointnum parameter;    // the Q, or the high edge of the bandstop
+} biquadsettingsstruct;
+
+// normalized so a0 is one.  |a1| and |b1| can get close to 2, so they are fixedpointnum30s.
+typedef struct {
+    fixedpointnum30 b0, b1, b2, a1, a2;
+} biquadcoefficientsstruct;
+
+// one stage of a filter chain: the coefficients, worked out once, and the two state variables of each axis
+typedef struct {
+    biquadcoefficientsstruct coefficients;
+    fixedpointnum state[3][2];
+} biquadstruct;
+
+void initbiquad(biquadstruct * filter, const biquadsettingsstruct * settings, fixedpointnum samplerate);
+fixedpointnum biquadchainfilter(biquadstruct * chain, int stages, int axis, fixedpointnum input);
+void initfilters(void);
+void filtergyrorates(void);
+fixedpointnum filterdtermrate(int axis, fixedpointnum rate);
+
+// One step of a stage on one axis, direct form II transposed.  The state holds the partial sums for the next
+// two outputs, so there is one multiply per coefficient and the state only grows as big as the output does.
+static inline fixedpointnum biquadfilter(biquadstruct * filter, int axis, fixedpointnum input)
+{
+    biquadcoefficientsstruct *c = &filter->coefficients;
+    fixedpointnum *state = filter->state[axis];
+    fixedpointnum output = lib_fp_multiply30(c->b0, input) + state[0];
+
+    state[0] = lib_fp_multiply30(c->b1, input) - lib_fp_multiply30(c->a1, output) + state[1];
+    state[1] = lib_fp_multiply30(c->b2, input) - lib_fp_multiply30(c->a2, output);
+    return (output);
+}
@@ -15,18 +15,18 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include "gyro.h"
 #include "lib_i2c.h"
 #include "lib_timers.h"
 #include "rx.h"
 #include "lib_fp.h"
 #include "bradwii.h"
+#include "gyro.h"
 
 extern globalstruct global;
 
 // when adding gyros, the following functions need to be included:
 // initgyro() // initializes the gyro
-// readgyro() // loads global.gyrorate with gyro readings in fixedpointnum degrees per second
+// readgyrorates() // loads gyrorate with gyro readings in fixedpointnum degrees per second
 #if (GYRO_TYPE==MPU3050)
 #define MPU3050_ADDRESS     0x68        // address pin AD0 low (GND)
 #if (GYRO_LOW_PASS_FILTER<=6)
@@ -34,6 +34,22 @@ extern globalstruct global;
 #else
 #define MPU3050_DLPF_CFG   6
 #endif
+// the internal sample rate SMPLRT_DIV divides, 8kHz without the low pass filter
+#if (MPU3050_DLPF_CFG == 0)
+#define MPU3050_SAMPLE_RATE 8000
+#else
+#define MPU3050_SAMPLE_RATE 1000
+#endif
+
+// the FIFO, see readgyrofifo()
+#define GYRO_FIFO_ADDRESS MPU3050_ADDRESS
+#define GYRO_FIFO_COUNTREGISTER 0x3A    // FIFO_COUNTH, FIFO_COUNTL
+#define GYRO_FIFO_DATAREGISTER 0x3C     // FIFO_R
+#define GYRO_FIFO_USERCTRLREGISTER 0x3D // USER_CTRL
+#define GYRO_FIFO_ENABLE 0x40   // USER_CTRL -- FIFO_EN
+#define GYRO_FIFO_RESET 0x02    // USER_CTRL -- FIFO_RST
+#define GYRO_FIFO_SIZE 512
+#define GYRO_FIFO_RATE MPU3050_SAMPLE_RATE
 
 void initgyro(void)
 {
@@ -41,24 +57,34 @@ void initgyro(void)
     lib_timers_delaymilliseconds(5);
     lib_i2c_writereg(MPU3050_ADDRESS, 0x3E, 0x03); //PWR_MGMT_1 -- SLEEP 0; CYCLE 0; TEMP_DIS 0; CLKSEL 3 (PLL with Z Gyro reference)
     lib_i2c_writereg(MPU3050_ADDRESS, 0x16, MPU3050_DLPF_CFG + 0x18); // Gyro CONFIG -- EXT_SYNC_SET 0 (disable input pin for data sync) ; default DLPF_CFG = 0 => GYRO bandwidth = 256Hz); -- FS_SEL = 3: Full scale set to 2000 deg/sec
+#if (GYRO_FIFO == YES)
+    lib_i2c_writereg(MPU3050_ADDRESS, 0x15, MPU3050_SAMPLE_RATE / GYRO_SAMPLE_RATE - 1);       // SMPLRT_DIV
+    lib_i2c_writereg(MPU3050_ADDRESS, 0x12, 0x70);      // FIFO_EN -- GYRO_XOUT, GYRO_YOUT, GYRO_ZOUT
+#endif
 }
 
-void readgyro(void)
+static void gyrodatatorates(unsigned char *data, fixedpointnum * gyrorate)
 {
-    unsigned char data[6];
-    lib_i2c_readdata(MPU3050_ADDRESS, 0x1D, (unsigned char *) &data, 6);
-	
     // convert to fixedpointnum, in degrees per second
     // the gyro puts out a 16 bit signed int where each count equals 0.0609756097561 degrees/second
     // So we have 15 bit fractional part, need to shift that to FIXEDPOINTSHIFT and
     // take 2000deg/s into account.
     // This only works if FIXEDPOINTSHIFT >= 15
-    GYRO_ORIENTATION(global.gyrorate,
+    GYRO_ORIENTATION(gyrorate,
         ((int16_t) ((data[0] << 8) | data[1])) * (2000L << (FIXEDPOINTSHIFT - 15)),
         ((int16_t) ((data[2] << 8) | data[3])) * (2000L << (FIXEDPOINTSHIFT - 15)),
         ((int16_t) ((data[4] << 8) | data[5])) * (2000L << (FIXEDPOINTSHIFT - 15)));
 }
 
+#if (GYRO_FIFO == NO)
+static void readgyrorates(fixedpointnum * gyrorate)
+{
+    unsigned char data[6];
+    lib_i2c_readdata(MPU3050_ADDRESS, 0x1D, (unsigned char *) &data, 6);
+    gyrodatatorates(data, gyrorate);
+}
+#endif
+
 #elif (GYRO_TYPE==ITG3200)
 // ************************************************************************************************************
 // I2C Gyroscope ITG3200 
@@ -91,7 +117,7 @@ void initgyro(void)
     lib_timers_delaymilliseconds(100);
 }
 
-void readgyro(void)
+static void readgyrorates(fixedpointnum * gyrorate)
 {
     unsigned char data[6];
     lib_i2c_readdata(ITG3200_ADDRESS, 0X1D, (unsigned char *) &data, 6);
@@ -99,7 +125,7 @@ void readgyro(void)
     // convert to fixedpointnum, in degrees per second
     // the gyro puts out an int where each count equals 0.0695652173913 degrees/second
     // we want fixedpointnums, so we multiply by 4559 (0.0695652173913 * (1<<FIXEDPOINTSHIFT))
-    GYRO_ORIENTATION(global.gyrorate, ((data[0] << 8) | data[1]) * 4559L,       // range: +/- 8192; +/- 2000 deg/sec
+    GYRO_ORIENTATION(gyrorate, ((data[0] << 8) | data[1]) * 4559L,       // range: +/- 8192; +/- 2000 deg/sec
                       ((data[2] << 8) | data[3]) * 4559L, ((data[4] << 8) | data[5]) * 4559L);
 }
 
@@ -110,6 +136,29 @@ void readgyro(void)
 #else
 #define MPU6050_DLPF_CFG   6
 #endif
+// the gyro's internal sample rate SMPLRT_DIV divides, 8kHz without the low pass filter
+#if (MPU6050_DLPF_CFG == 0)
+#define MPU6050_SAMPLE_RATE 8000
+#else
+#define MPU6050_SAMPLE_RATE 1000
+#endif
+// the accelerometer's samples go in the FIFO too, ahead of the gyro's.  Its data registers update at 1kHz.
+#if (ACCELEROMETER_TYPE == MPU6050)
+#define MPU6050_FIFO_ACCEL 0x08
+#define GYRO_FIFO_ACCBYTES 6
+#else
+#define MPU6050_FIFO_ACCEL 0
+#endif
+
+// the FIFO, see readgyrofifo()
+#define GYRO_FIFO_ADDRESS MPU6050_ADDRESS
+#define GYRO_FIFO_COUNTREGISTER 0x72    // FIFO_COUNTH, FIFO_COUNTL
+#define GYRO_FIFO_DATAREGISTER 0x74     // FIFO_R_W
+#define GYRO_FIFO_USERCTRLREGISTER 0x6A // USER_CTRL
+#define GYRO_FIFO_ENABLE 0x40   // USER_CTRL -- FIFO_EN
+#define GYRO_FIFO_RESET 0x04    // USER_CTRL -- FIFO_RESET
+#define GYRO_FIFO_SIZE 1024
+#define GYRO_FIFO_RATE MPU6050_SAMPLE_RATE
 
 void initgyro(void)
 {
@@ -121,18 +170,249 @@ void initgyro(void)
     lib_i2c_writereg(MPU6050_ADDRESS, 0x6B, 0x03);      //PWR_MGMT_1    -- SLEEP 0; CYCLE 0; TEMP_DIS 0; CLKSEL 3 (PLL with Z Gyro reference)
     lib_i2c_writereg(MPU6050_ADDRESS, 0x1A, MPU6050_DLPF_CFG);  //CONFIG        -- EXT_SYNC_SET 0 (disable input pin for data sync) ; default DLPF_CFG = 0 => ACC bandwidth = 260Hz  GYRO bandwidth = 256Hz)
     lib_i2c_writereg(MPU6050_ADDRESS, 0x1B, 0x18);      //GYRO_CONFIG   -- FS_SEL = 3: Full scale set to 2000 deg/sec
+#if (GYRO_FIFO == YES)
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x19, MPU6050_SAMPLE_RATE / GYRO_SAMPLE_RATE - 1);       //SMPLRT_DIV
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x23, 0x70 | MPU6050_FIFO_ACCEL);        //FIFO_EN       -- XG, YG, ZG and ACCEL
+#endif
 }
 
-void readgyro(void)
+static void gyrodatatorates(unsigned char *data, fixedpointnum * gyrorate)
 {
-    unsigned char data[6];
-    lib_i2c_readdata(MPU6050_ADDRESS, 0x43, (unsigned char *) &data, 6);
     // convert to fixedpointnum, in degrees per second
     // the gyro puts out an int where each count equals 0.0609756097561 degrees/second
     // we want fixedpointnums, so we multiply by 3996 (0.0609756097561 * (1<<FIXEDPOINTSHIFT))
-    GYRO_ORIENTATION(global.gyrorate,
+    GYRO_ORIENTATION(gyrorate,
         ((int16_t) ((data[0] << 8) | data[1])) * 3996L,       // range: +/- 8192; +/- 2000 deg/sec
         ((int16_t) ((data[2] << 8) | data[3])) * 3996L,
         ((int16_t) ((data[4] << 8) | data[5])) * 3996L);
 }
+
+#if (MPU6050_COMBINED_READ == YES)
+#if (ACCELEROMETER_TYPE != MPU6050) || (GYRO_SAMPLE_RATE != 0)
+#error "MPU6050_COMBINED_READ needs the MPU6050 as the accelerometer and the gyro read by the main loop"
+#endif
+// ACCEL_XOUT_H to GYRO_ZOUT_L are one block with TEMP_OUT in between.  readgyro() reads all 14 bytes in one
+// transaction and keeps the accelerometer and temperature for readacc() and gyrotemperature().
+static int16_t mpu6050acc[3];
+static int16_t mpu6050temperature;
+
+static void readgyrorates(fixedpointnum * gyrorate)
+{
+    unsigned char data[14];
+    lib_i2c_readdata(MPU6050_ADDRESS, 0x3B, (unsigned char *) &data, 14);
+    for (int x = 0; x < 3; ++x)
+        mpu6050acc[x] = (int16_t) ((data[2 * x] << 8) | data[2 * x + 1]);
+    mpu6050temperature = (int16_t) ((data[6] << 8) | data[7]);
+    gyrodatatorates(&data[8], gyrorate);
+}
+
+// the accelerometer's readings as they come from the sensor, from the last readgyro()
+void readgyrocombinedacc(int16_t * acc)
+{
+    for (int x = 0; x < 3; ++x)
+        acc[x] = mpu6050acc[x];
+}
+
+// the die temperature in degrees C from the last readgyro().  Each count is 1/340 degree, 0 is 36.53 degrees.
+fixedpointnum gyrotemperature(void)
+{
+    // 65536/340 = 192.75 = 771/4
+    return ((mpu6050temperature * 771L) >> 2) + FIXEDPOINTCONSTANT(36.53);
+}
+
+#elif (GYRO_FIFO == NO)
+static void readgyrorates(fixedpointnum * gyrorate)
+{
+    unsigned char data[6];
+    lib_i2c_readdata(MPU6050_ADDRESS, 0x43, (unsigned char *) &data, 6);
+    gyrodatatorates(data, gyrorate);
+}
+#endif
+#endif
+
+#if (GYRO_SAMPLE_RATE == 0)
+void readgyro(void)
+{
+    readgyrorates(global.gyrorate);
+}
+
+#else
+// Gyro oversampling.  A timer interrupt reads the gyro GYRO_SAMPLE_RATE times a second into a ring buffer, or
+// with GYRO_FIFO the gyro samples itself into its FIFO and readgyrofifo() moves the samples into the ring buffer.
+// The imu integrates every sample, so the attitude doesn't depend on how regularly the main loop gets to it.
+// If the main loop is so late that the buffer fills up, new samples are added to the newest one, up to
+// GYRO_SAMPLE_MAXSUM samples so the sum can't overflow at full scale.  Samples after that are lost.
+// Each slot is the sum of the rates and how many samples went into it.
+#define GYRO_SAMPLE_BUFFER_MASK (GYRO_SAMPLE_BUFFER_SIZE - 1)
+#define GYRO_SAMPLE_MAXSUM 16   // gyrosamplereciprocals[] goes up to it
+
+static fixedpointnum gyrosamples[GYRO_SAMPLE_BUFFER_SIZE][3];
+static unsigned char gyrosamplecounts[GYRO_SAMPLE_BUFFER_SIZE];
+static volatile unsigned char gyrosamplehead = 0;      // the slot the interrupt fills next
+static volatile unsigned char gyrosampletail = 0;      // the oldest slot the main loop hasn't read
+
+static void addgyrosample(fixedpointnum * rates)
+{
+    unsigned char head = gyrosamplehead;
+
+    if (((head + 1) & GYRO_SAMPLE_BUFFER_MASK) != gyrosampletail) {
+        for (int x = 0; x < 3; ++x)
+            gyrosamples[head][x] = rates[x];
+        gyrosamplecounts[head] = 1;
+        gyrosamplehead = (head + 1) & GYRO_SAMPLE_BUFFER_MASK;
+    } else {
+        // full.  The newest slot can't be the one the main loop is reading, that is the oldest.
+        head = (head - 1) & GYRO_SAMPLE_BUFFER_MASK;
+        if (gyrosamplecounts[head] < GYRO_SAMPLE_MAXSUM) {
+            for (int x = 0; x < 3; ++x)
+                gyrosamples[head][x] += rates[x];
+            ++gyrosamplecounts[head];
+        }
+    }
+}
+
+#if (GYRO_FIFO == YES)
+#if (GYRO_TYPE != MPU3050) && (GYRO_TYPE != MPU6050)
+#error "GYRO_FIFO needs an MPU3050 or MPU6050"
+#endif
+#if (GYRO_FIFO_RATE % GYRO_SAMPLE_RATE != 0) || (GYRO_FIFO_RATE / GYRO_SAMPLE_RATE > 256)
+#error "GYRO_SAMPLE_RATE has to divide the gyro's internal sample rate"
+#endif
+#ifndef GYRO_FIFO_ACCBYTES
+#define GYRO_FIFO_ACCBYTES 0
+#endif
+#define GYRO_FIFO_SAMPLEBYTES (GYRO_FIFO_ACCBYTES + 6)
+
+#if (GYRO_FIFO_ACCBYTES != 0)
+static int16_t gyrofifoacc[3];  // the average of the accelerometer samples of the last readgyrofifo()
+#endif
+
+static void resetgyrofifo(void)
+{
+    lib_i2c_writereg(GYRO_FIFO_ADDRESS, GYRO_FIFO_USERCTRLREGISTER, GYRO_FIFO_RESET);
+    lib_i2c_writereg(GYRO_FIFO_ADDRESS, GYRO_FIFO_USERCTRLREGISTER, GYRO_FIFO_ENABLE);
+}
+
+// Moves the samples from the gyro's FIFO into the ring buffer.  It reads how many there are, then all of them in
+// one burst, or in bursts of a ring buffer full if the main loop was very late.  A burst costs the address and
+// register bytes once instead of once per sample.  If the FIFO may have overflowed the samples don't start at a
+// sample any more, so it is emptied and those samples are lost.
+void readgyrofifo(void)
+{
+    unsigned char data[GYRO_SAMPLE_BUFFER_SIZE * GYRO_FIFO_SAMPLEBYTES];
+
+    lib_i2c_readdata(GYRO_FIFO_ADDRESS, GYRO_FIFO_COUNTREGISTER, data, 2);
+    unsigned int samples = (data[0] << 8) | data[1];
+
+    if (samples > GYRO_FIFO_SIZE - GYRO_FIFO_SAMPLEBYTES) {
+        resetgyrofifo();
+        return;
+    }
+    samples /= GYRO_FIFO_SAMPLEBYTES;
+
+#if (GYRO_FIFO_ACCBYTES != 0)
+    int32_t accsum[3] = { 0, 0, 0 };
+    unsigned int acccount = samples;
+#endif
+    while (samples) {
+        unsigned char burst = samples < GYRO_SAMPLE_BUFFER_SIZE ? samples : GYRO_SAMPLE_BUFFER_SIZE;
+
+        lib_i2c_readdata(GYRO_FIFO_ADDRESS, GYRO_FIFO_DATAREGISTER, data, burst * GYRO_FIFO_SAMPLEBYTES);
+        for (unsigned char i = 0; i < burst; ++i) {
+            unsigned char *sample = &data[i * GYRO_FIFO_SAMPLEBYTES];
+            fixedpointnum rates[3];
+
+#if (GYRO_FIFO_ACCBYTES != 0)
+            for (int x = 0; x < 3; ++x)
+                accsum[x] += (int16_t) ((sample[2 * x] << 8) | sample[2 * x + 1]);
+#endif
+            gyrodatatorates(&sample[GYRO_FIFO_ACCBYTES], rates);
+            addgyrosample(rates);
+        }
+        samples -= burst;
+    }
+#if (GYRO_FIFO_ACCBYTES != 0)
+    if (acccount)
+        for (int x = 0; x < 3; ++x)
+            gyrofifoacc[x] = accsum[x] / (int32_t) acccount;
+#endif
+}
+
+#if (GYRO_FIFO_ACCBYTES != 0)
+// the accelerometer's readings as they come from the sensor, averaged over the samples of the last readgyrofifo()
+void readgyrofifoacc(int16_t * acc)
+{
+    for (int x = 0; x < 3; ++x)
+        acc[x] = gyrofifoacc[x];
+}
+#endif
+
+#else
+// the timer interrupt
+static void samplegyro(void)
+{
+    fixedpointnum rates[3];
+
+    readgyrorates(rates);
+    addgyrosample(rates);
+}
+#endif
+
+void startgyrosampling(void)
+{
+    gyrosampletail = gyrosamplehead;
+#if (GYRO_FIFO == YES)
+    resetgyrofifo();
+#else
+    lib_timers_startperiodiccallback(1000000L / GYRO_SAMPLE_RATE, samplegyro);
+#endif
+}
+
+// takes the oldest slot out of the buffer.  Returns how many samples were added up in it, 0 if there were none.
+unsigned char readgyrosample(fixedpointnum * gyroratesum)
+{
+    unsigned char tail = gyrosampletail;
+
+    if (tail == gyrosamplehead)
+        return 0;
+
+    unsigned char count = gyrosamplecounts[tail];
+    for (int x = 0; x < 3; ++x)
+        gyroratesum[x] = gyrosamples[tail][x];
+    gyrosampletail = (tail + 1) & GYRO_SAMPLE_BUFFER_MASK;
+    return count;
+}
+
+// 1/count, so averaging a slot is a multiply rather than the M0's software divide
+static const fixedpointnum gyrosamplereciprocals[GYRO_SAMPLE_MAXSUM + 1] = {
+    0, FIXEDPOINTONE, FIXEDPOINTCONSTANT(1.0 / 2), FIXEDPOINTCONSTANT(1.0 / 3), FIXEDPOINTCONSTANT(1.0 / 4),
+    FIXEDPOINTCONSTANT(1.0 / 5), FIXEDPOINTCONSTANT(1.0 / 6), FIXEDPOINTCONSTANT(1.0 / 7), FIXEDPOINTCONSTANT(1.0 / 8),
+    FIXEDPOINTCONSTANT(1.0 / 9), FIXEDPOINTCONSTANT(1.0 / 10), FIXEDPOINTCONSTANT(1.0 / 11), FIXEDPOINTCONSTANT(1.0 / 12),
+    FIXEDPOINTCONSTANT(1.0 / 13), FIXEDPOINTCONSTANT(1.0 / 14), FIXEDPOINTCONSTANT(1.0 / 15), FIXEDPOINTCONSTANT(1.0 / 16)
+};
+
+// turns the sum of count samples from readgyrosample() into their average
+void averagegyrosample(fixedpointnum * gyroratesum, unsigned char count)
+{
+    if (count > 1)
+        for (int x = 0; x < 3; ++x)
+            gyroratesum[x] = lib_fp_multiply(gyroratesum[x], gyrosamplereciprocals[count]);
+}
+
+// empties the buffer and leaves the newest rates in global.gyrorate.  If no sample came in since the last
+// call, global.gyrorate stays as it was.
+void readgyro(void)
+{
+    fixedpointnum rates[3];
+    unsigned char count;
+
+#if (GYRO_FIFO == YES)
+    readgyrofifo();
+#endif
+    while ((count = readgyrosample(rates))) {
+        averagegyrosample(rates, count);
+        for (int x = 0; x < 3; ++x)
+            global.gyrorate[x] = rates[x];
+    }
+}
 #endif
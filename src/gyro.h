@@ -17,3 +17,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 void initgyro(void);
 void readgyro(void);
+
+#if (GYRO_SAMPLE_RATE != 0)
+void startgyrosampling(void);
+unsigned char readgyrosample(fixedpointnum * gyroratesum);
+void averagegyrosample(fixedpointnum * gyroratesum, unsigned char count);
+#endif
+#if (GYRO_FIFO == YES)
+void readgyrofifo(void);
+void readgyrofifoacc(int16_t * acc);
+#endif
+#if (MPU6050_COMBINED_READ == YES)
+void readgyrocombinedacc(int16_t * acc);
+fixedpointnum gyrotemperature(void);
+#endif
@@ -27,6 +27,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "baro.h"
 #include "imu.h"
 #include "compass.h"
+#if (ACC_SIX_POSITION_CALIBRATION == YES)
+#include "eeprom.h"
+#endif
 
 extern globalstruct global;
 extern usersettingsstruct usersettings;
@@ -61,42 +64,306 @@ fixedpointnum estimated_compass_vector[3] = { FIXEDPOINTONE, 0, 0 };    // start
 
 #define ONE_OVER_ACC_COMPLIMENTARY_FILTER_TIME_PERIOD FIXEDPOINTCONSTANT(1.0/ACC_COMPLIMENTARY_FILTER_TIME_PERIOD)
 
+#if (ACC_ADAPTIVE_GAIN == YES)
+// ACC_ADAPTIVE_GAIN weighs each accelerometer reading by how far it can be trusted, instead of taking all of it
+// between MINACCMAGNITUDESQUARED and MAXACCMAGNITUDESQUARED and none of it outside.  The weight is the product of
+// three parts.  It falls to zero as |a| gets ACC_ADAPTIVE_WINDOW away from 1 g, and as the roll or pitch rate gets
+// to ACC_ADAPTIVE_RATE, where the accelerometer mostly sees the thrust (flips).  It halves when the vibration,
+// the running average of how much the readings change from one to the next, summed over the axes, gets to
+// ACC_ADAPTIVE_VIBRATION, and the vibration widens the |a| window so shaking alone doesn't shut it.  While the
+// rate is above half of ACC_ADAPTIVE_RATE the gain is raised for ACC_ADAPTIVE_RECOVERY_CHARGE seconds per second,
+// by up to ACC_ADAPTIVE_RECOVERY_GAIN after ACC_ADAPTIVE_RECOVERY_TIME, so after a flip the estimate catches up
+// with the gyro error it collected.  ACC_ADAPTIVE_WINDOW has to stay below 1.  However much the vibration
+// widens the window, a reading of 2 g or more gets no weight, it couldn't go in a fixedpointnum30.
+#ifndef ACC_ADAPTIVE_WINDOW
+#define ACC_ADAPTIVE_WINDOW 0.15        // g
+#endif
+#ifndef ACC_ADAPTIVE_RATE
+#define ACC_ADAPTIVE_RATE 500.0         // degrees per second
+#endif
+#ifndef ACC_ADAPTIVE_VIBRATION
+#define ACC_ADAPTIVE_VIBRATION 1.0      // g
+#endif
+#ifndef ACC_ADAPTIVE_RECOVERY_GAIN
+#define ACC_ADAPTIVE_RECOVERY_GAIN 8.0
+#endif
+#ifndef ACC_ADAPTIVE_RECOVERY_TIME
+#define ACC_ADAPTIVE_RECOVERY_TIME 2.0  // seconds
+#endif
+#ifndef ACC_ADAPTIVE_RECOVERY_CHARGE
+#define ACC_ADAPTIVE_RECOVERY_CHARGE 8.0
+#endif
+
+// |a|-1 is about (|a|^2-1)/2, so the magnitude part is 1-|(|a|^2-1)|/(2*(ACC_ADAPTIVE_WINDOW+vibration))
+#define FP_ACC_ADAPTIVE_WINDOW FIXEDPOINTCONSTANT(ACC_ADAPTIVE_WINDOW)
+#define FP_ONE_OVER_ACC_ADAPTIVE_RATE FIXEDPOINTCONSTANT(1.0/ACC_ADAPTIVE_RATE)
+#define FP_ACC_ADAPTIVE_VIBRATION FIXEDPOINTCONSTANT(ACC_ADAPTIVE_VIBRATION)
+#define FP_ACC_ADAPTIVE_RECOVERY_TIME FIXEDPOINT24CONSTANT(ACC_ADAPTIVE_RECOVERY_TIME)
+#define FP_ACC_ADAPTIVE_RECOVERY_CHARGE FIXEDPOINTCONSTANT(ACC_ADAPTIVE_RECOVERY_CHARGE)
+#define FP_ACC_ADAPTIVE_RECOVERY_SLOPE FIXEDPOINTCONSTANT((ACC_ADAPTIVE_RECOVERY_GAIN-1.0)/ACC_ADAPTIVE_RECOVERY_TIME)
+#define FP_ONE_OVER_ACC_VIBRATION_TIME_PERIOD FIXEDPOINTCONSTANT(2.0)   // averaged over half a second
+#define MAXADAPTIVEACCMAGNITUDESQUARED FIXEDPOINTCONSTANT(4.0)
+
+static fixedpointnum lastaccreading[3];
+static fixedpointnum accvibration;      // g
+static fixedpointnum24 accrecoverytime; // seconds, what is left of the raised gain
+#endif
+
+// The euler angles take three lib_fp_atan2()s, and full acro mode doesn't use them.  They are worked out when
+// something asks for them with imuupdateeulerattitude(), at most once per attitude update.
+static bool eulerattitudestale = true;
+
+#if (IMU_ESTIMATOR == QUATERNION_ESTIMATOR)
+// The quaternion estimator turns the attitude by the gyro and by the error between its down vector and the
+// accelerometer's.  The error times 1/ACC_COMPLIMENTARY_FILTER_TIME_PERIOD makes it creep like the vector
+// filter does.  The integral of the error times GYRO_BIAS_GAIN is its estimate of the gyro bias (a PI controller,
+// or Mahony's filter).  The default makes the two gains critically damped.
+#ifndef GYRO_BIAS_GAIN
+#define GYRO_BIAS_GAIN (.25/(ACC_COMPLIMENTARY_FILTER_TIME_PERIOD*ACC_COMPLIMENTARY_FILTER_TIME_PERIOD))        // per second squared
+#endif
+#define FP_GYRO_BIAS_GAIN FIXEDPOINTCONSTANT(GYRO_BIAS_GAIN)
+#define MAXGYROBIAS FIXEDPOINT30CONSTANT(.1)     // radians per second
+// Without a compass nothing corrects the bias of the yaw gyro (Z).  The accelerometer only sees it while tilted,
+// which is mostly while accelerating, so the yaw bias it would learn is mostly wrong and then never unlearned.
+#if (COMPASS_TYPE == NO_COMPASS)
+#define GYROBIASAXES 2
+#else
+#define GYROBIASAXES 3
+#endif
+
+static fixedpointnum30 attitudequaternion[4];
+static fixedpointnum30 gyrobias[3];    // radians per second in the attitude vectors' frame
+#endif
+
+#if (GYRO_SAMPLE_RATE != 0) && (GYRO_FIFO == NO)
+// The gyro's timer interrupt reads it on the same I2C bus as the other sensors, so it waits while they are read.
+#define HOLDGYROSAMPLING() lib_timers_holdperiodiccallback(true)
+#define RELEASEGYROSAMPLING() lib_timers_holdperiodiccallback(false)
+#else
+#define HOLDGYROSAMPLING()
+#define RELEASEGYROSAMPLING()
+#endif
+
+#if (GYRO_SAMPLE_RATE != 0)
+
+// the rotation of one gyro sample in radians per degree per second, as a fixedpointnum shifted left 32, so
+// lib_fp_multiplyshift() by GYRO_SAMPLE_ANGLESHIFT turns the rate into a fixedpointnum24 angle
+#define FP_GYRO_SAMPLE_RADIANS ((fixedpointnum)(3.14159265358979 / 180 / GYRO_SAMPLE_RATE * 4294967296.0 + .5))
+#define GYRO_SAMPLE_ANGLESHIFT (FIXEDPOINTSHIFT + 32 - FIXEDPOINT24SHIFT)
+
+static fixedpointnum24 previousgyrosampleangles[3];
+#endif
+
+// The calibration averages the gyro (and accelerometer) readings while the aircraft sits still, until the averages'
+// standard errors (the readings' standard deviation over the square root of the number of readings) are below
+// GYRO_CALIBRATION_ERROR and ACC_CALIBRATION_ERROR, but for at least CALIBRATION_MIN_TIME.  A reading further than
+// GYRO_CALIBRATION_MOTION or ACC_CALIBRATION_MOTION from its average means the aircraft moved, and the averages
+// start over.  After CALIBRATION_MAX_TIME it gives up and keeps the calibration it had, and the gyro's is still good
+// to arm with.  The averages since the last restart may be from the aircraft still settling, and it may have moved
+// all along.
+#ifndef GYRO_CALIBRATION_ERROR
+#define GYRO_CALIBRATION_ERROR 0.02     // degrees per second
+#endif
+#ifndef GYRO_CALIBRATION_MOTION
+#define GYRO_CALIBRATION_MOTION 3.0     // degrees per second
+#endif
+#ifndef ACC_CALIBRATION_ERROR
+#define ACC_CALIBRATION_ERROR 0.001     // g
+#endif
+#ifndef ACC_CALIBRATION_MOTION
+#define ACC_CALIBRATION_MOTION 0.05     // g
+#endif
+#ifndef CALIBRATION_MIN_TIME
+#define CALIBRATION_MIN_TIME 0.5        // seconds
+#endif
+#ifndef CALIBRATION_MAX_TIME
+#define CALIBRATION_MAX_TIME 8.0        // seconds
+#endif
+// the errors squared, shifted left 32
+#define FP_GYRO_CALIBRATION_ERRORSQUARED ((fixedpointnum)(GYRO_CALIBRATION_ERROR * GYRO_CALIBRATION_ERROR * 4294967296.0 + .5))
+#define FP_ACC_CALIBRATION_ERRORSQUARED ((fixedpointnum)(ACC_CALIBRATION_ERROR * ACC_CALIBRATION_ERROR * 4294967296.0 + .5))
+#define MAXRUNNINGSTATSREADING FIXEDPOINTCONSTANT(100)        // so a reading fits in a fixedpointnum24
+
+// the average and variance of three readings since the last motion, as fixedpointnum24s
+typedef struct {
+    fixedpointnum24 mean[3];
+    fixedpointnum24 variance[3];
+    fixedpointnum24 time;       // seconds of readings, up to the time limit
+} runningstatsstruct;
+
+calibrationinfostruct calibrationinfo;
+
+// With GYRO_BIAS_TRACKING the imu keeps averaging the raw gyro rates whenever the aircraft is disarmed and still,
+// with the calibration's limits.  Once the average is good enough it becomes the gyro calibration, and it keeps
+// updating it for as long as the aircraft stays still.  After GYRO_BIAS_TIME_CONSTANT seconds the average becomes a
+// lowpass filter, so it follows the bias as the gyro warms up.  Without it, it only runs while the gyro isn't
+// calibrated, after a calibration timed out with no calibration to keep, so the aircraft can still be armed.
+#ifndef GYRO_BIAS_TIME_CONSTANT
+#define GYRO_BIAS_TIME_CONSTANT 2.0     // seconds
+#endif
+
+static runningstatsstruct gyrobiasstats;
+
+#if (ACC_SIX_POSITION_CALIBRATION == YES)
+// The six position calibration fits a gain and an offset to each accelerometer axis.  The aircraft is held still
+// with each axis pointing straight down and straight up in turn, in any order.  A position counts once the
+// averages settle like the level calibration's, the largest one is over ACC_SIX_POSITION_MIN_G and its axis and
+// sign haven't had their turn yet.  Each position's averages (x,y,z) go into the normal equations of the least
+// squares fit of the ellipsoid A*x^2+B*y^2+C*z^2+D*x+E*y+F*z=1, so the positions needn't be square.  With all six,
+// the main loop solves the equations a step at a time, so it never stalls: a column of the elimination per loop,
+// then a row of the back substitution per loop, then the gains and offsets.  The centre of the ellipsoid is
+// c=(-D/2A,-E/2B,-F/2C), and scaling x-cx by sqrt(A/(1+A*cx^2+B*cy^2+C*cz^2)) and so on turns it into the 1 g
+// sphere.  Without a new position for ACC_SIX_POSITION_TIMEOUT seconds, or with a fit that can't be an
+// accelerometer, it fails and keeps the old calibration.
+#ifndef ACC_SIX_POSITION_MIN_G
+#define ACC_SIX_POSITION_MIN_G 0.8
+#endif
+#ifndef ACC_SIX_POSITION_TIMEOUT
+#define ACC_SIX_POSITION_TIMEOUT 60.0   // seconds
+#endif
+#define ACC_SIX_POSITION_MAX_GAIN_ERROR 0.25
+#define ACC_SIX_POSITION_MAX_OFFSET 0.5 // g
+
+#define SIXPOSITIONUNKNOWNS 6
+#define SIXPOSITIONALL 0x3F
+
+accsixpositioninfostruct accsixpositioninfo;
+static runningstatsstruct sixpositionstats;
+static fixedpointnum sixpositionequations[SIXPOSITIONUNKNOWNS][SIXPOSITIONUNKNOWNS + 1];       // solved in place
+static unsigned char sixpositionstep;
+static fixedpointnum oldacccalibration[3];
+static int16_t oldaccgaincorrection[3];
+#endif
+
 //fixedpointnum ; // convert from degrees to radians and include fudge factor
-fixedpointnum barotimeinterval = 0;     // accumulated time between barometer reads
-fixedpointnum compasstimeinterval = 0;  // accumulated time between barometer reads
+fixedpointnum24 barotimeinterval = 0;   // accumulated time between barometer reads
+fixedpointnum24 compasstimeinterval = 0;        // accumulated time between compass reads
 fixedpointnum lastbarorawaltitude;      // remember our last reading so we can calculate altitude velocity
 
-// read the acc and gyro a bunch of times and get an average of how far off they are.
-// assumes the aircraft is sitting level and still.
+// adds readings that came global.timesliver after the last ones.  If one is further than motion from its
+// average, the averages start over with these readings and it returns false.  After timelimit seconds the average
+// becomes a lowpass filter with that time constant.
+static bool addrunningstats(runningstatsstruct * stats, fixedpointnum * readings, fixedpointnum24 motion, fixedpointnum24 timelimit)
+{
+    fixedpointnum24 values[3];
+    bool still = true;
+
+    for (int x = 0; x < 3; ++x) {
+        if (lib_fp_abs(readings[x]) > MAXRUNNINGSTATSREADING) {
+            stats->time = 0;
+            return false;
+        }
+        values[x] = readings[x] << TIMESLIVEREXTRASHIFT;
+        if (stats->time && lib_fp_abs(values[x] - stats->mean[x]) > motion)
+            still = false;
+    }
+    if (!still)
+        stats->time = 0;
+
+    if (stats->time < timelimit)
+        stats->time += global.timesliver;
+    // these readings' share of the average, a fixedpointnum24.  It is 1 for the first readings.
+    fixedpointnum24 fraction = lib_fp_divide(global.timesliver << TIMESLIVEREXTRASHIFT, stats->time);
+
+    for (int x = 0; x < 3; ++x) {
+        fixedpointnum24 difference = values[x] - stats->mean[x];
+        fixedpointnum24 square = lib_fp_multiply24(difference, difference);
+
+        // the weighted mean and variance, with the variance's update (1-fraction)*(variance+fraction*difference^2)
+        stats->mean[x] += lib_fp_multiply24(fraction, difference);
+        stats->variance[x] += lib_fp_multiply24(fraction, lib_fp_multiply24(FIXEDPOINT24ONE - fraction, square) - stats->variance[x]);
+    }
+    return still;
+}
+
+// true if the averages have CALIBRATION_MIN_TIME of readings and their standard errors are below the error whose
+// square, shifted left 32, is errorsquared.  A standard error squared is variance*timesliver/time.
+static bool runningstatssettled(runningstatsstruct * stats, fixedpointnum errorsquared)
+{
+    if (stats->time < FIXEDPOINT24CONSTANT(CALIBRATION_MIN_TIME))
+        return false;
+    for (int x = 0; x < 3; ++x)
+        if (lib_fp_multiply24(global.timesliver, stats->variance[x]) > lib_fp_multiplyshift(stats->time, errorsquared, 32))
+            return false;
+    return true;
+}
+
+// applies the acc calibration to global.acc_g_vector, one multiply and add per axis.  The readings are multiples of
+// 1/1024 g, so dropping 4 bits loses nothing and the product of up to 8 g and a gain error of up to 0.5 fits.
+static void correctaccreading(void)
+{
+    for (int x = 0; x < 3; ++x)
+        global.acc_g_vector[x] += (((global.acc_g_vector[x] >> 4) * usersettings.accgaincorrection[x]) >> 12) + usersettings.acccalibration[x];
+}
+
+// read the acc and gyro until their averages settle and use the averages to calibrate them, see
+// GYRO_CALIBRATION_ERROR above.  Assumes the aircraft is sitting level.
 // If both==false, only gyro is calibrated and accelerometer calibration not touched.
+// The acc gains of the six position calibration are kept, only the offsets are measured again.
 void calibrategyroandaccelerometer(bool both)
 {
+    runningstatsstruct gyrostats, accstats;
+    fixedpointnum previousgyrocalibration[3], previousacccalibration[3];
+    bool hadgyrocalibration = global.gyrocalibrated || global.usersettingsfromeeprom;
 #ifdef X4_BUILD
     uint8_t ledstatus;
+    fixedpointnum24 motiontime = -FIXEDPOINT24CONSTANT(1);      // when it last moved
 #endif
 
     for (int x = 0; x < 3; ++x) {
+        previousgyrocalibration[x] = usersettings.gyrocalibration[x];
+        previousacccalibration[x] = usersettings.acccalibration[x];
         usersettings.gyrocalibration[x] = 0;
         if(both)
             usersettings.acccalibration[x] = 0;
     }
 
-    fixedpointnum totaltime = 0;
+    fixedpointnum24 totaltime = 0;
+    gyrostats.time = accstats.time = 0;
+    calibrationinfo.restarts = 0;
+    calibrationinfo.timedout = 0;
 
     // calibrate the gyro and acc
-    while (totaltime < (FIXEDPOINTCONSTANT(4) << TIMESLIVEREXTRASHIFT)) // 4 seconds
-    {
+    while (1) {
         readgyro();
         if(both) {
+            HOLDGYROSAMPLING();
             readacc();
+            RELEASEGYROSAMPLING();
+            correctaccreading();
             global.acc_g_vector[ZINDEX] -= FIXEDPOINTONE; // vertical vector should be at 1g
         }
 
         calculatetimesliver();
         totaltime += global.timesliver;
+
+        bool still = addrunningstats(&gyrostats, global.gyrorate, FIXEDPOINT24CONSTANT(GYRO_CALIBRATION_MOTION), FIXEDPOINT24CONSTANT(CALIBRATION_MAX_TIME));
+        if (both && !addrunningstats(&accstats, global.acc_g_vector, FIXEDPOINT24CONSTANT(ACC_CALIBRATION_MOTION), FIXEDPOINT24CONSTANT(CALIBRATION_MAX_TIME)))
+            still = false;
+        if (!still) {
+            // start both over, from the next readings
+            gyrostats.time = accstats.time = 0;
 #ifdef X4_BUILD
+            motiontime = totaltime;
+#endif
+            if (calibrationinfo.restarts < 255)
+                ++calibrationinfo.restarts;
+        } else if (runningstatssettled(&gyrostats, FP_GYRO_CALIBRATION_ERRORSQUARED)
+            && (!both || runningstatssettled(&accstats, FP_ACC_CALIBRATION_ERRORSQUARED)))
+            break;
+
+        if (totaltime >= FIXEDPOINT24CONSTANT(CALIBRATION_MAX_TIME)) {
+            calibrationinfo.timedout = 1;
+            break;
+        }
+#ifdef X4_BUILD
+        if (totaltime - motiontime < FIXEDPOINT24CONSTANT(.5)) {
+            // It moved, all LEDs flash fast while it starts over
+            x4_set_leds((totaltime >> (FIXEDPOINT24SHIFT - 4)) & 1 ? X4_LED_ALL : X4_LED_NONE);
+            continue;
+        }
         // Rotating LED pattern
-        ledstatus = (uint8_t)((totaltime >> (FIXEDPOINTSHIFT+TIMESLIVEREXTRASHIFT-3))& 0x3);
+        ledstatus = (uint8_t)((totaltime >> (FIXEDPOINT24SHIFT-3))& 0x3);
         switch(ledstatus) {
         case 0:
             x4_set_leds(X4_LED_FL);
@@ -112,115 +379,532 @@ void calibrategyroandaccelerometer(bool both)
             break;
         }
 #endif
+    }
+
+    calibrationinfo.milliseconds = lib_fp_multiply24(totaltime, 1000L);
+    if (calibrationinfo.timedout) {
         for (int x = 0; x < 3; ++x) {
-            lib_fp_lowpassfilter(&usersettings.gyrocalibration[x], -global.gyrorate[x], global.timesliver, FIXEDPOINTONEOVERONE, TIMESLIVEREXTRASHIFT);
-            if(both)
-                lib_fp_lowpassfilter(&usersettings.acccalibration[x], -global.acc_g_vector[x], global.timesliver, FIXEDPOINTONEOVERONE, TIMESLIVEREXTRASHIFT);
+            usersettings.gyrocalibration[x] = previousgyrocalibration[x];
+            usersettings.acccalibration[x] = previousacccalibration[x];
+            calibrationinfo.gyrovariance[x] = gyrostats.variance[x];
+            calibrationinfo.accvariance[x] = both ? accstats.variance[x] : 0;
+        }
+        // the gyro calibration it had is still good to arm with.  Without one, trackgyrobias() measures the gyro from
+        // the control task.  The X4's ledtask() shows it failed until the next calibration.
+        if (hadgyrocalibration)
+            global.gyrocalibrated = 1;
+        gyrobiasstats.time = 0;
+        return;
+    }
+
+    for (int x = 0; x < 3; ++x) {
+        usersettings.gyrocalibration[x] = -(gyrostats.mean[x] >> TIMESLIVEREXTRASHIFT);
+        calibrationinfo.gyrovariance[x] = gyrostats.variance[x];
+        calibrationinfo.accvariance[x] = 0;
+        if(both) {
+            usersettings.acccalibration[x] = -(accstats.mean[x] >> TIMESLIVEREXTRASHIFT);
+            calibrationinfo.accvariance[x] = accstats.variance[x];
         }
     }
+    global.gyrocalibrated = 1;
 }
 
+// see GYRO_BIAS_TRACKING above.  Uses global.gyrorate and global.stable of this update.
+static void trackgyrobias(void)
+{
+    fixedpointnum rates[3];
+
+    for (int x = 0; x < 3; ++x)
+        rates[x] = global.gyrorate[x] - usersettings.gyrocalibration[x];
+    if (!global.stable || global.armed) {
+        gyrobiasstats.time = 0;
+        return;
+    }
+    if (addrunningstats(&gyrobiasstats, rates, FIXEDPOINT24CONSTANT(GYRO_CALIBRATION_MOTION), FIXEDPOINT24CONSTANT(GYRO_BIAS_TIME_CONSTANT))
+        && runningstatssettled(&gyrobiasstats, FP_GYRO_CALIBRATION_ERRORSQUARED)) {
+        for (int x = 0; x < 3; ++x)
+            usersettings.gyrocalibration[x] = -(gyrobiasstats.mean[x] >> TIMESLIVEREXTRASHIFT);
+        global.gyrocalibrated = 1;
+    }
+}
+
+#if (ACC_SIX_POSITION_CALIBRATION == YES)
+// starts the six position calibration, see ACC_SIX_POSITION_CALIBRATION above.  The acc readings are raw while it
+// runs.  Starting again while it runs starts over, keeping the calibration from before the first start.
+void startaccsixpositioncalibration(void)
+{
+    if (accsixpositioninfo.state != ACCSIXPOSITIONCOLLECTING && accsixpositioninfo.state != ACCSIXPOSITIONSOLVING)
+        for (int x = 0; x < 3; ++x) {
+            oldacccalibration[x] = usersettings.acccalibration[x];
+            oldaccgaincorrection[x] = usersettings.accgaincorrection[x];
+        }
+    for (int x = 0; x < 3; ++x) {
+        usersettings.acccalibration[x] = 0;
+        usersettings.accgaincorrection[x] = 0;
+    }
+    for (int i = 0; i < SIXPOSITIONUNKNOWNS; ++i)
+        for (int j = 0; j <= SIXPOSITIONUNKNOWNS; ++j)
+            sixpositionequations[i][j] = 0;
+    sixpositionstats.time = 0;
+    accsixpositioninfo.positions = 0;
+    accsixpositioninfo.waitingtime = 0;
+    accsixpositioninfo.state = ACCSIXPOSITIONCOLLECTING;
+}
+
+static void endaccsixpositioncalibration(bool succeeded)
+{
+    if (succeeded) {
+        accsixpositioninfo.state = ACCSIXPOSITIONDONE;
+        CONTROLTASKWRITEUSERSETTINGS();
+        return;
+    }
+    for (int x = 0; x < 3; ++x) {
+        usersettings.acccalibration[x] = oldacccalibration[x];
+        usersettings.accgaincorrection[x] = oldaccgaincorrection[x];
+    }
+    accsixpositioninfo.state = ACCSIXPOSITIONFAILED;
+}
+
+// adds this reading to the averages and, once they settle in a new position, adds that position to the equations
+static void collectaccsixposition(void)
+{
+    accsixpositioninfo.waitingtime += global.timesliver >> TIMESLIVEREXTRASHIFT;
+    if (accsixpositioninfo.waitingtime > FIXEDPOINTCONSTANT(ACC_SIX_POSITION_TIMEOUT)) {
+        endaccsixpositioncalibration(false);
+        return;
+    }
+    if (!addrunningstats(&sixpositionstats, global.acc_g_vector, FIXEDPOINT24CONSTANT(ACC_CALIBRATION_MOTION), FIXEDPOINT24CONSTANT(CALIBRATION_MAX_TIME))
+        || !runningstatssettled(&sixpositionstats, FP_ACC_CALIBRATION_ERRORSQUARED))
+        return;
+
+    fixedpointnum a[3];
+    int axis = 0;
+    for (int x = 0; x < 3; ++x) {
+        a[x] = sixpositionstats.mean[x] >> TIMESLIVEREXTRASHIFT;
+        if (lib_fp_abs(a[x]) > lib_fp_abs(a[axis]))
+            axis = x;
+    }
+    unsigned char position = 1 << (axis * 2 + (a[axis] < 0));
+    if (lib_fp_abs(a[axis]) < FIXEDPOINTCONSTANT(ACC_SIX_POSITION_MIN_G) || (accsixpositioninfo.positions & position))
+        return;
+
+    // the position's row of the fit and its right hand side, 1
+    fixedpointnum row[SIXPOSITIONUNKNOWNS + 1];
+    for (int x = 0; x < 3; ++x) {
+        row[x] = lib_fp_multiply(a[x], a[x]);
+        row[x + 3] = a[x];
+    }
+    row[SIXPOSITIONUNKNOWNS] = FIXEDPOINTONE;
+    for (int i = 0; i < SIXPOSITIONUNKNOWNS; ++i)
+        for (int j = 0; j <= SIXPOSITIONUNKNOWNS; ++j)
+            sixpositionequations[i][j] += lib_fp_multiply(row[i], row[j]);
+
+    accsixpositioninfo.positions |= position;
+    accsixpositioninfo.waitingtime = 0;
+    if (accsixpositioninfo.positions == SIXPOSITIONALL) {
+        accsixpositioninfo.state = ACCSIXPOSITIONSOLVING;
+        sixpositionstep = 0;
+    }
+}
+
+// turns the solution A..F into the calibration
+static void finishaccsixposition(void)
+{
+    fixedpointnum solution[SIXPOSITIONUNKNOWNS], centre[3];
+    fixedpointnum g = FIXEDPOINTONE;
+
+    for (int i = 0; i < SIXPOSITIONUNKNOWNS; ++i)
+        solution[i] = sixpositionequations[i][SIXPOSITIONUNKNOWNS];
+    for (int x = 0; x < 3; ++x) {
+        if (solution[x] <= 0) {
+            endaccsixpositioncalibration(false);
+            return;
+        }
+        centre[x] = lib_fp_divide(-solution[x + 3], solution[x] << 1);
+        g += lib_fp_multiply(solution[x], lib_fp_multiply(centre[x], centre[x]));
+    }
+    for (int x = 0; x < 3; ++x) {
+        fixedpointnum gain = lib_fp_sqrt(lib_fp_divide(solution[x], g));
+        fixedpointnum offset = -lib_fp_multiply(gain, centre[x]);
+        if (lib_fp_abs(gain - FIXEDPOINTONE) > FIXEDPOINTCONSTANT(ACC_SIX_POSITION_MAX_GAIN_ERROR)
+            || lib_fp_abs(offset) > FIXEDPOINTCONSTANT(ACC_SIX_POSITION_MAX_OFFSET)) {
+            endaccsixpositioncalibration(false);
+            return;
+        }
+        usersettings.accgaincorrection[x] = gain - FIXEDPOINTONE;
+        usersettings.acccalibration[x] = offset;
+    }
+    endaccsixpositioncalibration(true);
+}
+
+// one step of solving the equations: gaussian elimination with partial pivoting, a column per step, then back
+// substitution, a row per step, leaving the solution in the right hand side
+static void solveaccsixposition(void)
+{
+    fixedpointnum(*n)[SIXPOSITIONUNKNOWNS + 1] = sixpositionequations;
+    int k = sixpositionstep++;
+
+    if (k < SIXPOSITIONUNKNOWNS) {
+        int pivot = k;
+        for (int r = k + 1; r < SIXPOSITIONUNKNOWNS; ++r)
+            if (lib_fp_abs(n[r][k]) > lib_fp_abs(n[pivot][k]))
+                pivot = r;
+        if (n[pivot][k] == 0) {
+            endaccsixpositioncalibration(false);
+            return;
+        }
+        for (int c = k; c <= SIXPOSITIONUNKNOWNS; ++c) {
+            fixedpointnum swap = n[k][c];
+            n[k][c] = n[pivot][c];
+            n[pivot][c] = swap;
+        }
+        for (int r = k + 1; r < SIXPOSITIONUNKNOWNS; ++r) {
+            fixedpointnum factor = lib_fp_divide(n[r][k], n[k][k]);
+            for (int c = k; c <= SIXPOSITIONUNKNOWNS; ++c)
+                n[r][c] -= lib_fp_multiply(factor, n[k][c]);
+        }
+    } else if (k < 2 * SIXPOSITIONUNKNOWNS) {
+        int r = 2 * SIXPOSITIONUNKNOWNS - 1 - k;
+        fixedpointnum sum = n[r][SIXPOSITIONUNKNOWNS];
+        for (int c = r + 1; c < SIXPOSITIONUNKNOWNS; ++c)
+            sum -= lib_fp_multiply(n[r][c], n[c][SIXPOSITIONUNKNOWNS]);
+        n[r][SIXPOSITIONUNKNOWNS] = lib_fp_divide(sum, n[r][r]);
+    } else
+        finishaccsixposition();
+}
+
+// the main loop calls this every loop, after the imu
+void accsixpositioncalibrationstep(void)
+{
+    if (accsixpositioninfo.state == ACCSIXPOSITIONCOLLECTING)
+        collectaccsixposition();
+    else if (accsixpositioninfo.state == ACCSIXPOSITIONSOLVING)
+        solveaccsixposition();
+}
+#endif
+
 void initimu(void)
 {
     // calibrate both sensors if we didn't load any data from eeprom
     if (global.usersettingsfromeeprom == 0)
         calibrategyroandaccelerometer(true);
+#if (GYRO_BIAS_TRACKING == YES)
+    else {
+        // trackgyrobias() takes over from the gyro calibration in eeprom
+        global.gyrocalibrated = 0;
+        gyrobiasstats.time = 0;
+    }
+#else
     else // only gyro
         calibrategyroandaccelerometer(false);
+#endif
 
     global.estimateddownvector[XINDEX] = 0;
     global.estimateddownvector[YINDEX] = 0;
-    global.estimateddownvector[ZINDEX] = FIXEDPOINTONE;
+    global.estimateddownvector[ZINDEX] = FIXEDPOINT30ONE;
 
-    global.estimatedwestvector[XINDEX] = FIXEDPOINTONE;
+    global.estimatedwestvector[XINDEX] = FIXEDPOINT30ONE;
     global.estimatedwestvector[YINDEX] = 0;
     global.estimatedwestvector[ZINDEX] = 0;
 
+#if (IMU_ESTIMATOR == QUATERNION_ESTIMATOR)
+    attitudequaternion[0] = FIXEDPOINT30ONE;
+    for (int x = 0; x < 3; ++x) {
+        attitudequaternion[x + 1] = 0;
+        gyrobias[x] = 0;
+    }
+#endif
+#if (ACC_ADAPTIVE_GAIN == YES)
+    for (int x = 0; x < 3; ++x)
+        lastaccreading[x] = global.acc_g_vector[x];
+    accvibration = 0;
+    accrecoverytime = 0;
+#endif
+
+    eulerattitudestale = true;
+
     lastbarorawaltitude = global.altitude = global.barorawaltitude;
 
     global.altitudevelocity = 0;
 
 }
 
+#if (ACC_ADAPTIVE_GAIN == YES)
+// the weight of this accelerometer reading, from 0 to 1, see ACC_ADAPTIVE_GAIN above.  Also keeps track of the
+// vibration and of the raised gain after the readings couldn't be trusted.
+static fixedpointnum adaptiveaccweight(fixedpointnum accmagnitudesquared)
+{
+    fixedpointnum change = 0;
+
+    for (int x = 0; x < 3; ++x) {
+        change += lib_fp_abs(global.acc_g_vector[x] - lastaccreading[x]);
+        lastaccreading[x] = global.acc_g_vector[x];
+    }
+    lib_fp_lowpassfilterinline(&accvibration, change, global.timesliver >> (TIMESLIVEREXTRASHIFT - 3), FP_ONE_OVER_ACC_VIBRATION_TIME_PERIOD, 3);
+
+    fixedpointnum weight = FIXEDPOINTONE - lib_fp_divide(lib_fp_abs(accmagnitudesquared - FIXEDPOINTONE), (FP_ACC_ADAPTIVE_WINDOW + accvibration) << 1);
+    fixedpointnum rate = lib_fp_abs(global.gyrorate[ROLLINDEX]);
+
+    if (lib_fp_abs(global.gyrorate[PITCHINDEX]) > rate)
+        rate = lib_fp_abs(global.gyrorate[PITCHINDEX]);
+    fixedpointnum rateweight = FIXEDPOINTONE - lib_fp_multiply(rate, FP_ONE_OVER_ACC_ADAPTIVE_RATE);
+
+    if (weight < 0 || rateweight < 0 || accmagnitudesquared >= MAXADAPTIVEACCMAGNITUDESQUARED)
+        weight = 0;
+    else
+        weight = lib_fp_multiply(lib_fp_multiply(weight, rateweight), lib_fp_divide(FP_ACC_ADAPTIVE_VIBRATION, FP_ACC_ADAPTIVE_VIBRATION + accvibration));
+
+    if (rateweight < FIXEDPOINTONEOVERTWO) {
+        accrecoverytime += TIMESLIVERTIMES(FP_ACC_ADAPTIVE_RECOVERY_CHARGE);
+        if (accrecoverytime > FP_ACC_ADAPTIVE_RECOVERY_TIME)
+            accrecoverytime = FP_ACC_ADAPTIVE_RECOVERY_TIME;
+    } else if ((accrecoverytime -= global.timesliver) < 0)
+        accrecoverytime = 0;
+    return (weight);
+}
+
+// the gain the weight is raised by after the readings couldn't be trusted, from 1 to ACC_ADAPTIVE_RECOVERY_GAIN
+static fixedpointnum accrecoverygain(void)
+{
+    return (FIXEDPOINTONE + lib_fp_multiply24(accrecoverytime, FP_ACC_ADAPTIVE_RECOVERY_SLOPE));
+}
+#endif
+
+#if (IMU_ESTIMATOR == VECTOR_ESTIMATOR)
+// lib_fp_lowpassfilterchannels() for an attitude vector.  Moving the vector by fraction*(newvalue-vector)
+// is the same filter, and the difference is taken at half scale so it can't overflow if the vector flips over.
+static void lowpassfilterattitudevector(fixedpointnum30 * vector, fixedpointnum30 * newvalues, fixedpointnum24 timesliver, fixedpointnum oneoverperiod)
+{
+    fixedpointnum24 fraction = lib_fp_multiply(timesliver, oneoverperiod);
+
+    for (int x = 0; x < 3; ++x)
+        vector[x] += lib_fp_multiplyshift(fraction, (newvalues[x] >> 1) - (vector[x] >> 1), FIXEDPOINT24SHIFT - 1);
+}
+#endif
+
+#if (GYRO_SAMPLE_RATE != 0)
+// Integrates the gyro samples that came in since the last update into one rotation in the attitude vectors'
+// frame, (pitch, -roll, -yaw) in radians.  Just adding up the samples' rotations is only right while the axis of
+// rotation stays put.  When it moves, like when the quad wobbles on two axes at once, the sum is off by the coning
+// error, which the cross products correct: half of the rotation so far crossed with each sample's (the rotation
+// vector's differential equation), and a twelfth of the previous sample's crossed with each sample's for the
+// coning within a sample (the two sample algorithm).  Leaves the newest calibrated rates in global.gyrorate.
+static void integrategyrosamples(fixedpointnum24 * angles)
+{
+    fixedpointnum rates[3];
+    unsigned char count, lastcount = 0;
+
+    for (int x = 0; x < 3; ++x)
+        angles[x] = 0;
+
+#if (GYRO_FIFO == YES)
+    readgyrofifo();
+#endif
+    while ((count = readgyrosample(rates))) {
+        fixedpointnum24 sampleangles[3];
+        fixedpointnum24 coningaxis[3];
+        fixedpointnum24 coning[3];
+
+        // a slot holds the sum of count samples
+        for (int x = 0; x < 3; ++x)
+            rates[x] += usersettings.gyrocalibration[x] * count;
+
+        sampleangles[XINDEX] = lib_fp_multiplyshift(rates[PITCHINDEX], FP_GYRO_SAMPLE_RADIANS, GYRO_SAMPLE_ANGLESHIFT);
+        sampleangles[YINDEX] = -lib_fp_multiplyshift(rates[ROLLINDEX], FP_GYRO_SAMPLE_RADIANS, GYRO_SAMPLE_ANGLESHIFT);
+        sampleangles[ZINDEX] = -lib_fp_multiplyshift(rates[YAWINDEX], FP_GYRO_SAMPLE_RADIANS, GYRO_SAMPLE_ANGLESHIFT);
+
+        for (int x = 0; x < 3; ++x)
+            coningaxis[x] = (angles[x] >> 1) + lib_fp_multiply24(previousgyrosampleangles[x], FIXEDPOINT24CONSTANT(1.0 / 12));
+        vectorcrossproduct24(coningaxis, sampleangles, coning);
+
+        for (int x = 0; x < 3; ++x) {
+            angles[x] += sampleangles[x] + coning[x];
+            previousgyrosampleangles[x] = sampleangles[x];
+            global.gyrorate[x] = rates[x];
+        }
+        lastcount = count;
+    }
+    // if no sample came in, global.gyrorate keeps the last one
+    averagegyrosample(global.gyrorate, lastcount);
+}
+#endif
+
 //fixedpointnum totalrate[3]={0};
 //fixedpointnum timesincezerocrossing[3]={0};
 //char gyropositive[3]={0};
 
 void imucalculateestimatedattitude(void)
 {
+#if (GYRO_SAMPLE_RATE != 0)
+    fixedpointnum24 gyroangles[3];
+
+    integrategyrosamples(gyroangles);
+
+    HOLDGYROSAMPLING();
+    readacc();
+    RELEASEGYROSAMPLING();
+
+    // correct the acc readings to remove error, the gyro samples are already corrected
+    correctaccreading();
+
+    // back from the attitude vectors' frame
+    fixedpointnum24 rolldeltaangle = -gyroangles[YINDEX];
+    fixedpointnum24 pitchdeltaangle = gyroangles[XINDEX];
+    fixedpointnum24 yawdeltaangle = -gyroangles[ZINDEX];
+#else
     readgyro();
     readacc();
 
     // correct the gyro and acc readings to remove error      
-    for (int x = 0; x < 3; ++x) {
+    for (int x = 0; x < 3; ++x)
         global.gyrorate[x] = global.gyrorate[x] + usersettings.gyrocalibration[x];
-        global.acc_g_vector[x] = global.acc_g_vector[x] + usersettings.acccalibration[x];
-    }
+    correctaccreading();
 
     // calculate how many degrees we have rotated around each axis.  Keep in mind that timesliver is
-    // shifted TIMESLIVEREXTRASHIFT bits to the left, so our delta angles will be as well.  This is
-    // good because they are generally very small angles;
+    // a fixedpointnum24, so our delta angles will be as well.  This is good because they are generally
+    // very small angles;
 
     // create a multiplier that will include timesliver and a conversion from degrees to radians
     // we need radians for small angle approximation
-    fixedpointnum multiplier = lib_fp_multiply(global.timesliver, FIXEDPOINTPIOVER180);
-
-    fixedpointnum rolldeltaangle = lib_fp_multiply(global.gyrorate[ROLLINDEX], multiplier);
-    fixedpointnum pitchdeltaangle = lib_fp_multiply(global.gyrorate[PITCHINDEX], multiplier);
-    fixedpointnum yawdeltaangle = lib_fp_multiply(global.gyrorate[YAWINDEX], multiplier);
+    fixedpointnum24 multiplier = TIMESLIVERTIMES(FIXEDPOINTPIOVER180);
 
-    rotatevectorwithsmallangles(global.estimateddownvector, rolldeltaangle, pitchdeltaangle, yawdeltaangle);
-    rotatevectorwithsmallangles(global.estimatedwestvector, rolldeltaangle, pitchdeltaangle, yawdeltaangle);
+    fixedpointnum24 rolldeltaangle = lib_fp_multiply(global.gyrorate[ROLLINDEX], multiplier);
+    fixedpointnum24 pitchdeltaangle = lib_fp_multiply(global.gyrorate[PITCHINDEX], multiplier);
+    fixedpointnum24 yawdeltaangle = lib_fp_multiply(global.gyrorate[YAWINDEX], multiplier);
+#endif
 
-    // if the accellerometer's gravity vector is close to one G, use a complimentary filter
-    // to gently adjust our estimated g vector so that it stays in line with the real one.
+    // if the accellerometer's gravity vector is close to one G, use it to gently adjust our estimated
+    // g vector so that it stays in line with the real one.
     // If the magnitude of the vector is not near one G, then it will be difficult to determine
     // which way is down, so we just skip it.
     fixedpointnum accmagnitudesquared = lib_fp_multiply(global.acc_g_vector[XINDEX], global.acc_g_vector[XINDEX]) + lib_fp_multiply(global.acc_g_vector[YINDEX], global.acc_g_vector[YINDEX]) + lib_fp_multiply(global.acc_g_vector[ZINDEX], global.acc_g_vector[ZINDEX]);
+    // |a| is below 1.05, or below 2 with ACC_ADAPTIVE_GAIN, when it is used, so each component fits in a
+    // fixedpointnum30
+    fixedpointnum30 accvector[3];
+
+    global.stable = accmagnitudesquared > MINACCMAGNITUDESQUARED && accmagnitudesquared < MAXACCMAGNITUDESQUARED;
+#if (GYRO_BIAS_TRACKING == NO)
+    if (!global.gyrocalibrated)
+#endif
+        trackgyrobias();
+
+    // how much of the accelerometer's correction to use, all or nothing unless ACC_ADAPTIVE_GAIN weighs it
+    fixedpointnum accweight = global.stable ? FIXEDPOINTONE : 0;
+    fixedpointnum acconeoverperiod = ONE_OVER_ACC_COMPLIMENTARY_FILTER_TIME_PERIOD;
+#if (ACC_ADAPTIVE_GAIN == YES)
+    accweight = adaptiveaccweight(accmagnitudesquared);
+    acconeoverperiod = lib_fp_multiply(lib_fp_multiply(accweight, accrecoverygain()), ONE_OVER_ACC_COMPLIMENTARY_FILTER_TIME_PERIOD);
+#endif
+    if (accweight)
+        for (int x = 0; x < 3; ++x)
+            accvector[x] = FIXEDPOINTTOFIXEDPOINT30(global.acc_g_vector[x]);
+
+#if (IMU_ESTIMATOR == QUATERNION_ESTIMATOR)
+    // the gyro's rotation in the attitude vectors' frame, which is (pitch, -roll, -yaw), less the bias we have learned
+    fixedpointnum24 angles[3];
+
+    angles[XINDEX] = pitchdeltaangle + lib_fp_multiply30(gyrobias[XINDEX], global.timesliver);
+    angles[YINDEX] = -rolldeltaangle + lib_fp_multiply30(gyrobias[YINDEX], global.timesliver);
+    angles[ZINDEX] = -yawdeltaangle + lib_fp_multiply30(gyrobias[ZINDEX], global.timesliver);
+
+    if (accweight) {
+        // the cross product is the axis that turns our down vector towards the accelerometer's, as long as the
+        // sine of the angle between them.
+        fixedpointnum30 error[3];
+        fixedpointnum24 proportionalfraction = lib_fp_multiply(global.timesliver, acconeoverperiod);
+        fixedpointnum24 integralfraction = TIMESLIVERTIMES(FP_GYRO_BIAS_GAIN);
+#if (ACC_ADAPTIVE_GAIN == YES)
+        // the bias only learns from the weight, the raised gain is for the attitude
+        integralfraction = lib_fp_multiply(integralfraction, accweight);
+#endif
+
+        vectorcrossproduct30(accvector, global.estimateddownvector, error);
+        for (int x = 0; x < 3; ++x)
+            angles[x] += lib_fp_multiply30(proportionalfraction, error[x]);
+        for (int x = 0; x < GYROBIASAXES; ++x) {
+            gyrobias[x] += lib_fp_multiplyshift(integralfraction, error[x], FIXEDPOINT24SHIFT);
+            lib_fp_constrain(&gyrobias[x], -MAXGYROBIAS, MAXGYROBIAS);
+        }
+    }
+#if (COMPASS_TYPE != NO_COMPASS)
+    compasstimeinterval += global.timesliver;
+
+    HOLDGYROSAMPLING();
+    int gotnewcompassreading = readcompass();
+    RELEASEGYROSAMPLING();
+
+    if (gotnewcompassreading) {
+        // the same for the west vector, from the cross product of the compass and down vectors like the vector
+        // estimator.  Only the part of the error around the down vector is used, the accelerometer does the rest.
+        fixedpointnum30 westvector[3];
+        fixedpointnum30 error[3];
+
+        vectorcrossproduct(global.compassvector, global.estimateddownvector, westvector);
+        vectorcrossproduct30(westvector, global.estimatedwestvector, error);
+
+        fixedpointnum30 yawerror = lib_fp_multiply30(error[XINDEX], global.estimateddownvector[XINDEX])
+            + lib_fp_multiply30(error[YINDEX], global.estimateddownvector[YINDEX])
+            + lib_fp_multiply30(error[ZINDEX], global.estimateddownvector[ZINDEX]);
+        fixedpointnum24 proportionalfraction = lib_fp_multiply(compasstimeinterval, ONE_OVER_ACC_COMPLIMENTARY_FILTER_TIME_PERIOD);
+        fixedpointnum24 integralfraction = lib_fp_multiply(compasstimeinterval, FP_GYRO_BIAS_GAIN);
 
-    if (accmagnitudesquared > MINACCMAGNITUDESQUARED && accmagnitudesquared < MAXACCMAGNITUDESQUARED) {
-        global.stable = 1;
         for (int x = 0; x < 3; ++x) {
-            lib_fp_lowpassfilter(&global.estimateddownvector[x], global.acc_g_vector[x], global.timesliver, ONE_OVER_ACC_COMPLIMENTARY_FILTER_TIME_PERIOD, TIMESLIVEREXTRASHIFT);
+            fixedpointnum30 axiserror = lib_fp_multiply30(yawerror, global.estimateddownvector[x]);
+
+            angles[x] += lib_fp_multiply30(proportionalfraction, axiserror);
+            gyrobias[x] += lib_fp_multiplyshift(integralfraction, axiserror, FIXEDPOINT24SHIFT);
+            lib_fp_constrain(&gyrobias[x], -MAXGYROBIAS, MAXGYROBIAS);
         }
-    } else
-        global.stable = 0;
+        compasstimeinterval = 0;
+    }
+#endif
+
+    rotatequaternionwithsmallangles(attitudequaternion, angles);
+    renormalizequaternion30(attitudequaternion);
+    quaterniontoattitudevectors30(attitudequaternion, global.estimateddownvector, global.estimatedwestvector);
+#else
+    rotatevectorswithsmallangles(global.estimateddownvector, global.estimatedwestvector, rolldeltaangle, pitchdeltaangle, yawdeltaangle);
+
+    // the complimentary filter
+    if (accweight)
+        lowpassfilterattitudevector(global.estimateddownvector, accvector, global.timesliver, acconeoverperiod);
 
     compasstimeinterval += global.timesliver;
 
 #if (COMPASS_TYPE != NO_COMPASS)
+    HOLDGYROSAMPLING();
     int gotnewcompassreading = readcompass();
+    RELEASEGYROSAMPLING();
 
     if (gotnewcompassreading) {
         // use the compass to correct the yaw in our estimated attitude.
         // the compass vector points somewhat north, but it also points down more than north where I live, so we can't
         // get the yaw directly from the compass vector.  Instead, we have to take a cross product of
         // the gravity vector and the compass vector, which should point west
-        fixedpointnum westvector[3];
+        fixedpointnum30 westvector[3];
 
+        // the compass vector is a fixedpointnum, so lib_fp_multiply() leaves the result a fixedpointnum30
         vectorcrossproduct(global.compassvector, global.estimateddownvector, westvector);
 
         // use the actual compass reading to slowly adjust our estimated west vector
-        for (int x = 0; x < 3; ++x) {
-            lib_fp_lowpassfilter(&global.estimatedwestvector[x], westvector[x], compasstimeinterval >> TIMESLIVEREXTRASHIFT, ONE_OVER_ACC_COMPLIMENTARY_FILTER_TIME_PERIOD, 0);
-        }
+        lowpassfilterattitudevector(global.estimatedwestvector, westvector, compasstimeinterval, ONE_OVER_ACC_COMPLIMENTARY_FILTER_TIME_PERIOD);
         compasstimeinterval = 0;
     }
 #else
-    if (compasstimeinterval > (6553L << TIMESLIVEREXTRASHIFT))  // 10 hz
+    if (compasstimeinterval > FIXEDPOINT24CONSTANT(.1))  // 10 hz
     {                           // we aren't using the comopass
         // we need to make sure the west vector stays around unit length and stays perpendicular to the down vector
         // first make it perpendicular by crossing it with the down vector and then back again
-        fixedpointnum vector[3];
-
-        vectorcrossproduct(global.estimatedwestvector, global.estimateddownvector, vector);
-        vectorcrossproduct(global.estimateddownvector, vector, global.estimatedwestvector);
+        fixedpointnum30 vector[3];
 
-        normalizevector(global.estimatedwestvector);
+        vectorcrossproduct30(global.estimatedwestvector, global.estimateddownvector, vector);
+        vectorcrossproduct30(global.estimateddownvector, vector, global.estimatedwestvector);
+        normalizevector30(global.estimatedwestvector);
 
         compasstimeinterval = 0;
     }
 #endif
+#endif
 
 #if (BAROMETER_TYPE != NO_BAROMETER)
     barotimeinterval += global.timesliver;
@@ -229,25 +913,32 @@ void imucalculateestimatedattitude(void)
     // Integrate again to determine position
 //normalizevector(global.estimateddownvector);
 
-    fixedpointnum verticalacceleration = lib_fp_multiply(vectordotproduct(global.acc_g_vector, global.estimateddownvector) - FIXEDPOINTONE, FIXEDPOINTCONSTANT(9.8));
-    global.altitudevelocity += (lib_fp_multiply(verticalacceleration >> TIMESLIVEREXTRASHIFT, global.timesliver));
-    global.altitude += (lib_fp_multiply(global.altitudevelocity >> TIMESLIVEREXTRASHIFT, global.timesliver));
+    fixedpointnum verticalacceleration = lib_fp_multiply30(global.estimateddownvector[XINDEX], global.acc_g_vector[XINDEX])
+        + lib_fp_multiply30(global.estimateddownvector[YINDEX], global.acc_g_vector[YINDEX])
+        + lib_fp_multiply30(global.estimateddownvector[ZINDEX], global.acc_g_vector[ZINDEX]);
+    verticalacceleration = lib_fp_multiply(verticalacceleration - FIXEDPOINTONE, FIXEDPOINTCONSTANT(9.8));
+    global.altitudevelocity += lib_fp_multiply24(global.timesliver, verticalacceleration);
+    global.altitude += lib_fp_multiply24(global.timesliver, global.altitudevelocity);
+
+    HOLDGYROSAMPLING();
+    int gotnewbaroreading = readbaro();
+    RELEASEGYROSAMPLING();
 
-    if (readbaro()) {           // we got a new baro reading
+    if (gotnewbaroreading) {    // we got a new baro reading
         fixedpointnum baroaltitudechange = global.barorawaltitude - lastbarorawaltitude;
 
         // filter out errant baro readings.  I don't know why I need to do this, but every once in a while the baro
         // will give a reading of 3000 meters when it should read 150 meters.
         if (lib_fp_abs(baroaltitudechange) < FIXEDPOINTCONSTANT(500)) {
             // Use the baro reading to adjust the altitude over time (basically a complimentary filter)
-            lib_fp_lowpassfilter(&global.altitude, global.barorawaltitude, barotimeinterval >> TIMESLIVEREXTRASHIFT, FIXEDPOINTONEOVERONE, 0);
+            lib_fp_lowpassfilter(&global.altitude, global.barorawaltitude, FIXEDPOINT24TOFIXEDPOINT(barotimeinterval), FIXEDPOINTONEOVERONE, 0);
 
             // Use the change in barometer readings to get an altitude velocity.  Use this to adjust the altitude velocity
             // over time (basically a complimentary filter).
             // We don't want to divide by the time interval to get velocity (divide is expensive) to then turn around and
             // multiply by the same time interval. So the following is the same as the lib_fp_lowpassfilter code
             // except we eliminate the multiply.
-            fixedpointnum fraction = lib_fp_multiply(barotimeinterval >> TIMESLIVEREXTRASHIFT, FIXEDPOINTONEOVERONEHALF);
+            fixedpointnum fraction = lib_fp_multiply24(barotimeinterval, FIXEDPOINTONEOVERONEHALF);
             global.altitudevelocity = (baroaltitudechange + lib_fp_multiply((FIXEDPOINTONE) - fraction, global.altitudevelocity));
 
             lastbarorawaltitude = global.barorawaltitude;
@@ -256,7 +947,19 @@ void imucalculateestimatedattitude(void)
     }
 #endif
 
-    // convert our vectors to euler angles
+    eulerattitudestale = true;
+}
+
+// makes global.currentestimatedeulerattitude current.  Call it before using the angles.
+void imuupdateeulerattitude(void)
+{
+    if (eulerattitudestale)
+        imucalculateeulerattitude();
+}
+
+void imucalculateeulerattitude(void)
+{
+    // convert our vectors to euler angles.  lib_fp_atan2() only needs the ratio, so the fixedpointnum30s go in as they are.
     global.currentestimatedeulerattitude[ROLLINDEX] = lib_fp_atan2(global.estimateddownvector[XINDEX], global.estimateddownvector[ZINDEX]);
     if (lib_fp_abs(global.currentestimatedeulerattitude[ROLLINDEX]) > FIXEDPOINT45 && lib_fp_abs(global.currentestimatedeulerattitude[ROLLINDEX]) < FIXEDPOINT135) {
         global.currentestimatedeulerattitude[PITCHINDEX] = lib_fp_atan2(global.estimateddownvector[YINDEX], lib_fp_abs(global.estimateddownvector[XINDEX]));
@@ -271,4 +974,8 @@ void imucalculateestimatedattitude(void)
 
     global.currentestimatedeulerattitude[YAWINDEX] = lib_fp_atan2(global.estimatedwestvector[YINDEX], xvalue) + FP_MAG_DECLINATION_DEGREES;
     lib_fp_constrain180(&global.currentestimatedeulerattitude[YAWINDEX]);
+
+    // cleared once the angles are written, so they are never current half done.  The serial task holds the
+    // control task around this, which would mark them stale again.
+    eulerattitudestale = false;
 }
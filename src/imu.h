@@ -17,7 +17,37 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "lib_fp.h"
 
+// what the last calibrategyroandaccelerometer() took, for MSP_CALIBRATION_INFO
+typedef struct {
+    uint16_t milliseconds;      // how long it took
+    unsigned char restarts;     // how often it started over because the aircraft moved
+    unsigned char timedout;     // 1 if it gave up at CALIBRATION_MAX_TIME and kept the calibration it had
+    fixedpointnum24 gyrovariance[3];    // of the readings it averaged, degrees per second squared
+    fixedpointnum24 accvariance[3];     // g squared, 0 if it only calibrated the gyro
+} calibrationinfostruct;
+
+extern calibrationinfostruct calibrationinfo;
+
+// the states of the six position accelerometer calibration
+#define ACCSIXPOSITIONIDLE 0
+#define ACCSIXPOSITIONCOLLECTING 1      // waiting for the aircraft to be held still in the next position
+#define ACCSIXPOSITIONSOLVING 2         // fitting the gains and offsets, a step per main loop
+#define ACCSIXPOSITIONDONE 3
+#define ACCSIXPOSITIONFAILED 4          // timed out or the fit made no sense, the old calibration is kept
+
+// how the six position accelerometer calibration is going, for the LEDs and MSP_ACC_SIX_POSITION_INFO
+typedef struct {
+    unsigned char state;
+    unsigned char positions;    // a bit for each axis and sign that has read 1 g: +x, -x, +y, -y, +z, -z
+    fixedpointnum waitingtime;  // seconds since it started or took the last position
+} accsixpositioninfostruct;
+
+extern accsixpositioninfostruct accsixpositioninfo;
 
 void initimu(void);
 void imucalculateestimatedattitude(void);
+void imuupdateeulerattitude(void);
+void imucalculateeulerattitude(void);
 void calibrategyroandaccelerometer(bool both);
+void startaccsixpositioncalibration(void);
+void accsixpositioncalibrationstep(void);
@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "gps.h"
 #include "lib_fp.h"
 #include "bradwii.h"
+#include "imu.h"
 
 #if (GPS_TYPE!=NO_GPS)
 
@@ -105,6 +106,7 @@ void navigation_set_destination(fixedpointnum latitude, fixedpointnum longitude)
     navigation_desiredeulerattitude[PITCHINDEX] = 0;
 
     // for now, we will just stay rotated to the yaw angle we started at
+    imuupdateeulerattitude();
     navigation_desiredeulerattitude[YAWINDEX] = global.currentestimatedeulerattitude[YAWINDEX];
 }
 
@@ -116,6 +118,8 @@ void navigation_setangleerror(unsigned char gotnewgpsreading, fixedpointnum * an
     // and adjust the angle errors that were passed to us.  They have already been set by pilot input.
     // For now, we just override any pilot input.
 
+    imuupdateeulerattitude();
+
     // keep track of the time between good gps readings.
     navigation_time_sliver += global.timesliver;
 
@@ -129,8 +133,10 @@ void navigation_setangleerror(unsigned char gotnewgpsreading, fixedpointnum * an
         // split the distance into it's ontrack and crosstrack components
         // see the diagram above
         fixedpointnum angledifference = global.navigation_bearing - navigation_starttodestbearing;
-        fixedpointnum crosstrack_distance = lib_fp_multiply(global.navigation_distance, lib_fp_sine(angledifference));
-        fixedpointnum ontrack_distance = lib_fp_multiply(global.navigation_distance, lib_fp_cosine(angledifference));
+        fixedpointnum sineofangle, cosineofangle;
+        lib_fp_sincos(angledifference, &sineofangle, &cosineofangle);
+        fixedpointnum crosstrack_distance = lib_fp_multiply(global.navigation_distance, sineofangle);
+        fixedpointnum ontrack_distance = lib_fp_multiply(global.navigation_distance, cosineofangle);
 
         // accumulate integrated error for both ontrack and crosstrack
         navigation_crosstrack_integrated_error += lib_fp_multiply(crosstrack_distance, navigation_time_sliver);
@@ -168,8 +174,7 @@ void navigation_setangleerror(unsigned char gotnewgpsreading, fixedpointnum * an
         // and the angle between waypoints and rotate our tilts by that much.   
         angledifference = global.currentestimatedeulerattitude[YAWINDEX] - navigation_starttodestbearing;
 
-        fixedpointnum sineofangle = lib_fp_sine(angledifference);
-        fixedpointnum cosineofangle = lib_fp_cosine(angledifference);
+        lib_fp_sincos(angledifference, &sineofangle, &cosineofangle);
 
         navigation_desiredeulerattitude[ROLLINDEX] = lib_fp_multiply(crosstracktiltangle, cosineofangle) - lib_fp_multiply(ontracktiltangle, sineofangle);
         navigation_desiredeulerattitude[PITCHINDEX] = lib_fp_multiply(crosstracktiltangle, sineofangle) + lib_fp_multiply(ontracktiltangle, cosineofangle);
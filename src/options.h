@@ -86,6 +86,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define BMP085 1
 #define MS5611 2
 
+// IMU_ESTIMATOR's
+#define VECTOR_ESTIMATOR 0
+#define QUATERNION_ESTIMATOR 1
+
 // MULTIWII_CONFIG_SERIAL_PORTS
 // These can be added (or or'ed together) to choose muliple ports
 #define NOSERIALPORT 0
@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "pilotcontrol.h"
 #include "bradwii.h"
 #include "vectors.h"
+#include "imu.h"
 #include "lib_timers.h"
 
 extern globalstruct global;
@@ -40,8 +41,12 @@ static fixedpointnum accumulatedyawerror = 0;
 
 void resetpilotcontrol(void)
 {                               // called when switching from navigation control to pilot control or when idling on the ground.
-    // keeps us from accumulating yaw error that we can't correct.
-    desiredcompassheading = global.currentestimatedeulerattitude[YAWINDEX];
+    // keeps us from accumulating yaw error that we can't correct.  Only compass mode uses the heading, and it
+    // takes the current one when it is switched on.
+    if (global.activecheckboxitems & CHECKBOXMASKCOMPASS) {
+        imuupdateeulerattitude();
+        desiredcompassheading = global.currentestimatedeulerattitude[YAWINDEX];
+    }
     // Same for yaw hold mode
     accumulatedyawerror = 0;
 
@@ -58,10 +63,11 @@ void getangleerrorfrompilotinput(fixedpointnum * angleerror)
 
     // if in headfree mode, rotate the pilot's stick inputs by the angle that is the difference between where we are currently heading and where we were heading when we armed.
     if (global.activecheckboxitems & CHECKBOXMASKHEADFREE) {
+        imuupdateeulerattitude();
         fixedpointnum angledifference = global.currentestimatedeulerattitude[YAWINDEX] - global.heading_when_armed;
 
-        fixedpointnum cosangledifference = lib_fp_cosine(angledifference);
-        fixedpointnum sinangledifference = lib_fp_sine(angledifference);
+        fixedpointnum sinangledifference, cosangledifference;
+        lib_fp_sincos(angledifference, &sinangledifference, &cosangledifference);
         rxpitchvalue = lib_fp_multiply(global.rxvalues[PITCHINDEX], cosangledifference) + lib_fp_multiply(global.rxvalues[ROLLINDEX], sinangledifference);
         rxrollvalue = lib_fp_multiply(global.rxvalues[ROLLINDEX], cosangledifference) - lib_fp_multiply(global.rxvalues[PITCHINDEX], sinangledifference);
     } else {
@@ -69,20 +75,6 @@ void getangleerrorfrompilotinput(fixedpointnum * angleerror)
         rxrollvalue = global.rxvalues[ROLLINDEX];
     }
 
-    // first, calculate level mode values
-    // how far is our estimated current attitude from our desired attitude?
-    // desired angle is rxvalue (-1 to 1) times LEVEL_MODE_MAX_TILT
-    // First, figure out which max angle we are using depending on aux switch settings.
-    fixedpointnum levelmodemaxangle;
-    if (global.activecheckboxitems & CHECKBOXMASKHIGHANGLE)
-        levelmodemaxangle = FP_LEVEL_MODE_MAX_TILT_HIGH_ANGLE;
-    else
-        levelmodemaxangle = FP_LEVEL_MODE_MAX_TILT;
-
-    // the angle error is how much our current angles differ from our desired angles.
-    fixedpointnum levelmoderollangleerror = lib_fp_multiply(rxrollvalue, levelmodemaxangle) - global.currentestimatedeulerattitude[ROLLINDEX];
-    fixedpointnum levelmodepitchangleerror = lib_fp_multiply(rxpitchvalue, levelmodemaxangle) - global.currentestimatedeulerattitude[PITCHINDEX];
-
     // In acro mode, we want the rotation rate to be proportional to the pilot's stick movement.  The desired rotation rate is
     // the stick movement * a multiplier.
     // Fill angleerror with acro values.  If we are currently rotating at rate X and
@@ -103,7 +95,7 @@ void getangleerrorfrompilotinput(fixedpointnum * angleerror)
     angleerror[PITCHINDEX] = lib_fp_multiply(lib_fp_multiply(rxpitchvalue, maxpitchandrollrate) - global.gyrorate[PITCHINDEX], global.timesliver);
 
     // put a low pass filter on the yaw gyro.  If we don't do this, things can get jittery.
-    lib_fp_lowpassfilter(&filteredyawgyrorate, global.gyrorate[YAWINDEX], global.timesliver >> (TIMESLIVEREXTRASHIFT - 3), FIXEDPOINTONEOVERONESIXTYITH, 3);
+    lib_fp_lowpassfilterinline(&filteredyawgyrorate, global.gyrorate[YAWINDEX], global.timesliver >> (TIMESLIVEREXTRASHIFT - 3), FIXEDPOINTONEOVERONESIXTYITH, 3);
 
     if(global.activecheckboxitems & CHECKBOXMASKYAWHOLD) {
         // Yaw hold: control yaw angle instead of yaw rate by accumulating the yaw errors.
@@ -113,14 +105,14 @@ void getangleerrorfrompilotinput(fixedpointnum * angleerror)
             accumulatedyawerror = 0;
         }
         // Accumulate yaw angle error
-        accumulatedyawerror += lib_fp_multiply(lib_fp_multiply(global.rxvalues[YAWINDEX], maxyawrate) - filteredyawgyrorate, global.timesliver) >> TIMESLIVEREXTRASHIFT;
+        accumulatedyawerror += lib_fp_multiply24(global.timesliver, lib_fp_multiply(global.rxvalues[YAWINDEX], maxyawrate) - filteredyawgyrorate);
         // Make sure it does not get too high
         lib_fp_constrain180(&accumulatedyawerror);
         angleerror[YAWINDEX] = accumulatedyawerror;
     } else {
         // Normal mode: control yaw rate
         // Calculate yaw angle error since last update based on desired and actual yaw rate.
-        // TIMESLIVEREXTRASHIFT is not used here, so this value is 256 times higher than expected.
+        // timesliver is a fixedpointnum24 and lib_fp_multiply() leaves the result one too, so this value is 256 times higher than expected.
         // This is OK because timesliver is very small, making the angle error during this time
         // also very small. Using the amplified result the same yaw PID control parameters can be used
         // for all modes (normal, compass and yaw hold).
@@ -129,6 +121,7 @@ void getangleerrorfrompilotinput(fixedpointnum * angleerror)
 
     // handle compass control
     if (global.activecheckboxitems & CHECKBOXMASKCOMPASS) {
+        imuupdateeulerattitude();
         if (!(global.previousactivecheckboxitems & CHECKBOXMASKCOMPASS)) {      // we just switched into compass mode
             // reset the angle error to zero so that we don't yaw because of the switch
             desiredcompassheading = global.currentestimatedeulerattitude[YAWINDEX];
@@ -181,9 +174,28 @@ void getangleerrorfrompilotinput(fixedpointnum * angleerror)
         }
     }
 
-    // combine level and acro modes
-    angleerror[ROLLINDEX] = lib_fp_multiply(angleerror[ROLLINDEX], acromodefraction) + lib_fp_multiply(levelmoderollangleerror, levelmodefraction);
-    angleerror[PITCHINDEX] = lib_fp_multiply(angleerror[PITCHINDEX], acromodefraction) + lib_fp_multiply(levelmodepitchangleerror, levelmodefraction);
+    // combine level and acro modes.  Full acro doesn't need the level mode values, or the euler angles for them.
+    angleerror[ROLLINDEX] = lib_fp_multiply(angleerror[ROLLINDEX], acromodefraction);
+    angleerror[PITCHINDEX] = lib_fp_multiply(angleerror[PITCHINDEX], acromodefraction);
+    if (levelmodefraction) {
+        // calculate level mode values
+        // how far is our estimated current attitude from our desired attitude?
+        // desired angle is rxvalue (-1 to 1) times LEVEL_MODE_MAX_TILT
+        // First, figure out which max angle we are using depending on aux switch settings.
+        fixedpointnum levelmodemaxangle;
+        if (global.activecheckboxitems & CHECKBOXMASKHIGHANGLE)
+            levelmodemaxangle = FP_LEVEL_MODE_MAX_TILT_HIGH_ANGLE;
+        else
+            levelmodemaxangle = FP_LEVEL_MODE_MAX_TILT;
+
+        // the angle error is how much our current angles differ from our desired angles.
+        imuupdateeulerattitude();
+        fixedpointnum levelmoderollangleerror = lib_fp_multiply(rxrollvalue, levelmodemaxangle) - global.currentestimatedeulerattitude[ROLLINDEX];
+        fixedpointnum levelmodepitchangleerror = lib_fp_multiply(rxpitchvalue, levelmodemaxangle) - global.currentestimatedeulerattitude[PITCHINDEX];
+
+        angleerror[ROLLINDEX] += lib_fp_multiply(levelmoderollangleerror, levelmodefraction);
+        angleerror[PITCHINDEX] += lib_fp_multiply(levelmodepitchangleerror, levelmodefraction);
+    }
 
 //if (1) // auto banking (experimental)
 //   {
@@ -231,10 +243,10 @@ void getangleerrorfrompilotinput(fixedpointnum *angleerror)
    fixedpointnum desiredpitchangle=lib_fp_multiply(global.rxvalues[PITCHINDEX]-FPRXMIDPOINT,DESIREDANGLEMULTIPLIER);
    
    // rotate a unit vector around the pitch an roll axes
-   fixedpointnum sineofrollangle=lib_fp_sine(desiredrollangle);
-   fixedpointnum cosineofrollangle=lib_fp_cosine(desiredrollangle);
-   fixedpointnum sineofpitchangle=lib_fp_sine(desiredpitchangle);
-   fixedpointnum cosineofpitchangle=lib_fp_cosine(desiredpitchangle);
+   fixedpointnum sineofrollangle,cosineofrollangle;
+   fixedpointnum sineofpitchangle,cosineofpitchangle;
+   lib_fp_sincos(desiredrollangle,&sineofrollangle,&cosineofrollangle);
+   lib_fp_sincos(desiredpitchangle,&sineofpitchangle,&cosineofpitchangle);
    
    desireddownvector[0]=lib_fp_multiply(sineofrollangle,cosineofpitchangle);
    desireddownvector[1]=lib_fp_multiply(sineofpitchangle,cosineofrollangle);
@@ -269,8 +281,7 @@ void getangleerrorfrompilotinput(fixedpointnum *angleerror)
    vectorcrossproduct(desiredwestvector, desireddownvector,vector);
    if (vector[0]!=0 || vector[1]!=0 || vector[2]!=0)
       {
-      vectorcrossproduct(desireddownvector,vector, desiredwestvector);
-      normalizevector(desiredwestvector);
+      vectorcrossproductnormalized(desireddownvector,vector, desiredwestvector, LIB_FP_INVSQRT_TABLE);
       }
    
    // find the axis of rotation and angle from our current down vector to the desired one
@@ -353,8 +364,8 @@ void getangleerrorfrompilotinput(fixedpointnum *angleerror)
    angle=desiredangle-currentrollangle;
 
    // rotate the disired downvector by this angle about the roll axis
-   fixedpointnum sineofangle=lib_fp_sine(angle);
-   fixedpointnum cosineofangle=lib_fp_cosine(angle);
+   fixedpointnum sineofangle,cosineofangle;
+   lib_fp_sincos(angle,&sineofangle,&cosineofangle);
 
    fixedpointnum vector[3];
    fixedpointnum vector2[3];
@@ -381,8 +392,7 @@ void getangleerrorfrompilotinput(fixedpointnum *angleerror)
    
    angle=desiredangle-angle;
 
-   sineofangle=lib_fp_sine(angle);
-   cosineofangle=lib_fp_cosine(angle);
+   lib_fp_sincos(angle,&sineofangle,&cosineofangle);
    
    // rotate the desired downvector by this angle about the pitch axis
    desireddownvector[XINDEX]=vector[XINDEX];
@@ -404,10 +414,10 @@ void getangleerrorfrompilotinput(fixedpointnum *angleerror)
    fixedpointnum desiredpitchangle=lib_fp_multiply(global.rxvalues[PITCHINDEX]-FPRXMIDPOINT,DESIREDANGLEMULTIPLIER);
    
    // rotate a unit vector around the pitch and roll axes
-   fixedpointnum sineofrollangle=lib_fp_sine(desiredrollangle);
-   fixedpointnum cosineofrollangle=lib_fp_cosine(desiredrollangle);
-   fixedpointnum sineofpitchangle=lib_fp_sine(desiredpitchangle);
-   fixedpointnum cosineofpitchangle=lib_fp_cosine(desiredpitchangle);
+   fixedpointnum sineofrollangle,cosineofrollangle;
+   fixedpointnum sineofpitchangle,cosineofpitchangle;
+   lib_fp_sincos(desiredrollangle,&sineofrollangle,&cosineofrollangle);
+   lib_fp_sincos(desiredpitchangle,&sineofpitchangle,&cosineofpitchangle);
    
    desireddownvector[0]=lib_fp_multiply(sineofrollangle,cosineofpitchangle);
    desireddownvector[1]=lib_fp_multiply(sineofpitchangle,cosineofrollangle);
@@ -440,8 +450,7 @@ void getangleerrorfrompilotinput(fixedpointnum *angleerror)
    vectorcrossproduct(desiredwestvector, desireddownvector,vector);
    if (vector[0]!=0 || vector[1]!=0 || vector[2]!=0)
       {
-      vectorcrossproduct(desireddownvector,vector, desiredwestvector);
-      normalizevector(desiredwestvector);
+      vectorcrossproductnormalized(desireddownvector,vector, desiredwestvector, LIB_FP_INVSQRT_TABLE);
       }
    
    // find the axis of rotation and angle from our current down vector to the desired one
@@ -0,0 +1,52 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// project file headers
+#include "profiler.h"
+
+// How a loop splits between the imu, the pilot control, the pid and the other tasks, in CPU cycles.  The probes
+// are compiled out unless PROFILER is YES, and each costs two reads of the cycle counter and an exit call then.
+// With CONTROL_LOOP_INTERRUPT the control task's probes run in the interrupt and the others in the main loop, but
+// no probe runs in both, so only MSP_PROFILER holds the control task, to read them all from the same run.
+
+#if (PROFILER == YES)
+profilerprobestruct profilerprobes[NUMPROBES];
+
+void resetprofiler(void)
+{
+    for (int i = 0; i < NUMPROBES; ++i) {
+        profilerprobes[i].cycles = 0;
+        profilerprobes[i].maxcycles = 0;
+        profilerprobes[i].count = 0;
+    }
+}
+
+void profilerexit(int probe)
+{
+    profilerprobestruct *stats = &profilerprobes[probe];
+    uint32_t cycles = lib_timers_getcycles() - stats->start;
+
+    if (stats->count == 0xFFFF || (stats->cycles & 0x80000000)) {
+        stats->count >>= 1;
+        stats->cycles >>= 1;
+    }
+    ++stats->count;
+    stats->cycles += cycles;
+    if (cycles > stats->maxcycles)
+        stats->maxcycles = cycles;
+}
+#endif
@@ -0,0 +1,54 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "defs.h"
+#include "lib_timers.h"
+
+// The profiler's probes, as MSP_PROFILER sends them.  Each times the code between its PROFILERENTER() and
+// PROFILEREXIT() in CPU cycles, see lib_timers_getcycles().  A probe can be inside another one, the control task's
+// includes the imu's, pilot's and pid's.
+#define PROBECONTROL 0          // the whole control task
+#define PROBEIMU 1              // imucalculateestimatedattitude(), with the sensor reads
+#define PROBEPILOT 2            // getangleerrorfrompilotinput()
+#define PROBEPID 3              // the pid and the mixer
+#define PROBERX 4               // the receiver task
+#define PROBEBATTERY 5          // the battery task
+#define NUMPROBES 6
+
+// the cycles are halved with the count rather than overflowing, so the mean stays right
+typedef struct {
+    uint32_t start;             // the cycle count at PROFILERENTER()
+    uint32_t cycles;            // the sum of the runs
+    uint32_t maxcycles;
+    uint16_t count;
+} profilerprobestruct;
+
+#if (PROFILER == YES)
+extern profilerprobestruct profilerprobes[NUMPROBES];
+
+void resetprofiler(void);
+void profilerexit(int probe);
+
+#define PROFILERENTER(probe) (profilerprobes[probe].start = lib_timers_getcycles())
+#define PROFILEREXIT(probe) profilerexit(probe)
+#else
+#define PROFILERENTER(probe)
+#define PROFILEREXIT(probe)
+#endif
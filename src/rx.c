@@ -34,6 +34,9 @@ unsigned char channelindex[] = { ROLLINDEX,PITCHINDEX,THROTTLEINDEX,YAWINDEX,AUX
 
 extern globalstruct global;
 
+// readrx() runs at its own pace, the filters use the time since it last ran
+static unsigned long rxtimeslivertimer;
+
 #if CONTROL_BOARD_TYPE == CONTROL_BOARD_WLT_V202
 void initrx(void)
 {
@@ -43,6 +46,7 @@ void readrx(void)
 {
     int chan;
     uint16_t data;
+    fixedpointnum24 timesliver = readtimesliver(&rxtimeslivertimer);
 
     for (chan = 0; chan < 8; ++chan) {
 //        data = pwmRead(chan);
@@ -50,7 +54,7 @@ void readrx(void)
         data = 1500;
 
         // convert from 1000-2000 range to -1 to 1 fixedpointnum range and low pass filter to remove glitches
-        lib_fp_lowpassfilter(&global.rxvalues[channelindex[chan]], ((fixedpointnum) data - 1500) * 131L, global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+        lib_fp_lowpassfilter(&global.rxvalues[channelindex[chan]], ((fixedpointnum) data - 1500) * 131L, timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
     }
 }
 
@@ -65,6 +69,7 @@ void readrx(void)
 {
     int chan;
     uint16_t data;
+    fixedpointnum24 timesliver = readtimesliver(&rxtimeslivertimer);
 
     for (chan = 0; chan < 8; ++chan) {
         data = pwmRead(chan);
@@ -72,7 +77,7 @@ void readrx(void)
         data = 1500;
 
         // convert from 1000-2000 range to -1 to 1 fixedpointnum range and low pass filter to remove glitches
-        lib_fp_lowpassfilter(&global.rxvalues[channelindex[chan]], ((fixedpointnum) data - 1500) * 131L, global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+        lib_fp_lowpassfilter(&global.rxvalues[channelindex[chan]], ((fixedpointnum) data - 1500) * 131L, timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
     }
 }
 #endif
@@ -96,6 +96,9 @@ static int chandirection;
 
 static uint8_t packet[21];
 static unsigned long timeout_timer;
+// readrx() runs at its own pace, the filter and the hopping use the time since it last ran
+static unsigned long rxtimeslivertimer;
+static fixedpointnum24 rxtimesliver;
 
 void init_a7105(void);
 int checkpacket( void);
@@ -211,28 +214,33 @@ void decodepacket()
 {
 	// converts [0;XXXX] to [-1;1] fixed point num
 	// throttle multiplier slightly higher so it reaches 65535 at default 100% rates
-	lib_fp_lowpassfilter(&global.rxvalues[THROTTLEINDEX], ( ((uint32_t) (packet[9]+256*packet[10])) - PPM_OFFSET ) * THROTTLE_GAIN , global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
-	lib_fp_lowpassfilter(&global.rxvalues[PITCHINDEX], ( ((uint32_t) (packet[7]+256*packet[8])) - PPM_OFFSET ) * CHANNEL_GAIN , global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+	// all channels share the timesliver, so they go through the filter in one pass
+	fixedpointnum newvalues[RXNUMCHANNELS];
+
+	newvalues[THROTTLEINDEX] = ( ((uint32_t) (packet[9]+256*packet[10])) - PPM_OFFSET ) * THROTTLE_GAIN;
+	newvalues[PITCHINDEX] = ( ((uint32_t) (packet[7]+256*packet[8])) - PPM_OFFSET ) * CHANNEL_GAIN;
 
 #ifdef SWAP_YAW_AND_ROLL
-		lib_fp_lowpassfilter(&global.rxvalues[YAWINDEX], ( ((uint32_t) (packet[5]+256*packet[6])) - PPM_OFFSET ) * CHANNEL_GAIN, global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
-		lib_fp_lowpassfilter(&global.rxvalues[ROLLINDEX], ( ((uint32_t) (packet[11]+256*packet[12])) - PPM_OFFSET ) * CHANNEL_GAIN , global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+		newvalues[YAWINDEX] = ( ((uint32_t) (packet[5]+256*packet[6])) - PPM_OFFSET ) * CHANNEL_GAIN;
+		newvalues[ROLLINDEX] = ( ((uint32_t) (packet[11]+256*packet[12])) - PPM_OFFSET ) * CHANNEL_GAIN;
 #else
-		lib_fp_lowpassfilter(&global.rxvalues[ROLLINDEX], ( ((uint32_t) (packet[5]+256*packet[6])) - PPM_OFFSET ) * CHANNEL_GAIN, global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
-		lib_fp_lowpassfilter(&global.rxvalues[YAWINDEX], ( ((uint32_t) (packet[11]+256*packet[12])) - PPM_OFFSET ) * CHANNEL_GAIN , global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+		newvalues[ROLLINDEX] = ( ((uint32_t) (packet[5]+256*packet[6])) - PPM_OFFSET ) * CHANNEL_GAIN;
+		newvalues[YAWINDEX] = ( ((uint32_t) (packet[11]+256*packet[12])) - PPM_OFFSET ) * CHANNEL_GAIN;
 #endif
 	
 	// AUX1 == CH5
-	lib_fp_lowpassfilter(&global.rxvalues[AUX1INDEX], ( ((uint32_t) (packet[13]+256*packet[14])) - PPM_OFFSET ) * SWITCH_GAIN , global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+	newvalues[AUX1INDEX] = ( ((uint32_t) (packet[13]+256*packet[14])) - PPM_OFFSET ) * SWITCH_GAIN;
 	// AUX2 == CH6
-	lib_fp_lowpassfilter(&global.rxvalues[AUX2INDEX], ( ((uint32_t) (packet[15]+256*packet[16])) - PPM_OFFSET ) * SWITCH_GAIN , global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+	newvalues[AUX2INDEX] = ( ((uint32_t) (packet[15]+256*packet[16])) - PPM_OFFSET ) * SWITCH_GAIN;
 
 #if (RXNUMCHANNELS>6)  
-	lib_fp_lowpassfilter(&global.rxvalues[AUX3INDEX], ( ((uint32_t) (packet[17]+256*packet[18])) - PPM_OFFSET ) * SWITCH_GAIN , global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+	newvalues[AUX3INDEX] = ( ((uint32_t) (packet[17]+256*packet[18])) - PPM_OFFSET ) * SWITCH_GAIN;
 #endif
 #if (RXNUMCHANNELS>7)
-	lib_fp_lowpassfilter(&global.rxvalues[AUX4INDEX], ( ((uint32_t) (packet[19]+256*packet[20])) - PPM_OFFSET ) * SWITCH_GAIN , global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+	newvalues[AUX4INDEX] = ( ((uint32_t) (packet[19]+256*packet[20])) - PPM_OFFSET ) * SWITCH_GAIN;
 #endif
+	lib_fp_lowpassfilterchannels(global.rxvalues, newvalues, RXNUMCHANNELS, rxtimesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+
 // this is done in other places too, but better safe then sorry
   lib_fp_constrain(&global.rxvalues[THROTTLEINDEX], -FIXEDPOINTONE, FIXEDPOINTONE);
 	//  lib_fp_constrain(&global.rxvalues[ROLLINDEX], -FIXEDPOINTONE, FIXEDPOINTONE);
@@ -277,6 +285,7 @@ void nextchannel( )
 
 void readrx(void)
 {
+	rxtimesliver = readtimesliver(&rxtimeslivertimer);
 	char mode = A7105_ReadRegister(A7105_00_MODE);
 	if(mode & A7105_MODE_TRER_MASK)
 		{// nothing received
@@ -335,9 +344,9 @@ void readrx(void)
 	 
 // 2200 uS reading packet by softspi and other delays in this routine
 // 1700uS loop time is adjusted dynamically 
-// global.timesliver >> 4 == loop time in microseconds
+// rxtimesliver >> 4 == time since the last readrx() in microseconds
 
- unsigned long offset = (global.timesliver >> 4) + SPI_DELAY;
+ unsigned long offset = (rxtimesliver >> 4) + SPI_DELAY;
  int skippackets = 0;
 	 
  // this is basically division by HOP_TIME
@@ -92,6 +92,7 @@ static uint8_t bind_phase;
 static uint8_t boundprotocol;
 static uint8_t tryprotocol;
 static uint32_t packet_timer;
+static unsigned long rxtimeslivertimer;        // readrx() runs at its own pace, see readtimesliver()
 //static uint32_t rx_timeout;
 //static uint32_t valid_packets;
 //static uint32_t missed_packets;
@@ -327,6 +328,7 @@ void readrx(void)
 {
     int chan;
     uint16_t data[8];
+    fixedpointnum24 timesliver = readtimesliver(&rxtimeslivertimer);
 
     if (!(NRF24L01_ReadReg(NRF24L01_07_STATUS) & BV(NRF24L01_07_RX_DR))) {
         uint32_t t = lib_timers_gettimermicroseconds(packet_timer);
@@ -356,7 +358,7 @@ void readrx(void)
 //        data = 1500;
 
         // convert from 1000-2000 range to -1 to 1 fixedpointnum range and low pass filter to remove glitches
-        lib_fp_lowpassfilter(&global.rxvalues[chan], ((fixedpointnum) data[chan] - 1500) * 131L, global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+        lib_fp_lowpassfilter(&global.rxvalues[chan], ((fixedpointnum) data[chan] - 1500) * 131L, timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
     }
     // reset the failsafe timer
     global.failsafetimer = lib_timers_starttimer();
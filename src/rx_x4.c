@@ -38,6 +38,9 @@ static const uint8_t allowed_ch[] = {0x14, 0x1E, 0x28, 0x32, 0x3C, 0x46, 0x50, 0
 static uint8_t packet[16], channel, counter;
 static uint8_t txid[4];
 static unsigned long timeout_timer;
+// readrx() runs at its own pace, the filter uses the time since it last ran
+static unsigned long rxtimeslivertimer;
+static fixedpointnum24 rxtimesliver;
 void init_a7105(void);
 bool hubsan_check_integrity(void);
 void update_crc(void);
@@ -226,19 +229,25 @@ void decodepacket()
 {
     if(packet[0]==0x20) {
         // converts [0;255] to [-1;1] fixed point num
-        lib_fp_lowpassfilter(&global.rxvalues[THROTTLEINDEX], ((fixedpointnum) packet[2] - 0x80) * 513L, global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
-        lib_fp_lowpassfilter(&global.rxvalues[YAWINDEX], ((fixedpointnum) packet[4] - 0x80) * 513L, global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
-        lib_fp_lowpassfilter(&global.rxvalues[PITCHINDEX], ((fixedpointnum) 0x80 - packet[6]) * 513L, global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
-        lib_fp_lowpassfilter(&global.rxvalues[ROLLINDEX], ((fixedpointnum) 0x80 - packet[8]) * 513L, global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+        // all channels share the timesliver, so they go through the filter in one pass
+        fixedpointnum newvalues[AUX2INDEX + 1];
+
+        newvalues[THROTTLEINDEX] = ((fixedpointnum) packet[2] - 0x80) * 513L;
+        newvalues[YAWINDEX] = ((fixedpointnum) packet[4] - 0x80) * 513L;
+        newvalues[PITCHINDEX] = ((fixedpointnum) 0x80 - packet[6]) * 513L;
+        newvalues[ROLLINDEX] = ((fixedpointnum) 0x80 - packet[8]) * 513L;
         // "LEDs" channel, AUX1 (only on H107L, H107C, H107D and Deviation TXs, high by default)
-        lib_fp_lowpassfilter(&global.rxvalues[AUX1INDEX], ((fixedpointnum) (packet[9] & AUX1_FLAG ? 0x7F : -0x7F)) * 513L, global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+        newvalues[AUX1INDEX] = ((fixedpointnum) (packet[9] & AUX1_FLAG ? 0x7F : -0x7F)) * 513L;
         // "Flip" channel, AUX2 (only on H107L, H107C, H107D and Deviation TXs, high by default)
-        lib_fp_lowpassfilter(&global.rxvalues[AUX2INDEX], ((fixedpointnum) (packet[9] & AUX2_FLAG ? 0x7F : -0x7F)) * 513L, global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
+        newvalues[AUX2INDEX] = ((fixedpointnum) (packet[9] & AUX2_FLAG ? 0x7F : -0x7F)) * 513L;
+
+        lib_fp_lowpassfilterchannels(global.rxvalues, newvalues, AUX2INDEX + 1, rxtimesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
     }
 }
 
 void readrx(void) // todo : telemetry
 {
+    rxtimesliver = readtimesliver(&rxtimeslivertimer);
     if( lib_timers_gettimermicroseconds(timeout_timer) > 14000) {
         timeout_timer = lib_timers_starttimer();
         A7105_Strobe(A7105_RX);
@@ -0,0 +1,429 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// library headers
+#include "lib_timers.h"
+
+// project file headers
+#include "bradwii.h"
+#include "rx.h"
+#include "serial.h"
+#include "scheduler.h"
+#include "profiler.h"
+
+extern globalstruct global;
+
+// The main loop's tasks and when they run.  The control task (sensors, imu, pilot control, pid and mixer) runs on
+// every pass of the main loop, or every CONTROL_LOOP_PERIOD microseconds if that is set.  The others only need to
+// run every so often.  After the control task, a pass picks the due task with the highest priority times one more
+// than the control tasks it has waited, so a task that is always due can't starve the others.
+//
+// A task only runs if its estimated run time, the longest recent run, fits.  Without CONTROL_LOOP_PERIOD a pass can
+// spend as long on them as the slowest of them takes and a quarter more, so no pass takes much longer than the
+// control task and the slowest task, but quick tasks can still run after the slowest, and at least
+// MINBUDGETMICROSECONDS, or the tasks would never run the first time to get an estimate.  With it, they have to fit
+// before the control task is due again.  Then the estimate of a due task comes down a little with every control
+// task it waits, so one slow run, like a calibration over MSP, doesn't lock it out for good.
+//
+// The tasks run from the main loop only, so they don't need to be reentrant, and the control task's timesliver
+// is still the time since it last ran.
+//
+// With CONTROL_LOOP_INTERRUPT the control task runs from the periodic timer interrupt instead, and the main loop
+// only runs the others, as they come due.  The control task interrupts them wherever they are, so they don't have
+// to fit anywhere, and their run times include the control tasks that interrupted them.  Whatever they share with
+// the control task has to be safe to change under it: a word written at once, like a receiver channel or the
+// failsafe timer, or the control task held with HOLDCONTROLTASK() while they change it.
+//
+// A pass that runs no task is waiting, and the load in loadstats is the rest of the time over LOADWINDOW, less the
+// control tasks that interrupted the waiting.  With IDLE_WHEN_DISARMED a waiting pass sleeps while disarmed, if
+// nothing comes due before the millisecond tick that wakes it up again.  Without CONTROL_LOOP_PERIOD the control
+// task then only runs every DISARMED_CONTROL_LOOP_PERIOD, or there would never be anything to wait for.
+
+#ifndef RX_TASK_PERIOD
+#define RX_TASK_PERIOD 1400     // microseconds, polls the receiver about 700 times a second
+#endif
+#ifndef SERIAL_TASK_PERIOD
+#define SERIAL_TASK_PERIOD 10000        // the 256 byte receive buffer takes 22ms to fill at 115200 baud
+#endif
+#ifndef GPS_TASK_PERIOD
+#define GPS_TASK_PERIOD 10000
+#endif
+#ifndef BATTERY_TASK_PERIOD
+#define BATTERY_TASK_PERIOD 100000      // a battery reading every other run
+#endif
+#ifndef LED_TASK_PERIOD
+#define LED_TASK_PERIOD 20000   // the shortest blink is 50ms
+#endif
+#ifndef SETTINGS_TASK_PERIOD
+#define SETTINGS_TASK_PERIOD 20000
+#endif
+#ifndef DISARMED_CONTROL_LOOP_PERIOD
+#define DISARMED_CONTROL_LOOP_PERIOD 4000       // enough to keep the attitude and see the stick commands
+#endif
+#define MINBUDGETMICROSECONDS 500
+#define LOADWINDOW 1000000      // microseconds
+#define TICKMICROSECONDS 1000   // the SysTick that ends a sleep
+
+#if (PROFILER == YES)
+// the receivers' readrx() has a variant for each protocol, so the probe goes around it here
+static void profiledreadrx(void)
+{
+    PROFILERENTER(PROBERX);
+    readrx();
+    PROFILEREXIT(PROBERX);
+}
+#define RXTASKFUNCTION profiledreadrx
+#else
+#define RXTASKFUNCTION readrx
+#endif
+
+const taskstruct tasks[] = {
+    // the control task has to be first
+    { controltask, CONTROL_LOOP_PERIOD, 0, TASKCONTROL },
+    { RXTASKFUNCTION, RX_TASK_PERIOD, 4, TASKRX },
+#if (MULTIWII_CONFIG_SERIAL_PORTS != NOSERIALPORT)
+    { serialcheckforaction, SERIAL_TASK_PERIOD, 2, TASKSERIAL },
+#endif
+#if (GPS_TYPE != NO_GPS)
+    { gpstask, GPS_TASK_PERIOD, 2, TASKGPS },
+#endif
+#if (CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107L)
+    { batterytask, BATTERY_TASK_PERIOD, 1, TASKBATTERY },
+#endif
+    { ledtask, LED_TASK_PERIOD, 1, TASKLEDS },
+#if (CONTROL_LOOP_INTERRUPT == YES)
+    { settingstask, SETTINGS_TASK_PERIOD, 1, TASKSETTINGS },
+#endif
+};
+
+#define NUMTASKS (sizeof(tasks) / sizeof(tasks[0]))
+
+const unsigned char numtasks = NUMTASKS;
+taskstatsstruct taskstats[NUMTASKS];
+looptimestatsstruct looptimestats;
+loadstatsstruct loadstats;
+
+static uint32_t loadwindowstart;
+static uint32_t waitingmicroseconds;   // in the current load window
+static uint32_t asleepmicroseconds;
+static volatile uint32_t controlmicroseconds;  // the control tasks' run times, to take out of the waiting
+
+#if (CONTROL_LOOP_PERIOD != 0)
+static uint32_t nextcontroltime;   // when the control task is due
+#endif
+
+#if (CONTROL_LOOP_INTERRUPT == YES)
+static void controlinterrupt(void);
+#endif
+
+void initscheduler(void)
+{
+    uint32_t now = lib_timers_starttimer();
+
+    for (int i = 0; i < NUMTASKS; ++i) {
+        taskstats[i].lastrun = now;
+        taskstats[i].runs = 0;
+        taskstats[i].maxmicroseconds = 0;
+        taskstats[i].averagemicroseconds = 0;
+        taskstats[i].estimatedmicroseconds = 0;
+        taskstats[i].maxlatemicroseconds = 0;
+        taskstats[i].waiting = 0;
+    }
+    resetlooptimestats();
+    loadwindowstart = now;
+#if (CONTROL_LOOP_INTERRUPT == YES)
+    nextcontroltime = now + CONTROL_LOOP_PERIOD;
+    lib_timers_startperiodiccallback(CONTROL_LOOP_PERIOD, controlinterrupt);
+#elif (CONTROL_LOOP_PERIOD != 0)
+    nextcontroltime = now;
+#endif
+}
+
+static uint16_t clampmicroseconds(uint32_t microseconds)
+{
+    return (microseconds > 0xFFFF ? 0xFFFF : microseconds);
+}
+
+static bool isdue(int i, uint32_t now)
+{
+    return ((uint32_t) (now - taskstats[i].lastrun) >= tasks[i].period);
+}
+
+// runs task i, which was due late microseconds ago, and measures it.  Returns its run time.
+static uint16_t runtask(int i, uint32_t now, uint32_t late)
+{
+    taskstatsstruct *stats = &taskstats[i];
+
+    if (late > stats->maxlatemicroseconds)
+        stats->maxlatemicroseconds = clampmicroseconds(late);
+    // the control task counts the waiting from lastrun, in its interrupt with CONTROL_LOOP_INTERRUPT, so the other
+    // tasks hold it while they start
+    if (i != 0)
+        HOLDCONTROLTASK();
+    stats->lastrun = now;
+    stats->waiting = 0;
+    if (i != 0)
+        RELEASECONTROLTASK();
+
+    tasks[i].function();
+
+    uint16_t microseconds = clampmicroseconds(lib_timers_gettimermicroseconds(now));
+    ++stats->runs;
+    if (microseconds > stats->maxmicroseconds)
+        stats->maxmicroseconds = microseconds;
+    stats->averagemicroseconds = ((uint32_t) stats->averagemicroseconds * 7 + microseconds + 4) >> 3;
+    if (microseconds > stats->estimatedmicroseconds)
+        stats->estimatedmicroseconds = microseconds;
+    else
+        stats->estimatedmicroseconds -= (stats->estimatedmicroseconds - microseconds) >> 3;
+    return (microseconds);
+}
+
+void resetlooptimestats(void)
+{
+    for (int i = 0; i < LOOPTIMEBUCKETS; ++i)
+        looptimestats.buckets[i] = 0;
+    looptimestats.count = 0;
+    looptimestats.microseconds = 0;
+    looptimestats.minmicroseconds = 0xFFFF;
+    looptimestats.maxmicroseconds = 0;
+    looptimestats.clamps = 0;
+}
+
+// the shortest loop time that goes in bucket
+uint16_t looptimebucketedge(int bucket)
+{
+    if (bucket == 0)
+        return 0;
+    int shift = 8 + ((bucket - 1) >> 1);
+    return ((1 << shift) + (((bucket - 1) & 1) << (shift - 1)));
+}
+
+static int looptimebucket(uint32_t microseconds)
+{
+    if (microseconds < 256)
+        return 0;
+    if (microseconds >= 32768)
+        return LOOPTIMEBUCKETS - 1;
+    int shift = 8;
+    while (microseconds >> (shift + 1))
+        ++shift;
+    // the bit below the top one picks the half of the octave
+    return (1 + ((shift - 8) << 1) + ((microseconds >> (shift - 1)) & 1));
+}
+
+static void addlooptime(uint32_t microseconds)
+{
+    looptimestatsstruct *stats = &looptimestats;
+    int bucket = looptimebucket(microseconds);
+
+    if (stats->buckets[bucket] == 0xFFFF || (stats->microseconds & 0x80000000)) {
+        stats->count = 0;
+        for (int i = 0; i < LOOPTIMEBUCKETS; ++i) {
+            stats->buckets[i] >>= 1;
+            stats->count += stats->buckets[i];
+        }
+        stats->microseconds >>= 1;
+    }
+    ++stats->buckets[bucket];
+    ++stats->count;
+    stats->microseconds += microseconds;
+    if (microseconds < stats->minmicroseconds)
+        stats->minmicroseconds = microseconds;
+    if (microseconds > stats->maxmicroseconds)
+        stats->maxmicroseconds = clampmicroseconds(microseconds);
+    // 20000us is the FIXEDPOINTONEFIFTIETH calculatetimesliver() clamps to
+    if (microseconds > 20000 && stats->clamps < 0xFFFF)
+        ++stats->clamps;
+}
+
+// the loop time 99 in 100 loops are no longer than, to the end of its bucket or the longest loop time
+uint16_t looptimep99(void)
+{
+    uint32_t above = 0;
+    int bucket = LOOPTIMEBUCKETS - 1;
+
+    // the bucket where the longest 1% start
+    while (bucket > 0 && (above + looptimestats.buckets[bucket]) * 100 <= looptimestats.count) {
+        above += looptimestats.buckets[bucket];
+        --bucket;
+    }
+    if (bucket == LOOPTIMEBUCKETS - 1 || looptimebucketedge(bucket + 1) > looptimestats.maxmicroseconds)
+        return (looptimestats.maxmicroseconds);
+    return (looptimebucketedge(bucket + 1));
+}
+
+static void runcontroltask(uint32_t now, uint32_t late)
+{
+    addlooptime(now - taskstats[0].lastrun);
+    controlmicroseconds += runtask(0, now, late);
+
+    // the tasks that are due have waited another control task
+    for (int i = 1; i < NUMTASKS; ++i)
+        if (isdue(i, now)) {
+            if (taskstats[i].waiting < 255)
+                ++taskstats[i].waiting;
+#if (CONTROL_LOOP_PERIOD != 0) && (CONTROL_LOOP_INTERRUPT == NO)
+            taskstats[i].estimatedmicroseconds -= taskstats[i].estimatedmicroseconds >> 3;
+#endif
+        }
+}
+
+#if (CONTROL_LOOP_INTERRUPT == YES)
+// the timer interrupt
+static void controlinterrupt(void)
+{
+    uint32_t now = lib_timers_starttimer();
+    int32_t late = (int32_t) (now - nextcontroltime);
+
+    // the timer and the microsecond clock can be a tick apart
+    if (late < 0)
+        late = 0;
+    nextcontroltime += CONTROL_LOOP_PERIOD;
+    // held for more than a period, the timer starts its cadence again from now
+    if ((int32_t) (now - nextcontroltime) >= 0)
+        nextcontroltime = now + CONTROL_LOOP_PERIOD;
+    runcontroltask(now, late);
+}
+#endif
+
+#if (IDLE_WHEN_DISARMED == YES)
+// the microseconds until a task comes due, 0 if one is
+static int32_t timeuntildue(uint32_t now)
+{
+#if (CONTROL_LOOP_INTERRUPT == YES)
+    int32_t wait = INT32_MAX;   // the timer interrupt wakes it up for the control task
+#elif (CONTROL_LOOP_PERIOD == 0)
+    int32_t wait = DISARMED_CONTROL_LOOP_PERIOD - (int32_t) (now - taskstats[0].lastrun);
+#else
+    int32_t wait = (int32_t) (nextcontroltime - now);
+#endif
+    for (int i = 1; i < NUMTASKS; ++i) {
+        int32_t until = tasks[i].period - (int32_t) (now - taskstats[i].lastrun);
+        if (until < wait)
+            wait = until;
+    }
+    return (wait < 0 ? 0 : wait);
+}
+#endif
+
+// a pass that ran no task waited since passstart, less the control tasks that interrupted it
+static void waitpass(uint32_t passstart, uint32_t controlatstart)
+{
+#if (IDLE_WHEN_DISARMED == YES)
+    uint32_t now = lib_timers_starttimer();
+
+    if (!global.armed && timeuntildue(now) >= TICKMICROSECONDS) {
+        uint32_t controlbeforesleep = controlmicroseconds;
+        lib_timers_sleep();
+        int32_t asleep = (int32_t) (lib_timers_starttimer() - now - (controlmicroseconds - controlbeforesleep));
+        if (asleep > 0)
+            asleepmicroseconds += asleep;
+    }
+#endif
+    int32_t waiting = (int32_t) (lib_timers_starttimer() - passstart - (controlmicroseconds - controlatstart));
+    if (waiting > 0)
+        waitingmicroseconds += waiting;
+}
+
+// works out the load of the last window once it is over
+static void updateload(uint32_t now)
+{
+    if ((uint32_t) (now - loadwindowstart) < LOADWINDOW)
+        return;
+    uint32_t milliseconds = (now - loadwindowstart) / 1000;
+    // microseconds over milliseconds are tenths of a percent, without the M0's software divide for 64 bits
+    uint32_t waiting = waitingmicroseconds / milliseconds;
+    loadstats.load = waiting < 1000 ? 1000 - waiting : 0;
+    loadstats.asleep = asleepmicroseconds / milliseconds;
+    waitingmicroseconds = 0;
+    asleepmicroseconds = 0;
+    loadwindowstart = now;
+}
+
+// One pass of the main loop
+void runscheduler(void)
+{
+    uint32_t now = lib_timers_starttimer();
+    uint32_t passstart = now;
+    uint32_t controlatstart = controlmicroseconds;
+    bool ran = false;
+
+    updateload(now);
+
+#if (CONTROL_LOOP_INTERRUPT == YES)
+    // the timer interrupt runs the control task
+#elif (CONTROL_LOOP_PERIOD == 0)
+#if (IDLE_WHEN_DISARMED == YES)
+    if (global.armed || (uint32_t) (now - taskstats[0].lastrun) >= DISARMED_CONTROL_LOOP_PERIOD)
+#endif
+    {
+        runcontroltask(now, 0);
+        ran = true;
+    }
+
+    // the time this pass can spend on the other tasks
+    uint32_t budgetstart = lib_timers_starttimer();
+    int32_t budget = 0;
+    for (int i = 1; i < NUMTASKS; ++i)
+        if (taskstats[i].estimatedmicroseconds > budget)
+            budget = taskstats[i].estimatedmicroseconds;
+    budget += budget >> 2;
+    if (budget < MINBUDGETMICROSECONDS)
+        budget = MINBUDGETMICROSECONDS;
+#else
+    if ((int32_t) (now - nextcontroltime) >= 0) {
+        uint32_t late = now - nextcontroltime;
+        nextcontroltime += CONTROL_LOOP_PERIOD;
+        // more than a period late, start the cadence again from now rather than run it twice
+        if ((int32_t) (now - nextcontroltime) >= 0)
+            nextcontroltime = now + CONTROL_LOOP_PERIOD;
+        runcontroltask(now, late);
+        ran = true;
+    }
+#endif
+
+    for (;;) {
+        int best = 0;
+        unsigned int bestpriority = 0;
+
+        now = lib_timers_starttimer();
+#if (CONTROL_LOOP_INTERRUPT == YES)
+        int32_t available = INT32_MAX;
+#elif (CONTROL_LOOP_PERIOD == 0)
+        int32_t available = budget - (int32_t) (now - budgetstart);
+#else
+        int32_t available = (int32_t) (nextcontroltime - now);
+#endif
+        for (int i = 1; i < NUMTASKS; ++i) {
+            if (!isdue(i, now) || available < taskstats[i].estimatedmicroseconds)
+                continue;
+            unsigned int priority = tasks[i].priority * (taskstats[i].waiting + 1);
+            if (priority > bestpriority) {
+                best = i;
+                bestpriority = priority;
+            }
+        }
+        if (!best) {
+            if (!ran)
+                waitpass(passstart, controlatstart);
+            return;
+        }
+        runtask(best, now, now - taskstats[best].lastrun - tasks[best].period);
+        ran = true;
+    }
+}
@@ -0,0 +1,94 @@
+/*
+Copyright 2015 silverx
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "defs.h"
+#include "lib_timers.h"
+
+// the tasks' ids, as MSP_TASK_STATS sends them.  A build only has the tasks its hardware needs.
+#define TASKCONTROL 0
+#define TASKRX 1
+#define TASKSERIAL 2
+#define TASKGPS 3
+#define TASKBATTERY 4
+#define TASKLEDS 5
+#define TASKSETTINGS 6         // with CONTROL_LOOP_INTERRUPT
+
+typedef void (*taskfunctionptr)(void);
+
+typedef struct {
+    taskfunctionptr function;
+    uint32_t period;            // microseconds between runs
+    uint8_t priority;           // how much it counts for each control task it has waited, see scheduler.c
+    uint8_t id;
+} taskstruct;
+
+// what the scheduler measured, in microseconds.  The times are clamped to 65535.
+typedef struct {
+    uint32_t lastrun;           // lib_timers time when it last started
+    uint16_t runs;              // wraps
+    uint16_t maxmicroseconds;   // the longest run
+    uint16_t averagemicroseconds;
+    uint16_t estimatedmicroseconds;     // the longest recent run, to see if it fits before the control task
+    uint16_t maxlatemicroseconds;       // the latest start after it was due
+    uint8_t waiting;            // control tasks run since it was due
+} taskstatsstruct;
+
+// The control task's loop times, the microseconds from one start to the next, for catching the passes that
+// something like a radio read stalled.  Two buckets per octave: 0 below 256us, then 256, 384, 512, 768 and so on
+// up to 15 from 32768us, see looptimebucketedge().  Everything is halved rather than overflowing.
+#define LOOPTIMEBUCKETS 16
+
+typedef struct {
+    uint16_t buckets[LOOPTIMEBUCKETS];
+    uint32_t count;             // the sum of the buckets
+    uint32_t microseconds;      // the sum of the loop times, for the mean
+    uint16_t minmicroseconds;
+    uint16_t maxmicroseconds;   // clamped to 65535
+    uint16_t clamps;            // loop times over a fiftieth of a second, which calculatetimesliver() clamps
+} looptimestatsstruct;
+
+// How busy the main loop was over the last LOADWINDOW, in tenths of a percent.  A pass of the main loop that runs no
+// task is waiting, whether it spins or sleeps; the rest of the time is load.
+typedef struct {
+    uint16_t load;
+    uint16_t asleep;            // the part of the waiting spent asleep with IDLE_WHEN_DISARMED
+} loadstatsstruct;
+
+extern const taskstruct tasks[];
+extern taskstatsstruct taskstats[];
+extern const unsigned char numtasks;
+extern looptimestatsstruct looptimestats;
+extern loadstatsstruct loadstats;
+
+void initscheduler(void);
+void runscheduler(void);
+void resetlooptimestats(void);
+uint16_t looptimebucketedge(int bucket);
+uint16_t looptimep99(void);
+
+#if (CONTROL_LOOP_INTERRUPT == YES)
+// Keeps the control task's interrupt from running while the main loop uses the sensors it reads, like a
+// calibration asked for over MSP.  A control task that came due runs on release.
+#define HOLDCONTROLTASK() lib_timers_holdperiodiccallback(true)
+#define RELEASECONTROLTASK() lib_timers_holdperiodiccallback(false)
+#else
+#define HOLDCONTROLTASK() ((void) 0)
+#define RELEASECONTROLTASK() ((void) 0)
+#endif
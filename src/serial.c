@@ -30,9 +30,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "defs.h"
 #include "checkboxes.h"
 #include "compass.h"
-#include "eeprom.h"
 #include "imu.h"
+#include "eeprom.h"
 #include "gps.h"
+#include "scheduler.h"
+#include "profiler.h"
 
 #define MSP_VERSION 0
 #define  VERSION  112           // version 1.12
@@ -149,29 +151,135 @@ void evaluatecommand(char portnumber, unsigned char *data)
             sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
         }
     } else if (command == MSP_ATTITUDE) {       // send attitude data
+        fixedpointnum attitude[3];
+        // the control task would mark the angles stale again halfway through
+        HOLDCONTROLTASK();
+        imuupdateeulerattitude();
+        for (int x = 0; x < 3; ++x)
+            attitude[x] = global.currentestimatedeulerattitude[x];
+        RELEASECONTROLTASK();
         sendgoodheader(portnumber, 6);
         // convert our estimated gravity vector into roll and pitch angles
         int value;
-        value = (global.currentestimatedeulerattitude[0] * 10) >>FIXEDPOINTSHIFT;
+        value = (attitude[0] * 10) >>FIXEDPOINTSHIFT;
         sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
-        value = (global.currentestimatedeulerattitude[1] * 10) >>FIXEDPOINTSHIFT;
+        value = (attitude[1] * 10) >>FIXEDPOINTSHIFT;
         sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
-        value = (global.currentestimatedeulerattitude[2]) >>FIXEDPOINTSHIFT;
+        value = (attitude[2]) >>FIXEDPOINTSHIFT;
         sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
     } else if (command == MSP_ALTITUDE) {       // send attitude data
         sendgoodheader(portnumber, 4);
         fixedpointnum fp = (global.altitude * 25) >>(FIXEDPOINTSHIFT - 2);
         sendandchecksumdata(portnumber, (unsigned char *) &fp, 4);
     } else if (command == MSP_MAG_CALIBRATION) {        // send attitude data
-        if (!global.armed)
+        if (!global.armed) {
+            HOLDCONTROLTASK();
             calibratecompass();
+            RELEASECONTROLTASK();
+        }
         sendgoodheader(portnumber, 0);
     } else if (command == MSP_ACC_CALIBRATION) {        // send attitude data
-        if (!global.armed)
+        if (!global.armed) {
+            HOLDCONTROLTASK();
             calibrategyroandaccelerometer(true);
+            RELEASECONTROLTASK();
+        }
+        sendgoodheader(portnumber, 0);
+    }
+
+    else if (command == MSP_CALIBRATION_INFO) { // send how the last calibration went
+        sendgoodheader(portnumber, 28);
+        sendandchecksumint(portnumber, calibrationinfo.milliseconds);
+        sendandchecksumcharacter(portnumber, calibrationinfo.restarts);
+        sendandchecksumcharacter(portnumber, calibrationinfo.timedout);
+        // the variances as fixedpointnum24s
+        for (int x = 0; x < 3; ++x)
+            sendandchecksumlong(portnumber, calibrationinfo.gyrovariance[x]);
+        for (int x = 0; x < 3; ++x)
+            sendandchecksumlong(portnumber, calibrationinfo.accvariance[x]);
+    }
+#if (ACC_SIX_POSITION_CALIBRATION == YES)
+    else if (command == MSP_ACC_SIX_POSITION_CALIBRATION) {
+        if (!global.armed)
+            startaccsixpositioncalibration();
         sendgoodheader(portnumber, 0);
     }
 
+    else if (command == MSP_ACC_SIX_POSITION_INFO) {    // send how the six position calibration is going
+        sendgoodheader(portnumber, 20);
+        sendandchecksumcharacter(portnumber, accsixpositioninfo.state);
+        sendandchecksumcharacter(portnumber, accsixpositioninfo.positions);
+        // the gains minus one in 1/65536ths and the offsets as fixedpointnums, as they are in usersettings
+        for (int x = 0; x < 3; ++x)
+            sendandchecksumint(portnumber, usersettings.accgaincorrection[x]);
+        for (int x = 0; x < 3; ++x)
+            sendandchecksumlong(portnumber, usersettings.acccalibration[x]);
+    }
+#endif
+
+    else if (command == MSP_TASK_STATS) {       // send what the scheduler measured, see scheduler.h
+        sendgoodheader(portnumber, 1 + numtasks * 14);
+        sendandchecksumcharacter(portnumber, numtasks);
+        for (int i = 0; i < numtasks; ++i) {
+            sendandchecksumcharacter(portnumber, tasks[i].id);
+            sendandchecksumlong(portnumber, tasks[i].period);
+            sendandchecksumcharacter(portnumber, tasks[i].priority);
+            sendandchecksumint(portnumber, taskstats[i].runs);
+            sendandchecksumint(portnumber, taskstats[i].maxmicroseconds);
+            sendandchecksumint(portnumber, taskstats[i].averagemicroseconds);
+            sendandchecksumint(portnumber, taskstats[i].maxlatemicroseconds);
+        }
+    }
+
+    else if (command == MSP_LOOP_TIME) {        // send the control task's loop times in microseconds, see scheduler.h
+        sendgoodheader(portnumber, 15 + LOOPTIMEBUCKETS * 2);
+        sendandchecksumlong(portnumber, looptimestats.count);
+        sendandchecksumint(portnumber, looptimestats.count ? looptimestats.microseconds / looptimestats.count : 0);
+        sendandchecksumint(portnumber, looptimestats.count ? looptimestats.minmicroseconds : 0);
+        sendandchecksumint(portnumber, looptimestats.maxmicroseconds);
+        sendandchecksumint(portnumber, looptimep99());
+        sendandchecksumint(portnumber, looptimestats.clamps);
+        sendandchecksumcharacter(portnumber, LOOPTIMEBUCKETS);
+        for (int i = 0; i < LOOPTIMEBUCKETS; ++i)
+            sendandchecksumint(portnumber, looptimestats.buckets[i]);
+    }
+
+    else if (command == MSP_RESET_LOOP_TIME) {
+        HOLDCONTROLTASK();
+        resetlooptimestats();
+        RELEASECONTROLTASK();
+        sendgoodheader(portnumber, 0);
+    }
+
+    else if (command == MSP_CPU_LOAD) { // send how busy the main loop was, see scheduler.h
+        sendgoodheader(portnumber, 4);
+        sendandchecksumint(portnumber, loadstats.load);
+        sendandchecksumint(portnumber, loadstats.asleep);
+    }
+
+#if (PROFILER == YES)
+    else if (command == MSP_PROFILER) { // send what the probes measured in cycles, see profiler.h
+        sendgoodheader(portnumber, 3 + NUMPROBES * 10);
+        sendandchecksumint(portnumber, lib_timers_cyclespermicrosecond());
+        sendandchecksumcharacter(portnumber, NUMPROBES);
+        // the control task's probes all from the same run
+        HOLDCONTROLTASK();
+        for (int i = 0; i < NUMPROBES; ++i) {
+            sendandchecksumint(portnumber, profilerprobes[i].count);
+            sendandchecksumlong(portnumber, profilerprobes[i].cycles);
+            sendandchecksumlong(portnumber, profilerprobes[i].maxcycles);
+        }
+        RELEASECONTROLTASK();
+    }
+
+    else if (command == MSP_RESET_PROFILER) {
+        HOLDCONTROLTASK();
+        resetprofiler();
+        RELEASECONTROLTASK();
+        sendgoodheader(portnumber, 0);
+    }
+#endif
+
     else if (command == MSP_RAW_IMU) {  // send attitude data
         sendgoodheader(portnumber, 18);
         for (int x = 0; x < 3; ++x) {   // convert from g's to what multiwii uses
@@ -262,8 +370,12 @@ void evaluatecommand(char portnumber, unsigned char *data)
         defaultusersettings();
     } else if (command == MSP_EEPROM_WRITE) {   // reset user settings
         sendgoodheader(portnumber, 0);
-        if (!global.armed)
+        if (!global.armed) {
+            // the control task writes them too, after a calibration
+            HOLDCONTROLTASK();
             writeusersettingstoeeprom();
+            RELEASECONTROLTASK();
+        }
     } else if (command == MSP_RAW_GPS) {        // reset user settings
         sendgoodheader(portnumber, 14);
         sendandchecksumcharacter(portnumber, 0);        // gps fix
@@ -316,6 +428,12 @@ void serialcheckportforaction(char portnumber)
             int spaceneeded = 40;
             if (serialcommand[portnumber] == MSP_BOXNAMES)
                 spaceneeded = strlen(checkboxnames) + 10;
+            else if (serialcommand[portnumber] == MSP_TASK_STATS)
+                spaceneeded = numtasks * 14 + 10;
+            else if (serialcommand[portnumber] == MSP_LOOP_TIME)
+                spaceneeded = LOOPTIMEBUCKETS * 2 + 25;
+            else if (serialcommand[portnumber] == MSP_PROFILER)
+                spaceneeded = NUMPROBES * 10 + 10;
 
             if (numcharsavailable > serialdatasize[portnumber] && lib_serial_availableoutputbuffersize(portnumber) >= spaceneeded) {
                 unsigned char data[MAXPAYLOADSIZE + 1];
@@ -420,16 +538,22 @@ void serialcheckportforactiontest(char portnumber)
                 serialprintfixedpoint(portnumber, global.acc_g_vector[x]);
             }
         } else if (c == 't') {  // atttude angle values
+            fixedpointnum attitude[3];
+            HOLDCONTROLTASK();
+            imuupdateeulerattitude();
+            for (int x = 0; x < 3; ++x)
+                attitude[x] = global.currentestimatedeulerattitude[x];
+            RELEASECONTROLTASK();
             for (int x = 0; x < 3; ++x) {
-                serialprintfixedpoint(portnumber, global.currentestimatedeulerattitude[x]);
+                serialprintfixedpoint(portnumber, attitude[x]);
             }
         } else if (c == 'e') {  // atttude angle values
-            serialprintfixedpoint(portnumber, global.estimateddownvector[0]);
-            serialprintfixedpoint(portnumber, global.estimateddownvector[1]);
-            serialprintfixedpoint(portnumber, global.estimateddownvector[2]);
-            serialprintfixedpoint(portnumber, global.estimatedwestvector[0]);
-            serialprintfixedpoint(portnumber, global.estimatedwestvector[1]);
-            serialprintfixedpoint(portnumber, global.estimatedwestvector[2]);
+            serialprintfixedpoint(portnumber, FIXEDPOINT30TOFIXEDPOINT(global.estimateddownvector[0]));
+            serialprintfixedpoint(portnumber, FIXEDPOINT30TOFIXEDPOINT(global.estimateddownvector[1]));
+            serialprintfixedpoint(portnumber, FIXEDPOINT30TOFIXEDPOINT(global.estimateddownvector[2]));
+            serialprintfixedpoint(portnumber, FIXEDPOINT30TOFIXEDPOINT(global.estimatedwestvector[0]));
+            serialprintfixedpoint(portnumber, FIXEDPOINT30TOFIXEDPOINT(global.estimatedwestvector[1]));
+            serialprintfixedpoint(portnumber, FIXEDPOINT30TOFIXEDPOINT(global.estimatedwestvector[2]));
         } else if (c == 'd') {  // debug values
             for (int x = 0; x < 3; ++x)
                 serialprintfixedpoint(portnumber, global.debugvalue[x]);
@@ -43,6 +43,17 @@ void serialcheckforaction(void);
 #define MSP_PIDNAMES             117    //out message         the PID names
 #define MSP_WP                   118    //out message         get a WP, WP# is in the payload, returns (WP#, lat, lon, alt, flags) WP#0-home, WP#16-poshold
 
+// bradwii's own messages
+#define MSP_CALIBRATION_INFO     150    //out message         last calibration: milliseconds, restarts, timed out, gyro variance xyz, acc variance xyz
+#define MSP_ACC_SIX_POSITION_CALIBRATION 151  //in message no param, starts the six position acc calibration
+#define MSP_ACC_SIX_POSITION_INFO 152    //out message         six position acc calibration: state, positions, gain corrections xyz, offsets xyz
+#define MSP_TASK_STATS           153    //out message         per main loop task: id, period, priority, runs, max, average and latest start microseconds
+#define MSP_LOOP_TIME            154    //out message         control task loop times: count, mean, min, max, p99, clamps, histogram buckets
+#define MSP_RESET_LOOP_TIME      155    //in message          no param, clears the loop times
+#define MSP_PROFILER             156    //out message         with PROFILER: cycles per microsecond, per probe: runs, cycles, max cycles
+#define MSP_RESET_PROFILER       157    //in message          with PROFILER, no param, clears the probes
+#define MSP_CPU_LOAD             158    //out message         main loop load and time asleep over the last second, tenths of a percent
+
 #define MSP_SET_RAW_RC           200    //in message          8 rc chan
 #define MSP_SET_RAW_GPS          201    //in message          fix, numsat, lat, lon, alt, speed
 #define MSP_SET_PID              202    //in message          up to 16 P I D (8 are used)
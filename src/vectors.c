@@ -52,20 +52,213 @@ fixedpointnum vectordotproduct(fixedpointnum * v1, fixedpointnum * v2)
     return (lib_fp_multiply(v1[0], v2[0]) + lib_fp_multiply(v1[1], v2[1]) + lib_fp_multiply(v1[2], v2[2]));
 }
 
-void rotatevectorwithsmallangles(fixedpointnum * v, fixedpointnum rolldeltaangle, fixedpointnum pitchdeltaangle, fixedpointnum yawdeltaangle)
+void rotatevectorwithsmallangles(fixedpointnum * v, fixedpointnum24 rolldeltaangle, fixedpointnum24 pitchdeltaangle, fixedpointnum24 yawdeltaangle)
 {
     // rotate theattitude by the delta angles.
-    // assumes that the delta angles are small angles in degrees and that they are shifted left by TIMESLIVEREXTRASHIFT
+    // assumes that the delta angles are small angles in radians
     fixedpointnum v_tmp_x = v[XINDEX];
     fixedpointnum v_tmp_y = v[YINDEX];
     fixedpointnum v_tmp_z = v[ZINDEX];
 
-    // remember that our delta angles are shifted left by TIMESLIVEREXTRASHIFT for resolution.  Take it out here
-    v[XINDEX] += (lib_fp_multiply(rolldeltaangle, v_tmp_z) - lib_fp_multiply(yawdeltaangle, v_tmp_y)) >> (TIMESLIVEREXTRASHIFT);
-    v[YINDEX] += (lib_fp_multiply(pitchdeltaangle, v_tmp_z) + lib_fp_multiply(yawdeltaangle, v_tmp_x)) >> (TIMESLIVEREXTRASHIFT);
-    v[ZINDEX] -= (lib_fp_multiply(rolldeltaangle, v_tmp_x) + lib_fp_multiply(pitchdeltaangle, v_tmp_y)) >> (TIMESLIVEREXTRASHIFT);
+    v[XINDEX] += lib_fp_multiply24(rolldeltaangle, v_tmp_z) - lib_fp_multiply24(yawdeltaangle, v_tmp_y);
+    v[YINDEX] += lib_fp_multiply24(pitchdeltaangle, v_tmp_z) + lib_fp_multiply24(yawdeltaangle, v_tmp_x);
+    v[ZINDEX] -= lib_fp_multiply24(rolldeltaangle, v_tmp_x) + lib_fp_multiply24(pitchdeltaangle, v_tmp_y);
 }
 
+// The fused kernels below share one operand between several products.  The shared operand is
+// split once into a high part and a low part, and each product then takes two multiplies
+// instead of the four inside lib_fp_multiply().  They only hold for the ranges noted, which the
+// estimated attitude vectors stay well inside of.
+
+// small angle products: (angle * v) >> FIXEDPOINT24SHIFT for a fixedpointnum24 angle and a fixedpointnum30 v.
+// The angle is split at bit 12 and v is rounded to 18 bits after the point, so the high product is already
+// shifted 30 bits and only the low one needs a shift.  Needs |angle| < 2^24 (one radian) and |v| < 2^31 (2.0).
+#define SMALLANGLESPLIT (FIXEDPOINT24SHIFT / 2)
+#define SMALLANGLEVECTOR(v) (((v) + (1L << (SMALLANGLESPLIT - 1))) >> SMALLANGLESPLIT)
+#define SMALLANGLEMULTIPLY(high, low, v) ((high) * (v) + (((low) * (v)) >> SMALLANGLESPLIT))
+
+static void rotatevectorwithsplitangles(fixedpointnum30 * v, fixedpointnum24 * high, fixedpointnum24 * low)
+{
+    int32_t v_tmp_x = SMALLANGLEVECTOR(v[XINDEX]);
+    int32_t v_tmp_y = SMALLANGLEVECTOR(v[YINDEX]);
+    int32_t v_tmp_z = SMALLANGLEVECTOR(v[ZINDEX]);
+
+    v[XINDEX] += SMALLANGLEMULTIPLY(high[ROLLINDEX], low[ROLLINDEX], v_tmp_z) - SMALLANGLEMULTIPLY(high[YAWINDEX], low[YAWINDEX], v_tmp_y);
+    v[YINDEX] += SMALLANGLEMULTIPLY(high[PITCHINDEX], low[PITCHINDEX], v_tmp_z) + SMALLANGLEMULTIPLY(high[YAWINDEX], low[YAWINDEX], v_tmp_x);
+    v[ZINDEX] -= SMALLANGLEMULTIPLY(high[ROLLINDEX], low[ROLLINDEX], v_tmp_x) + SMALLANGLEMULTIPLY(high[PITCHINDEX], low[PITCHINDEX], v_tmp_y);
+}
+
+void rotatevectorswithsmallangles(fixedpointnum30 * v1, fixedpointnum30 * v2, fixedpointnum24 rolldeltaangle, fixedpointnum24 pitchdeltaangle, fixedpointnum24 yawdeltaangle)
+{
+    // rotatevectorwithsmallangles() for the two attitude vectors, which are fixedpointnum30s, with 24 multiplies.
+    // The gyro can't turn more than 40 degrees in the longest timesliver, so the one radian limit isn't reached.
+    fixedpointnum24 high[3];
+    fixedpointnum24 low[3];
+
+    high[ROLLINDEX] = rolldeltaangle >> SMALLANGLESPLIT;
+    low[ROLLINDEX] = rolldeltaangle & ((1L << SMALLANGLESPLIT) - 1);
+    high[PITCHINDEX] = pitchdeltaangle >> SMALLANGLESPLIT;
+    low[PITCHINDEX] = pitchdeltaangle & ((1L << SMALLANGLESPLIT) - 1);
+    high[YAWINDEX] = yawdeltaangle >> SMALLANGLESPLIT;
+    low[YAWINDEX] = yawdeltaangle & ((1L << SMALLANGLESPLIT) - 1);
+
+    rotatevectorwithsplitangles(v1, high, low);
+    rotatevectorwithsplitangles(v2, high, low);
+}
+
+// unit vector products: (a * b) >> FIXEDPOINTSHIFT with a split at bit 8.
+// Needs |a| * |b| < 2^39 so that the high product fits, e.g. both below 2^19 (8.0) and one of them below 2^20.
+#define UNITVECTORSPLIT 8
+#define UNITVECTORHIGH(a) ((a) >> UNITVECTORSPLIT)
+#define UNITVECTORLOW(a) ((a) & ((1L << UNITVECTORSPLIT) - 1))
+#define UNITVECTORMULTIPLY(high, low, b) ((((high) * (b)) >> UNITVECTORSPLIT) + (((low) * (b) + (1L << (FIXEDPOINTSHIFT - 1))) >> FIXEDPOINTSHIFT))
+
+fixedpointnum vectorcrossproductnormalized(fixedpointnum * v1, fixedpointnum * v2, fixedpointnum * v3, int invsqrtprecision)
+{
+    // v3 = v1 x v2 scaled to unit length, returns the squared length before normalizing like normalizevector().
+    // v1 and v2 must be shorter than 2.0 in every component. 24 multiplies instead of 48 plus lib_fp_invsqrtprecision().
+    // invsqrtprecision is one of the LIB_FP_INVSQRT_ precisions.
+    fixedpointnum high[3];
+    fixedpointnum low[3];
+
+    for (int x = 0; x < 3; ++x) {
+        high[x] = UNITVECTORHIGH(v1[x]);
+        low[x] = UNITVECTORLOW(v1[x]);
+    }
+
+    // |v3| stays below 8.0, so the components can be split again for the squares
+    v3[XINDEX] = UNITVECTORMULTIPLY(high[YINDEX], low[YINDEX], v2[ZINDEX]) - UNITVECTORMULTIPLY(high[ZINDEX], low[ZINDEX], v2[YINDEX]);
+    v3[YINDEX] = UNITVECTORMULTIPLY(high[ZINDEX], low[ZINDEX], v2[XINDEX]) - UNITVECTORMULTIPLY(high[XINDEX], low[XINDEX], v2[ZINDEX]);
+    v3[ZINDEX] = UNITVECTORMULTIPLY(high[XINDEX], low[XINDEX], v2[YINDEX]) - UNITVECTORMULTIPLY(high[YINDEX], low[YINDEX], v2[XINDEX]);
+
+    fixedpointnum vectorlengthsquared = 0;
+    for (int x = 0; x < 3; ++x)
+        vectorlengthsquared += UNITVECTORMULTIPLY(UNITVECTORHIGH(v3[x]), UNITVECTORLOW(v3[x]), v3[x]);
+
+    if (vectorlengthsquared < 10) {
+        v3[0] = FIXEDPOINTONE;
+        v3[1] = v3[2] = 0;
+    } else {
+        fixedpointnum multiplier = lib_fp_invsqrtprecision(vectorlengthsquared, invsqrtprecision);
+
+        if (multiplier < (1L << 20)) {
+            // the multiplier is shared by all three components
+            fixedpointnum multiplierhigh = UNITVECTORHIGH(multiplier);
+            fixedpointnum multiplierlow = UNITVECTORLOW(multiplier);
+            for (int x = 0; x < 3; ++x)
+                v3[x] = UNITVECTORMULTIPLY(multiplierhigh, multiplierlow, v3[x]);
+        } else {
+            // very short cross product, the multiplier is too big to split
+            for (int x = 0; x < 3; ++x)
+                v3[x] = lib_fp_multiply(v3[x], multiplier);
+        }
+    }
+    return (vectorlengthsquared);
+}
+
+void vectorcrossproduct30(fixedpointnum30 * v1, fixedpointnum30 * v2, fixedpointnum30 * v3)
+{
+    // vectorcrossproduct() for fixedpointnum30s.  Every component has to stay below 2.0, which it does for vectors
+    // no longer than about 1.4.
+    v3[XINDEX] = lib_fp_multiply30(v1[YINDEX], v2[ZINDEX]) - lib_fp_multiply30(v1[ZINDEX], v2[YINDEX]);
+    v3[YINDEX] = lib_fp_multiply30(v1[ZINDEX], v2[XINDEX]) - lib_fp_multiply30(v1[XINDEX], v2[ZINDEX]);
+    v3[ZINDEX] = lib_fp_multiply30(v1[XINDEX], v2[YINDEX]) - lib_fp_multiply30(v1[YINDEX], v2[XINDEX]);
+}
+
+#if (GYRO_SAMPLE_RATE != 0)
+void vectorcrossproduct24(fixedpointnum24 * v1, fixedpointnum24 * v2, fixedpointnum24 * v3)
+{
+    // vectorcrossproduct() for fixedpointnum24s, like small rotation vectors
+    v3[XINDEX] = lib_fp_multiply24(v1[YINDEX], v2[ZINDEX]) - lib_fp_multiply24(v1[ZINDEX], v2[YINDEX]);
+    v3[YINDEX] = lib_fp_multiply24(v1[ZINDEX], v2[XINDEX]) - lib_fp_multiply24(v1[XINDEX], v2[ZINDEX]);
+    v3[ZINDEX] = lib_fp_multiply24(v1[XINDEX], v2[YINDEX]) - lib_fp_multiply24(v1[YINDEX], v2[XINDEX]);
+}
+#endif
+
+fixedpointnum30 normalizevector30(fixedpointnum30 * v)
+{
+    // normalizevector() for fixedpointnum30s.  Vectors shorter than .5 are set to any unit length vector,
+    // since lib_fp_invsqrt30() can't return more than 2.0.
+    fixedpointnum30 vectorlengthsquared = lib_fp_multiply30(v[0], v[0])
+        + lib_fp_multiply30(v[1], v[1])
+        + lib_fp_multiply30(v[2], v[2]);
+
+    if (vectorlengthsquared < (FIXEDPOINT30ONE >> 2)) {
+        v[0] = FIXEDPOINT30ONE;
+        v[1] = v[2] = 0;
+    } else {
+        fixedpointnum30 multiplier = lib_fp_invsqrt30(vectorlengthsquared, LIB_FP_INVSQRT_TWONEWTON);
+
+        v[0] = lib_fp_multiply30(v[0], multiplier);
+        v[1] = lib_fp_multiply30(v[1], multiplier);
+        v[2] = lib_fp_multiply30(v[2], multiplier);
+    }
+    return (vectorlengthsquared);
+}
+
+#if (IMU_ESTIMATOR == QUATERNION_ESTIMATOR)
+// Attitude quaternions are fixedpointnum30s, w x y z, and rotate the attitude vectors' frame (X left, Y forward,
+// Z down) to the world frame, so the attitude vectors in that frame are rows of its rotation matrix.
+
+void rotatequaternionwithsmallangles(fixedpointnum30 * q, fixedpointnum24 * angles)
+{
+    // q = q + q * (0, angles) / 2 for small angles in radians around the X, Y and Z axes, which turns the attitude
+    // vectors the same way rotatevectorswithsmallangles() does.  The products are split like there, 24 multiplies.
+    // Each component of the change stays below the length of angles, so nothing overflows for a unit q.
+    fixedpointnum24 high[3];
+    fixedpointnum24 low[3];
+
+    for (int x = 0; x < 3; ++x) {
+        high[x] = angles[x] >> SMALLANGLESPLIT;
+        low[x] = angles[x] & ((1L << SMALLANGLESPLIT) - 1);
+    }
+
+    int32_t w = SMALLANGLEVECTOR(q[0]);
+    int32_t x = SMALLANGLEVECTOR(q[1]);
+    int32_t y = SMALLANGLEVECTOR(q[2]);
+    int32_t z = SMALLANGLEVECTOR(q[3]);
+
+    q[0] -= (SMALLANGLEMULTIPLY(high[XINDEX], low[XINDEX], x) + SMALLANGLEMULTIPLY(high[YINDEX], low[YINDEX], y) + SMALLANGLEMULTIPLY(high[ZINDEX], low[ZINDEX], z) + 1) >> 1;
+    q[1] += (SMALLANGLEMULTIPLY(high[XINDEX], low[XINDEX], w) + SMALLANGLEMULTIPLY(high[ZINDEX], low[ZINDEX], y) - SMALLANGLEMULTIPLY(high[YINDEX], low[YINDEX], z) + 1) >> 1;
+    q[2] += (SMALLANGLEMULTIPLY(high[YINDEX], low[YINDEX], w) + SMALLANGLEMULTIPLY(high[XINDEX], low[XINDEX], z) - SMALLANGLEMULTIPLY(high[ZINDEX], low[ZINDEX], x) + 1) >> 1;
+    q[3] += (SMALLANGLEMULTIPLY(high[ZINDEX], low[ZINDEX], w) + SMALLANGLEMULTIPLY(high[YINDEX], low[YINDEX], x) - SMALLANGLEMULTIPLY(high[XINDEX], low[XINDEX], y) + 1) >> 1;
+}
+
+void renormalizequaternion30(fixedpointnum30 * q)
+{
+    // scales q by (3 - |q|^2) / 2, one newton step towards unit length without lib_fp_invsqrt30().  It only holds
+    // for quaternions that are already close to unit length, which they stay if this is done after every rotation.
+    fixedpointnum30 lengthsquared = lib_fp_multiply30(q[0], q[0]) + lib_fp_multiply30(q[1], q[1]) + lib_fp_multiply30(q[2], q[2]) + lib_fp_multiply30(q[3], q[3]);
+    fixedpointnum30 multiplier = FIXEDPOINT30ONE + ((FIXEDPOINT30ONE - lengthsquared) >> 1);
+
+    for (int x = 0; x < 4; ++x)
+        q[x] = lib_fp_multiply30(q[x], multiplier);
+}
+
+void quaterniontoattitudevectors30(fixedpointnum30 * q, fixedpointnum30 * downvector, fixedpointnum30 * westvector)
+{
+    // the down vector is the world's Z axis and the west vector its X axis in the attitude vectors' frame.
+    // Shifting by one less than a multiply30 doubles each product for free.  9 multiplies.
+    fixedpointnum30 xx = lib_fp_multiplyshift(q[1], q[1], FIXEDPOINT30SHIFT - 1);
+    fixedpointnum30 yy = lib_fp_multiplyshift(q[2], q[2], FIXEDPOINT30SHIFT - 1);
+    fixedpointnum30 zz = lib_fp_multiplyshift(q[3], q[3], FIXEDPOINT30SHIFT - 1);
+    fixedpointnum30 xy = lib_fp_multiplyshift(q[1], q[2], FIXEDPOINT30SHIFT - 1);
+    fixedpointnum30 xz = lib_fp_multiplyshift(q[1], q[3], FIXEDPOINT30SHIFT - 1);
+    fixedpointnum30 yz = lib_fp_multiplyshift(q[2], q[3], FIXEDPOINT30SHIFT - 1);
+    fixedpointnum30 wx = lib_fp_multiplyshift(q[0], q[1], FIXEDPOINT30SHIFT - 1);
+    fixedpointnum30 wy = lib_fp_multiplyshift(q[0], q[2], FIXEDPOINT30SHIFT - 1);
+    fixedpointnum30 wz = lib_fp_multiplyshift(q[0], q[3], FIXEDPOINT30SHIFT - 1);
+
+    downvector[XINDEX] = xz - wy;
+    downvector[YINDEX] = yz + wx;
+    downvector[ZINDEX] = FIXEDPOINT30ONE - xx - yy;
+
+    westvector[XINDEX] = FIXEDPOINT30ONE - yy - zz;
+    westvector[YINDEX] = xy - wz;
+    westvector[ZINDEX] = xz + wy;
+}
+#endif
+
 // some extra vector functions that aren't currently used.
 #ifdef EXTENDEDVECTORFUNCTIONS
 void vectordifferencetoeulerangles(fixedpointnum * v1, fixedpointnum * v2, fixedpointnum * euler)
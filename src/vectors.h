@@ -30,6 +30,14 @@ fixedpointnum normalizevector(fixedpointnum * v);
 fixedpointnum vectordotproduct(fixedpointnum * v1, fixedpointnum * v2);
 void vectordifferencetoeulerangles(fixedpointnum * v1, fixedpointnum * v2, fixedpointnum * euler);
 void attitudetoeulerangles(attitudestruct * theattitude, fixedpointnum * eulerangles);
-void rotatevectorwithsmallangles(fixedpointnum * v, fixedpointnum rolldeltaangle, fixedpointnum pitchdeltaangle, fixedpointnum yawdeltaangle);
+void rotatevectorwithsmallangles(fixedpointnum * v, fixedpointnum24 rolldeltaangle, fixedpointnum24 pitchdeltaangle, fixedpointnum24 yawdeltaangle);
+void rotatevectorswithsmallangles(fixedpointnum30 * v1, fixedpointnum30 * v2, fixedpointnum24 rolldeltaangle, fixedpointnum24 pitchdeltaangle, fixedpointnum24 yawdeltaangle);
+fixedpointnum vectorcrossproductnormalized(fixedpointnum * v1, fixedpointnum * v2, fixedpointnum * v3, int invsqrtprecision);
+void vectorcrossproduct30(fixedpointnum30 * v1, fixedpointnum30 * v2, fixedpointnum30 * v3);
+fixedpointnum30 normalizevector30(fixedpointnum30 * v);
+void vectorcrossproduct24(fixedpointnum24 * v1, fixedpointnum24 * v2, fixedpointnum24 * v3);
+void rotatequaternionwithsmallangles(fixedpointnum30 * q, fixedpointnum24 * angles);
+void renormalizequaternion30(fixedpointnum30 * q);
+void quaterniontoattitudevectors30(fixedpointnum30 * q, fixedpointnum30 * downvector, fixedpointnum30 * westvector);
 void rotatevectorbyaxisangle(fixedpointnum * v1, fixedpointnum * axisvector, fixedpointnum angle, fixedpointnum * v2);
 void rotatevectorbyaxissmallangle(fixedpointnum * v1, fixedpointnum * axisvector, fixedpointnum angle);